@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "cv_pi5/cv_pi5.h"
+
+/*
+    export_consumer: follows the frames another process publishes with
+    frame_export, such as cam_trigger with camera.NAME.export_socket set.
+
+    Maps the capture buffers read-only and, once a second, prints the mean
+    luma of the frames it kept up with, how many it was too slow for and
+    how many were overwritten while it read them. An inference process
+    would run its model where mean_luma() is called.
+
+        export_consumer SOCKET
+*/
+
+static uint32_t mean_luma(const frame_export_shm *shm, const uint8_t *luma){
+    uint64_t sum = 0, samples = 0;
+    for (uint32_t y = 0; y < shm->height; y += 8)
+        for (uint32_t x = 0; x < shm->width; x += 8, ++samples) sum += luma[(size_t)y * shm->bytesperline[0] + x];
+    return samples ? (uint32_t)(sum / samples) : 0;
+}
+
+static uint64_t now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+int main(int argc, char **argv){
+    if (argc != 2){fprintf(stderr, "usage: %s SOCKET\n", argv[0]);return 2;}
+
+    frame_import fi;
+    if (!frame_import_open(&fi, argv[1])){perror(argv[1]);return 1;}
+    printf("%ux%u, %u buffers\n", fi.shm->width, fi.shm->height, fi.buffer_count);
+
+    unsigned frames = 0, torn = 0;
+    uint64_t luma_sum = 0, last_missed = 0, next_report = now_ms() + 1000;
+    for (;;){
+        frame_export_slot frame;
+        int got = frame_import_next(&fi, &frame, 1000);
+        if (got < 0){
+            if (errno != EPIPE) perror("frame import");
+            break;
+        }
+        if (got){
+            uint32_t luma = mean_luma(fi.shm, frame_import_plane(&fi, frame.index, 0));
+            if (frame_import_still_valid(&fi, &frame)){++frames; luma_sum += luma;}
+            else ++torn;
+        }
+        if (now_ms() >= next_report){
+            printf("%u frames, mean luma %llu, %llu missed, %u overwritten while read\n", frames,
+                   (unsigned long long)(frames ? luma_sum / frames : 0), (unsigned long long)(fi.missed - last_missed), torn);
+            frames = torn = 0;
+            luma_sum = 0;
+            last_missed = fi.missed;
+            next_report += 1000;
+        }
+    }
+    frame_import_close(&fi);
+    return 0;
+}
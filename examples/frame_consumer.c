@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <linux/videodev2.h>
+
+#include "cv_pi5/cv_pi5.h"
+
+/*
+    frame_consumer: the smallest in-process user of libcv_pi5.
+
+    Captures from a camera (or the synthetic source) and prints each
+    second's mean luma, read straight from the capture buffers. An analytics
+    process would do its work where mean_luma() is called, and requeue the
+    buffer when done with it.
+
+        frame_consumer [DEVICE [WIDTH HEIGHT]]      default synthetic 640 480
+*/
+
+typedef struct {
+    capture_device *cam;
+    unsigned frames;
+    uint64_t luma_sum;
+    bool failed;
+} consumer;
+
+static uint32_t mean_luma(const capture_device *cam, const capture_buffer *buffer){
+    const uint8_t *row = buffer->planes[0].data;
+    uint64_t sum = 0;
+    for (uint32_t y = 0; y < cam->height; y += 8, row += (size_t)cam->bytesperline[0] * 8)
+        for (uint32_t x = 0; x < cam->width; x += 8) sum += row[x];
+    uint64_t samples = (uint64_t)((cam->width + 7) / 8) * ((cam->height + 7) / 8);
+    return (uint32_t)(sum / samples);
+}
+
+static void on_capture(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)fd; (void)events;
+    consumer *c = ctx;
+    capture_frame frame;
+    int got;
+    while ((got = capture_dequeue(c->cam, &frame)) > 0){
+        c->luma_sum += mean_luma(c->cam, &c->cam->buffers[frame.index]);
+        ++c->frames;
+        if (!capture_requeue(c->cam, frame.index)){c->failed = true; evloop_stop(loop); return;}
+    }
+    if (got < 0){c->failed = true; evloop_stop(loop);}
+}
+
+static void on_second(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events;
+    consumer *c = ctx;
+    if (!evloop_timer_ack(fd)) return;
+    if (c->frames) printf("%u frames, mean luma %llu\n", c->frames, (unsigned long long)(c->luma_sum / c->frames));
+    c->frames = 0;
+    c->luma_sum = 0;
+}
+
+static void on_signal(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events; (void)ctx;
+    struct signalfd_siginfo si;
+    (void)!read(fd, &si, sizeof si);
+    evloop_stop(loop);
+}
+
+int main(int argc, char **argv){
+    if (cv_pi5_version() >> 16 != CV_PI5_VERSION_MAJOR){fprintf(stderr, "libcv_pi5 %u.x, built against %d.x\n", cv_pi5_version() >> 16, CV_PI5_VERSION_MAJOR);return 1;}
+
+    capture_config config = {
+        .device = argc > 1 ? argv[1] : "synthetic",
+        .width = argc > 3 ? (uint32_t)strtoul(argv[2], NULL, 0) : 640,
+        .height = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 0) : 480,
+        .pixelformat = V4L2_PIX_FMT_YUV420,
+        .fps = 30,
+        .buffer_count = 4,
+    };
+    capture_device cam;
+    evloop loop;
+    if (!evloop_init(&loop)){perror("evloop");return 1;}
+    static const int stop_signals[] = { SIGINT, SIGTERM };
+    if (evloop_add_signals(&loop, stop_signals, 2, on_signal, NULL) < 0){perror("signalfd");return 1;}
+    if (!capture_open(&cam, &config)){perror(config.device);return 1;}
+
+    consumer c = { .cam = &cam };
+    bool ok = evloop_add(&loop, cam.fd, EPOLLIN, on_capture, &c) && evloop_add_timer(&loop, 1000, 1000, on_second, &c) >= 0 &&
+              capture_start(&cam) && evloop_run(&loop) && !c.failed;
+    if (!ok) perror("capture");
+    capture_close(&cam);
+    evloop_destroy(&loop);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#ifndef CV_PI5_ANALYTICS_H
+#define CV_PI5_ANALYTICS_H
+
+/*
+    Analytics stage: a thread that scores a low-resolution side stream,
+    apart from the full-resolution recording path.
+
+    The ISP's second output (e.g. 480x270 next to the 1920x1080 main
+    stream) is captured as its own capture_device; its capture callback
+    only pushes descriptors into a dedicated frame_ring and wakes this
+    thread, which runs the motion detector on each frame's luma and hands
+    the buffer back to the driver. Triggers reach the pipeline through the
+    on_motion callback, called on this thread. The main stream's frames
+    never pass through here, so analytics costs recording neither CPU on
+    its thread nor a read of the full-size frames. With a motion_log
+    attached every frame's score is recorded in it, by capture timestamp.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/motion.h"
+#include "cv_pi5/sidecar.h"
+
+typedef void (*analytics_motion_fn)(void *ctx);
+
+typedef struct {
+    capture_device *cap;    // the low-res stream
+    frame_ring *frames;
+    motion_detector *motion;
+    motion_log *scores;     // NULL keeps none
+    analytics_motion_fn on_motion;
+    void *ctx;
+    uint64_t cpu_mask;      // bit n = CPU n, 0 leaves the thread unpinned
+
+    int wake_fd;            // eventfd, capture -> analytics
+    pthread_t thread;
+    bool running;
+    atomic_bool stop;
+    atomic_int error;
+} analytics_stage;
+
+// Returns true, or false with errno set
+bool analytics_start(analytics_stage *a, capture_device *cap, frame_ring *frames, motion_detector *motion,
+                     motion_log *scores, analytics_motion_fn on_motion, void *ctx, uint64_t cpu_mask);
+
+// Capture side: wakes the stage after one or more pushes
+void analytics_notify(analytics_stage *a);
+
+// Scores whatever is queued, joins the thread and returns false if a requeue failed
+bool analytics_stop(analytics_stage *a);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef CV_PI5_BUFFER_POOL_H
+#define CV_PI5_BUFFER_POOL_H
+
+/*
+    Preallocated pool of reference-counted buffers in a few fixed size
+    classes, shared by every stage a payload passes through.
+
+    All buffers live in one memfd mapping, created and prefaulted by
+    buffer_pool_init(): hugetlb pages when the system has them reserved,
+    otherwise ordinary shmem with transparent huge pages requested, so a
+    pool of a few hundred MiB costs few TLB entries either way. Nothing is
+    allocated after init.
+
+    A buffer is identified by its index. buffer_pool_get() hands out the
+    smallest free buffer that fits, with one reference; every stage that
+    keeps it takes another and drops it when done, and the last drop puts
+    it back. Each class keeps its free buffers on a lock-free stack, so any
+    thread may get, ref or unref.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFER_POOL_NONE UINT32_MAX
+#define BUFFER_POOL_MAX_CLASSES 4
+
+typedef struct {
+    size_t buffer_size;
+    uint32_t count;
+} buffer_pool_class_config;
+
+typedef struct {
+    size_t buffer_size;
+    uint32_t count;
+    uint32_t free;
+    uint32_t low_water;         // fewest free buffers seen since init
+    uint64_t exhausted;         // gets this class could not serve
+} buffer_pool_class_stats;
+
+typedef struct {
+    size_t buffer_size;
+    uint32_t first;             // index of the class's first buffer
+    uint32_t count;
+    size_t offset;              // into the mapping
+    _Atomic uint64_t free_head; // index of the top free buffer, tagged against ABA in the high half
+    _Atomic uint32_t free;
+    _Atomic uint32_t low_water;
+    _Atomic uint64_t exhausted;
+} buffer_pool_class;
+
+typedef struct {
+    int fd;                     // the memfd, so the pool can be shared with other processes
+    uint8_t *base;
+    size_t mapped;
+    bool hugetlb;               // backed by reserved huge pages
+    buffer_pool_class classes[BUFFER_POOL_MAX_CLASSES];
+    int class_count;
+    uint32_t total;
+    _Atomic uint32_t *refs;
+    _Atomic uint32_t *next;     // free-stack links
+} buffer_pool;
+
+// Classes must be given smallest first. Returns true, or false with errno set
+bool buffer_pool_init(buffer_pool *pool, const buffer_pool_class_config *classes, int class_count);
+void buffer_pool_destroy(buffer_pool *pool);
+
+// Smallest free buffer of at least size bytes, falling back to larger classes when a class runs out.
+// Returns its index with one reference held, or BUFFER_POOL_NONE
+uint32_t buffer_pool_get(buffer_pool *pool, size_t size);
+
+void buffer_pool_ref(buffer_pool *pool, uint32_t index);
+void buffer_pool_unref(buffer_pool *pool, uint32_t index);
+
+uint8_t *buffer_pool_data(const buffer_pool *pool, uint32_t index);
+size_t buffer_pool_size(const buffer_pool *pool, uint32_t index);
+
+void buffer_pool_get_stats(const buffer_pool *pool, buffer_pool_class_stats *stats, int max_classes);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef CV_PI5_CAPTURE_H
+#define CV_PI5_CAPTURE_H
+
+/*
+    V4L2 capture engine.
+
+    Buffers are allocated by the driver (V4L2_MEMORY_MMAP), mapped once at
+    open time and, where the driver supports it, exported as DMABUF fds so the
+    next stage can import them without a userspace copy. A dequeued buffer
+    belongs to the caller until it is handed back with capture_requeue().
+
+    Two device names stand in for a camera, for benchmarks and bring-up:
+    "synthetic" renders a moving, noisy test pattern and "replay:FILE" loops
+    raw frames read from FILE, which must hold whole frames of the requested
+    format and size. Either one is paced at the requested fps by a timerfd,
+    which is what cap->fd then is, so callers poll it the same way. A tick
+    that finds no buffer queued is dropped and shows up as a sequence gap,
+    as it would with a driver.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_MAX_BUFFERS 16
+#define CAPTURE_MAX_PLANES 3
+
+typedef struct {
+    const char *device;     // e.g. "/dev/video0"
+    uint32_t width;         // 0 keeps the driver's current size
+    uint32_t height;
+    uint32_t pixelformat;   // V4L2 fourcc, 0 keeps the driver's current format
+    uint32_t fps;           // 0 keeps the driver's current frame interval
+    uint32_t buffer_count;  // requested driver buffers, clamped to CAPTURE_MAX_BUFFERS before asking
+} capture_config;
+
+typedef struct {
+    void *data;             // mmap'd plane, read-only for consumers
+    size_t length;          // mapped size
+    int dmabuf_fd;          // VIDIOC_EXPBUF handle, -1 if the driver cannot export
+} capture_plane;
+
+typedef struct {
+    capture_plane planes[CAPTURE_MAX_PLANES];
+} capture_buffer;
+
+typedef struct {
+    uint32_t index;         // driver buffer index, give back with capture_requeue()
+    uint32_t sequence;      // driver frame counter, gaps mean the sensor dropped frames
+    uint32_t flags;         // V4L2_BUF_FLAG_*
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC: the driver's, else taken at dequeue
+    uint32_t num_planes;
+    uint32_t bytesused[CAPTURE_MAX_PLANES];
+} capture_frame;
+
+typedef struct capture_synthetic capture_synthetic;
+
+typedef struct {
+    int fd;
+    capture_synthetic *synthetic;   // frame generator in place of a driver, NULL for a V4L2 node
+    bool mplane;            // driver uses the multi-planar API
+    bool streaming;
+    uint32_t buf_type;      // V4L2_BUF_TYPE_VIDEO_CAPTURE[_MPLANE]
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;
+    uint32_t num_planes;
+    uint32_t bytesperline[CAPTURE_MAX_PLANES];
+    uint32_t buffer_count;
+    capture_buffer buffers[CAPTURE_MAX_BUFFERS];
+    _Atomic uint32_t *requeue_generations;  // optional, entry i bumped as buffer i goes back to the driver (frame_export.h)
+} capture_device;
+
+bool capture_open(capture_device *cap, const capture_config *cfg);
+bool capture_start(capture_device *cap);
+
+// Returns 1 when a frame was dequeued, 0 when none is ready yet (fd is non-blocking), -1 on error
+int capture_dequeue(capture_device *cap, capture_frame *frame);
+bool capture_requeue(capture_device *cap, uint32_t index);
+
+void capture_stop(capture_device *cap);
+void capture_close(capture_device *cap);
+
+// An fd another process can mmap plane of buffer index from, at *offset: the DMABUF where there is one,
+// else the synthetic source's memfd. Returns -1 with errno ENOTSUP when the plane cannot be shared
+int capture_plane_fd(const capture_device *cap, uint32_t index, uint32_t plane, uint64_t *offset);
+
+// The synthetic source behind the calls above; capture_open() picks it by device name
+bool capture_synthetic_match(const char *device);
+bool capture_synthetic_open(capture_device *cap, const capture_config *cfg);
+bool capture_synthetic_start(capture_device *cap);
+int capture_synthetic_dequeue(capture_device *cap, capture_frame *frame);
+bool capture_synthetic_requeue(capture_device *cap, uint32_t index);
+void capture_synthetic_stop(capture_device *cap);
+void capture_synthetic_close(capture_device *cap);
+int capture_synthetic_plane_fd(const capture_device *cap, uint32_t index, uint32_t plane, uint64_t *offset);
+
+#endif
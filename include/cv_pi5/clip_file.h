@@ -0,0 +1,64 @@
+#ifndef CV_PI5_CLIP_FILE_H
+#define CV_PI5_CLIP_FILE_H
+
+/*
+    Append-only clip file tuned for flash media.
+
+    The expected size is reserved up front with fallocate(FALLOC_FL_KEEP_SIZE)
+    so the clip lands in few extents, and with direct I/O the data bypasses
+    the page cache: writes are gathered into an aligned staging block and
+    issued as whole blocks. Close pads the last block, then truncates the file
+    to the bytes actually written, which also returns the unused reservation.
+    Both features fall back silently where the filesystem lacks them.
+
+    Nothing is forced to the medium on its own. clip_file_writeback() starts
+    writeback of what has been written since the last call, without
+    waiting (a no-op under direct I/O, which never dirties the page cache),
+    and clip_file_datasync() makes everything written so far durable,
+    staged bytes included, so the caller decides how much a power cut may
+    cost.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t preallocate_bytes; // 0 skips fallocate
+    bool direct_io;             // O_DIRECT, falls back to buffered I/O if refused
+    size_t block_size;          // staging block for direct I/O, rounded to the alignment; 0 picks 1 MiB
+} clip_file_options;
+
+typedef struct {
+    int fd;
+    bool direct;                // O_DIRECT actually in effect
+    size_t align;
+    uint8_t *block;             // aligned staging buffer, direct I/O only
+    size_t block_size;
+    size_t fill;
+    uint64_t flushed;           // bytes on disk, always a multiple of align while direct
+    uint64_t size;              // logical clip size
+    uint64_t preallocated;
+    uint64_t writeback;         // writeback started up to here
+    uint64_t durable;           // through fdatasync up to here
+} clip_file;
+
+// Returns true, or false with errno set
+bool clip_file_open(clip_file *f, const char *path, const clip_file_options *opt);
+bool clip_file_write(clip_file *f, const void *data, size_t length);
+
+// sync_file_range(SYNC_FILE_RANGE_WRITE) over the bytes written since the last call. Returns true, or false with errno set
+bool clip_file_writeback(clip_file *f);
+
+// Writes out anything staged, padded, and fdatasyncs. Returns true, or false with errno set
+bool clip_file_datasync(clip_file *f);
+
+// Bytes a power cut now could lose
+static inline uint64_t clip_file_unsynced(const clip_file *f){
+    return f->size - f->durable;
+}
+
+// Writes out anything staged, trims the file to its real size and closes it
+bool clip_file_close(clip_file *f);
+
+#endif
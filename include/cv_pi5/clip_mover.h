@@ -0,0 +1,82 @@
+#ifndef CV_PI5_CLIP_MOVER_H
+#define CV_PI5_CLIP_MOVER_H
+
+/*
+    Background thread that moves finished clips from a staging directory,
+    typically a tmpfs, to their final directory on slower media.
+
+    Clips are recorded into RAM, where a burst of triggers never waits on
+    the flash, and trickle out to it afterwards at rate_bytes a second, so
+    the mover's writes stay a steady background load instead of competing
+    with a clip being recorded straight to disk. Each clip is copied with
+    copy_file_range(), or splice() through a pipe where the kernel cannot
+    copy between the two filesystems, into a hidden temp file next to its
+    final name. The copy gets the staged file's mtime, is fdatasync'ed and
+    renamed into place, and only then is the staged file deleted. A clip
+    lost halfway, to an error or a crash, is still on tmpfs, to be moved
+    again. The rename never replaces a file already there under the
+    clip's name (clip_rename()): that move fails with EEXIST and leaves the
+    clip staged.
+
+    Clips are moved one at a time in the order they were submitted.
+    clip_mover_stop() moves whatever is still queued, unthrottled, before
+    it joins: the clips are at stake to a reboot until they are on disk.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/storage.h"
+
+// Mover thread: make bytes free in the final directory. Returns false with errno set to skip the clip
+typedef bool (*clip_mover_room_fn)(void *ctx, uint64_t bytes);
+
+// Mover thread: name has reached the final directory, or failed with error and is still staged
+typedef void (*clip_mover_done_fn)(void *ctx, const char *name, uint64_t bytes, void *arg, int error);
+
+typedef struct {
+    const char *staging_dir;
+    const char *final_dir;
+    uint64_t rate_bytes;            // per second, 0 unthrottled
+    clip_mover_room_fn make_room;   // NULL when the final directory has room of its own
+    clip_mover_done_fn done;        // NULL, or after every clip
+    void *ctx;
+} clip_mover_config;
+
+typedef struct clip_move clip_move;
+
+typedef struct {
+    int staging_fd;                 // directories
+    int final_fd;
+    uint64_t rate_bytes;
+    clip_mover_room_fn make_room;
+    clip_mover_done_fn done;
+    void *ctx;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    clip_move *head;                // next to move
+    clip_move *tail;
+    atomic_bool stopping;           // also lifts the throttle
+    _Atomic uint64_t pending_bytes; // submitted and not yet moved or given up on
+    _Atomic uint64_t moved_clips;
+    _Atomic uint64_t moved_bytes;
+} clip_mover;
+
+// Opens both directories and starts the thread. Returns true, or false with errno set
+bool clip_mover_start(clip_mover *m, const clip_mover_config *cfg);
+
+// Any thread: queues staged clip name of about bytes, passing arg to done.
+// Returns false with errno ENAMETOOLONG, ENOMEM or, once stopping, ESHUTDOWN
+bool clip_mover_submit(clip_mover *m, const char *name, uint64_t bytes, void *arg);
+
+// Any thread: bytes still in the staging directory on the mover's account
+uint64_t clip_mover_pending_bytes(clip_mover *m);
+
+// Moves everything still queued, joins the thread and closes the directories
+void clip_mover_stop(clip_mover *m);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef CV_PI5_CLIP_NAME_H
+#define CV_PI5_CLIP_NAME_H
+
+/*
+    Clip file names of the form
+
+        <prefix>YYYYMMDDTHHMMSSZ_<sequence><extension>
+
+    e.g. clip_20260314T091502Z_000042.h264. Timestamps are UTC from
+    CLOCK_REALTIME, so no localtime()/TZ lookup is involved, and the sequence
+    counts up for the life of the process, so two clips in the same second
+    still get distinct names. Across processes it is up to the caller to
+    seed the sequence past the names already on disk (clip_name_sequence())
+    and to refuse to replace a name that is taken anyway. Every field is fixed width: sorting the names
+    sorts the clips by start time, which is what the clip index relies on.
+
+    Names are also how a clip is told apart from anything else sharing its
+    directory: clip_name_valid() accepts only this pattern, with one of the
+    extensions cam_trigger records and an optional CLIP_MANUAL_MARK before
+    it, and eviction, retention and staging recovery touch nothing else.
+
+    The formatted date is cached and only rewritten when the day changes, the
+    time digits only when the second changes; generating a name is a
+    clock_gettime() and a copy into the caller's buffer, with no allocation.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CLIP_NAME_PREFIX_MAX 32
+#define CLIP_NAME_EXT_MAX 16
+#define CLIP_NAME_SEQ_DIGITS 6
+#define CLIP_NAME_STAMP_LEN 16
+#define CLIP_MANUAL_MARK "_manual"  // before the extension of a clip a trigger source asked for
+
+typedef struct {
+    char stamp[17];             // "YYYYMMDDTHHMMSSZ"
+    int64_t cached_day;         // days since the epoch that stamp[0..7] holds
+    int64_t cached_second;      // second of the epoch that stamp holds
+    uint32_t sequence;
+    char prefix[CLIP_NAME_PREFIX_MAX];
+    char extension[CLIP_NAME_EXT_MAX];
+    size_t prefix_len;
+    size_t extension_len;
+} clip_namer;
+
+// Returns true, or false with errno set
+bool clip_namer_init(clip_namer *n, const char *prefix, const char *extension);
+
+// Writes the next name into out. Returns its length, or 0 with errno ERANGE if out is too small
+size_t clip_namer_next(clip_namer *n, char *out, size_t out_size);
+
+// Same, for an explicit time; used when naming a clip after its trigger rather than now
+size_t clip_namer_format(clip_namer *n, const struct timespec *realtime, char *out, size_t out_size);
+
+// True when name is <prefix>YYYYMMDDTHHMMSSZ_NNNNNN[_manual].ts or .h264, with a non-empty,
+// non-hidden prefix ending in '_' and no '/'
+bool clip_name_valid(const char *name);
+
+// True when name is a valid clip name starting with prefix, with its sequence number in *sequence
+bool clip_name_sequence(const char *name, const char *prefix, uint32_t *sequence);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef CV_PI5_CLIP_REAPER_H
+#define CV_PI5_CLIP_REAPER_H
+
+/*
+    Background thread that enforces clip retention: clips past their
+    class's retention (storage.h) and, above quota_bytes of clips in all,
+    the next ones eviction would pick, are deleted well before the space
+    is needed.
+
+    The clip index is the only thing it reads, so retention never rescans
+    the output directory. Every interval_ms, and on clip_reaper_kick(), it
+    takes up to batch clips off the index in one short hold of the index's
+    lock and unlinks them afterwards, with unlinkat() on its own duplicate
+    of the directory fd, outside the lock. Deleting a large file is
+    journal and discard work on the same flash the clips are recorded to,
+    so deletions are paced to rate_bytes freed a second, a steady trickle
+    rather than a burst in front of the next clip's writes.
+
+    clip_index_make_space() on the recording path stays as the
+    backstop for when the reaper cannot keep up. A clip taken off the
+    index but not deleted, on an I/O error, is counted and left on disk
+    for the next start's scan.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/storage.h"
+
+#define CLIP_REAPER_MAX_BATCH 64
+
+// Reaper thread: locks and returns the shared index, or NULL with nothing locked when there is none
+typedef clip_index *(*clip_reaper_acquire_fn)(void *ctx);
+typedef void (*clip_reaper_release_fn)(void *ctx);
+
+typedef struct {
+    clip_reaper_acquire_fn acquire;
+    clip_reaper_release_fn release;
+    void *ctx;
+    uint64_t quota_bytes;       // all classes together, 0 for none
+    uint64_t rate_bytes;        // freed per second, 0 unthrottled
+    uint32_t batch;             // clips per hold of the index, at most CLIP_REAPER_MAX_BATCH
+    uint32_t interval_ms;
+} clip_reaper_config;
+
+typedef struct {
+    clip_reaper_config cfg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool kicked;
+    bool stopping;
+    _Atomic uint64_t expired_clips; // past their retention
+    _Atomic uint64_t quota_clips;   // over the quota
+    _Atomic uint64_t reaped_bytes;
+    _Atomic uint64_t errors;
+} clip_reaper;
+
+// Starts the thread. Returns true, or false with errno set
+bool clip_reaper_start(clip_reaper *r, const clip_reaper_config *cfg);
+
+// Any thread: check now, e.g. after a clip was added
+void clip_reaper_kick(clip_reaper *r);
+
+// Stops, abandoning the rest of a batch, and joins the thread
+void clip_reaper_stop(clip_reaper *r);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CV_PI5_CV_PI5_H
+#define CV_PI5_CV_PI5_H
+
+/*
+    libcv_pi5: everything cam_trigger is built from, as one library.
+
+    A process that wants frames in-process links libcv_pi5 (pkg-config
+    cv_pi5) and drives the same pieces cam_trigger does: a capture_device
+    on its own evloop, frame descriptors through a frame_ring, and the pixels
+    read straight out of the capture buffers, with no copy and no file in
+    between. examples/frame_consumer.c is the smallest such program.
+
+    The API is C11, and the headers below are all of it. Structs are
+    declared in the headers so callers can embed them without an
+    allocation, which makes their layout part of the ABI: a layout or
+    signature change bumps CV_PI5_VERSION_MAJOR and the library's SONAME,
+    anything added bumps MINOR. Check at start-up that the library loaded
+    is the one compiled against:
+
+        if (cv_pi5_version() >> 16 != CV_PI5_VERSION_MAJOR) ...
+*/
+
+#include <stdint.h>
+
+#include "cv_pi5/analytics.h"
+#include "cv_pi5/buffer_pool.h"
+#include "cv_pi5/capture.h"
+#include "cv_pi5/clip_file.h"
+#include "cv_pi5/clip_mover.h"
+#include "cv_pi5/clip_name.h"
+#include "cv_pi5/clip_reaper.h"
+#include "cv_pi5/encode_stage.h"
+#include "cv_pi5/encoder.h"
+#include "cv_pi5/evloop.h"
+#include "cv_pi5/frame_export.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/motion.h"
+#include "cv_pi5/packet.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/pixconv.h"
+#include "cv_pi5/pressure.h"
+#include "cv_pi5/pretrigger.h"
+#include "cv_pi5/sidecar.h"
+#include "cv_pi5/storage.h"
+#include "cv_pi5/storage_probe.h"
+#include "cv_pi5/stream_sink.h"
+#include "cv_pi5/supervisor.h"
+#include "cv_pi5/trace.h"
+#include "cv_pi5/trigger.h"
+#include "cv_pi5/ts_mux.h"
+#include "cv_pi5/wall_clock.h"
+#include "cv_pi5/worker_pool.h"
+#include "cv_pi5/writer.h"
+
+#define CV_PI5_VERSION_MAJOR 0
+#define CV_PI5_VERSION_MINOR 1
+#define CV_PI5_VERSION_PATCH 0
+
+// The library's own version, as major << 16 | minor << 8 | patch
+uint32_t cv_pi5_version(void);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CV_PI5_ENCODE_STAGE_H
+#define CV_PI5_ENCODE_STAGE_H
+
+/*
+    Encode stage: a thread between the frame ring and the packet ring.
+
+    The thread optionally pins itself to cpu_mask before opening the encoder,
+    so a software encoder and every worker thread it spawns stay on those
+    cores and off the ones capture runs on. With a buffer pool, encoded
+    packets are copied once into a pool buffer that the packet ring, the
+    pre-trigger history and the writer then share by reference.
+
+    encode_stage_set_bitrate() may be called from any thread; the stage
+    thread applies it ahead of the next frame, since the encoder is only
+    ever touched from there.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+#include "cv_pi5/encoder.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/writer.h"
+
+typedef struct {
+    capture_device *cap;
+    frame_ring *frames;
+    packet_ring *packets;
+    buffer_pool *pool;      // NULL copies packets into the packet ring's arena
+    frame_writer *writer;   // woken after packets are pushed
+    const char *backend;
+    encoder_config cfg;
+    uint64_t cpu_mask;      // bit n = CPU n, 0 leaves the thread unpinned
+
+    encoder enc;
+    int wake_fd;            // eventfd, capture -> encode stage
+    pthread_t thread;
+    bool running;
+    bool pushed;            // encode thread only: packets pushed since the last writer wake-up
+    atomic_bool stop;
+    atomic_int error;
+    _Atomic uint32_t bitrate_request;   // 0: none pending
+
+    pthread_mutex_t lock;   // start-up handshake
+    pthread_cond_t ready;
+    int open_state;         // 0 pending, 1 open, -1 failed with open_errno
+    int open_errno;
+
+    _Atomic uint64_t frames_encoded;
+    _Atomic uint64_t packets_dropped;   // packet ring full
+    _Atomic uint64_t pool_exhausted;    // packets that fell back to the arena
+} encode_stage;
+
+// Blocks until the encoder is open on the stage thread. Returns true, or false with errno set
+bool encode_stage_start(encode_stage *st, capture_device *cap, frame_ring *frames, packet_ring *packets,
+                        buffer_pool *pool, frame_writer *writer, const char *backend, const encoder_config *cfg, uint64_t cpu_mask);
+
+// Capture side: wakes the stage after one or more pushes
+void encode_stage_notify(encode_stage *st);
+
+// Asks for a new encoder bitrate; ignored by backends without rate control
+void encode_stage_set_bitrate(encode_stage *st, uint32_t bitrate_bps);
+
+// Encodes whatever is left in the frame ring, closes the encoder and joins the thread
+bool encode_stage_stop(encode_stage *st);
+
+#endif
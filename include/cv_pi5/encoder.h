@@ -0,0 +1,89 @@
+#ifndef CV_PI5_ENCODER_H
+#define CV_PI5_ENCODER_H
+
+/*
+    Video encoder interface with pluggable backends.
+
+    Every backend takes frames that still live in their capture buffers and
+    produces packets through the emit callback. Capture buffers go back to the
+    caller through the release callback; a backend that imports the DMABUF
+    holds on to the buffer until the hardware has read it, one that copies the
+    picture releases it as soon as encode() returns.
+
+    Backends:
+        "v4l2m2m"   V4L2 mem2mem hardware encoder, imports capture DMABUFs
+        "x264"      libx264 in ultrafast/zerolatency tuning, when built with it
+        "raw"       no encoding, frames are passed through by reference
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+#include "cv_pi5/packet.h"
+
+typedef enum {
+    ENCODER_CODEC_H264,
+    ENCODER_CODEC_HEVC,
+} encoder_codec;
+
+typedef struct {
+    encoder_codec codec;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;   // V4L2 fourcc of the incoming frames
+    uint32_t num_planes;
+    uint32_t bytesperline[CAPTURE_MAX_PLANES];
+    uint32_t fps;
+    uint32_t bitrate_bps;
+    uint32_t gop_length;    // frames between keyframes, also bounds pre-trigger granularity
+    const char *device;     // mem2mem node, NULL probes /dev/video*
+    uint32_t buffer_count;  // capture buffers that may be in flight
+    int threads;            // software backends, 0 picks one per pinned core
+} encoder_config;
+
+typedef struct encoder encoder;
+
+// frame_ref >= 0 means pkt->data points into that capture buffer and the receiver now owns it
+typedef bool (*encoder_emit_fn)(void *ctx, const encoded_packet *pkt, int32_t frame_ref);
+typedef void (*encoder_release_fn)(void *ctx, uint32_t frame_index);
+
+typedef struct {
+    const char *name;
+    bool (*open)(encoder *enc);
+    bool (*encode)(encoder *enc, const capture_frame *frame, const capture_buffer *buffer);
+    bool (*drain)(encoder *enc);     // collects finished output; may be called at any time
+    void (*close)(encoder *enc);     // emits what the encoder still holds first
+    bool (*set_bitrate)(encoder *enc, uint32_t bitrate_bps); // while open, NULL when the backend has no rate control
+} encoder_backend;
+
+struct encoder {
+    const encoder_backend *backend;
+    encoder_config cfg;
+    encoder_emit_fn emit;
+    encoder_release_fn release;
+    void *ctx;
+    int poll_fd;            // becomes readable when drain() has work, -1 for synchronous backends
+    void *priv;             // backend state
+};
+
+extern const encoder_backend encoder_backend_v4l2m2m;
+extern const encoder_backend encoder_backend_raw;
+#ifdef CV_PI5_HAVE_X264
+extern const encoder_backend encoder_backend_x264;
+#endif
+
+// Opens the named backend, or with "auto" the first that works: v4l2m2m, x264, raw.
+// Returns true, or false with errno set
+bool encoder_open(encoder *enc, const char *backend, const encoder_config *cfg,
+                  encoder_emit_fn emit, encoder_release_fn release, void *ctx);
+bool encoder_encode(encoder *enc, const capture_frame *frame, const capture_buffer *buffer);
+bool encoder_drain(encoder *enc);
+void encoder_close(encoder *enc);
+
+// Retargets rate control from the next frame on. Returns true, or false with errno set (ENOTSUP for raw)
+bool encoder_set_bitrate(encoder *enc, uint32_t bitrate_bps);
+
+const char *encoder_name(const encoder *enc);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef CV_PI5_EVLOOP_H
+#define CV_PI5_EVLOOP_H
+
+/*
+    epoll-based event loop.
+
+    Everything the process waits on is an fd registered here: V4L2 capture
+    nodes, trigger sources, timerfds and a signalfd, so an idle pipeline
+    sleeps in epoll_wait() instead of spinning. Callbacks run on the thread
+    that calls evloop_run() and must not block.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EVLOOP_MAX_SOURCES 32
+
+typedef struct evloop evloop;
+typedef void (*evloop_cb)(evloop *loop, int fd, uint32_t events, void *ctx);
+
+typedef struct {
+    int fd;                 // -1 while the slot is free
+    evloop_cb cb;
+    void *ctx;
+    bool owned;             // created by the loop, closed when removed
+    bool removed;           // removed during dispatch, slot reclaimed after the batch
+} evloop_source;
+
+struct evloop {
+    int epfd;
+    bool running;
+    bool dispatching;
+    _Atomic uint64_t iterations;    // completed epoll_wait() rounds, a cheap liveness signal other threads may read
+    evloop_source sources[EVLOOP_MAX_SOURCES];
+};
+
+// Returns true, or false with errno set
+bool evloop_init(evloop *loop);
+void evloop_destroy(evloop *loop);
+
+// Watches an fd owned by the caller; events are EPOLLIN etc.
+bool evloop_add(evloop *loop, int fd, uint32_t events, evloop_cb cb, void *ctx);
+bool evloop_remove(evloop *loop, int fd);
+
+// Creates a CLOCK_MONOTONIC timerfd owned by the loop. 0 for initial_ms leaves it disarmed.
+// Returns the fd, or -1 with errno set. Callbacks should evloop_timer_ack() the fd.
+int evloop_add_timer(evloop *loop, uint64_t initial_ms, uint64_t interval_ms, evloop_cb cb, void *ctx);
+bool evloop_timer_set(int timer_fd, uint64_t initial_ms, uint64_t interval_ms);
+uint64_t evloop_timer_ack(int timer_fd);
+
+// Blocks the signals for the calling thread and delivers them through a signalfd owned by the loop.
+// Threads created afterwards inherit the mask, so do this before starting workers.
+// Returns the fd, or -1 with errno set. Callbacks read struct signalfd_siginfo from it.
+int evloop_add_signals(evloop *loop, const int *signals, int count, evloop_cb cb, void *ctx);
+
+// Runs until evloop_stop() is called from a callback. Returns false with errno set on epoll failure
+bool evloop_run(evloop *loop);
+void evloop_stop(evloop *loop);
+
+#endif
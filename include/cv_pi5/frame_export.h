@@ -0,0 +1,138 @@
+#ifndef CV_PI5_FRAME_EXPORT_H
+#define CV_PI5_FRAME_EXPORT_H
+
+/*
+    Zero-copy frame export to other processes.
+
+    The capturing process listens on a Unix socket. A consumer that
+    connects is sent, once, a frame_export_hello and with it over
+    SCM_RIGHTS a memfd holding a frame_export_shm, then one fd per plane of
+    every capture buffer: the buffer's DMABUF, or the synthetic source's
+    memfd at the offset in the hello. It maps them all read-only and from
+    then on needs no syscall per frame but a futex wait:
+
+        producer, per dequeued frame        consumer
+        write descriptor into slot n % 16   futex-wait on published
+        published = n + 1, futex wake       read the newest slot (seqlock)
+                                            read the pixels
+                                            frame_import_still_valid()?
+
+    Consumers never own a buffer, so a slow or crashed one cannot hold up
+    the camera. The price is that the producer may hand a buffer back to the
+    driver while a consumer is still reading it. Every requeue bumps the
+    buffer's generation in shared memory first, so a consumer checks
+    afterwards that its frame's generation still holds, and discards what
+    it computed if not. A consumer that needs a frame for longer than the
+    pipeline's buffer depth copies it.
+
+    The layout below is the wire format, checked by magic and version, so
+    consumers in other languages can map it too.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+
+#define FRAME_EXPORT_MAGIC 0x35495043u  // "CPI5"
+#define FRAME_EXPORT_VERSION 1u
+#define FRAME_EXPORT_SLOTS 16
+#define FRAME_EXPORT_MAX_CLIENTS 8
+
+typedef struct {
+    _Atomic uint32_t seq;       // odd while the producer rewrites the slot
+    uint32_t index;             // capture buffer holding the pixels
+    uint32_t sequence;          // driver frame counter
+    uint32_t flags;             // V4L2_BUF_FLAG_*
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC
+    uint32_t generation;        // the buffer's requeue generation when it was published
+    uint32_t bytesused[CAPTURE_MAX_PLANES];
+} frame_export_slot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelformat;       // V4L2 fourcc
+    uint32_t num_planes;
+    uint32_t bytesperline[CAPTURE_MAX_PLANES];
+    uint32_t buffer_count;
+
+    _Alignas(64) _Atomic uint32_t published;    // futex word: frames published so far, wrapping
+    _Atomic uint32_t closed;                    // set once the producer stops; published is woken too
+
+    _Alignas(64) _Atomic uint32_t generations[CAPTURE_MAX_BUFFERS];
+    _Alignas(64) frame_export_slot slots[FRAME_EXPORT_SLOTS];
+} frame_export_shm;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t buffer_count;
+    uint32_t num_planes;
+    uint64_t shm_size;
+    uint64_t offsets[CAPTURE_MAX_BUFFERS][CAPTURE_MAX_PLANES];  // of each plane in its fd
+    uint64_t lengths[CAPTURE_MAX_BUFFERS][CAPTURE_MAX_PLANES];
+} frame_export_hello;
+
+// Producer side, on the thread that dequeues from cap
+
+typedef struct {
+    capture_device *cap;
+    int listen_fd;              // poll for EPOLLIN, then frame_export_accept()
+    int shm_fd;
+    frame_export_shm *shm;
+    uint32_t published;
+    int clients[FRAME_EXPORT_MAX_CLIENTS];
+    uint32_t client_count;
+    uint64_t clients_served;
+    char path[108];
+} frame_export;
+
+// Creates the shared ring and listens on socket_path, replacing a stale socket.
+// Fails with ENOTSUP when a buffer of cap cannot be shared. Returns true, or false with errno set
+bool frame_export_start(frame_export *fx, capture_device *cap, const char *socket_path);
+
+// Drops consumers that have gone away, then accepts one and sends it the hello.
+// Returns true, or false with errno set when that consumer could not be served
+bool frame_export_accept(frame_export *fx);
+
+// Publishes a frame just dequeued from cap, before it is passed on or requeued
+void frame_export_publish(frame_export *fx, const capture_frame *frame);
+
+// Tells consumers, closes the socket and detaches from cap, which must still be open
+// and no longer requeued from other threads
+void frame_export_stop(frame_export *fx);
+
+// Consumer side, in another process
+
+typedef struct {
+    int sock;
+    const frame_export_shm *shm;
+    size_t shm_size;
+    uint32_t buffer_count;
+    uint32_t num_planes;
+    void *maps[CAPTURE_MAX_BUFFERS][CAPTURE_MAX_PLANES];
+    size_t map_lengths[CAPTURE_MAX_BUFFERS][CAPTURE_MAX_PLANES];
+    uint32_t seen;              // published count at the last frame taken
+    bool started;               // a frame has been taken, so gaps count as missed
+    uint64_t missed;            // frames published that were never taken, the consumer being behind
+} frame_import;
+
+// Connects, receives and maps everything. Returns true, or false with errno set
+bool frame_import_open(frame_import *fi, const char *socket_path);
+
+// The newest frame not yet taken, waiting up to timeout_ms (-1 for ever).
+// Returns 1 with *frame filled, 0 on timeout, -1 with errno set (EPIPE once the producer has stopped)
+int frame_import_next(frame_import *fi, frame_export_slot *frame, int timeout_ms);
+
+const uint8_t *frame_import_plane(const frame_import *fi, uint32_t index, uint32_t plane);
+
+// After reading frame's pixels: false when its buffer may have been overwritten meanwhile
+bool frame_import_still_valid(const frame_import *fi, const frame_export_slot *frame);
+
+void frame_import_close(frame_import *fi);
+
+#endif
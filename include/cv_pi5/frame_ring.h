@@ -0,0 +1,63 @@
+#ifndef CV_PI5_FRAME_RING_H
+#define CV_PI5_FRAME_RING_H
+
+/*
+    Fixed-capacity single-producer/single-consumer ring of frame descriptors.
+
+    Only descriptors move through the ring; the pixels stay in the capture
+    buffers they were dequeued into. The producer and consumer indices live on
+    separate cache lines, and each side keeps a cached copy of the other's
+    index so the shared line is only touched when the cached view runs out.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+
+#define FRAME_RING_CACHE_LINE 64
+
+typedef capture_frame frame_desc;
+
+typedef struct {
+    size_t capacity;
+    size_t occupancy;       // descriptors waiting right now
+    size_t high_water;      // largest occupancy seen since init
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t overflows;     // pushes rejected because the ring was full
+} frame_ring_stats;
+
+typedef struct {
+    // Producer side
+    _Alignas(FRAME_RING_CACHE_LINE) _Atomic size_t head;
+    size_t cached_tail;
+    _Atomic size_t high_water;
+    _Atomic uint64_t overflows;
+
+    // Consumer side
+    _Alignas(FRAME_RING_CACHE_LINE) _Atomic size_t tail;
+    size_t cached_head;
+
+    // Read-only after init
+    _Alignas(FRAME_RING_CACHE_LINE) size_t capacity;
+    size_t mask;
+    frame_desc *slots;
+} frame_ring;
+
+// capacity is rounded up to a power of two
+bool frame_ring_init(frame_ring *ring, size_t capacity);
+void frame_ring_destroy(frame_ring *ring);
+
+// Producer only. Returns false and counts an overflow when the ring is full
+bool frame_ring_push(frame_ring *ring, const frame_desc *desc);
+
+// Consumer only. Returns false when the ring is empty
+bool frame_ring_pop(frame_ring *ring, frame_desc *desc);
+
+// Safe from any thread; the values are a snapshot, not a consistent cut
+void frame_ring_get_stats(const frame_ring *ring, frame_ring_stats *stats);
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef CV_PI5_METRICS_H
+#define CV_PI5_METRICS_H
+
+/*
+    Per-stage latency histograms and pipeline counters.
+
+    Each thread records into its own cache-aligned shard, claimed on first
+    use, so the hot path is a handful of uncontended relaxed atomic adds and
+    no thread ever writes a cache line another one is writing. Readers merge
+    the shards on demand.
+
+    Latencies are measured from the frame's sensor timestamp
+    (CLOCK_MONOTONIC) to the point where the stage finished with it, so the
+    histograms for successive stages show where the time goes:
+
+        dequeue         frame handed to userspace
+        encode          packet out of the encoder
+        write           packet handed to the clip file (live packets only)
+        write_call      duration of the write call itself
+        fsync           data durable on the medium
+        motion          time the motion detector spent on the frame
+
+    Peaks are high-water marks, kept as the largest value any thread
+    reported, e.g. unsynced_bytes_max: the most clip data that was ever
+    written but not yet durable, which is what a power cut at the worst
+    moment would have lost.
+
+    Histogram buckets are log2 with four linear sub-buckets per octave,
+    from 1 us to about 16 s.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    METRIC_STAGE_DEQUEUE,
+    METRIC_STAGE_ENCODE,
+    METRIC_STAGE_WRITE,
+    METRIC_STAGE_WRITE_CALL,
+    METRIC_STAGE_FSYNC,
+    METRIC_STAGE_MOTION,
+    METRIC_STAGE_COUNT
+} metric_stage;
+
+typedef enum {
+    METRIC_FRAMES_CAPTURED,
+    METRIC_FRAMES_SENSOR_DROPPED,   // sequence gaps reported by the driver
+    METRIC_FRAMES_RING_DROPPED,     // frame ring full
+    METRIC_FRAMES_ENCODED,
+    METRIC_PACKETS_DROPPED,         // packet ring full
+    METRIC_PACKETS_WRITTEN,
+    METRIC_BYTES_WRITTEN,
+    METRIC_WRITE_ERRORS,
+    METRIC_MOTION_TRIGGERS,
+    METRIC_POOL_EXHAUSTED,          // packets the buffer pool had no room for
+    METRIC_PRESSURE_DEGRADES,       // steps down the degradation ladder; minus recovers is the current depth
+    METRIC_PRESSURE_RECOVERS,
+    METRIC_FRAMES_SHED,             // skipped on purpose to lower the frame rate
+    METRIC_ANALYTICS_FRAMES,        // low-res side stream frames scored
+    METRIC_ANALYTICS_DROPPED,       // low-res frames dropped because the analytics ring was full
+    METRIC_SIDECARS_WRITTEN,        // thumbnail and index files next to finished clips
+    METRIC_SIDECAR_ERRORS,          // sidecar files that could not be written or were skipped
+    METRIC_CLIPS_SAVED,             // clips renamed into place
+    METRIC_TRIGGERS_COALESCED,      // triggers that extended a clip, or fell inside the debounce window
+    METRIC_TRIGGERS_DROPPED,        // triggers that waited out a clip's length for a concurrent slot
+    METRIC_CLIPS_MOVED,             // staged clips copied onto the final media
+    METRIC_CLIP_MOVE_ERRORS,        // staged clips that could not be moved, left staged
+    METRIC_STAGING_SPILLS,          // clips recorded straight to the final media because staging was full
+    METRIC_WALL_CLOCK_STEPS,        // wall time mappings restarted because the wall clock was set
+    METRIC_STREAM_QUEUE_DROPPED,    // packets no viewer got because the stream queue was full, up to a keyframe
+    METRIC_STREAM_UNITS_SKIPPED,    // access units a slow viewer skipped, per viewer
+    METRIC_STREAM_BYTES,            // sent to viewers, all of them together
+    METRIC_SUPERVISOR_ESCALATIONS,  // steps up the supervisor's backpressure ladder
+    METRIC_SUPERVISOR_RECOVERIES,
+    METRIC_ANALYTICS_SHED,          // frames motion skipped on the supervisor's word
+    METRIC_FRAMES_BACKLOG_DROPPED,  // dropped on the supervisor's word while the frame ring backed up
+    METRIC_PIPELINE_STALLS,         // pipelines whose heartbeat or progress stood still for stall_ms
+    METRIC_WATCHDOG_KICKS,
+    METRIC_CLIPS_EXPIRED,           // deleted by the reaper past their class's retention
+    METRIC_CLIPS_OVER_QUOTA,        // deleted by the reaper to keep clips under the quota
+    METRIC_REAP_ERRORS,             // clips the reaper could not delete, left for the next start
+    METRIC_COUNTER_COUNT
+} metric_counter;
+
+typedef enum {
+    METRIC_PEAK_UNSYNCED_BYTES,     // written to a clip but not yet through fdatasync, including staged bytes
+    METRIC_PEAK_STAGED_BYTES,       // clips waiting in the staging directory to be moved
+    METRIC_PEAK_COUNT
+} metric_peak;
+
+#define METRICS_SUB_BUCKETS 4
+#define METRICS_BUCKETS (24 * METRICS_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[METRICS_BUCKETS];
+} metrics_histogram;
+
+typedef struct {
+    metrics_histogram stages[METRIC_STAGE_COUNT];
+    uint64_t counters[METRIC_COUNTER_COUNT];
+    uint64_t peaks[METRIC_PEAK_COUNT];
+} metrics_snapshot;
+
+static inline uint64_t metrics_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_record(metric_stage stage, uint64_t latency_ns);
+
+// Records now - since_ns, ignoring timestamps that are in the future or implausibly old
+void metrics_record_since(metric_stage stage, uint64_t since_ns);
+
+void metrics_count(metric_counter counter, uint64_t n);
+
+// Raises the peak to value if it is higher
+void metrics_peak(metric_peak peak, uint64_t value);
+
+// Merges every thread's shard
+void metrics_snapshot_get(metrics_snapshot *snap);
+
+// Upper bound of the bucket holding the given quantile (0..1), in nanoseconds
+uint64_t metrics_quantile_ns(const metrics_histogram *h, double q);
+
+const char *metrics_stage_name(metric_stage stage);
+const char *metrics_counter_name(metric_counter counter);
+const char *metrics_peak_name(metric_peak peak);
+
+// Writes the current snapshot in InfluxDB line protocol, one line per stage plus one for the counters and peaks.
+// Returns true, or false with errno set
+bool metrics_dump(int fd, const char *measurement);
+
+// Stats socket: a listening Unix stream socket; every client that connects gets one dump and is closed.
+// metrics_listen() returns the fd, or -1 with errno set. Call metrics_serve() when it is readable.
+int metrics_listen(const char *path);
+void metrics_serve(int listen_fd, const char *measurement);
+
+#endif
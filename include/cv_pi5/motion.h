@@ -0,0 +1,62 @@
+#ifndef CV_PI5_MOTION_H
+#define CV_PI5_MOTION_H
+
+/*
+    Frame-differencing motion detector working on a luma plane.
+
+    Each frame is first reduced to a small working image: a low-res stream
+    is used as it comes (step 1), a full-res plane is box-filtered down by 2
+    or 4, which also averages away most sensor noise. The working image is
+    compared against the previous one block by block; per-pixel differences
+    below the noise floor count for nothing, a block changes when the rest
+    adds up past block_threshold, and a frame is motion when at least
+    min_blocks blocks changed. Only hold_frames motion frames in a row fire
+    the trigger, so a single flicker does not start a clip, and it fires
+    again every hold_frames frames for as long as the motion lasts, so
+    sustained motion keeps extending the clip it started.
+
+    All memory is allocated by motion_init(). The kernels use NEON on
+    AArch64 and plain C elsewhere; both give the same scores.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t width;             // luma plane as delivered
+    uint32_t height;
+    uint32_t stride;            // bytes per luma row
+    uint32_t step;              // 1, 2 or 4: downscale factor to the working image
+    uint32_t block;             // block edge in working pixels, 16 or 32
+    uint8_t noise_floor;        // per-pixel difference ignored up to this
+    uint32_t block_threshold;   // summed difference that marks a block changed
+    uint32_t min_blocks;        // changed blocks that make a motion frame
+    uint32_t hold_frames;       // motion frames in a row before firing
+    uint32_t warmup_frames;     // frames ignored at start while exposure settles
+} motion_config;
+
+typedef struct {
+    motion_config cfg;
+    uint32_t width;             // working image
+    uint32_t height;
+    uint32_t grid_width;        // blocks; partial blocks at the edges are ignored
+    uint32_t grid_height;
+    uint8_t *images[2];         // current and previous working image
+    int current;
+    uint64_t frames;
+    uint32_t run;               // consecutive motion frames
+    uint32_t score;             // changed blocks in the last frame
+    uint64_t fired;
+} motion_detector;
+
+// Returns true, or false with errno set
+bool motion_init(motion_detector *md, const motion_config *cfg);
+void motion_destroy(motion_detector *md);
+
+// Feeds one luma plane; returns true on every hold_frames-th frame of a run of motion frames
+bool motion_feed(motion_detector *md, const uint8_t *luma);
+
+// Forgets the reference frame and the current run, e.g. after a clip or a camera restart
+void motion_reset(motion_detector *md);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef CV_PI5_PACKET_H
+#define CV_PI5_PACKET_H
+
+/*
+    A unit of media data handed between pipeline stages: one encoded access
+    unit, or one raw frame when no encoder is in the path. The data is owned
+    by whoever produced the packet and is only valid for the duration of the
+    call it is passed to.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKET_FLAG_KEYFRAME 0x1u   // decodable without any earlier packet
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    uint64_t pts_ns;
+    uint32_t flags;
+} encoded_packet;
+
+#endif
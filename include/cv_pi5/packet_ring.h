@@ -0,0 +1,91 @@
+#ifndef CV_PI5_PACKET_RING_H
+#define CV_PI5_PACKET_RING_H
+
+/*
+    Single-producer/single-consumer queue of packets between the encode stage
+    and the writer.
+
+    Encoded payloads normally arrive in a buffer_pool buffer: the slot holds
+    the producer's reference and releasing the slot drops it, so a consumer
+    that wants the bytes for longer (the pre-trigger history) just takes a
+    reference of its own. Without a pool buffer, small payloads are copied
+    into a preallocated byte arena that is freed strictly in FIFO order.
+    Large payloads that already live in a capture buffer (raw frames) are
+    passed by reference instead: the slot carries the capture buffer index
+    and the consumer hands it back through the release callback once the
+    bytes are written.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/buffer_pool.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/packet.h"
+
+#define PACKET_RING_NO_REF UINT32_MAX
+
+typedef void (*packet_ring_release_fn)(void *ctx, uint32_t ref);
+
+typedef struct {
+    encoded_packet pkt;
+    uint32_t ref;           // capture buffer index, PACKET_RING_NO_REF for arena payloads
+    buffer_pool *pool;      // set for pool payloads
+    uint32_t buffer;        // their pool buffer
+    uint64_t arena_end;     // arena position to free up to once consumed
+} packet_ring_item;
+
+typedef struct {
+    size_t capacity;
+    size_t occupancy;
+    size_t high_water;
+    size_t arena_size;
+    size_t arena_used;
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t overflows;     // packets rejected for lack of a slot or arena space
+} packet_ring_stats;
+
+typedef struct {
+    // Producer side
+    _Alignas(FRAME_RING_CACHE_LINE) _Atomic size_t head;
+    uint64_t arena_head;    // monotonic byte position
+    _Atomic size_t high_water;
+    _Atomic uint64_t overflows;
+
+    // Consumer side
+    _Alignas(FRAME_RING_CACHE_LINE) _Atomic size_t tail;
+    _Atomic uint64_t arena_tail;
+
+    // Read-only after init
+    _Alignas(FRAME_RING_CACHE_LINE) size_t capacity;
+    size_t mask;
+    packet_ring_item *slots;
+    uint8_t *arena;
+    size_t arena_size;
+    packet_ring_release_fn release;
+    void *release_ctx;
+} packet_ring;
+
+bool packet_ring_init(packet_ring *ring, size_t max_packets, size_t arena_bytes,
+                      packet_ring_release_fn release, void *release_ctx);
+void packet_ring_destroy(packet_ring *ring);
+
+// Producer only: copies pkt->data into the arena
+bool packet_ring_push(packet_ring *ring, const encoded_packet *pkt);
+
+// Producer only: passes pkt->data by reference, ref is released by the consumer
+bool packet_ring_push_ref(packet_ring *ring, const encoded_packet *pkt, uint32_t ref);
+
+// Producer only: hands over one reference to a pool buffer holding pkt->data
+bool packet_ring_push_buffer(packet_ring *ring, const encoded_packet *pkt, buffer_pool *pool, uint32_t buffer);
+
+// Consumer only: peek at the oldest packet, then packet_ring_release() it when done with the bytes
+bool packet_ring_peek(packet_ring *ring, packet_ring_item *item);
+void packet_ring_release(packet_ring *ring, const packet_ring_item *item);
+
+void packet_ring_get_stats(const packet_ring *ring, packet_ring_stats *stats);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CV_PI5_PIXCONV_H
+#define CV_PI5_PIXCONV_H
+
+/*
+    Pixel-format conversion between the formats cameras deliver and the ones
+    the rest of the pipeline reads: a luma plane for the motion detector,
+    packed Y/Cb/Cr for thumbnails and planar 4:2:0 for the encoders.
+
+        from \ to   GREY    YUV24   YUV420
+        YUV420      yes     yes     -
+        NV12        yes     yes     yes
+        YUYV        yes     yes     yes
+        RGB24       yes     yes     yes
+        GREY        -       yes     -
+
+    The multi-planar YUV420M and NV12M convert like their single-plane
+    forms. Converting to YUV420 samples chroma from the even rows and, from
+    RGB24, the even columns; everything else keeps full resolution.
+
+    Each format pair has its own row kernel, and pixconv_plan() picks it
+    once per stream, so a row runs one loop with no format switch inside.
+    The kernels work in blocks of PIXCONV_BLOCK pixels; a width that is a
+    multiple of it gets a variant without the tail loop. Blocks use NEON
+    when the library is built with CV_PI5_PIXCONV_NEON on AArch64 and plain
+    C otherwise, which compilers vectorise well enough on other hosts; both
+    give the same bytes. RGB24 is converted with the BT.601 limited-range
+    matrix, as camera YUV is.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+
+#define PIXCONV_BLOCK 16            // pixels per kernel block
+#define PIXCONV_MAX_PLANES 3
+
+typedef void (*pixconv_row_fn)(const uint8_t *const *src, uint8_t *const *dst, uint32_t width);
+
+typedef struct {
+    uint8_t *planes[PIXCONV_MAX_PLANES];    // read-only as a source
+    uint32_t strides[PIXCONV_MAX_PLANES];   // bytes per row of each plane
+} pixconv_image;
+
+typedef struct {
+    uint32_t src_format;
+    uint32_t dst_format;
+    uint32_t width;
+    pixconv_row_fn even;            // rows 0, 2, 4... of the destination
+    pixconv_row_fn odd;             // the others: without their chroma for YUV420
+    uint8_t src_planes;
+    uint8_t dst_planes;
+    uint8_t src_shift[PIXCONV_MAX_PLANES];  // plane row = image row >> shift
+    uint8_t dst_shift[PIXCONV_MAX_PLANES];
+} pixconv;
+
+// Picks the kernels for rows width pixels wide, which must be even.
+// Returns false with errno ENOTSUP for a pair the table above lacks
+bool pixconv_plan(pixconv *c, uint32_t src_format, uint32_t dst_format, uint32_t width);
+
+// The planes of a dequeued frame in cap's format. Returns false with errno ENOTSUP
+// for formats pixconv does not read, EINVAL when the buffer is too small for them
+bool pixconv_capture_image(pixconv_image *img, const capture_device *cap, const capture_frame *frame);
+
+// Converts source row src_y into destination row dst_y, for resampling callers
+void pixconv_row(const pixconv *c, const pixconv_image *src, const pixconv_image *dst, uint32_t src_y, uint32_t dst_y);
+
+// Converts height rows, which must be even when either format is 4:2:0
+void pixconv_frame(const pixconv *c, const pixconv_image *src, const pixconv_image *dst, uint32_t height);
+
+#endif
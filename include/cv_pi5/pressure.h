@@ -0,0 +1,83 @@
+#ifndef CV_PI5_PRESSURE_H
+#define CV_PI5_PRESSURE_H
+
+/*
+    Degradation controller: trades quality for headroom when storage runs
+    low, the SoC runs hot or the pipeline's queues back up, so frames are
+    never simply lost.
+
+    The caller samples the inputs at a fixed interval and feeds them to
+    pressure_update(). Any input past its high mark for degrade_samples
+    samples in a row moves one level down the ladder; all inputs back under
+    their clear marks for recover_samples samples moves one level up. The
+    gap between the two marks and the two sample counts keep it from
+    oscillating. Each level is a pressure_step:
+
+        0   nominal
+        1   bitrate 75%
+        2   bitrate 50%
+        3   bitrate 50%, every other frame
+        4   bitrate 35%, every other frame, half resolution
+
+    Bitrate and frame rate change on the fly; resolution needs the capture
+    format and the encoder rebuilt, so it applies when a clip is opened.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PRESSURE_LEVELS 5
+#define PRESSURE_THERMAL_ZONES 4
+
+#define PRESSURE_STORAGE 0x1u
+#define PRESSURE_THERMAL 0x2u
+#define PRESSURE_QUEUE 0x4u
+
+typedef struct {
+    uint64_t free_low_bytes;    // free space below this is pressure
+    uint64_t free_clear_bytes;  // and above this is clear
+    int32_t temp_high_mc;       // millidegrees C, as /sys/class/thermal reports them
+    int32_t temp_clear_mc;
+    uint32_t queue_high_pct;    // fullest pipeline queue, percent of capacity
+    uint32_t queue_clear_pct;
+    uint32_t degrade_samples;
+    uint32_t recover_samples;
+} pressure_config;
+
+typedef struct {
+    bool free_known;
+    uint64_t free_bytes;
+    bool temp_known;
+    int32_t temp_mc;
+    uint32_t queue_pct;
+} pressure_sample;
+
+typedef struct {
+    uint32_t bitrate_pct;       // of the configured bitrate
+    uint32_t fps_divisor;       // keep one frame in this many
+    uint32_t scale_divisor;     // of the configured width and height
+} pressure_step;
+
+typedef struct {
+    pressure_config cfg;
+    int level;
+    uint32_t over;              // consecutive samples under pressure
+    uint32_t clear;             // consecutive samples all clear
+    uint32_t reasons;           // PRESSURE_* inputs past their high mark in the last sample
+    int thermal_fds[PRESSURE_THERMAL_ZONES];
+    int thermal_count;
+} pressure_controller;
+
+// Opens the thermal zones it finds; none is not an error. Returns true, or false with errno set
+bool pressure_init(pressure_controller *pc, const pressure_config *cfg);
+void pressure_destroy(pressure_controller *pc);
+
+// Hottest zone in millidegrees C; false when there is none to read
+bool pressure_read_temp(pressure_controller *pc, int32_t *temp_mc);
+
+// Returns +1 after stepping down a level, -1 after stepping back up, 0 otherwise
+int pressure_update(pressure_controller *pc, const pressure_sample *sample);
+
+const pressure_step *pressure_step_for(int level);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef CV_PI5_PRETRIGGER_H
+#define CV_PI5_PRETRIGGER_H
+
+/*
+    Rolling buffer of the most recent packets, kept so a clip can start
+    before the event that triggered it.
+
+    All memory is allocated by pretrigger_init(): one byte arena used as a
+    circular buffer plus a fixed array of packet entries. The buffer always
+    starts on a keyframe; when space or the time window runs out the oldest
+    whole group of pictures is evicted, never a single packet, so whatever is
+    flushed is decodable from its first byte.
+
+    pretrigger_init_pooled() keeps the history in buffer_pool buffers
+    instead of an arena of its own. A packet that already sits in a pool
+    buffer is kept by taking a reference, with no copy, and the byte budget
+    counts the buffers held.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/buffer_pool.h"
+#include "cv_pi5/packet.h"
+
+typedef struct {
+    size_t offset;          // into the arena, or into the pool buffer
+    uint32_t buffer;        // pool buffer, pooled mode only
+    size_t size;
+    uint64_t pts_ns;
+    uint32_t flags;
+} pretrigger_entry;
+
+typedef struct {
+    uint8_t *arena;
+    size_t arena_size;      // in pooled mode the budget for buffers held
+    buffer_pool *pool;      // NULL in arena mode
+    size_t pooled_bytes;
+    size_t head;            // next free byte
+
+    pretrigger_entry *entries;
+    size_t max_entries;
+    size_t first;           // oldest entry, always a keyframe while count > 0
+    size_t count;
+
+    uint64_t window_ns;     // how much history to keep
+
+    uint64_t evicted_gops;
+    uint64_t rejected;      // packets dropped: no keyframe to anchor them, or bigger than the arena
+} pretrigger_buffer;
+
+// Returns true, or false with errno set
+bool pretrigger_init(pretrigger_buffer *pb, size_t arena_bytes, size_t max_packets, uint64_t window_ns);
+bool pretrigger_init_pooled(pretrigger_buffer *pb, buffer_pool *pool, size_t budget_bytes, size_t max_packets, uint64_t window_ns);
+void pretrigger_destroy(pretrigger_buffer *pb);
+
+// Reserves size bytes for a new packet and returns where to write it, or NULL if the packet was rejected
+uint8_t *pretrigger_reserve(pretrigger_buffer *pb, size_t size, uint64_t pts_ns, uint32_t flags);
+bool pretrigger_append(pretrigger_buffer *pb, const encoded_packet *pkt);
+
+// Pooled mode: keeps pkt, whose bytes live in buffer, by taking a reference
+bool pretrigger_append_buffer(pretrigger_buffer *pb, const encoded_packet *pkt, uint32_t buffer);
+
+// Passes every buffered packet, oldest first, to sink and empties the buffer.
+// Stops and returns false as soon as sink does.
+typedef bool (*pretrigger_sink)(void *ctx, const encoded_packet *pkt);
+bool pretrigger_flush(pretrigger_buffer *pb, pretrigger_sink sink, void *ctx);
+
+void pretrigger_clear(pretrigger_buffer *pb);
+
+// Time between the oldest and newest buffered packet
+uint64_t pretrigger_span_ns(const pretrigger_buffer *pb);
+
+#endif
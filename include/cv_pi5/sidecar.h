@@ -0,0 +1,132 @@
+#ifndef CV_PI5_SIDECAR_H
+#define CV_PI5_SIDECAR_H
+
+/*
+    Sidecar files written next to each finished clip, for a review UI that
+    lists, previews and seeks clips without opening them:
+
+        <clip>.jpg  thumbnail of the clip's trigger frame
+        <clip>.idx  seek index: one entry per keyframe with its byte offset
+                    in the clip, its time since the clip's first packet and
+                    the motion score of that frame
+
+    The pipeline only collects, in memory and without a syscall: the writer
+    notes each packet in a seek_index as it writes it, whichever thread runs
+    the motion detector records every score in a motion_log, and the
+    capture thread copies a downscaled thumbnail of the first frame after
+    the trigger. Once the clip has been renamed into place the whole
+    sidecar_job goes to a worker_pool, where sidecar_job_run() fills in the
+    scores still missing, compresses the JPEG and writes both files, each
+    through a hidden temp file renamed into place so the clip index never
+    sees half of one.
+
+    The index is little-endian, as on the Pi:
+        seek_index_header                      40 bytes
+        seek_index_entry[header.entry_count]   24 bytes each
+*/
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/capture.h"
+#include "cv_pi5/packet.h"
+#include "cv_pi5/pixconv.h"
+#include "cv_pi5/storage.h"
+#include "cv_pi5/wall_clock.h"
+
+#define SEEK_INDEX_MAGIC 0x58495043u    // "CPIX"
+#define SEEK_INDEX_VERSION 2u           // 2 added start_wall_ns
+#define SEEK_SCORE_UNKNOWN UINT32_MAX   // no motion score for that frame
+
+#define MOTION_LOG_SLOTS 1024           // 34 s at 30 fps: a pre-trigger window and a clip's first seconds
+#define MOTION_LOG_MATCH_NS 50000000ull // a low-res frame this close to a keyframe scores it
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t motion_blocks;     // the grid scores count changed blocks of, 0 without motion
+    uint32_t width;             // of the recorded frames
+    uint32_t height;
+    uint64_t start_pts_ns;      // capture timestamp (CLOCK_MONOTONIC) of the clip's first packet
+    int64_t start_wall_ns;      // the same instant in wall time, ns since the epoch, 0 without a clock
+} seek_index_header;
+
+typedef struct {
+    uint64_t offset;            // the keyframe's first byte in the clip, with a muxer the fragment's PAT
+    uint64_t time_ns;           // since start_pts_ns
+    uint32_t motion_score;      // changed blocks, or SEEK_SCORE_UNKNOWN
+    uint32_t flags;             // 0, reserved
+} seek_index_entry;
+
+_Static_assert(sizeof(seek_index_header) == 40, "seek index header is wire format");
+_Static_assert(sizeof(seek_index_entry) == 24, "seek index entry is wire format");
+
+// Scores by frame timestamp, one writer, readers on any thread
+typedef struct {
+    _Atomic uint64_t timestamps[MOTION_LOG_SLOTS];  // 0 while a slot is rewritten
+    _Atomic uint32_t scores[MOTION_LOG_SLOTS];
+    uint32_t next;                                  // writer only
+} motion_log;
+
+void motion_log_record(motion_log *log, uint64_t timestamp_ns, uint32_t score);
+
+// The score recorded closest to timestamp_ns, within MOTION_LOG_MATCH_NS, else SEEK_SCORE_UNKNOWN
+uint32_t motion_log_lookup(const motion_log *log, uint64_t timestamp_ns);
+
+typedef struct {
+    seek_index_header header;
+    seek_index_entry *entries;
+    uint32_t capacity;
+    const motion_log *scores;   // NULL leaves every score unknown
+    const wall_clock *clock;    // NULL leaves start_wall_ns 0
+    bool started;
+    bool truncated;             // an entry could not be stored, the index skips keyframes
+} seek_index;
+
+// Writer thread: packet pkt is about to be written at offset in the clip
+void seek_index_note(seek_index *ix, const encoded_packet *pkt, uint64_t offset);
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint8_t *pixels;            // Y, Cb, Cr interleaved, width x height x 3
+    uint8_t *row;               // one source row in the same layout, source_width x 3
+    uint32_t source_width;
+    pixconv conv;               // source format to YUV24, planned on the first frame
+    bool planned;
+    bool ready;
+} sidecar_thumbnail;
+
+// False when this build writes no thumbnails (no libjpeg)
+bool sidecar_thumbnails_supported(void);
+
+// Capture thread, while frame's buffer is still its own: keeps a nearest-neighbour downscale.
+// Returns false with errno ENOTSUP for pixel formats pixconv cannot turn into YUV24
+bool sidecar_thumbnail_take(sidecar_thumbnail *t, const capture_device *cap, const capture_frame *frame);
+
+typedef struct {
+    char dir[PATH_MAX];
+    char name[CLIP_NAME_MAX];   // the finished clip, in dir
+    seek_index index;           // written as <name>.idx when wanted and started
+    sidecar_thumbnail thumb;    // written as <name>.jpg when ready
+    motion_log scores;          // copy of the session's log, taken once the clip is complete
+    bool want_index;
+} sidecar_job;
+
+// A job for one clip of width x height frames, thumbnails thumb_width wide (0 for none).
+// Returns the job, or NULL with errno set
+sidecar_job *sidecar_job_create(uint32_t width, uint32_t height, bool index, uint32_t thumb_width);
+
+// Once the clip is in place, with the scores the writer may not have found yet (NULL for none).
+// Returns true, or false with errno ENAMETOOLONG
+bool sidecar_job_set_clip(sidecar_job *job, const char *dir, const char *name, const motion_log *scores);
+
+// Writes the sidecars and frees the job; a worker_job_fn. Counts METRIC_SIDECARS_WRITTEN or METRIC_SIDECAR_ERRORS
+void sidecar_job_run(void *job);
+
+void sidecar_job_destroy(sidecar_job *job);
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef CV_PI5_STORAGE_H
+#define CV_PI5_STORAGE_H
+
+/*
+    In-memory index of the clips in one output directory.
+
+    The directory is scanned once when the index is opened. After that the
+    writer reports each finished clip with clip_index_add() and eviction pops
+    clips off min-heaps keyed on mtime, so keeping space free never needs
+    another readdir or stat. Free space comes from fstatvfs() on the
+    directory fd.
+
+    Clips come in retention classes, one heap each. A manual clip, one a
+    trigger source rather than motion asked for, carries CLIP_MANUAL_MARK
+    right before its extension, so the class survives a restart's scan and
+    a move between directories:
+
+        cam0_20260314T091502Z_000042_manual.ts
+
+    With retention set per class, the next clip to go is the one furthest
+    through its class's retention: a 6-day-old motion clip kept for 7 goes
+    before a 20-day-old manual one kept for 30. Classes without one are
+    only touched once the others are empty, oldest first, and with none
+    set at all the order is simply oldest first.
+
+    Only files named as clip_namer names them (clip_name_valid()) are
+    clips: whatever else shares the directory is never indexed, and so
+    never evicted. A clip's sidecar files (sidecar.h), named after it with
+    one of the suffixes below, are not clips of their own: eviction
+    deletes them along with their clip.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/clip_name.h"
+
+#define CLIP_NAME_MAX 128
+#define CLIP_THUMBNAIL_SUFFIX ".jpg"
+#define CLIP_SEEK_INDEX_SUFFIX ".idx"
+
+typedef enum {
+    CLIP_CLASS_MOTION,          // and anything without a mark
+    CLIP_CLASS_MANUAL,
+    CLIP_CLASS_COUNT
+} clip_class;
+
+typedef struct {
+    char name[CLIP_NAME_MAX];   // relative to the indexed directory
+    int64_t mtime_ns;           // CLOCK_REALTIME
+    uint64_t bytes;
+    clip_class kind;
+} clip_entry;
+
+typedef struct {
+    clip_entry *heap;           // min-heap, oldest clip at [0]
+    size_t count;
+    size_t capacity;
+    uint64_t bytes;
+} clip_heap;
+
+typedef struct {
+    int dir_fd;
+    clip_heap classes[CLIP_CLASS_COUNT];
+    uint32_t retention_s[CLIP_CLASS_COUNT]; // 0 keeps a class until space is needed
+    size_t count;
+    uint64_t total_bytes;       // sum of every indexed clip
+    uint64_t evicted_clips;
+    uint64_t evicted_bytes;
+} clip_index;
+
+// From the name's mark
+clip_class clip_class_of(const char *name);
+
+// Scans dir once. Hidden files (in-progress temp files), sidecars and other names are not clips.
+// Returns true, or false with errno set
+bool clip_index_open(clip_index *idx, const char *dir);
+void clip_index_close(clip_index *idx);
+
+// Records a finished clip; name is relative to the indexed directory
+bool clip_index_add(clip_index *idx, const char *name, uint64_t bytes, int64_t mtime_ns);
+
+// Same, taking size and mtime from the file itself; EINVAL for a name that is not a clip's
+bool clip_index_add_file(clip_index *idx, const char *name);
+
+// Per class, in seconds; the index starts with none
+void clip_index_set_retention(clip_index *idx, const uint32_t retention_s[CLIP_CLASS_COUNT]);
+
+// The clip eviction would take next at wall time now_ns, left in place. expired, if not NULL,
+// says whether it has outlived its class's retention. Returns false with errno ENOENT when empty
+bool clip_index_next(const clip_index *idx, int64_t now_ns, clip_entry *next, bool *expired);
+
+// Same, taken out of the index without deleting it, for deleting later with clip_delete()
+bool clip_index_take_next(clip_index *idx, int64_t now_ns, clip_entry *taken);
+
+// Deletes the next clip. Returns false with errno ENOENT once the index is empty
+bool clip_index_evict_next(clip_index *idx, clip_entry *evicted);
+
+// Renames from in from_dir_fd to to in to_dir_fd without ever replacing a file: false with errno EEXIST
+// when to is taken, so a name another run already used is never lost
+bool clip_rename(int from_dir_fd, const char *from, int to_dir_fd, const char *to);
+
+// Unlinks a clip and its sidecars in the directory dir_fd. Returns true, also when it was already gone
+bool clip_delete(int dir_fd, const char *name);
+
+// Space available to unprivileged writers on the indexed filesystem
+bool clip_index_free_bytes(const clip_index *idx, uint64_t *free_bytes);
+
+// Evicts clips, next first, until at least needed_bytes are free.
+// Returns how many clips were deleted, or -1 with errno set (ENOSPC if even an empty index isn't enough)
+int clip_index_make_space(clip_index *idx, uint64_t needed_bytes);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef CV_PI5_STORAGE_PROBE_H
+#define CV_PI5_STORAGE_PROBE_H
+
+/*
+    What the output directory's filesystem can do, found out once.
+
+    storage_probe_run() answers whether the directory is writable, which
+    filesystem and device it is on, its block size and whether O_DIRECT is
+    accepted, without creating a file or writing data: writability comes
+    from access() and the mount flags, O_DIRECT from opening an unnamed
+    O_TMPFILE, which is never linked and never written to. The result only
+    changes when the mount table does, so callers keep it and re-run the
+    probe when the fd from storage_probe_watch() signals a mount or unmount.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct {
+    bool writable;
+    bool direct_io;             // O_DIRECT open accepted
+    dev_t dev;                  // device of the directory, changes when something is mounted over it
+    uint64_t fs_magic;          // statfs f_type
+    char fs_type[32];           // from mountinfo, e.g. "ext4", "vfat", "tmpfs"
+    char mount_point[256];
+    uint32_t block_size;        // preferred I/O size
+    uint64_t free_bytes;
+    uint64_t total_bytes;
+} storage_probe;
+
+// Returns true, or false with errno set (ENOTDIR etc.); a read-only directory is still a success
+bool storage_probe_run(storage_probe *p, const char *dir);
+
+// True when the two probes describe different storage
+bool storage_probe_differs(const storage_probe *a, const storage_probe *b);
+
+// /proc/self/mountinfo, which raises EPOLLPRI when the mount table changes.
+// Returns the fd, or -1 with errno set
+int storage_probe_watch(void);
+
+// Re-arms the watch after an event; call before re-running the probe
+void storage_probe_watch_ack(int fd);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef CV_PI5_STREAM_SINK_H
+#define CV_PI5_STREAM_SINK_H
+
+/*
+    Live view over the network from the encode that records clips.
+
+    The writer thread, which owns the packet ring the encode stage fills,
+    offers every packet it takes, armed or recording, to the sink before
+    releasing it. Pool payloads are shared by reference, so a viewer costs
+    the pipeline a ring push and an eventfd write per packet and no copy.
+    When the sink's queue is full the packet is dropped for every viewer
+    and so is everything up to the next keyframe, so the queue only ever
+    holds a stream that decodes; the writer never waits. Raw frames passed
+    by capture buffer are never offered: they must go back to the driver.
+
+    The sink's own thread muxes what is queued into an MPEG transport
+    stream, in batches of up to STREAM_SINK_BATCH_PACKETS access units,
+    each batch once whatever the number of viewers. It then hands the batch
+    to each client with a single non-blocking sendmsg() that gathers the
+    client's unsent tail of earlier batches first, so a viewer costs one
+    syscall per batch. Viewers connect over TCP and read the stream as it
+    comes, e.g. ffplay tcp://camera:8554.
+
+    Each client has its own drop policy. A client joins at the next
+    keyframe. One whose socket takes only part of a batch keeps the rest
+    as its tail, and skips every batch until that tail has gone, then
+    resumes at the next keyframe. A client still behind after
+    STREAM_SINK_STALL_MS is disconnected. A slow viewer therefore loses
+    whole GOPs for itself and never slows the others, the writer or the
+    camera.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/encoder.h"
+#include "cv_pi5/evloop.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/ts_mux.h"
+#include "cv_pi5/wall_clock.h"
+
+#define STREAM_SINK_MAX_CLIENTS 8
+#define STREAM_SINK_QUEUE_PACKETS 32        // a second at 30 fps, held by reference
+#define STREAM_SINK_QUEUE_BYTES (2u << 20)  // for payloads without a pool buffer, copied
+#define STREAM_SINK_BATCH_PACKETS 8         // access units muxed per send round
+#define STREAM_SINK_SNDBUF (1u << 20)       // per client socket, what a brief stall can absorb
+#define STREAM_SINK_STALL_MS 5000           // behind for this long and a client is dropped
+
+typedef struct {
+    int fd;                     // -1 while the slot is free
+    bool synced;                // its stream is continuous, so the next batch goes out from its start
+    uint8_t *tail;              // bytes it has yet to take, ending on an access unit
+    size_t tail_size;
+    size_t tail_sent;
+    size_t tail_capacity;
+    uint64_t behind_since_ns;   // 0 while the tail is empty
+} stream_client;
+
+typedef struct {
+    int listen_fd;
+    int wake_fd;                // eventfd, writer -> sink thread
+    packet_ring queue;
+    ts_muxer mux;
+    evloop loop;
+    pthread_t thread;
+    atomic_bool stop;
+    bool gap;                   // writer thread only: skipping to a keyframe after a full queue
+
+    // Sink thread only
+    stream_client clients[STREAM_SINK_MAX_CLIENTS];
+    uint8_t *batch;             // transport stream of the access units being sent
+    size_t batch_size;
+    size_t batch_capacity;
+    size_t batch_key;           // offset of its first keyframe, SIZE_MAX for none
+    uint32_t batch_units;
+
+    _Atomic uint32_t client_count;
+    _Atomic uint64_t clients_served;
+    _Atomic uint64_t bytes_sent;
+} stream_sink;
+
+// Listens on TCP port, on every address, and starts the thread. clock may be NULL, as for ts_mux.
+// Returns true, or false with errno set
+bool stream_sink_start(stream_sink *s, uint16_t port, encoder_codec codec, const wall_clock *clock);
+
+// Writer thread: a packet taken from the encode stage's ring, before it is released
+void stream_sink_offer(stream_sink *s, const packet_ring_item *item);
+
+// After the writer has stopped: disconnects every client and frees what is still queued
+void stream_sink_stop(stream_sink *s);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef CV_PI5_SUPERVISOR_H
+#define CV_PI5_SUPERVISOR_H
+
+/*
+    Health supervisor: a thread of its own that watches every pipeline from
+    outside, so it still runs when a pipeline thread is stuck, and answers
+    sustained backpressure with a ladder of actions.
+
+    Each sample reads, for every attached subject:
+        heartbeat   the thread's event loop rounds: they move on every
+                    wakeup, and a callback spinning or blocked stops them
+        progress    packets the writer has taken off the packet ring,
+                    the far end of capture, encode and write together
+        queues      the frame ring ahead of the encoder and the packet
+                    ring ahead of the writer, the fuller one in percent
+        writes      the slowest write call since the last sample
+
+    A queue past queue_high_pct or a write slower than write_high_ms for
+    escalate_samples samples in a row raises the subject's action one step;
+    recover_samples clear samples lower it again. The pipeline thread reads
+    the action and applies it, cheapest loss first:
+
+        SUPERVISOR_NOMINAL          everything runs
+        SUPERVISOR_SHED_ANALYTICS   motion scores one frame in SUPERVISOR_ANALYTICS_DIVISOR
+        SUPERVISOR_LOWER_FPS        and one frame in SUPERVISOR_FPS_DIVISOR is recorded
+        SUPERVISOR_DROP_FRAMES      and frames are dropped while the frame ring is half full
+
+    The pressure controller (pressure.h) degrades quality for storage, heat
+    and queues with the encoder's help; this ladder is for when that is not
+    enough or too slow, and the two combine.
+
+    A subject whose heartbeat or progress has not moved for stall_ms is
+    stalled. With a watchdog device open, it is kicked after every sample in
+    which no subject is stalled and never otherwise, so a process that
+    spins or deadlocks without crashing gets the board reset once the
+    device's own timeout runs out. Stopping cleanly disarms it.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/evloop.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/writer.h"
+
+#define SUPERVISOR_MAX_SUBJECTS 8
+#define SUPERVISOR_ANALYTICS_DIVISOR 4
+#define SUPERVISOR_FPS_DIVISOR 2
+
+typedef enum {
+    SUPERVISOR_NOMINAL,
+    SUPERVISOR_SHED_ANALYTICS,
+    SUPERVISOR_LOWER_FPS,
+    SUPERVISOR_DROP_FRAMES,
+} supervisor_action;
+
+typedef struct {
+    uint32_t interval_ms;       // between samples
+    uint32_t stall_ms;          // heartbeat or progress standing still this long is a stall
+    uint32_t queue_high_pct;
+    uint32_t queue_clear_pct;
+    uint32_t write_high_ms;     // slowest write call per sample, 0 ignores write latency
+    uint32_t escalate_samples;
+    uint32_t recover_samples;
+    const char *watchdog;       // device path, e.g. /dev/watchdog; NULL or empty for none, only read by supervisor_start()
+    uint32_t watchdog_timeout_s;// set on the device, 0 keeps the driver's
+} supervisor_config;
+
+typedef struct {
+    const char *name;
+    const evloop *loop;         // heartbeat
+    const frame_ring *frames;   // NULL, with packets and writer, for a loop without a pipeline
+    const packet_ring *packets;
+    frame_writer *writer;
+} supervisor_subject;
+
+typedef struct {
+    supervisor_subject subject;
+    bool attached;
+    _Atomic int action;         // supervisor_action, read by the subject's own thread
+    uint32_t over;              // supervisor thread only from here
+    uint32_t clear;
+    uint64_t heartbeat;
+    uint64_t progress;
+    uint64_t heartbeat_ns;      // when each last moved
+    uint64_t progress_ns;
+    bool stalled;
+} supervisor_slot;
+
+typedef struct {
+    supervisor_config cfg;
+    int watchdog_fd;            // -1 without one
+    pthread_t thread;
+    pthread_mutex_t lock;       // slots
+    pthread_cond_t wake;        // stop
+    bool stopping;
+    supervisor_slot slots[SUPERVISOR_MAX_SUBJECTS];
+    _Atomic uint64_t kicks;
+    _Atomic uint64_t stalls;    // subjects found stalled, once per stall
+} supervisor;
+
+// Opens the watchdog, if any, and starts the thread. Returns true, or false with errno set
+bool supervisor_start(supervisor *sv, const supervisor_config *cfg);
+
+// Starts watching subject, whose pointers must stay valid until supervisor_detach().
+// Returns the slot, or -1 with errno ENOSPC
+int supervisor_attach(supervisor *sv, const supervisor_subject *subject);
+void supervisor_detach(supervisor *sv, int slot);
+
+// Subject's thread: the action to apply now, SUPERVISOR_NOMINAL for slot -1
+supervisor_action supervisor_action_for(supervisor *sv, int slot);
+
+// Joins the thread and disarms the watchdog
+void supervisor_stop(supervisor *sv);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CV_PI5_TRACE_H
+#define CV_PI5_TRACE_H
+
+/*
+    Timeline tracepoints at each pipeline stage, for seeing what every
+    thread was doing around a dropped frame rather than only that it
+    dropped.
+
+    Events go to the kernel's ftrace buffer through trace_marker, in the
+    atrace text format ("B|pid|name", "E|pid", "C|pid|name|value") that
+    Perfetto turns into per-thread slices and counter tracks, and that
+    trace-cmd and a plain cat of the trace show as they are. The kernel
+    stamps and orders them with its own sched and irq events, so one
+    capture shows a slow fdatasync next to the thread it held up:
+
+        echo 1 > /sys/kernel/tracing/tracing_on   (or let perfetto/trace-cmd do it)
+        cam_trigger --general.trace=true
+
+    The macros below are the only way in. Without CV_PI5_TRACE, as in the
+    debug and release presets, they compile to nothing and their arguments
+    are never evaluated. With it, as in the profile preset, each one costs
+    a relaxed load and a branch until trace_start() finds tracefs, then a
+    write() per event. Slices nest per thread: every TRACE_BEGIN() needs
+    its TRACE_END() on the same thread. Names are string literals.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef CV_PI5_TRACE
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#define TRACE_INSTANT(name) trace_instant(name)
+#define TRACE_COUNTER(name, value) trace_counter(name, (int64_t)(value))
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#endif
+
+// Opens trace_marker under tracefs or the older debugfs mount. Events are dropped until it
+// succeeds. Returns true, or false with errno set (ENOENT without tracefs, EACCES unprivileged)
+bool trace_start(void);
+
+// Events after this are dropped; safe while other threads still trace
+void trace_stop(void);
+
+// True while events are being written
+bool trace_enabled(void);
+
+// For the macros, which are what callers should use
+void trace_begin(const char *name);
+void trace_end(void);
+void trace_instant(const char *name);
+void trace_counter(const char *name, int64_t value);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CV_PI5_TRIGGER_H
+#define CV_PI5_TRIGGER_H
+
+/*
+    External trigger sources, each exposed as a non-blocking fd for the
+    event loop:
+
+        GPIO    a line on a gpiochip, edge events through the GPIO v2 uAPI
+        socket  a Unix datagram socket; every datagram received is one trigger
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    TRIGGER_GPIO,
+    TRIGGER_SOCKET,
+} trigger_kind;
+
+typedef struct {
+    trigger_kind kind;
+    int fd;
+    char path[108];         // socket path, unlinked on close
+} trigger_source;
+
+// Returns true, or false with errno set
+bool trigger_open_gpio(trigger_source *t, const char *chip, uint32_t line, bool rising_edge);
+bool trigger_open_socket(trigger_source *t, const char *path);
+
+// Consumes everything pending on the fd and returns how many triggers it held
+int trigger_read(trigger_source *t);
+
+void trigger_close(trigger_source *t);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef CV_PI5_TS_MUX_H
+#define CV_PI5_TS_MUX_H
+
+/*
+    MPEG transport stream muxer for one H.264 or HEVC video stream.
+
+    A transport stream has no index to finish: every 188-byte packet stands
+    alone, so a clip cut short by a power failure plays up to its last
+    complete packet and finalising a clip costs nothing beyond flushing the
+    last partial buffer. The stream is cut into fragments that start on a
+    keyframe with a fresh PAT and PMT, so a player (or a seek) can start
+    decoding at any fragment boundary without reading what came before.
+
+    Each access unit becomes one PES packet with a 90 kHz PTS taken from the
+    packet's capture timestamp, and carries the PCR. A stream starts at one
+    second by default; given a wall_clock it starts instead at the wall time
+    of its first packet, modulo the 33-bit 90 kHz range, so clips of the
+    same moment from different cameras carry the same PTS and a clip's PTS
+    reads as time of day. The clock is consulted once per stream, never per
+    packet.
+
+    Output is gathered into a fixed buffer and handed to the write callback
+    in chunks that are a multiple of 188 bytes, so at most one buffer is
+    lost to a crash on top of whatever the sink itself had not written yet.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/encoder.h"
+#include "cv_pi5/packet.h"
+#include "cv_pi5/wall_clock.h"
+
+#define TS_PACKET_SIZE 188
+#define TS_MUX_BUFFER_PACKETS 348   // just under 64 KiB per write
+
+typedef bool (*ts_mux_write_fn)(void *ctx, const void *data, size_t length);
+
+typedef struct {
+    encoder_codec codec;
+    uint32_t fragment_keyframes;    // keyframes per fragment, 0 or 1 starts one at every keyframe
+
+    bool passthrough;               // write packets as they are, e.g. raw frames that no container fits
+    const wall_clock *clock;        // NULL, or stamps each stream with the wall time it starts at
+    bool started;
+    uint64_t base_ns;               // pts of the first packet, which maps to the stream's start time
+    uint64_t base_pcr;              // that start time, in 90 kHz ticks
+    uint32_t keyframes_in_fragment;
+    uint8_t cc_pat;                 // continuity counters
+    uint8_t cc_pmt;
+    uint8_t cc_video;
+
+    uint64_t fragments;             // started so far, a sink may sync when this moves
+    uint64_t bytes;                 // handed to the write callback
+    size_t fill;
+    uint8_t buffer[TS_MUX_BUFFER_PACKETS * TS_PACKET_SIZE];
+} ts_muxer;
+
+// Returns true, or false with errno set
+bool ts_mux_init(ts_muxer *m, encoder_codec codec, uint32_t fragment_keyframes);
+
+// Starts a new stream, for the next file, keeping the codec, settings and clock; flush the last one first
+void ts_mux_restart(ts_muxer *m);
+
+// Muxes one access unit, writing full buffers to write(ctx, ...).
+// Returns false, with errno from the callback, if a write failed
+bool ts_mux_packet(ts_muxer *m, const encoded_packet *pkt, ts_mux_write_fn write, void *ctx);
+
+// True when pkt will open a new fragment, so everything muxed before it forms whole fragments
+bool ts_mux_starts_fragment(const ts_muxer *m, const encoded_packet *pkt);
+
+// Hands over whatever is buffered: once the last packet of a clip is in, or ahead of a sync
+bool ts_mux_flush(ts_muxer *m, ts_mux_write_fn write, void *ctx);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CV_PI5_WALL_CLOCK_H
+#define CV_PI5_WALL_CLOCK_H
+
+/*
+    Maps CLOCK_MONOTONIC timestamps, which is what V4L2 drivers stamp
+    frames with, to wall time (CLOCK_REALTIME) without reading the wall
+    clock per frame.
+
+    One thread calls wall_clock_update() about once a second. It reads both
+    clocks back to back, keeping the tightest of a few tries, and
+    compares the offset it measures with what the current mapping
+    predicts. A small error is slewed in, a quarter per update, and the
+    rate the offset moves at (the monotonic clock's drift against
+    NTP-disciplined wall time) is tracked so the mapping stays continuous
+    between updates. An error past WALL_CLOCK_STEP_NS, usually the wall
+    clock being set, restarts the mapping at the measured offset.
+
+    Any thread converts with wall_clock_to_wall(): a seqlock read and a
+    multiply, so stamping a clip or a stream needs no syscall.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define WALL_CLOCK_UPDATE_MS 1000
+#define WALL_CLOCK_STEP_NS 100000000ll  // 100 ms: beyond any slew, the clock was set
+#define WALL_CLOCK_MAX_DRIFT_PPB 500000 // 500 ppm, as adjtimex allows
+
+typedef struct {
+    _Atomic uint32_t seq;           // odd while the writer is mid-update
+    _Atomic uint64_t base_mono_ns;  // where the mapping below was last anchored
+    _Atomic int64_t base_offset_ns; // wall - monotonic at base_mono_ns
+    _Atomic int64_t drift_ppb;      // offset change per monotonic second, in ns per 1e9 ns
+
+    // Updater only
+    bool started;
+    uint64_t last_mono_ns;          // of the last measurement
+    int64_t last_offset_ns;
+    uint64_t steps;                 // restarts, the first measurement included
+} wall_clock;
+
+// Takes the first measurement. Returns true, or false with errno set
+bool wall_clock_init(wall_clock *c);
+
+// One thread, about every WALL_CLOCK_UPDATE_MS. Returns true when the mapping was restarted
+// rather than slewed; false on a slew, or with errno set if a clock could not be read
+bool wall_clock_update(wall_clock *c);
+
+// Any thread: wall time of monotonic timestamp mono_ns, in ns since the epoch
+int64_t wall_clock_to_wall(const wall_clock *c, uint64_t mono_ns);
+
+// Same, as a timespec
+struct timespec wall_clock_timespec(const wall_clock *c, uint64_t mono_ns);
+
+#endif
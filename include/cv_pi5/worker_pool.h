@@ -0,0 +1,50 @@
+#ifndef CV_PI5_WORKER_POOL_H
+#define CV_PI5_WORKER_POOL_H
+
+/*
+    A few background threads for work nothing is waiting on, such as the
+    sidecar files written after a clip closes.
+
+    The threads run under SCHED_IDLE and in the idle I/O class, so they only
+    get a core, or the disk, that the capture, encode and write threads
+    leave unused. Jobs are taken first in, first out from one queue under a
+    mutex: they come a few per clip, not per frame, so nothing here needs to
+    be lock-free. The queue is bounded; a job that does not fit is refused,
+    not blocked on.
+*/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WORKER_POOL_MAX_THREADS 4
+
+typedef void (*worker_job_fn)(void *arg);
+
+typedef struct worker_job worker_job;
+
+typedef struct {
+    pthread_t threads[WORKER_POOL_MAX_THREADS];
+    unsigned thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    worker_job *head;           // next to run
+    worker_job *tail;
+    size_t queued;
+    size_t max_queued;
+    bool stopping;
+    unsigned long long completed;
+} worker_pool;
+
+// Starts threads workers, 1 to WORKER_POOL_MAX_THREADS, with room for max_queued waiting jobs.
+// Returns true, or false with errno set
+bool worker_pool_start(worker_pool *pool, unsigned threads, size_t max_queued);
+
+// Any thread: queues fn(arg). Returns false with errno EAGAIN when the queue is full,
+// leaving arg with the caller
+bool worker_pool_submit(worker_pool *pool, worker_job_fn fn, void *arg);
+
+// Runs every job still queued, then joins the threads
+void worker_pool_stop(worker_pool *pool);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef CV_PI5_WRITER_H
+#define CV_PI5_WRITER_H
+
+/*
+    Writer thread that drains a packet_ring into a clip_file.
+
+    The encode stage pushes packets and calls writer_notify(); the writer
+    blocks on an eventfd while the ring is empty, writes each packet and
+    releases it. Raw frames passed by reference are written straight from
+    their capture buffer and requeued on release, so a slow write only eats
+    into the driver's spare buffers instead of stalling capture.
+
+    With a pre-trigger buffer attached the writer starts out armed: packets
+    are copied into the rolling buffer and released at once.
+    writer_trigger() flushes that history to the file and switches to writing
+    live packets.
+
+    With a muxer attached packets go into the file as a transport stream
+    instead of bare; the muxer's partly filled buffer is written out when the
+    writer stops.
+
+    Durability follows a writer_sync_policy. Writeback is started every
+    writeback_bytes and whenever writer_request_writeback() asks, typically
+    from an event loop timer, keeping the page cache from building a large
+    dirty backlog. fdatasync, the expensive part on SD cards, is left for
+    fragment boundaries: ahead of every Nth fragment's first packet (a
+    keyframe, with or without a muxer) and once at the end, so a power cut
+    costs at most the fragments since the last one. unsynced_max, also the
+    unsynced_bytes_max peak metric, is the worst that ever was at stake.
+
+    With a seek_index attached every packet is noted in it at the offset it
+    starts at, for the clip's sidecar index (sidecar.h). With a stream_sink
+    attached every packet, armed or recording, is offered to it just before
+    it is released, for live viewers (stream_sink.h).
+
+    One writer records clip after clip without a restart. writer_rotate()
+    hands over the next, already open, file: ahead of the next keyframe the
+    writer finishes the current clip (muxer tail, fdatasync, close) and
+    goes back to the armed state writing into the new one, so the new
+    clip's history starts on that keyframe and no frame falls between the
+    two. rotated_fd then becomes readable.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cv_pi5/clip_file.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/pretrigger.h"
+#include "cv_pi5/sidecar.h"
+#include "cv_pi5/stream_sink.h"
+#include "cv_pi5/ts_mux.h"
+
+typedef struct {
+    uint64_t writeback_bytes;       // start writeback every this many bytes written, 0 only on request
+    uint32_t datasync_fragments;    // fdatasync every this many fragments and at the end, 0 never
+} writer_sync_policy;
+
+typedef struct {
+    packet_ring *ring;
+    clip_file *out;         // owned by the caller, closed after writer_stop()
+    int wake_fd;            // eventfd, producer -> writer
+    pretrigger_buffer *pre; // NULL writes live from the start
+    ts_muxer *mux;          // NULL writes packets as they are; writer thread only once started
+    seek_index *index;      // NULL, or writer thread only until writer_stop()
+    stream_sink *stream;    // NULL, or fed by the writer thread until writer_stop()
+    atomic_bool triggered;
+    bool flushed;           // writer thread only: pre-trigger history is on disk
+    pthread_t thread;
+    bool running;
+    atomic_bool stop;
+    atomic_int error;       // first errno seen by the writer, 0 while healthy
+    _Atomic uint64_t packets_written;
+    _Atomic uint64_t bytes_written;
+
+    writer_sync_policy sync;
+    atomic_bool writeback_requested;
+    uint64_t writeback_at;          // writer thread only: out->size at the last writeback
+    uint32_t fragments_unsynced;    // writer thread only: boundaries passed since the last fdatasync
+    uint64_t last_pts_ns;           // writer thread only: newest packet written
+    _Atomic uint64_t datasyncs;
+    _Atomic uint64_t unsynced_max;  // bytes
+    _Atomic uint64_t write_ns_max;  // slowest write or fdatasync call; a reader may exchange it for 0 to sample it
+
+    clip_file *next_out;            // set by writer_rotate(), taken by the writer thread
+    seek_index *next_index;
+    atomic_bool rotate_requested;
+    int rotated_fd;                 // eventfd, writer -> caller, one count per rotation done
+    _Atomic uint64_t rotations;
+    atomic_int rotated_error;       // of the last clip rotated out, 0 when it was written whole
+} frame_writer;
+
+// sync may be NULL: nothing is synced and the file is left to the kernel's writeback.
+// stream, NULL for none, must outlive the writer
+bool writer_start(frame_writer *w, packet_ring *ring, clip_file *out, pretrigger_buffer *pre, ts_muxer *mux,
+                  const writer_sync_policy *sync, seek_index *index, stream_sink *stream);
+
+// Producer side: wakes the writer after one or more pushes
+void writer_notify(frame_writer *w);
+
+// Any thread: flush the pre-trigger history and start writing live packets
+void writer_trigger(frame_writer *w);
+
+// Any thread: start writeback of what has been written so far
+void writer_request_writeback(frame_writer *w);
+
+// After a trigger: at the next keyframe close the current clip and continue, armed, into next.
+// The writer owns next from here on. Returns false with errno EBUSY while a rotation is still pending
+bool writer_rotate(frame_writer *w, clip_file *next, seek_index *next_index);
+
+// Drains whatever is left in the ring, joins the thread and returns false if any write to the
+// current clip failed. A rotation still pending is dropped: the current clip takes the rest
+bool writer_stop(frame_writer *w);
+
+#endif
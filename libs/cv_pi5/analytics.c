@@ -0,0 +1,110 @@
+#include "cv_pi5/analytics.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static void record_error(analytics_stage *a, int error){
+    int expected = 0;
+    atomic_compare_exchange_strong(&a->error, &expected, error ? error : EIO);
+}
+
+static void score_pending(analytics_stage *a){
+    frame_desc frame;
+    while (frame_ring_pop(a->frames, &frame)){
+        uint64_t start = metrics_now_ns();
+        TRACE_BEGIN("motion");
+        bool moved = motion_feed(a->motion, a->cap->buffers[frame.index].planes[0].data);
+        TRACE_END();
+        metrics_record(METRIC_STAGE_MOTION, metrics_now_ns() - start);
+        if (a->scores) motion_log_record(a->scores, frame.timestamp_ns, a->motion->score);
+        if (!capture_requeue(a->cap, frame.index)) record_error(a, errno); // Before the callback, the driver wants it back soonest
+        metrics_count(METRIC_ANALYTICS_FRAMES, 1);
+        if (moved){metrics_count(METRIC_MOTION_TRIGGERS, 1); a->on_motion(a->ctx);}
+    }
+}
+
+static bool pin_to(uint64_t cpu_mask){
+    if (!cpu_mask) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; ++cpu)
+        if (cpu_mask & (1ull << cpu)) CPU_SET(cpu, &set);
+    int r = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+    if (r != 0){errno = r;return false;}
+    return true;
+}
+
+static void *analytics_main(void *arg){
+    analytics_stage *a = arg;
+    if (!pin_to(a->cpu_mask)) record_error(a, errno);
+
+    for (;;){
+        score_pending(a);
+        if (atomic_load_explicit(&a->stop, memory_order_acquire)){
+            score_pending(a); // Pushes that raced with stop
+            break;
+        }
+
+        uint64_t count;
+        if (read(a->wake_fd, &count, sizeof count) < 0 && errno != EINTR){
+            record_error(a, errno);
+            break;
+        }
+    }
+    return NULL;
+}
+
+bool analytics_start(analytics_stage *a, capture_device *cap, frame_ring *frames, motion_detector *motion,
+                     motion_log *scores, analytics_motion_fn on_motion, void *ctx, uint64_t cpu_mask){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!a || !cap || !frames || !motion || !on_motion){errno = EINVAL;return false;}
+
+    memset(a, 0, sizeof *a);
+    a->cap = cap;
+    a->frames = frames;
+    a->motion = motion;
+    a->scores = scores;
+    a->on_motion = on_motion;
+    a->ctx = ctx;
+    a->cpu_mask = cpu_mask;
+    atomic_init(&a->stop, false);
+    atomic_init(&a->error, 0);
+
+    a->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (a->wake_fd < 0) return false;
+
+    int r = pthread_create(&a->thread, NULL, analytics_main, a);
+    if (r != 0){close(a->wake_fd);a->wake_fd = -1;errno = r;return false;}
+    a->running = true;
+    return true;
+}
+
+void analytics_notify(analytics_stage *a){
+    uint64_t one = 1;
+    ssize_t n;
+    do { n = write(a->wake_fd, &one, sizeof one); } while (n < 0 && errno == EINTR);
+}
+
+bool analytics_stop(analytics_stage *a){
+    if (!a || !a->running) return false;
+
+    atomic_store_explicit(&a->stop, true, memory_order_release);
+    analytics_notify(a);
+    pthread_join(a->thread, NULL);
+    a->running = false;
+
+    close(a->wake_fd);
+    a->wake_fd = -1;
+
+    int error = atomic_load(&a->error);
+    if (error){errno = error;return false;}
+    return true;
+}
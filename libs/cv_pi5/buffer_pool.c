@@ -0,0 +1,178 @@
+#include "cv_pi5/buffer_pool.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define POOL_HUGE_PAGE ((size_t)2 << 20)
+#define POOL_ALIGN 4096             // Every buffer is page aligned, which O_DIRECT writes can use as they are
+
+/*
+    The free stack's head packs the top buffer's index into the low 32 bits
+    and a counter bumped by every pop into the high 32, so a pop that raced
+    with a pop and push of the same buffer fails its compare-exchange
+    instead of linking a stale next.
+*/
+
+static uint64_t pack(uint32_t index, uint32_t tag){
+    return (uint64_t)tag << 32 | index;
+}
+
+static void push_free(buffer_pool *pool, buffer_pool_class *c, uint32_t index){
+    uint64_t head = atomic_load_explicit(&c->free_head, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&pool->next[index], (uint32_t)head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&c->free_head, &head, pack(index, (uint32_t)(head >> 32)),
+                                                    memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&c->free, 1, memory_order_relaxed);
+}
+
+static uint32_t pop_free(buffer_pool *pool, buffer_pool_class *c){
+    uint64_t head = atomic_load_explicit(&c->free_head, memory_order_acquire);
+    for (;;){
+        uint32_t index = (uint32_t)head;
+        if (index == BUFFER_POOL_NONE) return BUFFER_POOL_NONE;
+        uint32_t next = atomic_load_explicit(&pool->next[index], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&c->free_head, &head, pack(next, (uint32_t)(head >> 32) + 1u),
+                                                  memory_order_acquire, memory_order_acquire))
+            break;
+    }
+    uint32_t left = atomic_fetch_sub_explicit(&c->free, 1, memory_order_relaxed) - 1;
+    if (left < atomic_load_explicit(&c->low_water, memory_order_relaxed))
+        atomic_store_explicit(&c->low_water, left, memory_order_relaxed); // A racing update may win; it is a statistic
+    return (uint32_t)head;
+}
+
+static void *map_pool(buffer_pool *pool, size_t bytes){
+    /*
+        Huge pages first; an empty hugetlb pool makes the prefault fail, and
+        then ordinary shmem with THP requested is the next best thing
+    */
+    size_t huge = (bytes + POOL_HUGE_PAGE - 1) & ~(POOL_HUGE_PAGE - 1);
+    int fd = memfd_create("cv_pi5_pool", MFD_CLOEXEC | MFD_HUGETLB);
+    if (fd >= 0){
+        void *p = ftruncate(fd, (off_t)huge) == 0
+            ? mmap(NULL, huge, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0) : MAP_FAILED;
+        if (p != MAP_FAILED){pool->fd = fd; pool->mapped = huge; pool->hugetlb = true; return p;}
+        close(fd);
+    }
+
+    fd = memfd_create("cv_pi5_pool", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, (off_t)huge) != 0){int saved = errno; close(fd); errno = saved; return NULL;}
+    void *p = mmap(NULL, huge, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED){int saved = errno; close(fd); errno = saved; return NULL;}
+    (void)madvise(p, huge, MADV_HUGEPAGE);          // Honoured when shmem_enabled allows it
+    (void)madvise(p, huge, MADV_POPULATE_WRITE);    // Prefault now, not on the hot path
+    (void)mlock(p, huge);                           // Unlocked the pages are still prefaulted
+    pool->fd = fd;
+    pool->mapped = huge;
+    return p;
+}
+
+bool buffer_pool_init(buffer_pool *pool, const buffer_pool_class_config *classes, int class_count){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!pool || !classes || class_count <= 0 || class_count > BUFFER_POOL_MAX_CLASSES){errno = EINVAL;return false;}
+    memset(pool, 0, sizeof *pool);
+    pool->fd = -1;
+
+    size_t bytes = 0;
+    uint64_t total = 0;
+    for (int i = 0; i < class_count; ++i){
+        if (classes[i].buffer_size == 0 || classes[i].count == 0){errno = EINVAL;return false;}
+        if (i > 0 && classes[i].buffer_size <= classes[i - 1].buffer_size){errno = EINVAL;return false;}
+
+        buffer_pool_class *c = &pool->classes[i];
+        c->buffer_size = (classes[i].buffer_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+        c->count = classes[i].count;
+        c->first = (uint32_t)total;
+        c->offset = bytes;
+        bytes += c->buffer_size * c->count;
+        total += c->count;
+    }
+    if (total >= BUFFER_POOL_NONE){errno = EINVAL;return false;}
+
+    pool->refs = calloc(total, sizeof *pool->refs);
+    pool->next = calloc(total, sizeof *pool->next);
+    if (!pool->refs || !pool->next){buffer_pool_destroy(pool);errno = ENOMEM;return false;}
+
+    pool->base = map_pool(pool, bytes);
+    if (!pool->base){int saved = errno; buffer_pool_destroy(pool); errno = saved; return false;}
+
+    pool->class_count = class_count;
+    pool->total = (uint32_t)total;
+    for (int i = 0; i < class_count; ++i){
+        buffer_pool_class *c = &pool->classes[i];
+        atomic_init(&c->free_head, pack(BUFFER_POOL_NONE, 0));
+        atomic_init(&c->free, 0);
+        atomic_init(&c->exhausted, 0);
+        for (uint32_t k = c->count; k-- > 0;) push_free(pool, c, c->first + k); // Lowest index on top
+        atomic_init(&c->low_water, c->count);
+    }
+    return true;
+}
+
+void buffer_pool_destroy(buffer_pool *pool){
+    if (!pool) return;
+    if (pool->base) munmap(pool->base, pool->mapped);
+    if (pool->fd >= 0) close(pool->fd);
+    free(pool->refs);
+    free(pool->next);
+    memset(pool, 0, sizeof *pool);
+    pool->fd = -1;
+}
+
+static buffer_pool_class *class_of(const buffer_pool *pool, uint32_t index){
+    for (int i = pool->class_count - 1; i > 0; --i)
+        if (index >= pool->classes[i].first) return (buffer_pool_class *)&pool->classes[i];
+    return (buffer_pool_class *)&pool->classes[0];
+}
+
+uint32_t buffer_pool_get(buffer_pool *pool, size_t size){
+    for (int i = 0; i < pool->class_count; ++i){
+        buffer_pool_class *c = &pool->classes[i];
+        if (c->buffer_size < size) continue;
+        uint32_t index = pop_free(pool, c);
+        if (index != BUFFER_POOL_NONE){
+            atomic_store_explicit(&pool->refs[index], 1, memory_order_relaxed);
+            return index;
+        }
+        atomic_fetch_add_explicit(&c->exhausted, 1, memory_order_relaxed);
+    }
+    return BUFFER_POOL_NONE;
+}
+
+void buffer_pool_ref(buffer_pool *pool, uint32_t index){
+    atomic_fetch_add_explicit(&pool->refs[index], 1, memory_order_relaxed);
+}
+
+void buffer_pool_unref(buffer_pool *pool, uint32_t index){
+    // Release so the last holder's reads of the data happen before the next owner's writes
+    if (atomic_fetch_sub_explicit(&pool->refs[index], 1, memory_order_acq_rel) == 1)
+        push_free(pool, class_of(pool, index), index);
+}
+
+uint8_t *buffer_pool_data(const buffer_pool *pool, uint32_t index){
+    const buffer_pool_class *c = class_of(pool, index);
+    return pool->base + c->offset + (size_t)(index - c->first) * c->buffer_size;
+}
+
+size_t buffer_pool_size(const buffer_pool *pool, uint32_t index){
+    return class_of(pool, index)->buffer_size;
+}
+
+void buffer_pool_get_stats(const buffer_pool *pool, buffer_pool_class_stats *stats, int max_classes){
+    for (int i = 0; i < pool->class_count && i < max_classes; ++i){
+        const buffer_pool_class *c = &pool->classes[i];
+        stats[i].buffer_size = c->buffer_size;
+        stats[i].count = c->count;
+        stats[i].free = atomic_load_explicit(&c->free, memory_order_relaxed);
+        stats[i].low_water = atomic_load_explicit(&c->low_water, memory_order_relaxed);
+        stats[i].exhausted = atomic_load_explicit(&c->exhausted, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,294 @@
+#include "cv_pi5/capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+static int xioctl(int fd, unsigned long request, void *arg){
+    /*
+        ioctl() that retries when interrupted by a signal
+    */
+    int r;
+    do { r = ioctl(fd, request, arg); } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+static bool set_format(capture_device *cap, const capture_config *cfg){
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof fmt);
+    fmt.type = cap->buf_type;
+    if (xioctl(cap->fd, VIDIOC_G_FMT, &fmt) != 0) return false; // Start from the driver's current format
+
+    if (cap->mplane){
+        if (cfg->width)  fmt.fmt.pix_mp.width = cfg->width;
+        if (cfg->height) fmt.fmt.pix_mp.height = cfg->height;
+        if (cfg->pixelformat) fmt.fmt.pix_mp.pixelformat = cfg->pixelformat;
+        fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    } else {
+        if (cfg->width)  fmt.fmt.pix.width = cfg->width;
+        if (cfg->height) fmt.fmt.pix.height = cfg->height;
+        if (cfg->pixelformat) fmt.fmt.pix.pixelformat = cfg->pixelformat;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    }
+    if (xioctl(cap->fd, VIDIOC_S_FMT, &fmt) != 0) return false;
+
+    // The driver may have adjusted the request, so record what we actually got
+    if (cap->mplane){
+        cap->width = fmt.fmt.pix_mp.width;
+        cap->height = fmt.fmt.pix_mp.height;
+        cap->pixelformat = fmt.fmt.pix_mp.pixelformat;
+        cap->num_planes = fmt.fmt.pix_mp.num_planes;
+        if (cap->num_planes == 0 || cap->num_planes > CAPTURE_MAX_PLANES){errno = EINVAL;return false;}
+        for (uint32_t p = 0; p < cap->num_planes; ++p) cap->bytesperline[p] = fmt.fmt.pix_mp.plane_fmt[p].bytesperline;
+    } else {
+        cap->width = fmt.fmt.pix.width;
+        cap->height = fmt.fmt.pix.height;
+        cap->pixelformat = fmt.fmt.pix.pixelformat;
+        cap->num_planes = 1;
+        cap->bytesperline[0] = fmt.fmt.pix.bytesperline;
+    }
+    if (cfg->pixelformat && cap->pixelformat != cfg->pixelformat){errno = EINVAL;return false;}
+    return true;
+}
+
+static void set_frame_rate(capture_device *cap, uint32_t fps){
+    /*
+        Best effort: plenty of drivers have a fixed rate and reject S_PARM
+    */
+    if (!fps) return;
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof parm);
+    parm.type = cap->buf_type;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = fps;
+    (void)xioctl(cap->fd, VIDIOC_S_PARM, &parm);
+}
+
+static bool map_buffers(capture_device *cap, uint32_t count){
+    /*
+        Asks the driver for its own buffers, maps every plane once and exports
+        each plane as a DMABUF. Nothing is copied or reallocated after this.
+        count is clamped to CAPTURE_MAX_BUFFERS before asking: every buffer
+        the driver allocates is one it may fill, and cap->buffers has to
+        hold them all.
+    */
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof req);
+    req.count = count < CAPTURE_MAX_BUFFERS ? count : CAPTURE_MAX_BUFFERS;
+    req.type = cap->buf_type;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(cap->fd, VIDIOC_REQBUFS, &req) != 0) return false;
+    if (req.count < 2 || req.count > CAPTURE_MAX_BUFFERS){
+        // One buffer can't be captured into while another is consumed; more than fit (a driver's minimum) go back
+        int error = req.count < 2 ? ENOMEM : ENOTSUP;
+        memset(&req, 0, sizeof req);
+        req.type = cap->buf_type;
+        req.memory = V4L2_MEMORY_MMAP;
+        (void)xioctl(cap->fd, VIDIOC_REQBUFS, &req);
+        errno = error;
+        return false;
+    }
+    cap->buffer_count = req.count;
+
+    for (uint32_t i = 0; i < cap->buffer_count; ++i){
+        struct v4l2_buffer buf;
+        struct v4l2_plane planes[CAPTURE_MAX_PLANES];
+        memset(&buf, 0, sizeof buf);
+        memset(planes, 0, sizeof planes);
+        buf.type = cap->buf_type;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (cap->mplane){
+            buf.m.planes = planes;
+            buf.length = cap->num_planes;
+        }
+        if (xioctl(cap->fd, VIDIOC_QUERYBUF, &buf) != 0) return false;
+
+        for (uint32_t p = 0; p < cap->num_planes; ++p){
+            capture_plane *plane = &cap->buffers[i].planes[p];
+            size_t length = cap->mplane ? planes[p].length : buf.length;
+            off_t offset = cap->mplane ? planes[p].m.mem_offset : buf.m.offset;
+
+            void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, cap->fd, offset);
+            if (data == MAP_FAILED) return false;
+            plane->data = data;
+            plane->length = length;
+
+            struct v4l2_exportbuffer exp;
+            memset(&exp, 0, sizeof exp);
+            exp.type = cap->buf_type;
+            exp.index = i;
+            exp.plane = p;
+            exp.flags = O_RDONLY | O_CLOEXEC;
+            plane->dmabuf_fd = xioctl(cap->fd, VIDIOC_EXPBUF, &exp) == 0 ? exp.fd : -1;
+        }
+    }
+    return true;
+}
+
+bool capture_open(capture_device *cap, const capture_config *cfg){
+    /*
+        Opens and configures a V4L2 capture node for streaming.
+        If successful returns true
+        else returns false with errno set, and cap is left closed
+    */
+    if (!cap || !cfg || !cfg->device || !*cfg->device){errno = EINVAL;return false;}
+    if (capture_synthetic_match(cfg->device)) return capture_synthetic_open(cap, cfg);
+
+    memset(cap, 0, sizeof *cap);
+    for (uint32_t i = 0; i < CAPTURE_MAX_BUFFERS; ++i)
+        for (uint32_t p = 0; p < CAPTURE_MAX_PLANES; ++p) cap->buffers[i].planes[p].dmabuf_fd = -1;
+
+    cap->fd = open(cfg->device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (cap->fd < 0) return false;
+
+    struct v4l2_capability caps;
+    memset(&caps, 0, sizeof caps);
+    if (xioctl(cap->fd, VIDIOC_QUERYCAP, &caps) != 0) goto fail;
+
+    uint32_t device_caps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+    if (!(device_caps & V4L2_CAP_STREAMING)){errno = ENOTSUP;goto fail;}
+    if (device_caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE){
+        cap->mplane = true;
+        cap->buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    } else if (device_caps & V4L2_CAP_VIDEO_CAPTURE){
+        cap->buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else {errno = ENOTSUP;goto fail;}
+
+    if (!set_format(cap, cfg)) goto fail;
+    set_frame_rate(cap, cfg->fps);
+    if (!map_buffers(cap, cfg->buffer_count ? cfg->buffer_count : 4)) goto fail;
+    return true;
+
+fail:;
+    int saved = errno;
+    capture_close(cap);
+    errno = saved;
+    return false;
+}
+
+bool capture_start(capture_device *cap){
+    /*
+        Queues every buffer to the driver and starts streaming
+    */
+    if (!cap || cap->fd < 0){errno = EINVAL;return false;}
+    if (cap->synthetic) return capture_synthetic_start(cap);
+    if (cap->streaming) return true;
+
+    for (uint32_t i = 0; i < cap->buffer_count; ++i)
+        if (!capture_requeue(cap, i)) return false;
+
+    enum v4l2_buf_type type = cap->buf_type;
+    if (xioctl(cap->fd, VIDIOC_STREAMON, &type) != 0) return false;
+    cap->streaming = true;
+    return true;
+}
+
+int capture_dequeue(capture_device *cap, capture_frame *frame){
+    if (cap->synthetic) return capture_synthetic_dequeue(cap, frame);
+
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[CAPTURE_MAX_PLANES];
+    memset(&buf, 0, sizeof buf);
+    memset(planes, 0, sizeof planes);
+    buf.type = cap->buf_type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (cap->mplane){
+        buf.m.planes = planes;
+        buf.length = cap->num_planes;
+    }
+
+    if (xioctl(cap->fd, VIDIOC_DQBUF, &buf) != 0) return errno == EAGAIN ? 0 : -1;
+
+    frame->index = buf.index;
+    frame->sequence = buf.sequence;
+    frame->flags = buf.flags;
+    frame->timestamp_ns = (uint64_t)buf.timestamp.tv_sec * 1000000000ull + (uint64_t)buf.timestamp.tv_usec * 1000ull;
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC || !frame->timestamp_ns){
+        // A driver stamping in some other clock, or not at all: dequeue time is the nearest monotonic stamp
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        frame->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    }
+    frame->num_planes = cap->num_planes;
+    for (uint32_t p = 0; p < cap->num_planes; ++p)
+        frame->bytesused[p] = cap->mplane ? planes[p].bytesused : buf.bytesused;
+    return 1;
+}
+
+bool capture_requeue(capture_device *cap, uint32_t index){
+    /*
+        Hands a buffer back to the driver. VIDIOC_QBUF is serialised by the
+        driver, so this may be called from a different thread than the one
+        that dequeued the frame.
+    */
+    if (index >= cap->buffer_count){errno = EINVAL;return false;}
+    // Before the driver can touch it: an unowned reader that sees the count move discards what it read
+    if (cap->requeue_generations) atomic_fetch_add_explicit(&cap->requeue_generations[index], 1, memory_order_release);
+    if (cap->synthetic) return capture_synthetic_requeue(cap, index);
+
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[CAPTURE_MAX_PLANES];
+    memset(&buf, 0, sizeof buf);
+    memset(planes, 0, sizeof planes);
+    buf.type = cap->buf_type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    if (cap->mplane){
+        buf.m.planes = planes;
+        buf.length = cap->num_planes;
+    }
+    return xioctl(cap->fd, VIDIOC_QBUF, &buf) == 0;
+}
+
+int capture_plane_fd(const capture_device *cap, uint32_t index, uint32_t plane, uint64_t *offset){
+    if (!cap || !offset || index >= cap->buffer_count || plane >= cap->num_planes){errno = EINVAL;return -1;}
+    int fd = cap->buffers[index].planes[plane].dmabuf_fd;
+    if (fd >= 0){*offset = 0;return fd;}
+    if (cap->synthetic) return capture_synthetic_plane_fd(cap, index, plane, offset);
+    errno = ENOTSUP;
+    return -1;
+}
+
+void capture_stop(capture_device *cap){
+    if (!cap || cap->fd < 0 || !cap->streaming) return;
+    if (cap->synthetic){capture_synthetic_stop(cap);return;}
+    enum v4l2_buf_type type = cap->buf_type;
+    (void)xioctl(cap->fd, VIDIOC_STREAMOFF, &type); // Also returns every queued buffer to the dequeued state
+    cap->streaming = false;
+}
+
+void capture_close(capture_device *cap){
+    if (!cap) return;
+    if (cap->synthetic){capture_synthetic_close(cap);return;}
+    capture_stop(cap);
+
+    for (uint32_t i = 0; i < CAPTURE_MAX_BUFFERS; ++i){
+        for (uint32_t p = 0; p < CAPTURE_MAX_PLANES; ++p){
+            capture_plane *plane = &cap->buffers[i].planes[p];
+            if (plane->dmabuf_fd >= 0) close(plane->dmabuf_fd);
+            if (plane->data) munmap(plane->data, plane->length);
+            plane->data = NULL;
+            plane->length = 0;
+            plane->dmabuf_fd = -1;
+        }
+    }
+
+    if (cap->fd >= 0){
+        if (cap->buffer_count){ // Release the driver's buffers
+            struct v4l2_requestbuffers req;
+            memset(&req, 0, sizeof req);
+            req.type = cap->buf_type;
+            req.memory = V4L2_MEMORY_MMAP;
+            (void)xioctl(cap->fd, VIDIOC_REQBUFS, &req);
+        }
+        close(cap->fd);
+    }
+    cap->fd = -1;
+    cap->buffer_count = 0;
+}
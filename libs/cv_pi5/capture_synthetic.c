@@ -0,0 +1,290 @@
+#include "cv_pi5/capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/udmabuf.h>
+#include <linux/videodev2.h>
+
+#define SYNTHETIC_PATTERN_FRAMES 16 // The pattern loops after this many frames
+#define SYNTHETIC_REPLAY_PREFIX "replay:"
+
+/*
+    Buffers live in one sealed memfd, so where /dev/udmabuf exists each one
+    can be exported as a real DMABUF and a hardware encoder imports it just
+    as it would a driver's. Every frame is copied from the prerendered
+    pattern or the replay file into its buffer on dequeue, standing in for
+    the sensor's DMA; that copy is part of the dequeue latency.
+*/
+
+struct capture_synthetic {
+    int memfd;
+    uint8_t *buffers;           // buffer i at i * buffer_stride
+    size_t buffers_mapped;
+    size_t buffer_stride;
+    size_t frame_size;
+    const uint8_t *source;      // source_frames frames back to back
+    size_t source_mapped;
+    uint32_t source_frames;
+    uint64_t period_ns;
+    uint64_t start_ns;
+    uint64_t ticks;             // timer expirations since start
+    _Atomic uint32_t queued;    // bit i: buffer i is ours to fill
+};
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static bool frame_layout(uint32_t pixelformat, uint32_t width, uint32_t height, uint32_t *bytesperline, size_t *frame_size){
+    switch (pixelformat){
+    case V4L2_PIX_FMT_YUV420: case V4L2_PIX_FMT_NV12:
+        if ((width | height) & 1) return false;
+        *bytesperline = width;
+        *frame_size = (size_t)width * height * 3 / 2;
+        return true;
+    case V4L2_PIX_FMT_GREY:
+        *bytesperline = width;
+        *frame_size = (size_t)width * height;
+        return true;
+    case V4L2_PIX_FMT_YUYV: case V4L2_PIX_FMT_UYVY:
+        if (width & 1) return false;
+        *bytesperline = width * 2;
+        *frame_size = (size_t)*bytesperline * height;
+        return true;
+    case V4L2_PIX_FMT_RGB24:
+        *bytesperline = width * 3;
+        *frame_size = (size_t)*bytesperline * height;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void render_pattern(const capture_device *cap, uint8_t *frame, uint32_t index){
+    /*
+        A diagonal gradient with a bright square sliding across it, plus a
+        little noise so encoders and the motion detector have real work
+    */
+    uint32_t w = cap->width, h = cap->height;
+    uint32_t side = h / 6 ? h / 6 : 1;
+    uint32_t sx = (uint32_t)((uint64_t)(w - (side < w ? side : w)) * index / SYNTHETIC_PATTERN_FRAMES);
+    uint32_t sy = (h - (side < h ? side : h)) / 2;
+    uint32_t seed = 2463534242u ^ index;
+
+    for (uint32_t y = 0; y < h; ++y){
+        uint8_t *row = frame + (size_t)y * cap->bytesperline[0];
+        for (uint32_t x = 0; x < w; ++x){
+            seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; // xorshift32
+            bool in_square = x >= sx && x < sx + side && y >= sy && y < sy + side;
+            uint8_t luma = in_square ? 235 : (uint8_t)(16 + (x + y) * 160 / (w + h) + (seed & 7));
+            switch (cap->pixelformat){
+            case V4L2_PIX_FMT_YUYV: row[2 * x] = luma; row[2 * x + 1] = 128; break;
+            case V4L2_PIX_FMT_UYVY: row[2 * x] = 128; row[2 * x + 1] = luma; break;
+            case V4L2_PIX_FMT_RGB24: row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = luma; break;
+            default: row[x] = luma; break;
+            }
+        }
+    }
+    if (cap->pixelformat == V4L2_PIX_FMT_YUV420 || cap->pixelformat == V4L2_PIX_FMT_NV12)
+        memset(frame + (size_t)w * h, 128, (size_t)w * h / 2); // Neutral chroma
+}
+
+static bool load_source(capture_device *cap, capture_synthetic *s, const char *device){
+    if (strncmp(device, SYNTHETIC_REPLAY_PREFIX, strlen(SYNTHETIC_REPLAY_PREFIX)) == 0){
+        int fd = open(device + strlen(SYNTHETIC_REPLAY_PREFIX), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0){int saved = errno; close(fd); errno = saved; return false;}
+        uint64_t frames = (uint64_t)st.st_size / s->frame_size;
+        if (frames == 0 || frames > UINT32_MAX){close(fd); errno = EINVAL; return false;} // Not even one whole frame
+        s->source_mapped = (size_t)(frames * s->frame_size);
+        void *p = mmap(NULL, s->source_mapped, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        int saved = errno;
+        close(fd);
+        if (p == MAP_FAILED){s->source_mapped = 0; errno = saved; return false;}
+        s->source = p;
+        s->source_frames = (uint32_t)frames;
+        return true;
+    }
+
+    s->source_mapped = s->frame_size * SYNTHETIC_PATTERN_FRAMES;
+    void *p = mmap(NULL, s->source_mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED){s->source_mapped = 0; return false;}
+    for (uint32_t i = 0; i < SYNTHETIC_PATTERN_FRAMES; ++i) render_pattern(cap, (uint8_t *)p + i * s->frame_size, i);
+    s->source = p;
+    s->source_frames = SYNTHETIC_PATTERN_FRAMES;
+    return true;
+}
+
+static void export_buffers(capture_device *cap, capture_synthetic *s){
+    // Best effort, like VIDIOC_EXPBUF: without udmabuf the planes are mapped memory only
+    int dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (dev < 0) return;
+    for (uint32_t i = 0; i < cap->buffer_count; ++i){
+        struct udmabuf_create create = {
+            .memfd = (uint32_t)s->memfd,
+            .flags = UDMABUF_FLAGS_CLOEXEC,
+            .offset = (uint64_t)i * s->buffer_stride,
+            .size = s->buffer_stride,
+        };
+        cap->buffers[i].planes[0].dmabuf_fd = ioctl(dev, UDMABUF_CREATE, &create);
+        if (cap->buffers[i].planes[0].dmabuf_fd < 0) break;
+    }
+    close(dev);
+}
+
+bool capture_synthetic_match(const char *device){
+    return strcmp(device, "synthetic") == 0 || strncmp(device, SYNTHETIC_REPLAY_PREFIX, strlen(SYNTHETIC_REPLAY_PREFIX)) == 0;
+}
+
+bool capture_synthetic_open(capture_device *cap, const capture_config *cfg){
+    /*
+        If successful returns true
+        else returns false with errno set, and cap is left closed
+    */
+    memset(cap, 0, sizeof *cap);
+    cap->fd = -1;
+    for (uint32_t i = 0; i < CAPTURE_MAX_BUFFERS; ++i)
+        for (uint32_t p = 0; p < CAPTURE_MAX_PLANES; ++p) cap->buffers[i].planes[p].dmabuf_fd = -1;
+
+    cap->buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    cap->width = cfg->width ? cfg->width : 1920;
+    cap->height = cfg->height ? cfg->height : 1080;
+    cap->pixelformat = cfg->pixelformat ? cfg->pixelformat : V4L2_PIX_FMT_YUV420;
+    cap->num_planes = 1;
+    cap->buffer_count = cfg->buffer_count ? cfg->buffer_count : 4;
+    if (cap->buffer_count > CAPTURE_MAX_BUFFERS) cap->buffer_count = CAPTURE_MAX_BUFFERS;
+
+    capture_synthetic *s = calloc(1, sizeof *s);
+    if (!s){errno = ENOMEM;return false;}
+    cap->synthetic = s;
+    s->memfd = -1;
+    s->period_ns = 1000000000ull / (cfg->fps ? cfg->fps : 30);
+    atomic_init(&s->queued, 0);
+
+    if (!frame_layout(cap->pixelformat, cap->width, cap->height, &cap->bytesperline[0], &s->frame_size)){errno = EINVAL;goto fail;}
+    if (!load_source(cap, s, cfg->device)) goto fail;
+
+    long page = sysconf(_SC_PAGESIZE);
+    s->buffer_stride = (s->frame_size + (size_t)page - 1) & ~((size_t)page - 1);
+    s->buffers_mapped = s->buffer_stride * cap->buffer_count;
+    s->memfd = memfd_create("cv_pi5_synthetic", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (s->memfd < 0 || ftruncate(s->memfd, (off_t)s->buffers_mapped) != 0) goto fail;
+    (void)fcntl(s->memfd, F_ADD_SEALS, F_SEAL_SHRINK); // udmabuf insists
+    void *p = mmap(NULL, s->buffers_mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s->memfd, 0);
+    if (p == MAP_FAILED) goto fail;
+    s->buffers = p;
+    for (uint32_t i = 0; i < cap->buffer_count; ++i){
+        cap->buffers[i].planes[0].data = s->buffers + (size_t)i * s->buffer_stride;
+        cap->buffers[i].planes[0].length = s->buffer_stride;
+    }
+    export_buffers(cap, s);
+
+    cap->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (cap->fd < 0) goto fail;
+    return true;
+
+fail:;
+    int saved = errno;
+    capture_synthetic_close(cap);
+    errno = saved;
+    return false;
+}
+
+bool capture_synthetic_start(capture_device *cap){
+    if (cap->streaming) return true;
+    capture_synthetic *s = cap->synthetic;
+    atomic_store_explicit(&s->queued, (1u << cap->buffer_count) - 1, memory_order_release);
+
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = (time_t)(s->period_ns / 1000000000ull), .tv_nsec = (long)(s->period_ns % 1000000000ull) },
+    };
+    its.it_value = its.it_interval;
+    s->start_ns = now_ns();
+    s->ticks = 0;
+    if (timerfd_settime(cap->fd, 0, &its, NULL) != 0) return false;
+    cap->streaming = true;
+    return true;
+}
+
+int capture_synthetic_dequeue(capture_device *cap, capture_frame *frame){
+    capture_synthetic *s = cap->synthetic;
+    uint64_t expirations;
+    if (read(cap->fd, &expirations, sizeof expirations) != (ssize_t)sizeof expirations) return errno == EAGAIN ? 0 : -1;
+
+    // Ticks the caller slept through are frames the sensor would have dropped
+    s->ticks += expirations;
+    uint32_t queued = atomic_load_explicit(&s->queued, memory_order_acquire);
+    if (queued == 0) return 0; // No buffer to fill, so this tick is dropped too
+
+    uint32_t index = (uint32_t)__builtin_ctz(queued);
+    atomic_fetch_and_explicit(&s->queued, ~(1u << index), memory_order_relaxed);
+
+    uint32_t sequence = (uint32_t)(s->ticks - 1);
+    memcpy(cap->buffers[index].planes[0].data, s->source + (size_t)(sequence % s->source_frames) * s->frame_size, s->frame_size);
+
+    frame->index = index;
+    frame->sequence = sequence;
+    frame->flags = 0;
+    frame->timestamp_ns = s->start_ns + s->ticks * s->period_ns; // When the tick was due, like a start-of-frame stamp
+    frame->num_planes = 1;
+    frame->bytesused[0] = (uint32_t)s->frame_size;
+    return 1;
+}
+
+bool capture_synthetic_requeue(capture_device *cap, uint32_t index){
+    /*
+        Any thread, like VIDIOC_QBUF
+    */
+    if (index >= cap->buffer_count){errno = EINVAL;return false;}
+    atomic_fetch_or_explicit(&cap->synthetic->queued, 1u << index, memory_order_release);
+    return true;
+}
+
+int capture_synthetic_plane_fd(const capture_device *cap, uint32_t index, uint32_t plane, uint64_t *offset){
+    // A single plane per buffer, at its page-aligned slot in the memfd
+    if (index >= cap->buffer_count || plane != 0){errno = EINVAL;return -1;}
+    *offset = (uint64_t)index * cap->synthetic->buffer_stride;
+    return cap->synthetic->memfd;
+}
+
+void capture_synthetic_stop(capture_device *cap){
+    struct itimerspec its;
+    memset(&its, 0, sizeof its);
+    (void)timerfd_settime(cap->fd, 0, &its, NULL);
+    atomic_store_explicit(&cap->synthetic->queued, 0, memory_order_relaxed);
+    cap->streaming = false;
+}
+
+void capture_synthetic_close(capture_device *cap){
+    capture_synthetic *s = cap->synthetic;
+    if (cap->streaming) capture_synthetic_stop(cap);
+    for (uint32_t i = 0; i < CAPTURE_MAX_BUFFERS; ++i){
+        capture_plane *plane = &cap->buffers[i].planes[0];
+        if (plane->dmabuf_fd >= 0) close(plane->dmabuf_fd);
+        plane->data = NULL;
+        plane->length = 0;
+        plane->dmabuf_fd = -1;
+    }
+    if (s){
+        if (s->buffers) munmap(s->buffers, s->buffers_mapped);
+        if (s->source) munmap((void *)s->source, s->source_mapped);
+        if (s->memfd >= 0) close(s->memfd);
+        free(s);
+    }
+    if (cap->fd >= 0) close(cap->fd);
+    cap->fd = -1;
+    cap->synthetic = NULL;
+    cap->buffer_count = 0;
+}
@@ -0,0 +1,133 @@
+#include "cv_pi5/clip_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CLIP_FILE_ALIGN 4096    // Covers 512e and 4Kn devices alike
+
+static bool pwrite_all(int fd, const void *data, size_t length, uint64_t offset){
+    const char *p = data;
+    while (length){
+        ssize_t n = pwrite(fd, p, length, (off_t)offset);
+        if (n < 0){if (errno == EINTR) continue; return false;}
+        p += n;
+        offset += (uint64_t)n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+bool clip_file_open(clip_file *f, const char *path, const clip_file_options *opt){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!f || !path || !*path || !opt){errno = EINVAL;return false;}
+    memset(f, 0, sizeof *f);
+    f->align = CLIP_FILE_ALIGN;
+
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    f->fd = -1;
+    if (opt->direct_io){
+        f->fd = open(path, flags | O_DIRECT, 0664);
+        f->direct = f->fd >= 0; // tmpfs and some FUSE mounts refuse O_DIRECT with EINVAL
+    }
+    if (f->fd < 0) f->fd = open(path, flags, 0664);
+    if (f->fd < 0) return false;
+
+    if (f->direct){
+        size_t block = opt->block_size ? opt->block_size : (size_t)1 << 20;
+        block = (block + f->align - 1) / f->align * f->align;
+        f->block = aligned_alloc(f->align, block);
+        if (!f->block){ // Still usable, just through the page cache
+            int fl = fcntl(f->fd, F_GETFL);
+            if (fl >= 0) (void)fcntl(f->fd, F_SETFL, fl & ~O_DIRECT);
+            f->direct = false;
+        } else {
+            f->block_size = block;
+        }
+    }
+
+    if (opt->preallocate_bytes &&
+        fallocate(f->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)opt->preallocate_bytes) == 0)
+        f->preallocated = opt->preallocate_bytes; // EOPNOTSUPP on filesystems without extents is fine
+    return true;
+}
+
+static bool flush_block(clip_file *f, size_t length){
+    if (!pwrite_all(f->fd, f->block, length, f->flushed)) return false;
+    f->flushed += length;
+    return true;
+}
+
+bool clip_file_write(clip_file *f, const void *data, size_t length){
+    if (!f->direct){
+        if (!pwrite_all(f->fd, data, length, f->size)) return false;
+        f->size += length;
+        f->flushed = f->size;
+        return true;
+    }
+
+    const uint8_t *p = data;
+    while (length){
+        size_t n = f->block_size - f->fill;
+        if (n > length) n = length;
+        memcpy(f->block + f->fill, p, n);
+        f->fill += n;
+        f->size += n;
+        p += n;
+        length -= n;
+
+        if (f->fill == f->block_size){
+            if (!flush_block(f, f->block_size)) return false;
+            f->fill = 0;
+        }
+    }
+    return true;
+}
+
+bool clip_file_writeback(clip_file *f){
+    if (f->direct || f->flushed <= f->writeback) return true;
+    if (sync_file_range(f->fd, (off_t)f->writeback, (off_t)(f->flushed - f->writeback), SYNC_FILE_RANGE_WRITE) != 0) return false;
+    f->writeback = f->flushed;
+    return true;
+}
+
+bool clip_file_datasync(clip_file *f){
+    if (f->direct && f->fill){ // The partial block goes out padded, and again in full once it fills
+        size_t padded = (f->fill + f->align - 1) / f->align * f->align;
+        memset(f->block + f->fill, 0, padded - f->fill);
+        if (!pwrite_all(f->fd, f->block, padded, f->flushed)) return false;
+    }
+    if (fdatasync(f->fd) != 0) return false;
+    f->durable = f->size;
+    if (f->writeback < f->flushed) f->writeback = f->flushed;
+    return true;
+}
+
+bool clip_file_close(clip_file *f){
+    if (!f || f->fd < 0){errno = EBADF;return false;}
+    bool ok = true;
+    int saved = 0;
+
+    if (f->direct && f->fill){ // O_DIRECT only takes whole blocks: pad, then trim below
+        size_t padded = (f->fill + f->align - 1) / f->align * f->align;
+        memset(f->block + f->fill, 0, padded - f->fill);
+        if (!flush_block(f, padded)){ok = false; saved = errno;}
+        f->fill = 0;
+    }
+
+    // Cuts the padding and hands back whatever part of the reservation went unused
+    if (ftruncate(f->fd, (off_t)f->size) != 0 && ok){ok = false; saved = errno;}
+    if (close(f->fd) != 0 && ok){ok = false; saved = errno;}
+    f->fd = -1;
+
+    free(f->block);
+    f->block = NULL;
+    if (!ok) errno = saved;
+    return ok;
+}
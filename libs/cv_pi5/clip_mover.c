@@ -0,0 +1,218 @@
+#include "cv_pi5/clip_mover.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CLIP_MOVER_CHUNK ((size_t)1 << 20)  // Per copy call: the throttle's granularity
+#define CLIP_MOVER_TEMP_SUFFIX ".move"
+
+struct clip_move {
+    char name[CLIP_NAME_MAX];
+    uint64_t bytes;             // as submitted, for pending_bytes
+    void *arg;
+    clip_move *next;
+};
+
+static void throttle(clip_mover *m, uint64_t start_ns, uint64_t copied){
+    // Sleeps until copied bytes are no more than rate_bytes a second since start_ns
+    if (!m->rate_bytes || atomic_load_explicit(&m->stopping, memory_order_relaxed)) return;
+    uint64_t due = start_ns + copied * 1000000000ull / m->rate_bytes, now = metrics_now_ns();
+    if (due <= now) return;
+    uint64_t wait = due - now;
+    struct timespec ts = { .tv_sec = (time_t)(wait / 1000000000ull), .tv_nsec = (long)(wait % 1000000000ull) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+static bool splice_chunk(int in, int out, int pipe_fds[2], size_t length, size_t *moved){
+    // One chunk in -> pipe -> out, for filesystem pairs copy_file_range() refuses
+    if (pipe_fds[0] < 0 && pipe2(pipe_fds, O_CLOEXEC) != 0) return false;
+    ssize_t n = splice(in, NULL, pipe_fds[1], NULL, length, SPLICE_F_MOVE);
+    if (n < 0) return false;
+    *moved = (size_t)n;
+    for (size_t left = (size_t)n; left; ){
+        ssize_t w = splice(pipe_fds[0], NULL, out, NULL, left, SPLICE_F_MOVE);
+        if (w < 0){if (errno == EINTR) continue; return false;}
+        left -= (size_t)w;
+    }
+    return true;
+}
+
+static bool copy_clip(clip_mover *m, int in, int out){
+    /*
+        Both offsets are the files' own, so a copy can switch to splice()
+        midway and carry on from where copy_file_range() stopped.
+        If successful returns true
+        else returns false and an errno
+    */
+    int pipe_fds[2] = { -1, -1 };
+    bool use_splice = false, ok = true;
+    uint64_t copied = 0, start = metrics_now_ns();
+    for (;;){
+        size_t moved = 0;
+        if (!use_splice){
+            ssize_t n = copy_file_range(in, NULL, out, NULL, CLIP_MOVER_CHUNK, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)){use_splice = true;continue;}
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0){ok = false;break;}
+            moved = (size_t)n;
+        } else if (!splice_chunk(in, out, pipe_fds, CLIP_MOVER_CHUNK, &moved)){
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (moved == 0) break; // End of the staged file
+        copied += moved;
+        throttle(m, start, copied);
+    }
+    int saved = errno;
+    if (pipe_fds[0] >= 0){close(pipe_fds[0]); close(pipe_fds[1]);}
+    errno = saved;
+    return ok;
+}
+
+static bool move_clip(clip_mover *m, const char *name, uint64_t *bytes){
+    /*
+        If successful returns true
+        else returns false and an errno, with the clip still staged:
+        EEXIST when final_dir already has a file of its name
+    */
+    char temp[CLIP_NAME_MAX + 8];
+    if (snprintf(temp, sizeof temp, ".%s%s", name, CLIP_MOVER_TEMP_SUFFIX) >= (int)sizeof temp){errno = ENAMETOOLONG;return false;}
+
+    int in = openat(m->staging_fd, name, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    struct stat st;
+    if (fstat(in, &st) != 0){int saved = errno; close(in); errno = saved; return false;}
+    *bytes = (uint64_t)st.st_size;
+    if (m->make_room && !m->make_room(m->ctx, *bytes)){int saved = errno; close(in); errno = saved; return false;}
+
+    int out = openat(m->final_fd, temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+    if (out < 0){int saved = errno; close(in); errno = saved; return false;}
+    const struct timespec times[2] = { st.st_atim, st.st_mtim }; // The clip index orders eviction by mtime
+    bool ok = copy_clip(m, in, out) && futimens(out, times) == 0 && fdatasync(out) == 0;
+    int saved = errno;
+    if (close(out) != 0 && ok){saved = errno; ok = false;}
+    close(in);
+    if (ok && !clip_rename(m->final_fd, temp, m->final_fd, name)){saved = errno; ok = false;}
+    if (!ok){(void)unlinkat(m->final_fd, temp, 0); errno = saved; return false;}
+
+    (void)unlinkat(m->staging_fd, name, 0); // Moved: a leftover would only be moved, harmlessly, again
+    return true;
+}
+
+static void *mover_main(void *arg){
+    clip_mover *m = arg;
+    pthread_mutex_lock(&m->lock);
+    for (;;){
+        while (!m->head && !atomic_load_explicit(&m->stopping, memory_order_relaxed)) pthread_cond_wait(&m->wake, &m->lock);
+        clip_move *job = m->head;
+        if (!job) break; // Stopping with the queue drained
+        m->head = job->next;
+        if (!m->head) m->tail = NULL;
+        pthread_mutex_unlock(&m->lock);
+
+        uint64_t bytes = job->bytes;
+        TRACE_BEGIN("clip_move");
+        int error = move_clip(m, job->name, &bytes) ? 0 : errno;
+        TRACE_END();
+        atomic_fetch_sub_explicit(&m->pending_bytes, job->bytes, memory_order_relaxed);
+        if (!error){
+            atomic_fetch_add_explicit(&m->moved_clips, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&m->moved_bytes, bytes, memory_order_relaxed);
+            metrics_count(METRIC_CLIPS_MOVED, 1);
+        } else {
+            metrics_count(METRIC_CLIP_MOVE_ERRORS, 1);
+        }
+        if (m->done) m->done(m->ctx, job->name, bytes, job->arg, error);
+        free(job);
+
+        pthread_mutex_lock(&m->lock);
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+bool clip_mover_start(clip_mover *m, const clip_mover_config *cfg){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!m || !cfg || !cfg->staging_dir || !cfg->final_dir){errno = EINVAL;return false;}
+    memset(m, 0, sizeof *m);
+    m->rate_bytes = cfg->rate_bytes;
+    m->make_room = cfg->make_room;
+    m->done = cfg->done;
+    m->ctx = cfg->ctx;
+
+    m->staging_fd = open(cfg->staging_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m->staging_fd < 0) return false;
+    m->final_fd = open(cfg->final_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m->final_fd < 0){int saved = errno; close(m->staging_fd); errno = saved; return false;}
+
+    int r = pthread_mutex_init(&m->lock, NULL);
+    if (r == 0 && (r = pthread_cond_init(&m->wake, NULL)) != 0) pthread_mutex_destroy(&m->lock);
+    if (r == 0 && (r = pthread_create(&m->thread, NULL, mover_main, m)) != 0){
+        pthread_cond_destroy(&m->wake);
+        pthread_mutex_destroy(&m->lock);
+    }
+    if (r != 0){
+        close(m->final_fd);
+        close(m->staging_fd);
+        errno = r;
+        return false;
+    }
+    return true;
+}
+
+bool clip_mover_submit(clip_mover *m, const char *name, uint64_t bytes, void *arg){
+    if (!m || !name || !*name){errno = EINVAL;return false;}
+    if (strlen(name) >= CLIP_NAME_MAX){errno = ENAMETOOLONG;return false;}
+
+    clip_move *job = calloc(1, sizeof *job);
+    if (!job){errno = ENOMEM;return false;}
+    strcpy(job->name, name);
+    job->bytes = bytes;
+    job->arg = arg;
+
+    pthread_mutex_lock(&m->lock);
+    if (atomic_load_explicit(&m->stopping, memory_order_relaxed)){
+        pthread_mutex_unlock(&m->lock);
+        free(job);
+        errno = ESHUTDOWN;
+        return false;
+    }
+    if (m->tail) m->tail->next = job;
+    else m->head = job;
+    m->tail = job;
+    uint64_t pending = atomic_fetch_add_explicit(&m->pending_bytes, bytes, memory_order_relaxed) + bytes;
+    pthread_cond_signal(&m->wake);
+    pthread_mutex_unlock(&m->lock);
+    metrics_peak(METRIC_PEAK_STAGED_BYTES, pending);
+    return true;
+}
+
+uint64_t clip_mover_pending_bytes(clip_mover *m){
+    return atomic_load_explicit(&m->pending_bytes, memory_order_relaxed);
+}
+
+void clip_mover_stop(clip_mover *m){
+    if (!m) return;
+    pthread_mutex_lock(&m->lock);
+    atomic_store_explicit(&m->stopping, true, memory_order_relaxed);
+    pthread_cond_broadcast(&m->wake);
+    pthread_mutex_unlock(&m->lock);
+
+    pthread_join(m->thread, NULL);
+    pthread_cond_destroy(&m->wake);
+    pthread_mutex_destroy(&m->lock);
+    close(m->final_fd);
+    close(m->staging_fd);
+}
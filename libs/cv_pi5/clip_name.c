@@ -0,0 +1,134 @@
+#include "cv_pi5/clip_name.h"
+
+#include <errno.h>
+#include <string.h>
+
+static void put_digits(char *dst, uint32_t value, int width){
+    for (int i = width - 1; i >= 0; --i){
+        dst[i] = (char)('0' + value % 10u);
+        value /= 10u;
+    }
+}
+
+static void civil_from_days(int64_t days, int *year, unsigned *month, unsigned *day){
+    /*
+        Proleptic Gregorian date from days since 1970-01-01
+        (H. Hinnant's days_from_civil, inverted)
+    */
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = (unsigned)(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int)(yoe + era * 400 + (*month <= 2));
+}
+
+bool clip_namer_init(clip_namer *n, const char *prefix, const char *extension){
+    if (!n) {errno = EINVAL;return false;}
+    if (!prefix) prefix = "";
+    if (!extension) extension = "";
+    size_t plen = strlen(prefix), elen = strlen(extension);
+    if (plen >= CLIP_NAME_PREFIX_MAX || elen >= CLIP_NAME_EXT_MAX){errno = ENAMETOOLONG;return false;}
+
+    memset(n, 0, sizeof *n);
+    memcpy(n->prefix, prefix, plen);
+    memcpy(n->extension, extension, elen);
+    n->prefix_len = plen;
+    n->extension_len = elen;
+    memcpy(n->stamp, "00000000T000000Z", sizeof n->stamp);
+    n->cached_day = INT64_MIN;
+    n->cached_second = INT64_MIN;
+    return true;
+}
+
+static void update_stamp(clip_namer *n, int64_t second){
+    if (second == n->cached_second) return;
+
+    int64_t day = second >= 0 ? second / 86400 : (second - 86399) / 86400;
+    if (day != n->cached_day){ // Date digits change once a day
+        int year; unsigned month, mday;
+        civil_from_days(day, &year, &month, &mday);
+        put_digits(n->stamp, (uint32_t)(year < 0 ? 0 : year), 4);
+        put_digits(n->stamp + 4, month, 2);
+        put_digits(n->stamp + 6, mday, 2);
+        n->cached_day = day;
+    }
+
+    uint32_t sod = (uint32_t)(second - day * 86400);
+    put_digits(n->stamp + 9, sod / 3600u, 2);
+    put_digits(n->stamp + 11, sod / 60u % 60u, 2);
+    put_digits(n->stamp + 13, sod % 60u, 2);
+    n->cached_second = second;
+}
+
+size_t clip_namer_format(clip_namer *n, const struct timespec *realtime, char *out, size_t out_size){
+    const size_t stamp_len = sizeof n->stamp - 1;
+    const size_t len = n->prefix_len + stamp_len + 1 + CLIP_NAME_SEQ_DIGITS + n->extension_len;
+    if (!out || out_size <= len){errno = ERANGE;return 0;}
+
+    update_stamp(n, (int64_t)realtime->tv_sec);
+
+    char *p = out;
+    memcpy(p, n->prefix, n->prefix_len); p += n->prefix_len;
+    memcpy(p, n->stamp, stamp_len); p += stamp_len;
+    *p++ = '_';
+    put_digits(p, n->sequence++ % 1000000u, CLIP_NAME_SEQ_DIGITS); p += CLIP_NAME_SEQ_DIGITS;
+    memcpy(p, n->extension, n->extension_len); p += n->extension_len;
+    *p = '\0';
+    return len;
+}
+
+static bool digits(const char *s, size_t n){
+    for (size_t i = 0; i < n; ++i) if (s[i] < '0' || s[i] > '9') return false;
+    return true;
+}
+
+static bool ends_with(const char *s, size_t length, const char *suffix){
+    size_t n = strlen(suffix);
+    return length >= n && !memcmp(s + length - n, suffix, n);
+}
+
+static size_t prefix_length(const char *name){
+    /*
+        Parsed from the end, where every field is fixed width.
+        Returns the length of name's prefix, its '_' included, or 0 when name is not a clip's
+    */
+    static const char *const extensions[] = { ".ts", ".h264" };
+    if (!name || name[0] == '.' || strchr(name, '/')) return 0;
+    size_t length = strlen(name);
+    bool known = false;
+    for (size_t i = 0; i < sizeof extensions / sizeof *extensions && !known; ++i)
+        if (ends_with(name, length, extensions[i])){length -= strlen(extensions[i]); known = true;}
+    if (!known) return 0;
+    if (ends_with(name, length, CLIP_MANUAL_MARK)) length -= strlen(CLIP_MANUAL_MARK);
+
+    const size_t tail = CLIP_NAME_STAMP_LEN + 1 + CLIP_NAME_SEQ_DIGITS; // stamp_sequence
+    if (length < tail + 2) return 0; // A prefix of at least one character and its '_'
+    const char *p = name + length - tail;
+    if (p[-1] != '_' || !digits(p, 8) || p[8] != 'T' || !digits(p + 9, 6) || p[15] != 'Z' ||
+        p[16] != '_' || !digits(p + 17, CLIP_NAME_SEQ_DIGITS)) return 0;
+    return length - tail;
+}
+
+bool clip_name_valid(const char *name){
+    return prefix_length(name) != 0;
+}
+
+bool clip_name_sequence(const char *name, const char *prefix, uint32_t *sequence){
+    size_t n = prefix_length(name);
+    if (!sequence || !prefix || !n || n != strlen(prefix) || memcmp(name, prefix, n)) return false;
+    const char *p = name + n + CLIP_NAME_STAMP_LEN + 1;
+    uint32_t value = 0;
+    for (int i = 0; i < CLIP_NAME_SEQ_DIGITS; ++i) value = value * 10u + (uint32_t)(p[i] - '0');
+    *sequence = value;
+    return true;
+}
+
+size_t clip_namer_next(clip_namer *n, char *out, size_t out_size){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return clip_namer_format(n, &now, out, out_size);
+}
@@ -0,0 +1,160 @@
+#include "cv_pi5/clip_reaper.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    clip_entry entry;
+    bool expired;
+} reap_item;
+
+static int64_t wall_now_ns(void){
+    // Clip mtimes are wall time
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+static struct timespec deadline_after(uint64_t ns){
+    struct timespec due;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    ns += (uint64_t)due.tv_nsec;
+    due.tv_sec += (time_t)(ns / 1000000000ull);
+    due.tv_nsec = (long)(ns % 1000000000ull);
+    return due;
+}
+
+static bool wait_until(clip_reaper *r, const struct timespec *due, bool wake_on_kick){
+    // With r->lock held. Returns false once stopping
+    while (!r->stopping && !(wake_on_kick && r->kicked) && pthread_cond_timedwait(&r->wake, &r->lock, due) != ETIMEDOUT) {}
+    return !r->stopping;
+}
+
+static size_t collect(clip_reaper *r, reap_item *batch, int *dir_fd){
+    /*
+        Takes what is due off the index, in one hold of its lock.
+        Returns how many, with dir_fd a duplicate the caller closes
+    */
+    clip_index *idx = r->cfg.acquire(r->cfg.ctx);
+    if (!idx) return 0;
+    size_t n = 0;
+    int64_t now = wall_now_ns();
+    clip_entry next;
+    bool expired;
+    while (n < r->cfg.batch && clip_index_next(idx, now, &next, &expired) &&
+           (expired || (r->cfg.quota_bytes && idx->total_bytes > r->cfg.quota_bytes))){
+        if (n == 0 && (*dir_fd = fcntl(idx->dir_fd, F_DUPFD_CLOEXEC, 0)) < 0) break; // The index may be reopened elsewhere once released
+        (void)clip_index_take_next(idx, now, &batch[n].entry);
+        batch[n++].expired = expired;
+    }
+    r->cfg.release(r->cfg.ctx);
+    return n;
+}
+
+static bool pace(clip_reaper *r, uint64_t start_ns, uint64_t freed){
+    // Waits until freed bytes are no more than rate_bytes a second since start_ns. Returns false once stopping
+    pthread_mutex_lock(&r->lock);
+    bool go = !r->stopping;
+    if (go && r->cfg.rate_bytes){
+        uint64_t due = start_ns + (uint64_t)((double)freed / (double)r->cfg.rate_bytes * 1e9), now = metrics_now_ns();
+        if (due > now){
+            struct timespec ts = deadline_after(due - now);
+            go = wait_until(r, &ts, false);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+    return go;
+}
+
+static void reap(clip_reaper *r, int dir_fd, const reap_item *item){
+    if (!clip_delete(dir_fd, item->entry.name)){
+        atomic_fetch_add_explicit(&r->errors, 1, memory_order_relaxed);
+        metrics_count(METRIC_REAP_ERRORS, 1);
+        return;
+    }
+    atomic_fetch_add_explicit(item->expired ? &r->expired_clips : &r->quota_clips, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->reaped_bytes, item->entry.bytes, memory_order_relaxed);
+    metrics_count(item->expired ? METRIC_CLIPS_EXPIRED : METRIC_CLIPS_OVER_QUOTA, 1);
+}
+
+static void *reaper_main(void *arg){
+    clip_reaper *r = arg;
+    reap_item batch[CLIP_REAPER_MAX_BATCH];
+    uint64_t start = metrics_now_ns(), freed = 0; // The pace, kept across passes so kicks cannot outrun it
+    for (;;){
+        pthread_mutex_lock(&r->lock);
+        struct timespec due = deadline_after((uint64_t)r->cfg.interval_ms * 1000000ull);
+        bool go = wait_until(r, &due, true);
+        r->kicked = false;
+        pthread_mutex_unlock(&r->lock);
+        if (!go) break;
+
+        uint64_t now = metrics_now_ns();
+        if (!r->cfg.rate_bytes || start + (uint64_t)((double)freed / (double)r->cfg.rate_bytes * 1e9) <= now){start = now; freed = 0;} // Caught up
+        size_t n;
+        int dir_fd = -1;
+        while (go && (n = collect(r, batch, &dir_fd)) > 0){
+            TRACE_BEGIN("clip_reap");
+            for (size_t i = 0; i < n && (go = pace(r, start, freed)); ++i){ // Stopping abandons the rest to the next start's scan
+                reap(r, dir_fd, &batch[i]);
+                freed += batch[i].entry.bytes;
+            }
+            TRACE_END();
+            close(dir_fd);
+            dir_fd = -1;
+        }
+        if (!go) break;
+    }
+    return NULL;
+}
+
+bool clip_reaper_start(clip_reaper *r, const clip_reaper_config *cfg){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!r || !cfg || !cfg->acquire || !cfg->release || !cfg->interval_ms || !cfg->batch || cfg->batch > CLIP_REAPER_MAX_BATCH){errno = EINVAL;return false;}
+    memset(r, 0, sizeof *r);
+    r->cfg = *cfg;
+    atomic_init(&r->expired_clips, 0);
+    atomic_init(&r->quota_clips, 0);
+    atomic_init(&r->reaped_bytes, 0);
+    atomic_init(&r->errors, 0);
+
+    pthread_condattr_t attr; // Timed waits on CLOCK_MONOTONIC, which setting the time does not move
+    int e = pthread_condattr_init(&attr);
+    if (e == 0){
+        if ((e = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)) == 0 && (e = pthread_mutex_init(&r->lock, NULL)) == 0 &&
+            (e = pthread_cond_init(&r->wake, &attr)) != 0) pthread_mutex_destroy(&r->lock);
+        pthread_condattr_destroy(&attr);
+    }
+    if (e == 0 && (e = pthread_create(&r->thread, NULL, reaper_main, r)) != 0){
+        pthread_cond_destroy(&r->wake);
+        pthread_mutex_destroy(&r->lock);
+    }
+    if (e != 0){errno = e;return false;}
+    return true;
+}
+
+void clip_reaper_kick(clip_reaper *r){
+    pthread_mutex_lock(&r->lock);
+    r->kicked = true;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void clip_reaper_stop(clip_reaper *r){
+    if (!r) return;
+    pthread_mutex_lock(&r->lock);
+    r->stopping = true;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+}
@@ -0,0 +1,238 @@
+#include "cv_pi5/encode_stage.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static void record_error(encode_stage *st, int error){
+    int expected = 0;
+    atomic_compare_exchange_strong(&st->error, &expected, error ? error : EIO);
+}
+
+static bool push_pooled(encode_stage *st, const encoded_packet *pkt){
+    /*
+        The one copy an encoded packet gets: encoder output into a pool
+        buffer. With the pool dry the packet ring's arena takes it instead,
+        which costs the pre-trigger history a second copy but drops nothing.
+    */
+    uint32_t buffer = buffer_pool_get(st->pool, pkt->size);
+    if (buffer == BUFFER_POOL_NONE){
+        atomic_fetch_add_explicit(&st->pool_exhausted, 1, memory_order_relaxed);
+        metrics_count(METRIC_POOL_EXHAUSTED, 1);
+        return packet_ring_push(st->packets, pkt);
+    }
+
+    uint8_t *data = buffer_pool_data(st->pool, buffer);
+    memcpy(data, pkt->data, pkt->size);
+    encoded_packet copy = *pkt;
+    copy.data = data;
+    if (packet_ring_push_buffer(st->packets, &copy, st->pool, buffer)) return true;
+    buffer_pool_unref(st->pool, buffer);
+    return false;
+}
+
+static bool emit_packet(void *ctx, const encoded_packet *pkt, int32_t frame_ref){
+    encode_stage *st = ctx;
+    metrics_record_since(METRIC_STAGE_ENCODE, pkt->pts_ns);
+    bool ok = frame_ref >= 0 ? packet_ring_push_ref(st->packets, pkt, (uint32_t)frame_ref)
+            : st->pool       ? push_pooled(st, pkt)
+                             : packet_ring_push(st->packets, pkt);
+    if (!ok){
+        atomic_fetch_add_explicit(&st->packets_dropped, 1, memory_order_relaxed);
+        metrics_count(METRIC_PACKETS_DROPPED, 1);
+        TRACE_INSTANT("packet_dropped");
+        return false;
+    }
+    st->pushed = true;
+    return true;
+}
+
+static void release_frame(void *ctx, uint32_t frame_index){
+    encode_stage *st = ctx;
+    if (!capture_requeue(st->cap, frame_index)) record_error(st, errno);
+}
+
+static void wake_writer(encode_stage *st){
+    if (!st->pushed) return;
+    st->pushed = false;
+    writer_notify(st->writer);
+}
+
+static void apply_bitrate(encode_stage *st){
+    uint32_t bitrate = atomic_exchange_explicit(&st->bitrate_request, 0, memory_order_relaxed);
+    if (bitrate && bitrate != st->enc.cfg.bitrate_bps)
+        (void)encoder_set_bitrate(&st->enc, bitrate); // Best effort: an encoder that refuses keeps its old rate
+}
+
+static void encode_pending(encode_stage *st){
+    frame_desc frame;
+    apply_bitrate(st);
+    while (frame_ring_pop(st->frames, &frame)){
+        TRACE_BEGIN("encode");
+        bool encoded = encoder_encode(&st->enc, &frame, &st->cap->buffers[frame.index]);
+        TRACE_END();
+        if (encoded){
+            atomic_fetch_add_explicit(&st->frames_encoded, 1, memory_order_relaxed);
+            metrics_count(METRIC_FRAMES_ENCODED, 1);
+        }
+        wake_writer(st); // Per frame, so the writer never waits on a whole burst
+    }
+}
+
+static bool pin_to(uint64_t cpu_mask){
+    if (!cpu_mask) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; ++cpu)
+        if (cpu_mask & (1ull << cpu)) CPU_SET(cpu, &set);
+    int r = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+    if (r != 0){errno = r;return false;}
+    return true;
+}
+
+static void report_open(encode_stage *st, int state, int error){
+    pthread_mutex_lock(&st->lock);
+    st->open_state = state;
+    st->open_errno = error;
+    pthread_cond_signal(&st->ready);
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void *encode_main(void *arg){
+    encode_stage *st = arg;
+
+    // Pin first: a software encoder's worker threads inherit the affinity at open time
+    if (!pin_to(st->cpu_mask) ||
+        !encoder_open(&st->enc, st->backend, &st->cfg, emit_packet, release_frame, st)){
+        report_open(st, -1, errno);
+        return NULL;
+    }
+    report_open(st, 1, 0);
+
+    struct pollfd fds[2] = {
+        { .fd = st->wake_fd, .events = POLLIN },
+        { .fd = st->enc.poll_fd, .events = POLLIN | POLLOUT }, // m2m: bitstream ready / input consumed; -1 is ignored
+    };
+
+    for (;;){
+        encode_pending(st);
+        if (atomic_load_explicit(&st->stop, memory_order_acquire)){
+            encode_pending(st); // Pushes that raced with stop
+            break;
+        }
+
+        if (poll(fds, 2, -1) < 0){
+            if (errno == EINTR) continue;
+            record_error(st, errno);
+            break;
+        }
+        if (fds[0].revents & POLLIN){
+            uint64_t count;
+            (void)read(st->wake_fd, &count, sizeof count);
+        }
+        if (fds[1].revents & (POLLERR | POLLHUP | POLLNVAL)){
+            // The encoder fd failed: polling it again would only spin. Frames still go to encode()
+            record_error(st, EIO);
+            fds[1].fd = -1;
+            st->pushed = false;
+            writer_notify(st->writer); // For whatever it already pushed
+        } else if (fds[1].revents & (POLLIN | POLLOUT | POLLPRI)){
+            if (!encoder_drain(&st->enc)) record_error(st, errno);
+            wake_writer(st);
+        }
+    }
+
+    encoder_drain(&st->enc);
+    encoder_close(&st->enc); // Also releases any capture buffer the encoder still held
+    wake_writer(st);
+    return NULL;
+}
+
+bool encode_stage_start(encode_stage *st, capture_device *cap, frame_ring *frames, packet_ring *packets,
+                        buffer_pool *pool, frame_writer *writer, const char *backend, const encoder_config *cfg, uint64_t cpu_mask){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!st || !cap || !frames || !packets || !writer || !cfg){errno = EINVAL;return false;}
+
+    memset(st, 0, sizeof *st);
+    st->cap = cap;
+    st->frames = frames;
+    st->packets = packets;
+    st->pool = pool;
+    st->writer = writer;
+    st->backend = backend;
+    st->cfg = *cfg;
+    st->cpu_mask = cpu_mask;
+    st->enc.poll_fd = -1;
+    atomic_init(&st->stop, false);
+    atomic_init(&st->error, 0);
+    atomic_init(&st->bitrate_request, 0);
+    atomic_init(&st->frames_encoded, 0);
+    atomic_init(&st->packets_dropped, 0);
+    atomic_init(&st->pool_exhausted, 0);
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_cond_init(&st->ready, NULL);
+
+    st->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (st->wake_fd < 0) goto fail;
+
+    int r = pthread_create(&st->thread, NULL, encode_main, st);
+    if (r != 0){errno = r;goto fail;}
+
+    pthread_mutex_lock(&st->lock);
+    while (st->open_state == 0) pthread_cond_wait(&st->ready, &st->lock);
+    pthread_mutex_unlock(&st->lock);
+
+    if (st->open_state < 0){
+        pthread_join(st->thread, NULL);
+        errno = st->open_errno;
+        goto fail;
+    }
+    st->running = true;
+    return true;
+
+fail:;
+    int saved = errno;
+    if (st->wake_fd >= 0) close(st->wake_fd);
+    st->wake_fd = -1;
+    pthread_cond_destroy(&st->ready);
+    pthread_mutex_destroy(&st->lock);
+    errno = saved;
+    return false;
+}
+
+void encode_stage_notify(encode_stage *st){
+    uint64_t one = 1;
+    ssize_t n;
+    do { n = write(st->wake_fd, &one, sizeof one); } while (n < 0 && errno == EINTR);
+}
+
+void encode_stage_set_bitrate(encode_stage *st, uint32_t bitrate_bps){
+    atomic_store_explicit(&st->bitrate_request, bitrate_bps, memory_order_relaxed);
+    encode_stage_notify(st);
+}
+
+bool encode_stage_stop(encode_stage *st){
+    if (!st || !st->running) return false;
+
+    atomic_store_explicit(&st->stop, true, memory_order_release);
+    encode_stage_notify(st);
+    pthread_join(st->thread, NULL);
+    st->running = false;
+
+    close(st->wake_fd);
+    st->wake_fd = -1;
+    pthread_cond_destroy(&st->ready);
+    pthread_mutex_destroy(&st->lock);
+
+    int error = atomic_load(&st->error);
+    if (error){errno = error;return false;}
+    return true;
+}
@@ -0,0 +1,81 @@
+#include "cv_pi5/encoder.h"
+
+#include <errno.h>
+#include <string.h>
+
+static const encoder_backend *const auto_order[] = {
+    &encoder_backend_v4l2m2m,
+#ifdef CV_PI5_HAVE_X264
+    &encoder_backend_x264,
+#endif
+    &encoder_backend_raw,
+};
+
+static bool try_open(encoder *enc, const encoder_backend *backend){
+    enc->backend = backend;
+    enc->priv = NULL;
+    enc->poll_fd = -1;
+    if (backend->open(enc)) return true;
+    enc->backend = NULL;
+    return false;
+}
+
+bool encoder_open(encoder *enc, const char *backend, const encoder_config *cfg,
+                  encoder_emit_fn emit, encoder_release_fn release, void *ctx){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!enc || !cfg || !emit || !release){errno = EINVAL;return false;}
+
+    memset(enc, 0, sizeof *enc);
+    enc->cfg = *cfg;
+    enc->emit = emit;
+    enc->release = release;
+    enc->ctx = ctx;
+    enc->poll_fd = -1;
+
+    const size_t n = sizeof auto_order / sizeof auto_order[0];
+    if (!backend || !*backend || strcmp(backend, "auto") == 0){
+        int first_error = 0;
+        for (size_t i = 0; i < n; ++i){
+            if (try_open(enc, auto_order[i])) return true;
+            if (!first_error) first_error = errno; // The preferred backend's reason is the useful one
+        }
+        errno = first_error ? first_error : ENODEV;
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        if (strcmp(auto_order[i]->name, backend) == 0) return try_open(enc, auto_order[i]);
+
+    errno = ENOENT;
+    return false;
+}
+
+bool encoder_encode(encoder *enc, const capture_frame *frame, const capture_buffer *buffer){
+    return enc->backend->encode(enc, frame, buffer);
+}
+
+bool encoder_drain(encoder *enc){
+    return enc->backend->drain(enc);
+}
+
+bool encoder_set_bitrate(encoder *enc, uint32_t bitrate_bps){
+    if (!enc->backend->set_bitrate){errno = ENOTSUP;return false;}
+    if (!enc->backend->set_bitrate(enc, bitrate_bps)) return false;
+    enc->cfg.bitrate_bps = bitrate_bps;
+    return true;
+}
+
+void encoder_close(encoder *enc){
+    if (!enc || !enc->backend) return;
+    enc->backend->close(enc);
+    enc->backend = NULL;
+    enc->priv = NULL;
+    enc->poll_fd = -1;
+}
+
+const char *encoder_name(const encoder *enc){
+    return enc && enc->backend ? enc->backend->name : "none";
+}
@@ -0,0 +1,44 @@
+#include "cv_pi5/encoder.h"
+
+#include <errno.h>
+
+/*
+    Pass-through backend: frames leave as they came, by reference to their
+    capture buffer, so the writer still writes straight from driver memory.
+    Only single-plane formats can be described by one packet.
+*/
+
+static bool raw_open(encoder *enc){
+    if (enc->cfg.num_planes != 1){errno = ENOTSUP;return false;}
+    return true;
+}
+
+static bool raw_encode(encoder *enc, const capture_frame *frame, const capture_buffer *buffer){
+    encoded_packet pkt = {
+        .data = buffer->planes[0].data,
+        .size = frame->bytesused[0],
+        .pts_ns = frame->timestamp_ns,
+        .flags = PACKET_FLAG_KEYFRAME, // Every raw frame stands alone
+    };
+    if (enc->emit(enc->ctx, &pkt, (int32_t)frame->index)) return true;
+
+    enc->release(enc->ctx, frame->index); // Nobody took ownership, so the frame is dropped
+    return false;
+}
+
+static bool raw_drain(encoder *enc){
+    (void)enc;
+    return true;
+}
+
+static void raw_close(encoder *enc){
+    (void)enc;
+}
+
+const encoder_backend encoder_backend_raw = {
+    .name = "raw",
+    .open = raw_open,
+    .encode = raw_encode,
+    .drain = raw_drain,
+    .close = raw_close,
+};
@@ -0,0 +1,365 @@
+#include "cv_pi5/encoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+/*
+    V4L2 mem2mem backend.
+
+    The OUTPUT queue (raw frames into the encoder) uses V4L2_MEMORY_DMABUF and
+    imports the capture buffers directly, with the capture buffer index used as
+    the OUTPUT buffer index so a completed OUTPUT buffer maps straight back to
+    the capture buffer to release. The CAPTURE queue (bitstream out) is small
+    and driver-allocated; its payloads are handed to emit() and requeued.
+    Closing drains the encoder first (V4L2_ENC_CMD_STOP, then bitstream up
+    to the buffer flagged LAST), so a clip keeps its last frames.
+*/
+
+#define M2M_BITSTREAM_BUFFERS 6
+#define M2M_PROBE_NODES 64
+#define M2M_FLUSH_TIMEOUT_MS 500    // for the last bitstream after V4L2_ENC_CMD_STOP, from drivers that never flag it
+
+typedef struct {
+    int fd;
+    uint32_t coded_format;
+    uint32_t cap_count;
+    struct { void *data; size_t length; } cap_bufs[M2M_BITSTREAM_BUFFERS];
+    uint32_t inflight;      // bitmask of capture buffers the hardware still holds
+    bool streaming;
+} m2m_state;
+
+static int xioctl(int fd, unsigned long request, void *arg){
+    int r;
+    do { r = ioctl(fd, request, arg); } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+static bool supports_format(int fd, uint32_t type, uint32_t fourcc){
+    struct v4l2_fmtdesc desc;
+    for (uint32_t i = 0;; ++i){
+        memset(&desc, 0, sizeof desc);
+        desc.index = i;
+        desc.type = type;
+        if (xioctl(fd, VIDIOC_ENUM_FMT, &desc) != 0) return false;
+        if (desc.pixelformat == fourcc) return true;
+    }
+}
+
+static int open_encoder_node(const char *path, uint32_t coded_format, uint32_t raw_format){
+    /*
+        Returns an fd if path is a multi-planar mem2mem device that can turn
+        raw_format into coded_format, else -1
+    */
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct v4l2_capability caps;
+    memset(&caps, 0, sizeof caps);
+    if (xioctl(fd, VIDIOC_QUERYCAP, &caps) == 0){
+        uint32_t device_caps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+        if ((device_caps & V4L2_CAP_VIDEO_M2M_MPLANE) && (device_caps & V4L2_CAP_STREAMING) &&
+            supports_format(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, coded_format) &&
+            supports_format(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, raw_format)) return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+static void set_control(int fd, uint32_t id, int32_t value){
+    /*
+        Best effort: encoders differ in which controls they expose
+    */
+    struct v4l2_control ctrl = { .id = id, .value = value };
+    (void)xioctl(fd, VIDIOC_S_CTRL, &ctrl);
+}
+
+static bool configure(m2m_state *s, const encoder_config *cfg){
+    struct v4l2_format fmt;
+
+    // Bitstream side
+    memset(&fmt, 0, sizeof fmt);
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    fmt.fmt.pix_mp.width = cfg->width;
+    fmt.fmt.pix_mp.height = cfg->height;
+    fmt.fmt.pix_mp.pixelformat = s->coded_format;
+    fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix_mp.num_planes = 1;
+    fmt.fmt.pix_mp.plane_fmt[0].sizeimage = cfg->width * cfg->height / 2 + (1u << 20); // Worst-case keyframe
+    if (xioctl(s->fd, VIDIOC_S_FMT, &fmt) != 0) return false;
+    if (fmt.fmt.pix_mp.pixelformat != s->coded_format){errno = ENOTSUP;return false;}
+
+    // Raw side: must match the capture layout exactly or the imported buffers would be misread
+    memset(&fmt, 0, sizeof fmt);
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    fmt.fmt.pix_mp.width = cfg->width;
+    fmt.fmt.pix_mp.height = cfg->height;
+    fmt.fmt.pix_mp.pixelformat = cfg->pixelformat;
+    fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix_mp.num_planes = (uint8_t)cfg->num_planes;
+    for (uint32_t p = 0; p < cfg->num_planes; ++p) fmt.fmt.pix_mp.plane_fmt[p].bytesperline = cfg->bytesperline[p];
+    if (xioctl(s->fd, VIDIOC_S_FMT, &fmt) != 0) return false;
+    if (fmt.fmt.pix_mp.pixelformat != cfg->pixelformat || fmt.fmt.pix_mp.num_planes != cfg->num_planes ||
+        fmt.fmt.pix_mp.width != cfg->width || fmt.fmt.pix_mp.height != cfg->height){errno = ENOTSUP;return false;}
+    for (uint32_t p = 0; p < cfg->num_planes; ++p)
+        if (fmt.fmt.pix_mp.plane_fmt[p].bytesperline != cfg->bytesperline[p]){errno = ENOTSUP;return false;}
+
+    if (cfg->fps){
+        struct v4l2_streamparm parm;
+        memset(&parm, 0, sizeof parm);
+        parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        parm.parm.output.timeperframe.numerator = 1;
+        parm.parm.output.timeperframe.denominator = cfg->fps;
+        (void)xioctl(s->fd, VIDIOC_S_PARM, &parm);
+    }
+
+    if (cfg->bitrate_bps) set_control(s->fd, V4L2_CID_MPEG_VIDEO_BITRATE, (int32_t)cfg->bitrate_bps);
+    if (cfg->gop_length){
+        set_control(s->fd, V4L2_CID_MPEG_VIDEO_GOP_SIZE, (int32_t)cfg->gop_length);
+        if (cfg->codec == ENCODER_CODEC_H264) set_control(s->fd, V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, (int32_t)cfg->gop_length);
+    }
+    set_control(s->fd, V4L2_CID_MPEG_VIDEO_REPEAT_SEQ_HEADER, 1); // Every keyframe must be a valid clip start
+    return true;
+}
+
+static bool setup_buffers(m2m_state *s, const encoder_config *cfg){
+    struct v4l2_requestbuffers req;
+
+    memset(&req, 0, sizeof req);
+    req.count = cfg->buffer_count;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    req.memory = V4L2_MEMORY_DMABUF;
+    if (xioctl(s->fd, VIDIOC_REQBUFS, &req) != 0) return false;
+    if (req.count < cfg->buffer_count){errno = ENOMEM;return false;} // Capture indices are used as-is
+
+    memset(&req, 0, sizeof req);
+    req.count = M2M_BITSTREAM_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(s->fd, VIDIOC_REQBUFS, &req) != 0) return false;
+    if (req.count == 0){errno = ENOMEM;return false;}
+    s->cap_count = req.count < M2M_BITSTREAM_BUFFERS ? req.count : M2M_BITSTREAM_BUFFERS;
+
+    for (uint32_t i = 0; i < s->cap_count; ++i){
+        struct v4l2_buffer buf;
+        struct v4l2_plane plane;
+        memset(&buf, 0, sizeof buf);
+        memset(&plane, 0, sizeof plane);
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        buf.m.planes = &plane;
+        buf.length = 1;
+        if (xioctl(s->fd, VIDIOC_QUERYBUF, &buf) != 0) return false;
+
+        void *data = mmap(NULL, plane.length, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, plane.m.mem_offset);
+        if (data == MAP_FAILED) return false;
+        s->cap_bufs[i].data = data;
+        s->cap_bufs[i].length = plane.length;
+
+        if (xioctl(s->fd, VIDIOC_QBUF, &buf) != 0) return false;
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    if (xioctl(s->fd, VIDIOC_STREAMON, &type) != 0) return false;
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    if (xioctl(s->fd, VIDIOC_STREAMON, &type) != 0) return false;
+    s->streaming = true;
+    return true;
+}
+
+static void m2m_close(encoder *enc);
+
+static bool m2m_open(encoder *enc){
+    const encoder_config *cfg = &enc->cfg;
+    if (cfg->buffer_count == 0 || cfg->buffer_count > 32 || cfg->num_planes == 0){errno = EINVAL;return false;}
+
+    m2m_state *s = calloc(1, sizeof *s);
+    if (!s){errno = ENOMEM;return false;}
+    s->fd = -1;
+    s->coded_format = cfg->codec == ENCODER_CODEC_HEVC ? V4L2_PIX_FMT_HEVC : V4L2_PIX_FMT_H264;
+    enc->priv = s;
+
+    if (cfg->device){
+        s->fd = open_encoder_node(cfg->device, s->coded_format, cfg->pixelformat);
+    } else {
+        char path[32];
+        for (int i = 0; i < M2M_PROBE_NODES && s->fd < 0; ++i){
+            snprintf(path, sizeof path, "/dev/video%d", i);
+            s->fd = open_encoder_node(path, s->coded_format, cfg->pixelformat);
+        }
+    }
+    if (s->fd < 0){m2m_close(enc);errno = ENODEV;return false;} // Pi 5 has no H.264 block, this is the common case there
+
+    if (!configure(s, cfg) || !setup_buffers(s, cfg)){
+        int saved = errno;
+        m2m_close(enc);
+        errno = saved;
+        return false;
+    }
+    enc->poll_fd = s->fd;
+    return true;
+}
+
+static bool dequeue(encoder *enc, bool *last){
+    /*
+        Hands finished capture buffers back and emits finished bitstream.
+        last, if not NULL, is set once the encoder has emitted everything
+        it held before V4L2_ENC_CMD_STOP
+    */
+    m2m_state *s = enc->priv;
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[CAPTURE_MAX_PLANES];
+
+    for (;;){
+        memset(&buf, 0, sizeof buf);
+        memset(planes, 0, sizeof planes);
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buf.memory = V4L2_MEMORY_DMABUF;
+        buf.m.planes = planes;
+        buf.length = enc->cfg.num_planes;
+        if (xioctl(s->fd, VIDIOC_DQBUF, &buf) != 0){if (errno == EAGAIN) break; return false;}
+        s->inflight &= ~(1u << buf.index);
+        enc->release(enc->ctx, buf.index);
+    }
+
+    for (;;){
+        memset(&buf, 0, sizeof buf);
+        memset(planes, 0, sizeof planes);
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.m.planes = planes;
+        buf.length = 1;
+        if (xioctl(s->fd, VIDIOC_DQBUF, &buf) != 0){
+            if (errno == EAGAIN) break;
+            if (errno == EPIPE && last){*last = true; break;} // Drained, and the LAST buffer already dequeued
+            return false;
+        }
+        if ((buf.flags & V4L2_BUF_FLAG_LAST) && last) *last = true;
+
+        if (planes[0].bytesused > planes[0].data_offset){
+            encoded_packet pkt = {
+                .data = (const uint8_t *)s->cap_bufs[buf.index].data + planes[0].data_offset,
+                .size = planes[0].bytesused - planes[0].data_offset,
+                .pts_ns = (uint64_t)buf.timestamp.tv_sec * 1000000000ull + (uint64_t)buf.timestamp.tv_usec * 1000ull,
+                .flags = (buf.flags & V4L2_BUF_FLAG_KEYFRAME) ? PACKET_FLAG_KEYFRAME : 0,
+            };
+            (void)enc->emit(enc->ctx, &pkt, -1); // A full downstream queue drops the packet, not the encoder
+        }
+
+        buf.m.planes[0].bytesused = 0;
+        if (xioctl(s->fd, VIDIOC_QBUF, &buf) != 0) return false;
+    }
+    return true;
+}
+
+static bool m2m_drain(encoder *enc){
+    return dequeue(enc, NULL);
+}
+
+static void flush(encoder *enc){
+    /*
+        Best effort, before STREAMOFF discards what the encoder still holds:
+        asks it to finish and emits bitstream until the buffer flagged LAST,
+        for at most M2M_FLUSH_TIMEOUT_MS
+    */
+    m2m_state *s = enc->priv;
+    struct v4l2_encoder_cmd cmd;
+    memset(&cmd, 0, sizeof cmd);
+    cmd.cmd = V4L2_ENC_CMD_STOP;
+    if (xioctl(s->fd, VIDIOC_ENCODER_CMD, &cmd) != 0) return; // No drain support: nothing to wait for
+
+    struct timespec now, due;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    due.tv_nsec += (long)M2M_FLUSH_TIMEOUT_MS * 1000000L;
+    due.tv_sec += due.tv_nsec / 1000000000L;
+    due.tv_nsec %= 1000000000L;
+    bool last = false;
+    while (dequeue(enc, &last) && !last){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t left_ms = ((int64_t)(due.tv_sec - now.tv_sec) * 1000000000ll + (due.tv_nsec - now.tv_nsec)) / 1000000;
+        if (left_ms <= 0) break;
+        struct pollfd pfd = { .fd = s->fd, .events = POLLIN };
+        if (poll(&pfd, 1, (int)left_ms) < 0 && errno != EINTR) break;
+        if (pfd.revents & (POLLERR | POLLNVAL)) break;
+    }
+}
+
+static bool m2m_encode(encoder *enc, const capture_frame *frame, const capture_buffer *buffer){
+    m2m_state *s = enc->priv;
+    if (frame->index >= enc->cfg.buffer_count){enc->release(enc->ctx, frame->index);errno = EINVAL;return false;}
+
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[CAPTURE_MAX_PLANES];
+    memset(&buf, 0, sizeof buf);
+    memset(planes, 0, sizeof planes);
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buf.memory = V4L2_MEMORY_DMABUF;
+    buf.index = frame->index;
+    buf.m.planes = planes;
+    buf.length = enc->cfg.num_planes;
+    buf.field = V4L2_FIELD_NONE;
+    buf.timestamp.tv_sec = (time_t)(frame->timestamp_ns / 1000000000ull); // Copied through to the bitstream buffer
+    buf.timestamp.tv_usec = (suseconds_t)(frame->timestamp_ns % 1000000000ull / 1000ull);
+
+    for (uint32_t p = 0; p < enc->cfg.num_planes; ++p){
+        if (buffer->planes[p].dmabuf_fd < 0){enc->release(enc->ctx, frame->index);errno = ENOTSUP;return false;}
+        planes[p].m.fd = buffer->planes[p].dmabuf_fd;
+        planes[p].length = (uint32_t)buffer->planes[p].length;
+        planes[p].bytesused = frame->bytesused[p];
+    }
+
+    if (xioctl(s->fd, VIDIOC_QBUF, &buf) != 0){int saved = errno; enc->release(enc->ctx, frame->index); errno = saved; return false;}
+    s->inflight |= 1u << frame->index;
+    return m2m_drain(enc);
+}
+
+static void m2m_close(encoder *enc){
+    m2m_state *s = enc->priv;
+    if (!s) return;
+
+    if (s->fd >= 0){
+        if (s->streaming){
+            flush(enc);
+            enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+            (void)xioctl(s->fd, VIDIOC_STREAMOFF, &type);
+            type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+            (void)xioctl(s->fd, VIDIOC_STREAMOFF, &type);
+        }
+        for (uint32_t i = 0; i < 32; ++i) // STREAMOFF gave these back without a DQBUF
+            if (s->inflight & (1u << i)) enc->release(enc->ctx, i);
+
+        for (uint32_t i = 0; i < s->cap_count; ++i)
+            if (s->cap_bufs[i].data) munmap(s->cap_bufs[i].data, s->cap_bufs[i].length);
+        close(s->fd);
+    }
+    free(s);
+    enc->priv = NULL;
+    enc->poll_fd = -1;
+}
+
+static bool m2m_set_bitrate(encoder *enc, uint32_t bitrate_bps){
+    /*
+        Most stateful encoders accept a new bitrate while streaming
+    */
+    m2m_state *s = enc->priv;
+    struct v4l2_control ctrl = { .id = V4L2_CID_MPEG_VIDEO_BITRATE, .value = (int32_t)bitrate_bps };
+    return xioctl(s->fd, VIDIOC_S_CTRL, &ctrl) == 0;
+}
+
+const encoder_backend encoder_backend_v4l2m2m = {
+    .name = "v4l2m2m",
+    .open = m2m_open,
+    .encode = m2m_encode,
+    .drain = m2m_drain,
+    .close = m2m_close,
+    .set_bitrate = m2m_set_bitrate,
+};
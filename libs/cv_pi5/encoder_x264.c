@@ -0,0 +1,181 @@
+#include "cv_pi5/encoder.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x264.h>
+#include <linux/videodev2.h>
+
+/*
+    Software fallback through libx264, tuned "ultrafast" + "zerolatency":
+    no B-frames, no lookahead, slice threads. x264 copies the picture into
+    its own frame pool during x264_encoder_encode(), so the capture buffer is
+    released before encode() returns.
+
+    x264 starts its worker threads inside x264_encoder_open(), and threads
+    inherit the creating thread's affinity, so opening from a pinned encode
+    stage pins the whole encoder to those cores.
+*/
+
+typedef struct {
+    x264_t *handle;
+    x264_picture_t pic;
+} sw_state;
+
+static int pinned_cpus(void){
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) != 0) return 1;
+    int n = CPU_COUNT(&set);
+    return n > 0 ? n : 1;
+}
+
+static bool sw_open(encoder *enc){
+    const encoder_config *cfg = &enc->cfg;
+    if (cfg->codec != ENCODER_CODEC_H264){errno = ENOTSUP;return false;}
+
+    int csp;
+    switch (cfg->pixelformat){
+    case V4L2_PIX_FMT_YUV420: case V4L2_PIX_FMT_YUV420M: csp = X264_CSP_I420; break;
+    case V4L2_PIX_FMT_NV12: case V4L2_PIX_FMT_NV12M: csp = X264_CSP_NV12; break;
+    default: errno = ENOTSUP; return false;
+    }
+
+    x264_param_t param;
+    if (x264_param_default_preset(&param, "ultrafast", "zerolatency") < 0){errno = EINVAL;return false;}
+    param.i_csp = csp;
+    param.i_width = (int)cfg->width;
+    param.i_height = (int)cfg->height;
+    param.i_fps_num = cfg->fps ? cfg->fps : 30;
+    param.i_fps_den = 1;
+    param.i_timebase_num = 1;
+    param.i_timebase_den = 1000000; // pts in microseconds
+    param.i_threads = cfg->threads > 0 ? cfg->threads : pinned_cpus();
+    param.b_sliced_threads = 1;     // Frame threads would add a frame of latency each
+    param.i_keyint_max = cfg->gop_length ? (int)cfg->gop_length : param.i_fps_num;
+    param.b_repeat_headers = 1;     // SPS/PPS in front of every keyframe, so any keyframe can start a clip
+    param.b_annexb = 1;
+    param.i_log_level = X264_LOG_ERROR;
+    if (cfg->bitrate_bps){
+        param.rc.i_rc_method = X264_RC_ABR;
+        param.rc.i_bitrate = (int)(cfg->bitrate_bps / 1000u);
+        param.rc.i_vbv_max_bitrate = param.rc.i_bitrate;
+        param.rc.i_vbv_buffer_size = param.rc.i_bitrate;
+    }
+    if (x264_param_apply_profile(&param, "high") < 0){errno = EINVAL;return false;}
+
+    sw_state *s = calloc(1, sizeof *s);
+    if (!s){errno = ENOMEM;return false;}
+    s->handle = x264_encoder_open(&param);
+    if (!s->handle){free(s);errno = EINVAL;return false;}
+
+    x264_picture_init(&s->pic);
+    s->pic.img.i_csp = csp;
+    enc->priv = s;
+    return true;
+}
+
+static void fill_planes(const encoder *enc, const capture_buffer *buffer, x264_picture_t *pic){
+    /*
+        Points the x264 picture at the capture buffer. Contiguous YUV420 and
+        NV12 arrive as one plane, so the chroma planes are found by offset.
+    */
+    const encoder_config *cfg = &enc->cfg;
+    const uint32_t stride = cfg->bytesperline[0];
+    uint8_t *base = buffer->planes[0].data;
+    bool nv12 = pic->img.i_csp == X264_CSP_NV12;
+
+    pic->img.i_plane = nv12 ? 2 : 3;
+    pic->img.plane[0] = base;
+    pic->img.i_stride[0] = (int)stride;
+
+    if (cfg->num_planes > 1){
+        for (uint32_t p = 1; p < cfg->num_planes && p < 3; ++p){
+            pic->img.plane[p] = buffer->planes[p].data;
+            pic->img.i_stride[p] = (int)cfg->bytesperline[p];
+        }
+        return;
+    }
+
+    uint8_t *chroma = base + (size_t)stride * cfg->height;
+    if (nv12){
+        pic->img.plane[1] = chroma;
+        pic->img.i_stride[1] = (int)stride;
+    } else {
+        pic->img.plane[1] = chroma;
+        pic->img.plane[2] = chroma + (size_t)(stride / 2) * (cfg->height / 2);
+        pic->img.i_stride[1] = pic->img.i_stride[2] = (int)(stride / 2);
+    }
+}
+
+static bool emit_nals(encoder *enc, x264_nal_t *nals, int payload, const x264_picture_t *out){
+    if (payload <= 0) return true;
+    encoded_packet pkt = {
+        .data = nals[0].p_payload, // NAL payloads are contiguous in one buffer
+        .size = (size_t)payload,
+        .pts_ns = (uint64_t)out->i_pts * 1000ull,
+        .flags = out->b_keyframe ? PACKET_FLAG_KEYFRAME : 0,
+    };
+    (void)enc->emit(enc->ctx, &pkt, -1);
+    return true;
+}
+
+static bool sw_encode(encoder *enc, const capture_frame *frame, const capture_buffer *buffer){
+    sw_state *s = enc->priv;
+    x264_picture_t out;
+    x264_nal_t *nals;
+    int count;
+
+    fill_planes(enc, buffer, &s->pic);
+    s->pic.i_pts = (int64_t)(frame->timestamp_ns / 1000ull);
+    s->pic.i_type = X264_TYPE_AUTO;
+
+    int payload = x264_encoder_encode(s->handle, &nals, &count, &s->pic, &out);
+    enc->release(enc->ctx, frame->index); // x264 has its own copy now
+    if (payload < 0){errno = EIO;return false;}
+    return emit_nals(enc, nals, payload, &out);
+}
+
+static bool sw_drain(encoder *enc){
+    (void)enc; // zerolatency has no delayed frames to collect between calls
+    return true;
+}
+
+static void sw_close(encoder *enc){
+    sw_state *s = enc->priv;
+    if (!s) return;
+
+    x264_picture_t out;
+    x264_nal_t *nals;
+    int count;
+    while (x264_encoder_delayed_frames(s->handle) > 0){ // Flush whatever is left
+        int payload = x264_encoder_encode(s->handle, &nals, &count, NULL, &out);
+        if (payload < 0) break;
+        emit_nals(enc, nals, payload, &out);
+    }
+    x264_encoder_close(s->handle);
+    free(s);
+    enc->priv = NULL;
+}
+
+static bool sw_set_bitrate(encoder *enc, uint32_t bitrate_bps){
+    sw_state *s = enc->priv;
+    if (!bitrate_bps){errno = EINVAL;return false;}
+    x264_param_t param;
+    x264_encoder_parameters(s->handle, &param);
+    if (param.rc.i_rc_method != X264_RC_ABR){errno = ENOTSUP;return false;} // reconfig cannot leave constant quality
+    param.rc.i_bitrate = (int)(bitrate_bps / 1000u);
+    param.rc.i_vbv_max_bitrate = param.rc.i_bitrate;
+    param.rc.i_vbv_buffer_size = param.rc.i_bitrate;
+    if (x264_encoder_reconfig(s->handle, &param) < 0){errno = EINVAL;return false;}
+    return true;
+}
+
+const encoder_backend encoder_backend_x264 = {
+    .name = "x264",
+    .open = sw_open,
+    .encode = sw_encode,
+    .drain = sw_drain,
+    .close = sw_close,
+    .set_bitrate = sw_set_bitrate,
+};
@@ -0,0 +1,160 @@
+#include "cv_pi5/evloop.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define EVLOOP_BATCH 16
+
+bool evloop_init(evloop *loop){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!loop){errno = EINVAL;return false;}
+    memset(loop, 0, sizeof *loop);
+    for (int i = 0; i < EVLOOP_MAX_SOURCES; ++i) loop->sources[i].fd = -1;
+    atomic_init(&loop->iterations, 0);
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    return loop->epfd >= 0;
+}
+
+void evloop_destroy(evloop *loop){
+    if (!loop) return;
+    for (int i = 0; i < EVLOOP_MAX_SOURCES; ++i){
+        evloop_source *src = &loop->sources[i];
+        if (src->fd >= 0 && src->owned && !src->removed) close(src->fd);
+        src->fd = -1;
+    }
+    if (loop->epfd >= 0) close(loop->epfd);
+    loop->epfd = -1;
+}
+
+static evloop_source *find_source(evloop *loop, int fd){
+    for (int i = 0; i < EVLOOP_MAX_SOURCES; ++i)
+        if (loop->sources[i].fd == fd && !loop->sources[i].removed) return &loop->sources[i];
+    return NULL;
+}
+
+static bool add_source(evloop *loop, int fd, uint32_t events, evloop_cb cb, void *ctx, bool owned){
+    if (!loop || fd < 0 || !cb){errno = EINVAL;return false;}
+    if (find_source(loop, fd)){errno = EEXIST;return false;}
+
+    evloop_source *src = NULL;
+    for (int i = 0; i < EVLOOP_MAX_SOURCES && !src; ++i)
+        if (loop->sources[i].fd < 0) src = &loop->sources[i];
+    if (!src){errno = ENOSPC;return false;}
+
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) return false;
+
+    src->fd = fd;
+    src->cb = cb;
+    src->ctx = ctx;
+    src->owned = owned;
+    src->removed = false;
+    return true;
+}
+
+bool evloop_add(evloop *loop, int fd, uint32_t events, evloop_cb cb, void *ctx){
+    return add_source(loop, fd, events, cb, ctx, false);
+}
+
+bool evloop_remove(evloop *loop, int fd){
+    evloop_source *src = loop ? find_source(loop, fd) : NULL;
+    if (!src){errno = ENOENT;return false;}
+
+    (void)epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+    if (src->owned) close(fd);
+    if (loop->dispatching) src->removed = true; // Events for it may still be in this batch
+    else src->fd = -1;
+    return true;
+}
+
+bool evloop_timer_set(int timer_fd, uint64_t initial_ms, uint64_t interval_ms){
+    struct itimerspec spec = {
+        .it_value = { .tv_sec = (time_t)(initial_ms / 1000u), .tv_nsec = (long)(initial_ms % 1000u) * 1000000L },
+        .it_interval = { .tv_sec = (time_t)(interval_ms / 1000u), .tv_nsec = (long)(interval_ms % 1000u) * 1000000L },
+    };
+    return timerfd_settime(timer_fd, 0, &spec, NULL) == 0;
+}
+
+uint64_t evloop_timer_ack(int timer_fd){
+    /*
+        Returns how many expirations happened since the last ack
+    */
+    uint64_t expirations = 0;
+    if (read(timer_fd, &expirations, sizeof expirations) != (ssize_t)sizeof expirations) return 0;
+    return expirations;
+}
+
+int evloop_add_timer(evloop *loop, uint64_t initial_ms, uint64_t interval_ms, evloop_cb cb, void *ctx){
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) return -1;
+    if ((initial_ms && !evloop_timer_set(fd, initial_ms, interval_ms)) || !add_source(loop, fd, EPOLLIN, cb, ctx, true)){
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int evloop_add_signals(evloop *loop, const int *signals, int count, evloop_cb cb, void *ctx){
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int i = 0; i < count; ++i) sigaddset(&mask, signals[i]);
+
+    int r = pthread_sigmask(SIG_BLOCK, &mask, NULL); // Otherwise the default handler still runs
+    if (r != 0){errno = r;return -1;}
+
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) return -1;
+    if (!add_source(loop, fd, EPOLLIN, cb, ctx, true)){
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+bool evloop_run(evloop *loop){
+    struct epoll_event events[EVLOOP_BATCH];
+    loop->running = true;
+
+    while (loop->running){
+        int n = epoll_wait(loop->epfd, events, EVLOOP_BATCH, -1);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            loop->running = false;
+            return false;
+        }
+
+        loop->dispatching = true;
+        for (int i = 0; i < n; ++i){
+            evloop_source *src = events[i].data.ptr;
+            if (src->fd < 0 || src->removed) continue;
+            src->cb(loop, src->fd, events[i].events, src->ctx);
+        }
+        loop->dispatching = false;
+
+        for (int i = 0; i < EVLOOP_MAX_SOURCES; ++i){ // Reclaim slots removed during dispatch
+            if (loop->sources[i].removed){
+                loop->sources[i].fd = -1;
+                loop->sources[i].removed = false;
+            }
+        }
+        atomic_fetch_add_explicit(&loop->iterations, 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+void evloop_stop(evloop *loop){
+    loop->running = false;
+}
@@ -0,0 +1,311 @@
+#include "cv_pi5/frame_export.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HELLO_MAX_FDS (1 + CAPTURE_MAX_BUFFERS * CAPTURE_MAX_PLANES)
+
+// Not FUTEX_PRIVATE_FLAG: the word is shared between processes
+static void futex_wake_all(_Atomic uint32_t *word){
+    (void)syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int futex_wait(const _Atomic uint32_t *word, uint32_t expected, int timeout_ms){
+    struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000L };
+    return (int)syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout_ms < 0 ? NULL : &ts, NULL, 0);
+}
+
+static bool fill_address(struct sockaddr_un *addr, const char *path){
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr->sun_path){errno = ENAMETOOLONG;return false;}
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+bool frame_export_start(frame_export *fx, capture_device *cap, const char *socket_path){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!fx || !cap || !socket_path || !*socket_path){errno = EINVAL;return false;}
+    memset(fx, 0, sizeof *fx);
+    fx->listen_fd = -1;
+    fx->shm_fd = -1;
+
+    uint64_t offset;
+    for (uint32_t i = 0; i < cap->buffer_count; ++i)
+        for (uint32_t p = 0; p < cap->num_planes; ++p)
+            if (capture_plane_fd(cap, i, p, &offset) < 0) return false;
+
+    struct sockaddr_un addr;
+    if (!fill_address(&addr, socket_path)) return false;
+    snprintf(fx->path, sizeof fx->path, "%s", socket_path);
+
+    fx->shm_fd = memfd_create("cv_pi5_frame_export", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fx->shm_fd < 0 || ftruncate(fx->shm_fd, sizeof *fx->shm) != 0) goto fail;
+    void *p = mmap(NULL, sizeof *fx->shm, PROT_READ | PROT_WRITE, MAP_SHARED, fx->shm_fd, 0);
+    if (p == MAP_FAILED) goto fail;
+    fx->shm = p;
+    // Consumers get the fd but can only map it read-only; best effort, F_SEAL_FUTURE_WRITE needs Linux 5.1
+    (void)fcntl(fx->shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE);
+
+    frame_export_shm *shm = fx->shm;
+    shm->magic = FRAME_EXPORT_MAGIC;
+    shm->version = FRAME_EXPORT_VERSION;
+    shm->width = cap->width;
+    shm->height = cap->height;
+    shm->pixelformat = cap->pixelformat;
+    shm->num_planes = cap->num_planes;
+    memcpy(shm->bytesperline, cap->bytesperline, sizeof shm->bytesperline);
+    shm->buffer_count = cap->buffer_count;
+
+    fx->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); // One hello, fds and all, per read
+    if (fx->listen_fd < 0) goto fail;
+    (void)unlink(socket_path); // Left behind by a previous run
+    if (bind(fx->listen_fd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(fx->listen_fd, FRAME_EXPORT_MAX_CLIENTS) != 0) goto fail;
+
+    fx->cap = cap;
+    cap->requeue_generations = shm->generations;
+    return true;
+
+fail:;
+    int saved = errno;
+    if (fx->listen_fd >= 0) close(fx->listen_fd);
+    if (fx->shm) munmap(fx->shm, sizeof *fx->shm);
+    if (fx->shm_fd >= 0) close(fx->shm_fd);
+    fx->listen_fd = fx->shm_fd = -1;
+    fx->shm = NULL;
+    errno = saved;
+    return false;
+}
+
+static void reap_clients(frame_export *fx){
+    // A consumer never writes, so readable means it hung up
+    for (uint32_t i = 0; i < fx->client_count;){
+        char byte;
+        ssize_t n = recv(fx->clients[i], &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){++i;continue;}
+        close(fx->clients[i]);
+        fx->clients[i] = fx->clients[--fx->client_count];
+    }
+}
+
+bool frame_export_accept(frame_export *fx){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!fx || !fx->shm){errno = EINVAL;return false;}
+    reap_clients(fx);
+
+    int client = accept4(fx->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client < 0) return false;
+    if (fx->client_count == FRAME_EXPORT_MAX_CLIENTS){close(client);errno = EUSERS;return false;}
+
+    const capture_device *cap = fx->cap;
+    frame_export_hello hello;
+    memset(&hello, 0, sizeof hello);
+    hello.magic = FRAME_EXPORT_MAGIC;
+    hello.version = FRAME_EXPORT_VERSION;
+    hello.buffer_count = cap->buffer_count;
+    hello.num_planes = cap->num_planes;
+    hello.shm_size = sizeof *fx->shm;
+
+    int fds[HELLO_MAX_FDS];
+    size_t nfds = 0;
+    fds[nfds++] = fx->shm_fd;
+    for (uint32_t i = 0; i < cap->buffer_count; ++i)
+        for (uint32_t p = 0; p < cap->num_planes; ++p){
+            fds[nfds++] = capture_plane_fd(cap, i, p, &hello.offsets[i][p]);
+            hello.lengths[i][p] = cap->buffers[i].planes[p].length;
+        }
+
+    union {
+        char buf[CMSG_SPACE(sizeof fds)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof control);
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof hello };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = CMSG_SPACE(nfds * sizeof(int)) };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+
+    if (sendmsg(client, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof hello){
+        int saved = errno;
+        close(client);
+        errno = saved ? saved : EIO;
+        return false;
+    }
+    fx->clients[fx->client_count++] = client; // Kept only to notice it leaving
+    ++fx->clients_served;
+    return true;
+}
+
+void frame_export_publish(frame_export *fx, const capture_frame *frame){
+    frame_export_shm *shm = fx->shm;
+    frame_export_slot *slot = &shm->slots[fx->published % FRAME_EXPORT_SLOTS];
+
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->index = frame->index;
+    slot->sequence = frame->sequence;
+    slot->flags = frame->flags;
+    slot->timestamp_ns = frame->timestamp_ns;
+    slot->generation = atomic_load_explicit(&shm->generations[frame->index], memory_order_relaxed); // Ours until we pass it on
+    memcpy(slot->bytesused, frame->bytesused, sizeof slot->bytesused);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+    atomic_store_explicit(&shm->published, ++fx->published, memory_order_release);
+    if (fx->client_count) futex_wake_all(&shm->published); // The one syscall, and only with someone to wake
+}
+
+void frame_export_stop(frame_export *fx){
+    if (!fx || !fx->shm) return;
+    atomic_store_explicit(&fx->shm->closed, 1, memory_order_release);
+    futex_wake_all(&fx->shm->published);
+
+    for (uint32_t i = 0; i < fx->client_count; ++i) close(fx->clients[i]);
+    fx->client_count = 0;
+    close(fx->listen_fd);
+    (void)unlink(fx->path);
+    fx->listen_fd = -1;
+
+    // Consumers keep their own mappings of the buffers; ours of the ring goes with the capture device's pointer
+    fx->cap->requeue_generations = NULL;
+    munmap(fx->shm, sizeof *fx->shm);
+    close(fx->shm_fd);
+    fx->shm = NULL;
+    fx->shm_fd = -1;
+}
+
+static bool receive_hello(int sock, frame_export_hello *hello, int *fds, size_t *nfds){
+    union {
+        char buf[CMSG_SPACE(HELLO_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = hello, .iov_len = sizeof *hello };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof control.buf };
+    ssize_t n;
+    do { n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); } while (n < 0 && errno == EINTR);
+    if (n < 0) return false;
+
+    *nfds = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)){
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds + *nfds, CMSG_DATA(c), count * sizeof(int));
+        *nfds += count;
+    }
+    if (n != (ssize_t)sizeof *hello || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))){errno = EPROTO;return false;}
+    if (hello->magic != FRAME_EXPORT_MAGIC || hello->version != FRAME_EXPORT_VERSION || hello->shm_size != sizeof(frame_export_shm) ||
+        hello->buffer_count > CAPTURE_MAX_BUFFERS || hello->num_planes > CAPTURE_MAX_PLANES ||
+        *nfds != 1 + (size_t)hello->buffer_count * hello->num_planes){errno = EPROTO;return false;}
+    return true;
+}
+
+bool frame_import_open(frame_import *fi, const char *socket_path){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!fi || !socket_path){errno = EINVAL;return false;}
+    memset(fi, 0, sizeof *fi);
+
+    struct sockaddr_un addr;
+    if (!fill_address(&addr, socket_path)) return false;
+    fi->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fi->sock < 0) return false;
+
+    frame_export_hello hello;
+    int fds[HELLO_MAX_FDS];
+    size_t nfds = 0;
+    bool ok = connect(fi->sock, (struct sockaddr *)&addr, sizeof addr) == 0 && receive_hello(fi->sock, &hello, fds, &nfds);
+
+    if (ok){
+        void *p = mmap(NULL, sizeof(frame_export_shm), PROT_READ, MAP_SHARED, fds[0], 0);
+        ok = p != MAP_FAILED;
+        if (ok){fi->shm = p; fi->shm_size = sizeof(frame_export_shm);}
+        fi->buffer_count = hello.buffer_count;
+        fi->num_planes = hello.num_planes;
+        for (uint32_t i = 0; ok && i < fi->buffer_count; ++i)
+            for (uint32_t pl = 0; ok && pl < fi->num_planes; ++pl){
+                p = mmap(NULL, hello.lengths[i][pl], PROT_READ, MAP_SHARED, fds[1 + i * fi->num_planes + pl], (off_t)hello.offsets[i][pl]);
+                ok = p != MAP_FAILED;
+                if (ok){fi->maps[i][pl] = p; fi->map_lengths[i][pl] = hello.lengths[i][pl];}
+            }
+    }
+
+    int saved = errno;
+    for (size_t i = 0; i < nfds; ++i) close(fds[i]); // The mappings hold the memory
+    if (!ok){frame_import_close(fi);errno = saved;return false;}
+    return true;
+}
+
+int frame_import_next(frame_import *fi, frame_export_slot *frame, int timeout_ms){
+    const frame_export_shm *shm = fi->shm;
+    uint32_t published;
+    bool waited = false;
+    while ((published = atomic_load_explicit(&shm->published, memory_order_acquire)) == fi->seen){
+        if (atomic_load_explicit(&shm->closed, memory_order_acquire)){errno = EPIPE;return -1;}
+        if (waited) return 0;
+        if (futex_wait(&shm->published, published, timeout_ms) != 0 && errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) return -1;
+        waited = true;
+    }
+    if (fi->started) fi->missed += published - fi->seen - 1;
+    fi->started = true;
+    fi->seen = published;
+
+    // The newest slot; if the producer laps us while copying, the retry just reads a newer frame
+    const frame_export_slot *slot = &shm->slots[(published - 1) % FRAME_EXPORT_SLOTS];
+    for (;;){
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq & 1) continue;
+        frame->index = slot->index;
+        frame->sequence = slot->sequence;
+        frame->flags = slot->flags;
+        frame->timestamp_ns = slot->timestamp_ns;
+        frame->generation = slot->generation;
+        memcpy(frame->bytesused, slot->bytesused, sizeof frame->bytesused);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) break;
+    }
+    atomic_init(&frame->seq, 0);
+    if (frame->index >= fi->buffer_count){errno = EPROTO;return -1;}
+    return 1;
+}
+
+const uint8_t *frame_import_plane(const frame_import *fi, uint32_t index, uint32_t plane){
+    if (index >= fi->buffer_count || plane >= fi->num_planes) return NULL;
+    return fi->maps[index][plane];
+}
+
+bool frame_import_still_valid(const frame_import *fi, const frame_export_slot *frame){
+    atomic_thread_fence(memory_order_acquire); // The pixel reads before the generation read
+    return atomic_load_explicit(&fi->shm->generations[frame->index], memory_order_relaxed) == frame->generation;
+}
+
+void frame_import_close(frame_import *fi){
+    if (!fi) return;
+    for (uint32_t i = 0; i < CAPTURE_MAX_BUFFERS; ++i)
+        for (uint32_t p = 0; p < CAPTURE_MAX_PLANES; ++p)
+            if (fi->maps[i][p]){munmap(fi->maps[i][p], fi->map_lengths[i][p]); fi->maps[i][p] = NULL;}
+    if (fi->shm) munmap((void *)fi->shm, fi->shm_size);
+    fi->shm = NULL;
+    if (fi->sock >= 0) close(fi->sock);
+    fi->sock = -1;
+}
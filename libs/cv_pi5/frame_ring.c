@@ -0,0 +1,84 @@
+#include "cv_pi5/frame_ring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool frame_ring_init(frame_ring *ring, size_t capacity){
+    /*
+        Allocates every slot up front; push and pop never allocate.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!ring || capacity == 0 || capacity > ((size_t)1 << 30)){errno = EINVAL;return false;}
+
+    size_t rounded = 1;
+    while (rounded < capacity) rounded <<= 1; // Power of two so wrap-around is a mask, not a divide
+
+    memset(ring, 0, sizeof *ring);
+    size_t bytes = rounded * sizeof(frame_desc);
+    bytes = (bytes + FRAME_RING_CACHE_LINE - 1) & ~(size_t)(FRAME_RING_CACHE_LINE - 1);
+    ring->slots = aligned_alloc(FRAME_RING_CACHE_LINE, bytes);
+    if (!ring->slots) return false;
+
+    ring->capacity = rounded;
+    ring->mask = rounded - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->high_water, 0);
+    atomic_init(&ring->overflows, 0);
+    return true;
+}
+
+void frame_ring_destroy(frame_ring *ring){
+    if (!ring) return;
+    free(ring->slots);
+    ring->slots = NULL;
+    ring->capacity = 0;
+}
+
+bool frame_ring_push(frame_ring *ring, const frame_desc *desc){
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - ring->cached_tail >= ring->capacity){ // Looks full, refresh our view of the consumer
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail >= ring->capacity){
+            atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+            return false;
+        }
+    }
+
+    ring->slots[head & ring->mask] = *desc;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release); // Publishes the slot to the consumer
+
+    ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire); // Fresh: the cached one only moves when the ring looks full
+    size_t occupancy = head + 1 - ring->cached_tail;
+    if (occupancy > atomic_load_explicit(&ring->high_water, memory_order_relaxed))
+        atomic_store_explicit(&ring->high_water, occupancy, memory_order_relaxed); // Only the producer writes it
+    return true;
+}
+
+bool frame_ring_pop(frame_ring *ring, frame_desc *desc){
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == ring->cached_head){ // Looks empty, refresh our view of the producer
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->cached_head) return false;
+    }
+
+    *desc = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release); // Hands the slot back to the producer
+    return true;
+}
+
+void frame_ring_get_stats(const frame_ring *ring, frame_ring_stats *stats){
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire); // Tail first so head - tail can't go negative
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    stats->capacity = ring->capacity;
+    stats->occupancy = head - tail;
+    stats->high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    stats->pushed = head;
+    stats->popped = tail;
+    stats->overflows = atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
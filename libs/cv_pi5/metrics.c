@@ -0,0 +1,234 @@
+#include "cv_pi5/metrics.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_MAX_SHARDS 32
+#define METRICS_MAX_LATENCY_NS (60ull * 1000000000ull)
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} shard_histogram;
+
+typedef struct {
+    _Alignas(64) shard_histogram stages[METRIC_STAGE_COUNT];
+    _Atomic uint64_t counters[METRIC_COUNTER_COUNT];
+    _Atomic uint64_t peaks[METRIC_PEAK_COUNT];
+} metrics_shard;
+
+static metrics_shard shards[METRICS_MAX_SHARDS];
+static _Atomic unsigned shards_claimed;
+static _Thread_local metrics_shard *local_shard;
+
+static metrics_shard *shard(void){
+    /*
+        Threads past METRICS_MAX_SHARDS share the last shard; the atomic adds
+        keep that correct, it is just no longer contention-free
+    */
+    if (!local_shard){
+        unsigned i = atomic_fetch_add_explicit(&shards_claimed, 1, memory_order_relaxed);
+        local_shard = &shards[i < METRICS_MAX_SHARDS ? i : METRICS_MAX_SHARDS - 1];
+    }
+    return local_shard;
+}
+
+static unsigned bucket_for(uint64_t ns){
+    uint64_t us = ns / 1000u;
+    if (us < METRICS_SUB_BUCKETS) return (unsigned)us; // First octave is linear
+    unsigned octave = 63u - (unsigned)__builtin_clzll(us);
+    unsigned sub = (unsigned)(us >> (octave - 2)) & (METRICS_SUB_BUCKETS - 1);
+    unsigned b = (octave - 1) * METRICS_SUB_BUCKETS + sub;
+    return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+}
+
+static uint64_t bucket_upper_ns(unsigned b){
+    if (b < METRICS_SUB_BUCKETS) return (uint64_t)(b + 1) * 1000u;
+    unsigned octave = b / METRICS_SUB_BUCKETS + 1, sub = b % METRICS_SUB_BUCKETS;
+    uint64_t base = 1ull << octave;
+    return (base + (base >> 2) * (sub + 1)) * 1000u;
+}
+
+void metrics_record(metric_stage stage, uint64_t latency_ns){
+    shard_histogram *h = &shard()->stages[stage];
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, latency_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[bucket_for(latency_ns)], 1, memory_order_relaxed);
+    if (latency_ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->max_ns, latency_ns, memory_order_relaxed); // Only this thread writes its shard's max
+}
+
+void metrics_record_since(metric_stage stage, uint64_t since_ns){
+    uint64_t now = metrics_now_ns();
+    if (since_ns == 0 || since_ns > now || now - since_ns > METRICS_MAX_LATENCY_NS) return;
+    metrics_record(stage, now - since_ns);
+}
+
+void metrics_count(metric_counter counter, uint64_t n){
+    atomic_fetch_add_explicit(&shard()->counters[counter], n, memory_order_relaxed);
+}
+
+void metrics_peak(metric_peak peak, uint64_t value){
+    _Atomic uint64_t *p = &shard()->peaks[peak];
+    if (value > atomic_load_explicit(p, memory_order_relaxed)) atomic_store_explicit(p, value, memory_order_relaxed); // Shard-private, like max_ns
+}
+
+void metrics_snapshot_get(metrics_snapshot *snap){
+    memset(snap, 0, sizeof *snap);
+    unsigned n = atomic_load_explicit(&shards_claimed, memory_order_relaxed);
+    if (n > METRICS_MAX_SHARDS) n = METRICS_MAX_SHARDS;
+
+    for (unsigned i = 0; i < n; ++i){
+        metrics_shard *s = &shards[i];
+        for (int st = 0; st < METRIC_STAGE_COUNT; ++st){
+            shard_histogram *src = &s->stages[st];
+            metrics_histogram *dst = &snap->stages[st];
+            dst->count += atomic_load_explicit(&src->count, memory_order_relaxed);
+            dst->sum_ns += atomic_load_explicit(&src->sum_ns, memory_order_relaxed);
+            uint64_t max = atomic_load_explicit(&src->max_ns, memory_order_relaxed);
+            if (max > dst->max_ns) dst->max_ns = max;
+            for (int b = 0; b < METRICS_BUCKETS; ++b)
+                dst->buckets[b] += atomic_load_explicit(&src->buckets[b], memory_order_relaxed);
+        }
+        for (int c = 0; c < METRIC_COUNTER_COUNT; ++c)
+            snap->counters[c] += atomic_load_explicit(&s->counters[c], memory_order_relaxed);
+        for (int pk = 0; pk < METRIC_PEAK_COUNT; ++pk){
+            uint64_t v = atomic_load_explicit(&s->peaks[pk], memory_order_relaxed);
+            if (v > snap->peaks[pk]) snap->peaks[pk] = v;
+        }
+    }
+}
+
+uint64_t metrics_quantile_ns(const metrics_histogram *h, double q){
+    uint64_t total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; ++b) total += h->buckets[b];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; ++b){
+        seen += h->buckets[b];
+        if (seen > rank){
+            uint64_t upper = bucket_upper_ns((unsigned)b);
+            return upper < h->max_ns || h->max_ns == 0 ? upper : h->max_ns; // Never report more than was seen
+        }
+    }
+    return h->max_ns;
+}
+
+const char *metrics_stage_name(metric_stage stage){
+    static const char *const names[METRIC_STAGE_COUNT] = {
+        "dequeue", "encode", "write", "write_call", "fsync", "motion",
+    };
+    return stage < METRIC_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+const char *metrics_counter_name(metric_counter counter){
+    static const char *const names[METRIC_COUNTER_COUNT] = {
+        "frames_captured", "frames_sensor_dropped", "frames_ring_dropped", "frames_encoded",
+        "packets_dropped", "packets_written", "bytes_written", "write_errors", "motion_triggers",
+        "pool_exhausted", "pressure_degrades", "pressure_recovers", "frames_shed",
+        "analytics_frames", "analytics_dropped", "sidecars_written", "sidecar_errors",
+        "clips_saved", "triggers_coalesced", "triggers_dropped",
+        "clips_moved", "clip_move_errors", "staging_spills", "wall_clock_steps",
+        "stream_queue_dropped", "stream_units_skipped", "stream_bytes_sent",
+        "supervisor_escalations", "supervisor_recoveries", "analytics_shed", "frames_backlog_dropped",
+        "pipeline_stalls", "watchdog_kicks", "clips_expired", "clips_over_quota", "reap_errors",
+    };
+    return counter < METRIC_COUNTER_COUNT ? names[counter] : "unknown";
+}
+
+const char *metrics_peak_name(metric_peak peak){
+    static const char *const names[METRIC_PEAK_COUNT] = {
+        "unsynced_bytes_max", "staged_bytes_max",
+    };
+    return peak < METRIC_PEAK_COUNT ? names[peak] : "unknown";
+}
+
+static bool write_all(int fd, const char *p, size_t length){
+    while (length){
+        ssize_t n = write(fd, p, length);
+        if (n < 0){if (errno == EINTR) continue; return false;}
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+bool metrics_dump(int fd, const char *measurement){
+    /*
+        e.g.
+        cam_trigger,stage=encode count=300i,mean_us=4100i,p50_us=4096i,p99_us=7168i,p999_us=9216i,max_us=9730i 1760000000000000000
+        cam_trigger frames_captured=300i,... 1760000000000000000
+    */
+    metrics_snapshot snap;
+    metrics_snapshot_get(&snap);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    unsigned long long ts = (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+
+    char buf[4096];
+    size_t len = 0;
+    for (int st = 0; st < METRIC_STAGE_COUNT; ++st){
+        const metrics_histogram *h = &snap.stages[st];
+        if (h->count == 0) continue;
+        len += (size_t)snprintf(buf + len, sizeof buf - len,
+            "%s,stage=%s count=%llui,mean_us=%llui,p50_us=%llui,p99_us=%llui,p999_us=%llui,max_us=%llui %llu\n",
+            measurement, metrics_stage_name((metric_stage)st), (unsigned long long)h->count,
+            (unsigned long long)(h->sum_ns / h->count / 1000u),
+            (unsigned long long)(metrics_quantile_ns(h, 0.50) / 1000u),
+            (unsigned long long)(metrics_quantile_ns(h, 0.99) / 1000u),
+            (unsigned long long)(metrics_quantile_ns(h, 0.999) / 1000u),
+            (unsigned long long)(h->max_ns / 1000u), ts);
+        if (len >= sizeof buf){errno = ENOBUFS;return false;}
+    }
+
+    len += (size_t)snprintf(buf + len, sizeof buf - len, "%s ", measurement);
+    for (int c = 0; c < METRIC_COUNTER_COUNT && len < sizeof buf; ++c)
+        len += (size_t)snprintf(buf + len, sizeof buf - len, "%s%s=%llui", c ? "," : "",
+                                metrics_counter_name((metric_counter)c), (unsigned long long)snap.counters[c]);
+    for (int pk = 0; pk < METRIC_PEAK_COUNT && len < sizeof buf; ++pk)
+        len += (size_t)snprintf(buf + len, sizeof buf - len, ",%s=%llui", metrics_peak_name((metric_peak)pk), (unsigned long long)snap.peaks[pk]);
+    if (len < sizeof buf) len += (size_t)snprintf(buf + len, sizeof buf - len, " %llu\n", ts);
+    if (len >= sizeof buf){errno = ENOBUFS;return false;}
+
+    return write_all(fd, buf, len);
+}
+
+int metrics_listen(const char *path){
+    if (!path || !*path){errno = EINVAL;return -1;}
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path){errno = ENAMETOOLONG;return -1;}
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    (void)unlink(path); // Left behind by a previous run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0 || listen(fd, 4) != 0){
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+void metrics_serve(int listen_fd, const char *measurement){
+    int client;
+    while ((client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0){
+        (void)metrics_dump(client, measurement); // One dump fits the socket buffer, so this never blocks for long
+        close(client);
+    }
+}
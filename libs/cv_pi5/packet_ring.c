@@ -0,0 +1,164 @@
+#include "cv_pi5/packet_ring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+bool packet_ring_init(packet_ring *ring, size_t max_packets, size_t arena_bytes,
+                      packet_ring_release_fn release, void *release_ctx){
+    /*
+        Allocates the slots and the payload arena up front.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!ring || max_packets == 0 || max_packets > ((size_t)1 << 20)){errno = EINVAL;return false;}
+
+    size_t rounded = 1;
+    while (rounded < max_packets) rounded <<= 1;
+
+    memset(ring, 0, sizeof *ring);
+    ring->slots = calloc(rounded, sizeof *ring->slots);
+    if (!ring->slots){errno = ENOMEM;return false;}
+
+    if (arena_bytes){
+        void *arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (arena == MAP_FAILED){int saved = errno; free(ring->slots); ring->slots = NULL; errno = saved; return false;}
+        ring->arena = arena;
+        ring->arena_size = arena_bytes;
+    }
+
+    ring->capacity = rounded;
+    ring->mask = rounded - 1;
+    ring->release = release;
+    ring->release_ctx = release_ctx;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->arena_tail, 0);
+    atomic_init(&ring->high_water, 0);
+    atomic_init(&ring->overflows, 0);
+    return true;
+}
+
+void packet_ring_destroy(packet_ring *ring){
+    if (!ring) return;
+    if (ring->arena) munmap(ring->arena, ring->arena_size);
+    free(ring->slots);
+    ring->arena = NULL;
+    ring->slots = NULL;
+    ring->capacity = 0;
+}
+
+static packet_ring_item *claim_slot(packet_ring *ring, size_t *head){
+    *head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (*head - tail >= ring->capacity) return NULL;
+    return &ring->slots[*head & ring->mask];
+}
+
+static void publish(packet_ring *ring, size_t head){
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    size_t occupancy = head + 1 - atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (occupancy > atomic_load_explicit(&ring->high_water, memory_order_relaxed))
+        atomic_store_explicit(&ring->high_water, occupancy, memory_order_relaxed);
+}
+
+static bool overflow(packet_ring *ring){
+    atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+    return false;
+}
+
+bool packet_ring_push(packet_ring *ring, const encoded_packet *pkt){
+    size_t head;
+    packet_ring_item *slot = claim_slot(ring, &head);
+    if (!slot || pkt->size == 0 || pkt->size > ring->arena_size) return overflow(ring);
+
+    // Payloads never straddle the end of the arena; skip the short tail instead
+    uint64_t start = ring->arena_head;
+    size_t offset = (size_t)(start % ring->arena_size);
+    if (ring->arena_size - offset < pkt->size){
+        start += ring->arena_size - offset;
+        offset = 0;
+    }
+    uint64_t end = start + pkt->size;
+    if (end - atomic_load_explicit(&ring->arena_tail, memory_order_acquire) > ring->arena_size) return overflow(ring);
+
+    memcpy(ring->arena + offset, pkt->data, pkt->size);
+    ring->arena_head = end;
+
+    slot->pkt = *pkt;
+    slot->pkt.data = ring->arena + offset;
+    slot->ref = PACKET_RING_NO_REF;
+    slot->pool = NULL;
+    slot->arena_end = end;
+    publish(ring, head);
+    return true;
+}
+
+bool packet_ring_push_ref(packet_ring *ring, const encoded_packet *pkt, uint32_t ref){
+    size_t head;
+    packet_ring_item *slot = claim_slot(ring, &head);
+    if (!slot) return overflow(ring);
+
+    slot->pkt = *pkt;
+    slot->ref = ref;
+    slot->pool = NULL;
+    slot->arena_end = ring->arena_head; // Frees nothing, but keeps arena_tail monotonic
+    publish(ring, head);
+    return true;
+}
+
+bool packet_ring_push_buffer(packet_ring *ring, const encoded_packet *pkt, buffer_pool *pool, uint32_t buffer){
+    size_t head;
+    packet_ring_item *slot = claim_slot(ring, &head);
+    if (!slot) return overflow(ring); // The reference stays with the caller
+
+    slot->pkt = *pkt;
+    slot->ref = PACKET_RING_NO_REF;
+    slot->pool = pool;
+    slot->buffer = buffer;
+    slot->arena_end = ring->arena_head;
+    publish(ring, head);
+    return true;
+}
+
+bool packet_ring_peek(packet_ring *ring, packet_ring_item *item){
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) return false;
+    *item = ring->slots[tail & ring->mask];
+    return true;
+}
+
+void packet_ring_release(packet_ring *ring, const packet_ring_item *item){
+    /*
+        Frees the oldest packet: arena bytes go back to the producer, a
+        referenced capture buffer goes back through the release callback and
+        a pool buffer loses the ring's reference
+    */
+    if (item->ref != PACKET_RING_NO_REF && ring->release) ring->release(ring->release_ctx, item->ref);
+    if (item->pool) buffer_pool_unref(item->pool, item->buffer);
+
+    atomic_store_explicit(&ring->arena_tail, item->arena_end, memory_order_release);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void packet_ring_get_stats(const packet_ring *ring, packet_ring_stats *stats){
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t arena_tail = atomic_load_explicit(&ring->arena_tail, memory_order_acquire);
+
+    stats->capacity = ring->capacity;
+    stats->occupancy = head - tail;
+    stats->high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    stats->arena_size = ring->arena_size;
+    stats->arena_used = 0;
+    if (head != tail){ // arena_head is producer-private, so derive usage from the newest published slot
+        uint64_t newest_end = ring->slots[(head - 1) & ring->mask].arena_end;
+        if (newest_end > arena_tail) stats->arena_used = (size_t)(newest_end - arena_tail);
+    }
+    stats->pushed = head;
+    stats->popped = tail;
+    stats->overflows = atomic_load_explicit(&ring->overflows, memory_order_relaxed);
+}
@@ -0,0 +1,368 @@
+#include "cv_pi5/pixconv.h"
+
+#include <errno.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+#if defined(CV_PI5_PIXCONV_NEON) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PIXCONV_NEON 1
+#endif
+
+/*
+    Every kernel converts one row, pixel pairs at a time: each _pair()
+    function is the scalar reference for pixels x and x + 1, each _block()
+    the same for PIXCONV_BLOCK pixels from x, in NEON where the build has
+    it. PIXCONV_KERNEL() turns a pair of them into the two row functions
+    pixconv_plan() chooses between.
+
+    Plane pointers are row starts: s[0] luma or packed pixels, s[1] and
+    s[2] chroma (NV12: s[1] interleaved CbCr); the same for d.
+*/
+
+#define SRC const uint8_t *const *s
+#define DST uint8_t *const *d
+
+static inline uint8_t rgb_luma(int r, int g, int b){
+    return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t rgb_cb(int r, int g, int b){
+    return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128); // Arithmetic shift, as vrshrq_n_s16
+}
+
+static inline uint8_t rgb_cr(int r, int g, int b){
+    return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+static inline void put_yuv24(uint8_t *out, uint8_t y, uint8_t cb, uint8_t cr){
+    out[0] = y; out[1] = cb; out[2] = cr;
+}
+
+// Luma planes copied as they are: YUV420 and NV12 to GREY, and the luma of NV12 to YUV420
+
+static inline void copy_luma_pair(SRC, DST, uint32_t x){
+    d[0][x] = s[0][x]; d[0][x + 1] = s[0][x + 1];
+}
+
+// YUYV: Y0 Cb Y1 Cr per pair
+
+static inline void yuyv_luma_pair(SRC, DST, uint32_t x){
+    d[0][x] = s[0][2 * x]; d[0][x + 1] = s[0][2 * x + 2];
+}
+
+static inline void yuyv_yuv24_pair(SRC, DST, uint32_t x){
+    const uint8_t *p = s[0] + 2 * x;
+    put_yuv24(d[0] + 3 * x, p[0], p[1], p[3]);
+    put_yuv24(d[0] + 3 * x + 3, p[2], p[1], p[3]);
+}
+
+static inline void yuyv_i420_pair(SRC, DST, uint32_t x){
+    const uint8_t *p = s[0] + 2 * x;
+    d[0][x] = p[0]; d[0][x + 1] = p[2];
+    d[1][x / 2] = p[1]; d[2][x / 2] = p[3];
+}
+
+// RGB24: R G B per pixel
+
+static inline void rgb_luma_pair(SRC, DST, uint32_t x){
+    const uint8_t *p = s[0] + 3 * x;
+    d[0][x] = rgb_luma(p[0], p[1], p[2]);
+    d[0][x + 1] = rgb_luma(p[3], p[4], p[5]);
+}
+
+static inline void rgb_yuv24_pair(SRC, DST, uint32_t x){
+    for (uint32_t i = 0; i < 2; ++i){
+        const uint8_t *p = s[0] + 3 * (x + i);
+        put_yuv24(d[0] + 3 * (x + i), rgb_luma(p[0], p[1], p[2]), rgb_cb(p[0], p[1], p[2]), rgb_cr(p[0], p[1], p[2]));
+    }
+}
+
+static inline void rgb_i420_pair(SRC, DST, uint32_t x){
+    const uint8_t *p = s[0] + 3 * x;
+    d[0][x] = rgb_luma(p[0], p[1], p[2]);
+    d[0][x + 1] = rgb_luma(p[3], p[4], p[5]);
+    d[1][x / 2] = rgb_cb(p[0], p[1], p[2]); // The pair's first pixel speaks for both
+    d[2][x / 2] = rgb_cr(p[0], p[1], p[2]);
+}
+
+// Planar and semi-planar 4:2:0 and GREY to packed 4:4:4
+
+static inline void i420_yuv24_pair(SRC, DST, uint32_t x){
+    put_yuv24(d[0] + 3 * x, s[0][x], s[1][x / 2], s[2][x / 2]);
+    put_yuv24(d[0] + 3 * x + 3, s[0][x + 1], s[1][x / 2], s[2][x / 2]);
+}
+
+static inline void nv12_yuv24_pair(SRC, DST, uint32_t x){
+    put_yuv24(d[0] + 3 * x, s[0][x], s[1][x], s[1][x + 1]);
+    put_yuv24(d[0] + 3 * x + 3, s[0][x + 1], s[1][x], s[1][x + 1]);
+}
+
+static inline void grey_yuv24_pair(SRC, DST, uint32_t x){
+    put_yuv24(d[0] + 3 * x, s[0][x], 128, 128);
+    put_yuv24(d[0] + 3 * x + 3, s[0][x + 1], 128, 128);
+}
+
+static inline void nv12_i420_pair(SRC, DST, uint32_t x){
+    d[0][x] = s[0][x]; d[0][x + 1] = s[0][x + 1];
+    d[1][x / 2] = s[1][x]; d[2][x / 2] = s[1][x + 1];
+}
+
+#ifdef PIXCONV_NEON
+static inline uint8x8_t luma8(uint8x8_t r, uint8x8_t g, uint8x8_t b){
+    uint16x8_t acc = vmull_u8(r, vdup_n_u8(66));    // At most 220 x 255: no 16-bit wrap
+    acc = vmlal_u8(acc, g, vdup_n_u8(129));
+    acc = vmlal_u8(acc, b, vdup_n_u8(25));
+    return vadd_u8(vrshrn_n_u16(acc, 8), vdup_n_u8(16));
+}
+
+static inline uint8x16_t luma16(uint8x16x3_t p){
+    return vcombine_u8(luma8(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2])),
+                       luma8(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2])));
+}
+
+static inline uint8x8_t chroma8(uint8x8_t r, uint8x8_t g, uint8x8_t b, int16_t kr, int16_t kg, int16_t kb){
+    int16x8_t acc = vmulq_n_s16(vreinterpretq_s16_u16(vmovl_u8(r)), kr); // Within +-112 x 255
+    acc = vmlaq_n_s16(acc, vreinterpretq_s16_u16(vmovl_u8(g)), kg);
+    acc = vmlaq_n_s16(acc, vreinterpretq_s16_u16(vmovl_u8(b)), kb);
+    return vqmovun_s16(vaddq_s16(vrshrq_n_s16(acc, 8), vdupq_n_s16(128)));
+}
+
+static inline uint8x16_t widen_chroma(uint8x8_t c){
+    uint8x8x2_t z = vzip_u8(c, c); // Each sample for both pixels of its pair
+    return vcombine_u8(z.val[0], z.val[1]);
+}
+
+static inline void copy_luma_block(SRC, DST, uint32_t x){
+    vst1q_u8(d[0] + x, vld1q_u8(s[0] + x));
+}
+
+static inline void yuyv_luma_block(SRC, DST, uint32_t x){
+    vst1q_u8(d[0] + x, vld2q_u8(s[0] + 2 * x).val[0]);
+}
+
+static inline void yuyv_yuv24_block(SRC, DST, uint32_t x){
+    uint8x8x4_t p = vld4_u8(s[0] + 2 * x); // Y0, Cb, Y1, Cr of 8 pairs
+    uint8x8x2_t y = vzip_u8(p.val[0], p.val[2]);
+    uint8x16x3_t out = { { vcombine_u8(y.val[0], y.val[1]), widen_chroma(p.val[1]), widen_chroma(p.val[3]) } };
+    vst3q_u8(d[0] + 3 * x, out);
+}
+
+static inline void yuyv_i420_block(SRC, DST, uint32_t x){
+    uint8x8x4_t p = vld4_u8(s[0] + 2 * x);
+    uint8x8x2_t y = { { p.val[0], p.val[2] } };
+    vst2_u8(d[0] + x, y);
+    vst1_u8(d[1] + x / 2, p.val[1]);
+    vst1_u8(d[2] + x / 2, p.val[3]);
+}
+
+static inline void rgb_luma_block(SRC, DST, uint32_t x){
+    vst1q_u8(d[0] + x, luma16(vld3q_u8(s[0] + 3 * x)));
+}
+
+static inline void rgb_yuv24_block(SRC, DST, uint32_t x){
+    uint8x16x3_t p = vld3q_u8(s[0] + 3 * x);
+    uint8x8_t rl = vget_low_u8(p.val[0]), gl = vget_low_u8(p.val[1]), bl = vget_low_u8(p.val[2]);
+    uint8x8_t rh = vget_high_u8(p.val[0]), gh = vget_high_u8(p.val[1]), bh = vget_high_u8(p.val[2]);
+    uint8x16x3_t out = { {
+        luma16(p),
+        vcombine_u8(chroma8(rl, gl, bl, -38, -74, 112), chroma8(rh, gh, bh, -38, -74, 112)),
+        vcombine_u8(chroma8(rl, gl, bl, 112, -94, -18), chroma8(rh, gh, bh, 112, -94, -18)),
+    } };
+    vst3q_u8(d[0] + 3 * x, out);
+}
+
+static inline void rgb_i420_block(SRC, DST, uint32_t x){
+    uint8x16x3_t p = vld3q_u8(s[0] + 3 * x);
+    vst1q_u8(d[0] + x, luma16(p));
+    uint8x8_t r = vget_low_u8(vuzpq_u8(p.val[0], p.val[0]).val[0]); // Even pixels
+    uint8x8_t g = vget_low_u8(vuzpq_u8(p.val[1], p.val[1]).val[0]);
+    uint8x8_t b = vget_low_u8(vuzpq_u8(p.val[2], p.val[2]).val[0]);
+    vst1_u8(d[1] + x / 2, chroma8(r, g, b, -38, -74, 112));
+    vst1_u8(d[2] + x / 2, chroma8(r, g, b, 112, -94, -18));
+}
+
+static inline void i420_yuv24_block(SRC, DST, uint32_t x){
+    uint8x16x3_t out = { { vld1q_u8(s[0] + x), widen_chroma(vld1_u8(s[1] + x / 2)), widen_chroma(vld1_u8(s[2] + x / 2)) } };
+    vst3q_u8(d[0] + 3 * x, out);
+}
+
+static inline void nv12_yuv24_block(SRC, DST, uint32_t x){
+    uint8x8x2_t c = vld2_u8(s[1] + x);
+    uint8x16x3_t out = { { vld1q_u8(s[0] + x), widen_chroma(c.val[0]), widen_chroma(c.val[1]) } };
+    vst3q_u8(d[0] + 3 * x, out);
+}
+
+static inline void grey_yuv24_block(SRC, DST, uint32_t x){
+    uint8x16x3_t out = { { vld1q_u8(s[0] + x), vdupq_n_u8(128), vdupq_n_u8(128) } };
+    vst3q_u8(d[0] + 3 * x, out);
+}
+
+static inline void nv12_i420_block(SRC, DST, uint32_t x){
+    vst1q_u8(d[0] + x, vld1q_u8(s[0] + x));
+    uint8x8x2_t c = vld2_u8(s[1] + x);
+    vst1_u8(d[1] + x / 2, c.val[0]);
+    vst1_u8(d[2] + x / 2, c.val[1]);
+}
+#else
+// A fixed trip count over the scalar pairs, for the compiler to unroll and vectorise
+#define PIXCONV_SCALAR_BLOCK(name) \
+    static inline void name##_block(SRC, DST, uint32_t x){ \
+        for (uint32_t i = 0; i < PIXCONV_BLOCK; i += 2) name##_pair(s, d, x + i); \
+    }
+
+PIXCONV_SCALAR_BLOCK(copy_luma)
+PIXCONV_SCALAR_BLOCK(yuyv_luma)
+PIXCONV_SCALAR_BLOCK(yuyv_yuv24)
+PIXCONV_SCALAR_BLOCK(yuyv_i420)
+PIXCONV_SCALAR_BLOCK(rgb_luma)
+PIXCONV_SCALAR_BLOCK(rgb_yuv24)
+PIXCONV_SCALAR_BLOCK(rgb_i420)
+PIXCONV_SCALAR_BLOCK(i420_yuv24)
+PIXCONV_SCALAR_BLOCK(nv12_yuv24)
+PIXCONV_SCALAR_BLOCK(grey_yuv24)
+PIXCONV_SCALAR_BLOCK(nv12_i420)
+#endif
+
+// name_blocks when the width is a multiple of PIXCONV_BLOCK, name_tail for any even width
+#define PIXCONV_KERNEL(name) \
+    static void name##_blocks(SRC, DST, uint32_t width){ \
+        for (uint32_t x = 0; x < width; x += PIXCONV_BLOCK) name##_block(s, d, x); \
+    } \
+    static void name##_tail(SRC, DST, uint32_t width){ \
+        uint32_t x = 0; \
+        for (; x + PIXCONV_BLOCK <= width; x += PIXCONV_BLOCK) name##_block(s, d, x); \
+        for (; x < width; x += 2) name##_pair(s, d, x); \
+    }
+
+PIXCONV_KERNEL(copy_luma)
+PIXCONV_KERNEL(yuyv_luma)
+PIXCONV_KERNEL(yuyv_yuv24)
+PIXCONV_KERNEL(yuyv_i420)
+PIXCONV_KERNEL(rgb_luma)
+PIXCONV_KERNEL(rgb_yuv24)
+PIXCONV_KERNEL(rgb_i420)
+PIXCONV_KERNEL(i420_yuv24)
+PIXCONV_KERNEL(nv12_yuv24)
+PIXCONV_KERNEL(grey_yuv24)
+PIXCONV_KERNEL(nv12_i420)
+
+typedef struct {
+    uint32_t src;
+    uint32_t dst;
+    pixconv_row_fn even_blocks, even_tail;
+    pixconv_row_fn odd_blocks, odd_tail;
+} pixconv_entry;
+
+#define PAIR(src, dst, even, odd) { src, dst, even##_blocks, even##_tail, odd##_blocks, odd##_tail }
+
+static const pixconv_entry kernels[] = {
+    PAIR(V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_GREY,    copy_luma,  copy_luma),
+    PAIR(V4L2_PIX_FMT_NV12,   V4L2_PIX_FMT_GREY,    copy_luma,  copy_luma),
+    PAIR(V4L2_PIX_FMT_YUYV,   V4L2_PIX_FMT_GREY,    yuyv_luma,  yuyv_luma),
+    PAIR(V4L2_PIX_FMT_RGB24,  V4L2_PIX_FMT_GREY,    rgb_luma,   rgb_luma),
+    PAIR(V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV24,   i420_yuv24, i420_yuv24),
+    PAIR(V4L2_PIX_FMT_NV12,   V4L2_PIX_FMT_YUV24,   nv12_yuv24, nv12_yuv24),
+    PAIR(V4L2_PIX_FMT_YUYV,   V4L2_PIX_FMT_YUV24,   yuyv_yuv24, yuyv_yuv24),
+    PAIR(V4L2_PIX_FMT_RGB24,  V4L2_PIX_FMT_YUV24,   rgb_yuv24,  rgb_yuv24),
+    PAIR(V4L2_PIX_FMT_GREY,   V4L2_PIX_FMT_YUV24,   grey_yuv24, grey_yuv24),
+    PAIR(V4L2_PIX_FMT_NV12,   V4L2_PIX_FMT_YUV420,  nv12_i420,  copy_luma),
+    PAIR(V4L2_PIX_FMT_YUYV,   V4L2_PIX_FMT_YUV420,  yuyv_i420,  yuyv_luma),
+    PAIR(V4L2_PIX_FMT_RGB24,  V4L2_PIX_FMT_YUV420,  rgb_i420,   rgb_luma),
+};
+
+static uint32_t base_format(uint32_t format){
+    switch (format){
+    case V4L2_PIX_FMT_YUV420M: return V4L2_PIX_FMT_YUV420;
+    case V4L2_PIX_FMT_NV12M: return V4L2_PIX_FMT_NV12;
+    default: return format;
+    }
+}
+
+static uint8_t plane_layout(uint32_t format, uint8_t *shift){
+    // Planes the kernels read or write, and the vertical subsampling of each
+    switch (format){
+    case V4L2_PIX_FMT_YUV420: shift[0] = 0; shift[1] = shift[2] = 1; return 3;
+    case V4L2_PIX_FMT_NV12: shift[0] = 0; shift[1] = 1; return 2;
+    default: shift[0] = 0; return 1;
+    }
+}
+
+bool pixconv_plan(pixconv *c, uint32_t src_format, uint32_t dst_format, uint32_t width){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!c || width == 0 || (width & 1)){errno = EINVAL;return false;}
+    uint32_t src = base_format(src_format), dst = base_format(dst_format);
+
+    const pixconv_entry *k = NULL;
+    for (size_t i = 0; i < sizeof kernels / sizeof *kernels && !k; ++i)
+        if (kernels[i].src == src && kernels[i].dst == dst) k = &kernels[i];
+    if (!k){errno = ENOTSUP;return false;}
+
+    memset(c, 0, sizeof *c);
+    c->src_format = src_format;
+    c->dst_format = dst_format;
+    c->width = width;
+    bool whole = width % PIXCONV_BLOCK == 0;
+    c->even = whole ? k->even_blocks : k->even_tail;
+    c->odd = whole ? k->odd_blocks : k->odd_tail;
+    c->src_planes = plane_layout(src, c->src_shift);
+    c->dst_planes = plane_layout(dst, c->dst_shift);
+    return true;
+}
+
+bool pixconv_capture_image(pixconv_image *img, const capture_device *cap, const capture_frame *frame){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!img || !cap || !frame || frame->index >= cap->buffer_count){errno = EINVAL;return false;}
+    const capture_buffer *b = &cap->buffers[frame->index];
+    size_t stride = cap->bytesperline[0], luma = stride * cap->height;
+
+    memset(img, 0, sizeof *img);
+    img->planes[0] = b->planes[0].data;
+    img->strides[0] = (uint32_t)stride;
+    switch (cap->pixelformat){
+    case V4L2_PIX_FMT_YUV420:
+        if (b->planes[0].length < luma + luma / 2){errno = EINVAL;return false;}
+        img->planes[1] = img->planes[0] + luma;
+        img->planes[2] = img->planes[1] + luma / 4;
+        img->strides[1] = img->strides[2] = (uint32_t)stride / 2;
+        return true;
+    case V4L2_PIX_FMT_YUV420M:
+        if (cap->num_planes < 3){errno = EINVAL;return false;}
+        for (int p = 1; p < 3; ++p){img->planes[p] = b->planes[p].data; img->strides[p] = cap->bytesperline[p];}
+        return true;
+    case V4L2_PIX_FMT_NV12:
+        if (b->planes[0].length < luma + luma / 2){errno = EINVAL;return false;}
+        img->planes[1] = img->planes[0] + luma;
+        img->strides[1] = (uint32_t)stride;
+        return true;
+    case V4L2_PIX_FMT_NV12M:
+        if (cap->num_planes < 2){errno = EINVAL;return false;}
+        img->planes[1] = b->planes[1].data;
+        img->strides[1] = cap->bytesperline[1];
+        return true;
+    case V4L2_PIX_FMT_GREY: case V4L2_PIX_FMT_YUYV: case V4L2_PIX_FMT_RGB24:
+        if (b->planes[0].length < luma){errno = EINVAL;return false;}
+        return true;
+    default:
+        errno = ENOTSUP;
+        return false;
+    }
+}
+
+void pixconv_row(const pixconv *c, const pixconv_image *src, const pixconv_image *dst, uint32_t src_y, uint32_t dst_y){
+    const uint8_t *s[PIXCONV_MAX_PLANES] = { 0 };
+    uint8_t *d[PIXCONV_MAX_PLANES] = { 0 };
+    for (uint8_t p = 0; p < c->src_planes; ++p) s[p] = src->planes[p] + (size_t)(src_y >> c->src_shift[p]) * src->strides[p];
+    for (uint8_t p = 0; p < c->dst_planes; ++p) d[p] = dst->planes[p] + (size_t)(dst_y >> c->dst_shift[p]) * dst->strides[p];
+    (dst_y & 1 ? c->odd : c->even)(s, d, c->width);
+}
+
+void pixconv_frame(const pixconv *c, const pixconv_image *src, const pixconv_image *dst, uint32_t height){
+    for (uint32_t y = 0; y < height; ++y) pixconv_row(c, src, dst, y, y);
+}
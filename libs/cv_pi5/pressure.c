@@ -0,0 +1,98 @@
+#include "cv_pi5/pressure.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Bitrate goes first because nobody sees it until the scene gets busy; resolution last because it waits for a clip
+static const pressure_step ladder[PRESSURE_LEVELS] = {
+    { .bitrate_pct = 100, .fps_divisor = 1, .scale_divisor = 1 },
+    { .bitrate_pct = 75,  .fps_divisor = 1, .scale_divisor = 1 },
+    { .bitrate_pct = 50,  .fps_divisor = 1, .scale_divisor = 1 },
+    { .bitrate_pct = 50,  .fps_divisor = 2, .scale_divisor = 1 },
+    { .bitrate_pct = 35,  .fps_divisor = 2, .scale_divisor = 2 },
+};
+
+bool pressure_init(pressure_controller *pc, const pressure_config *cfg){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!pc || !cfg || cfg->free_clear_bytes < cfg->free_low_bytes || cfg->temp_clear_mc > cfg->temp_high_mc ||
+        cfg->queue_clear_pct > cfg->queue_high_pct){errno = EINVAL;return false;}
+
+    memset(pc, 0, sizeof *pc);
+    pc->cfg = *cfg;
+    if (!pc->cfg.degrade_samples) pc->cfg.degrade_samples = 1;
+    if (!pc->cfg.recover_samples) pc->cfg.recover_samples = 1;
+
+    // Kept open and re-read with pread, one syscall per zone per sample
+    for (int zone = 0; zone < 16 && pc->thermal_count < PRESSURE_THERMAL_ZONES; ++zone){
+        char path[64];
+        snprintf(path, sizeof path, "/sys/class/thermal/thermal_zone%d/temp", zone);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) pc->thermal_fds[pc->thermal_count++] = fd;
+    }
+    return true;
+}
+
+void pressure_destroy(pressure_controller *pc){
+    if (!pc) return;
+    for (int i = 0; i < pc->thermal_count; ++i) close(pc->thermal_fds[i]);
+    pc->thermal_count = 0;
+}
+
+bool pressure_read_temp(pressure_controller *pc, int32_t *temp_mc){
+    bool any = false;
+    for (int i = 0; i < pc->thermal_count; ++i){
+        char buf[16];
+        ssize_t n = pread(pc->thermal_fds[i], buf, sizeof buf - 1, 0);
+        if (n <= 0) continue;
+        buf[n] = '\0';
+        long mc = strtol(buf, NULL, 10);
+        if (!any || mc > *temp_mc) *temp_mc = (int32_t)mc;
+        any = true;
+    }
+    return any;
+}
+
+int pressure_update(pressure_controller *pc, const pressure_sample *sample){
+    const pressure_config *c = &pc->cfg;
+    uint32_t over = 0, not_clear = 0;
+    if (sample->free_known){
+        if (sample->free_bytes < c->free_low_bytes) over |= PRESSURE_STORAGE;
+        if (sample->free_bytes < c->free_clear_bytes) not_clear |= PRESSURE_STORAGE;
+    }
+    if (sample->temp_known){
+        if (sample->temp_mc >= c->temp_high_mc) over |= PRESSURE_THERMAL;
+        if (sample->temp_mc > c->temp_clear_mc) not_clear |= PRESSURE_THERMAL;
+    }
+    if (sample->queue_pct >= c->queue_high_pct) over |= PRESSURE_QUEUE;
+    if (sample->queue_pct > c->queue_clear_pct) not_clear |= PRESSURE_QUEUE;
+    pc->reasons = over;
+
+    // Between the marks nothing moves and both runs start over
+    pc->over = over ? pc->over + 1 : 0;
+    pc->clear = not_clear ? 0 : pc->clear + 1;
+
+    if (pc->over >= c->degrade_samples && pc->level < PRESSURE_LEVELS - 1){
+        ++pc->level;
+        pc->over = 0;
+        return 1;
+    }
+    if (pc->clear >= c->recover_samples && pc->level > 0){
+        --pc->level;
+        pc->clear = 0;
+        return -1;
+    }
+    return 0;
+}
+
+const pressure_step *pressure_step_for(int level){
+    if (level < 0) level = 0;
+    if (level >= PRESSURE_LEVELS) level = PRESSURE_LEVELS - 1;
+    return &ladder[level];
+}
@@ -0,0 +1,228 @@
+#include "cv_pi5/pretrigger.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+bool pretrigger_init(pretrigger_buffer *pb, size_t arena_bytes, size_t max_packets, uint64_t window_ns){
+    /*
+        Allocates and prefaults the whole buffer so appending never allocates
+        or page-faults on the hot path.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!pb || arena_bytes == 0 || max_packets == 0){errno = EINVAL;return false;}
+    memset(pb, 0, sizeof *pb);
+
+    void *arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (arena == MAP_FAILED) return false;
+    (void)mlock(arena, arena_bytes); // Best effort, RLIMIT_MEMLOCK is often small
+
+    pb->entries = calloc(max_packets, sizeof *pb->entries);
+    if (!pb->entries){munmap(arena, arena_bytes);errno = ENOMEM;return false;}
+
+    pb->arena = arena;
+    pb->arena_size = arena_bytes;
+    pb->max_entries = max_packets;
+    pb->window_ns = window_ns;
+    return true;
+}
+
+bool pretrigger_init_pooled(pretrigger_buffer *pb, buffer_pool *pool, size_t budget_bytes, size_t max_packets, uint64_t window_ns){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!pb || !pool || budget_bytes == 0 || max_packets == 0){errno = EINVAL;return false;}
+    memset(pb, 0, sizeof *pb);
+
+    pb->entries = calloc(max_packets, sizeof *pb->entries);
+    if (!pb->entries){errno = ENOMEM;return false;}
+
+    pb->pool = pool;
+    pb->arena_size = budget_bytes;
+    pb->max_entries = max_packets;
+    pb->window_ns = window_ns;
+    return true;
+}
+
+void pretrigger_destroy(pretrigger_buffer *pb){
+    if (!pb) return;
+    if (pb->pool) pretrigger_clear(pb);
+    if (pb->arena) munmap(pb->arena, pb->arena_size);
+    free(pb->entries);
+    memset(pb, 0, sizeof *pb);
+}
+
+static pretrigger_entry *entry_at(pretrigger_buffer *pb, size_t i){
+    return &pb->entries[(pb->first + i) % pb->max_entries];
+}
+
+static size_t next_keyframe(pretrigger_buffer *pb){
+    /*
+        Position of the second keyframe, i.e. where the buffer would start
+        after evicting the oldest group of pictures; count if there is none
+    */
+    size_t i = 1;
+    while (i < pb->count && !(entry_at(pb, i)->flags & PACKET_FLAG_KEYFRAME)) ++i;
+    return i;
+}
+
+static void drop_entries(pretrigger_buffer *pb, size_t n){
+    if (pb->pool){
+        for (size_t i = 0; i < n; ++i){
+            const pretrigger_entry *e = entry_at(pb, i);
+            pb->pooled_bytes -= buffer_pool_size(pb->pool, e->buffer);
+            buffer_pool_unref(pb->pool, e->buffer);
+        }
+    }
+}
+
+static void evict_oldest_gop(pretrigger_buffer *pb){
+    size_t n = next_keyframe(pb);
+    drop_entries(pb, n);
+    pb->first = (pb->first + n) % pb->max_entries;
+    pb->count -= n;
+    if (pb->count == 0) pb->head = 0;
+    ++pb->evicted_gops;
+}
+
+static bool find_space(pretrigger_buffer *pb, size_t size, size_t *offset){
+    /*
+        Finds a contiguous free region in the arena. Packets never straddle
+        the end of the arena; when the tail is too short the packet goes to
+        the start and the tail is left unused until the data before it is
+        evicted.
+    */
+    if (pb->count == 0){pb->head = 0; *offset = 0; return true;}
+
+    size_t oldest = entry_at(pb, 0)->offset;
+    if (pb->head > oldest){ // Live data is [oldest, head)
+        if (pb->arena_size - pb->head >= size){*offset = pb->head; return true;}
+        if (oldest >= size){*offset = 0; return true;}
+    } else { // Wrapped: live data is [oldest, end) and [0, head)
+        if (oldest - pb->head >= size){*offset = pb->head; return true;}
+    }
+    return false;
+}
+
+static bool admit(pretrigger_buffer *pb, size_t size, uint64_t pts_ns, bool keyframe){
+    /*
+        Whether a packet may be added at all, after dropping history that is
+        older than the window needs, one group of pictures at a time
+    */
+    if (size == 0 || size > pb->arena_size || (pb->count == 0 && !keyframe)){++pb->rejected; return false;}
+
+    while (pb->count > 0){
+        size_t k = next_keyframe(pb);
+        if (k == pb->count && !keyframe) break; // Only one group buffered and this packet continues it
+        uint64_t next_start = k < pb->count ? entry_at(pb, k)->pts_ns : pts_ns;
+        if (pts_ns < next_start || pts_ns - next_start < pb->window_ns) break;
+        evict_oldest_gop(pb);
+    }
+    return true;
+}
+
+static pretrigger_entry *append_entry(pretrigger_buffer *pb, size_t offset, size_t size, uint64_t pts_ns, uint32_t flags){
+    pretrigger_entry *e = &pb->entries[(pb->first + pb->count) % pb->max_entries];
+    e->offset = offset;
+    e->size = size;
+    e->pts_ns = pts_ns;
+    e->flags = flags;
+    ++pb->count;
+    return e;
+}
+
+static bool make_pooled_room(pretrigger_buffer *pb, size_t held, bool keyframe){
+    // Evicts until one more entry holding held bytes fits the budget
+    while (pb->count == pb->max_entries || pb->pooled_bytes + held > pb->arena_size){
+        if (pb->count == 0){++pb->rejected; return false;} // The buffer alone is over budget
+        evict_oldest_gop(pb);
+        if (pb->count == 0 && !keyframe){++pb->rejected; return false;}
+    }
+    return true;
+}
+
+static uint8_t *reserve_pooled(pretrigger_buffer *pb, size_t size, uint64_t pts_ns, uint32_t flags){
+    bool keyframe = flags & PACKET_FLAG_KEYFRAME;
+    uint32_t buffer;
+    while ((buffer = buffer_pool_get(pb->pool, size)) == BUFFER_POOL_NONE){ // Our own history may be what is holding the pool
+        if (pb->count == 0){++pb->rejected; return NULL;}
+        evict_oldest_gop(pb);
+        if (pb->count == 0 && !keyframe){++pb->rejected; return NULL;}
+    }
+    size_t held = buffer_pool_size(pb->pool, buffer);
+    if (!make_pooled_room(pb, held, keyframe)){buffer_pool_unref(pb->pool, buffer); return NULL;}
+
+    append_entry(pb, 0, size, pts_ns, flags)->buffer = buffer;
+    pb->pooled_bytes += held;
+    return buffer_pool_data(pb->pool, buffer);
+}
+
+uint8_t *pretrigger_reserve(pretrigger_buffer *pb, size_t size, uint64_t pts_ns, uint32_t flags){
+    bool keyframe = flags & PACKET_FLAG_KEYFRAME;
+    if (!admit(pb, size, pts_ns, keyframe)) return NULL;
+    if (pb->pool) return reserve_pooled(pb, size, pts_ns, flags);
+
+    size_t offset;
+    while (pb->count == pb->max_entries || !find_space(pb, size, &offset)){
+        evict_oldest_gop(pb);
+        if (pb->count == 0 && !keyframe){++pb->rejected; return NULL;} // The group this packet belonged to is gone
+    }
+
+    append_entry(pb, offset, size, pts_ns, flags);
+    pb->head = offset + size;
+    return pb->arena + offset;
+}
+
+bool pretrigger_append(pretrigger_buffer *pb, const encoded_packet *pkt){
+    uint8_t *dst = pretrigger_reserve(pb, pkt->size, pkt->pts_ns, pkt->flags);
+    if (!dst) return false;
+    memcpy(dst, pkt->data, pkt->size);
+    return true;
+}
+
+bool pretrigger_append_buffer(pretrigger_buffer *pb, const encoded_packet *pkt, uint32_t buffer){
+    if (!pb->pool){errno = EINVAL;return false;}
+    bool keyframe = pkt->flags & PACKET_FLAG_KEYFRAME;
+    if (!admit(pb, pkt->size, pkt->pts_ns, keyframe)) return false;
+
+    size_t held = buffer_pool_size(pb->pool, buffer);
+    if (!make_pooled_room(pb, held, keyframe)) return false;
+
+    buffer_pool_ref(pb->pool, buffer);
+    const size_t offset = (size_t)(pkt->data - buffer_pool_data(pb->pool, buffer));
+    append_entry(pb, offset, pkt->size, pkt->pts_ns, pkt->flags)->buffer = buffer;
+    pb->pooled_bytes += held;
+    return true;
+}
+
+static const uint8_t *entry_data(const pretrigger_buffer *pb, const pretrigger_entry *e){
+    return pb->pool ? buffer_pool_data(pb->pool, e->buffer) + e->offset : pb->arena + e->offset;
+}
+
+bool pretrigger_flush(pretrigger_buffer *pb, pretrigger_sink sink, void *ctx){
+    bool ok = true;
+    for (size_t i = 0; i < pb->count && ok; ++i){
+        const pretrigger_entry *e = entry_at(pb, i);
+        encoded_packet pkt = { .data = entry_data(pb, e), .size = e->size, .pts_ns = e->pts_ns, .flags = e->flags };
+        ok = sink(ctx, &pkt);
+    }
+    pretrigger_clear(pb);
+    return ok;
+}
+
+void pretrigger_clear(pretrigger_buffer *pb){
+    drop_entries(pb, pb->count);
+    pb->first = 0;
+    pb->count = 0;
+    pb->head = 0;
+}
+
+uint64_t pretrigger_span_ns(const pretrigger_buffer *pb){
+    if (pb->count < 2) return 0;
+    const pretrigger_entry *oldest = &pb->entries[pb->first];
+    const pretrigger_entry *newest = &pb->entries[(pb->first + pb->count - 1) % pb->max_entries];
+    return newest->pts_ns - oldest->pts_ns;
+}
@@ -0,0 +1,251 @@
+#include "cv_pi5/sidecar.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#ifdef CV_PI5_HAVE_JPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+
+#define SIDECAR_JPEG_QUALITY 80
+
+void motion_log_record(motion_log *log, uint64_t timestamp_ns, uint32_t score){
+    uint32_t i = log->next++ % MOTION_LOG_SLOTS;
+    atomic_store_explicit(&log->timestamps[i], 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // A reader that sees the new score sees the slot cleared first
+    atomic_store_explicit(&log->scores[i], score, memory_order_relaxed);
+    atomic_store_explicit(&log->timestamps[i], timestamp_ns ? timestamp_ns : 1, memory_order_release);
+}
+
+uint32_t motion_log_lookup(const motion_log *log, uint64_t timestamp_ns){
+    uint32_t best = SEEK_SCORE_UNKNOWN;
+    uint64_t best_distance = MOTION_LOG_MATCH_NS + 1;
+    for (uint32_t i = 0; i < MOTION_LOG_SLOTS; ++i){
+        uint64_t t = atomic_load_explicit(&log->timestamps[i], memory_order_acquire);
+        if (!t) continue;
+        uint32_t score = atomic_load_explicit(&log->scores[i], memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&log->timestamps[i], memory_order_relaxed) != t) continue; // Rewritten under us
+        uint64_t distance = t > timestamp_ns ? t - timestamp_ns : timestamp_ns - t;
+        if (distance < best_distance){best = score; best_distance = distance;}
+    }
+    return best;
+}
+
+void seek_index_note(seek_index *ix, const encoded_packet *pkt, uint64_t offset){
+    if (!ix->started){
+        ix->started = true;
+        ix->header.start_pts_ns = pkt->pts_ns;
+        if (ix->clock) ix->header.start_wall_ns = wall_clock_to_wall(ix->clock, pkt->pts_ns);
+    }
+    if (!(pkt->flags & PACKET_FLAG_KEYFRAME)) return;
+
+    if (ix->header.entry_count == ix->capacity){ // A keyframe a second grows it once a minute at most
+        uint32_t capacity = ix->capacity ? ix->capacity * 2 : 64;
+        seek_index_entry *entries = realloc(ix->entries, (size_t)capacity * sizeof *entries);
+        if (!entries){ix->truncated = true;return;}
+        ix->entries = entries;
+        ix->capacity = capacity;
+    }
+    ix->entries[ix->header.entry_count++] = (seek_index_entry){
+        .offset = offset,
+        .time_ns = pkt->pts_ns > ix->header.start_pts_ns ? pkt->pts_ns - ix->header.start_pts_ns : 0,
+        .motion_score = ix->scores ? motion_log_lookup(ix->scores, pkt->pts_ns) : SEEK_SCORE_UNKNOWN,
+    };
+}
+
+bool sidecar_thumbnails_supported(void){
+#ifdef CV_PI5_HAVE_JPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool sidecar_thumbnail_take(sidecar_thumbnail *t, const capture_device *cap, const capture_frame *frame){
+    /*
+        Nearest neighbour from the rows the thumbnail samples, each converted
+        whole by pixconv: a pass over a sliver of the frame, cheap enough
+        for the capture thread once a clip.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!t || !cap || !frame || frame->index >= cap->buffer_count){errno = EINVAL;return false;}
+    if (t->ready || !t->pixels) return true;
+    if (cap->width != t->source_width){errno = EINVAL;return false;}
+    if (!t->planned && !(t->planned = pixconv_plan(&t->conv, cap->pixelformat, V4L2_PIX_FMT_YUV24, cap->width))) return false;
+
+    pixconv_image src, row = { .planes = { t->row } };
+    if (!pixconv_capture_image(&src, cap, frame)) return false;
+    uint8_t *out = t->pixels;
+    for (uint32_t ty = 0; ty < t->height; ++ty){
+        pixconv_row(&t->conv, &src, &row, (uint32_t)((size_t)ty * cap->height / t->height), 0);
+        for (uint32_t tx = 0; tx < t->width; ++tx, out += 3) memcpy(out, t->row + (size_t)tx * cap->width / t->width * 3, 3);
+    }
+    t->ready = true;
+    return true;
+}
+
+typedef bool (*sidecar_fill_fn)(FILE *f, const sidecar_job *job);
+
+static bool fill_index(FILE *f, const sidecar_job *job){
+    const seek_index *ix = &job->index;
+    if (fwrite(&ix->header, sizeof ix->header, 1, f) != 1) return false;
+    if (ix->header.entry_count && fwrite(ix->entries, sizeof *ix->entries, ix->header.entry_count, f) != ix->header.entry_count) return false;
+    return true;
+}
+
+#ifdef CV_PI5_HAVE_JPEG
+typedef struct {
+    struct jpeg_error_mgr base;
+    jmp_buf escape;
+} jpeg_error;
+
+static void on_jpeg_error(j_common_ptr c){
+    longjmp(((jpeg_error *)c->err)->escape, 1); // The default handler exit()s the whole process
+}
+
+static bool fill_thumbnail(FILE *f, const sidecar_job *job){
+    const sidecar_thumbnail *t = &job->thumb;
+    struct jpeg_compress_struct c;
+    jpeg_error err;
+    c.err = jpeg_std_error(&err.base);
+    err.base.error_exit = on_jpeg_error;
+    if (setjmp(err.escape)){jpeg_destroy_compress(&c); errno = EIO; return false;}
+
+    jpeg_create_compress(&c);
+    jpeg_stdio_dest(&c, f);
+    c.image_width = t->width;
+    c.image_height = t->height;
+    c.input_components = 3;
+    c.in_color_space = JCS_YCbCr; // Compressed as captured, no colour conversion
+    jpeg_set_defaults(&c);
+    jpeg_set_quality(&c, SIDECAR_JPEG_QUALITY, TRUE);
+    jpeg_start_compress(&c, TRUE);
+    while (c.next_scanline < c.image_height){
+        JSAMPROW row = t->pixels + (size_t)c.next_scanline * t->width * 3;
+        (void)jpeg_write_scanlines(&c, &row, 1);
+    }
+    jpeg_finish_compress(&c);
+    jpeg_destroy_compress(&c);
+    return !ferror(f);
+}
+#else
+static bool fill_thumbnail(FILE *f, const sidecar_job *job){
+    (void)f; (void)job;
+    errno = ENOTSUP;
+    return false;
+}
+#endif
+
+static bool write_sidecar(int dir_fd, const sidecar_job *job, const char *suffix, sidecar_fill_fn fill){
+    /*
+        Through a hidden temp file, renamed over once complete. Not synced:
+        a power cut can cost a thumbnail, never footage
+        If successful returns true
+        else returns false and an errno
+    */
+    char temp[CLIP_NAME_MAX + 16], final[CLIP_NAME_MAX + 8];
+    snprintf(temp, sizeof temp, ".%s%s.tmp", job->name, suffix);
+    snprintf(final, sizeof final, "%s%s", job->name, suffix);
+
+    int fd = openat(dir_fd, temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    FILE *f = fdopen(fd, "wb");
+    if (!f){int saved = errno; close(fd); (void)unlinkat(dir_fd, temp, 0); errno = saved; return false;}
+
+    bool ok = fill(f, job);
+    int saved = errno;
+    if (fclose(f) != 0 && ok){ok = false; saved = errno;}
+    if (ok && renameat(dir_fd, temp, dir_fd, final) != 0){ok = false; saved = errno;}
+    if (!ok) (void)unlinkat(dir_fd, temp, 0);
+    errno = saved;
+    return ok;
+}
+
+sidecar_job *sidecar_job_create(uint32_t width, uint32_t height, bool index, uint32_t thumb_width){
+    /*
+        If successful returns the job
+        else returns NULL and an errno
+    */
+    sidecar_job *job = calloc(1, sizeof *job);
+    if (!job){errno = ENOMEM;return NULL;}
+    job->want_index = index;
+    job->index.header = (seek_index_header){ .magic = SEEK_INDEX_MAGIC, .version = SEEK_INDEX_VERSION, .width = width, .height = height };
+
+    if (thumb_width && width && height && sidecar_thumbnails_supported()){
+        uint32_t tw = thumb_width < width ? thumb_width : width;
+        uint32_t th = (uint32_t)((uint64_t)height * tw / width);
+        job->thumb.width = tw;
+        job->thumb.height = th ? th : 1;
+        job->thumb.source_width = width;
+        job->thumb.pixels = malloc((size_t)job->thumb.width * job->thumb.height * 3);
+        job->thumb.row = malloc((size_t)width * 3);
+        if (!job->thumb.pixels || !job->thumb.row){sidecar_job_destroy(job);errno = ENOMEM;return NULL;}
+    }
+    return job;
+}
+
+bool sidecar_job_set_clip(sidecar_job *job, const char *dir, const char *name, const motion_log *scores){
+    if (!job || !dir || !name){errno = EINVAL;return false;}
+    if (strlen(dir) >= sizeof job->dir || strlen(name) >= sizeof job->name){errno = ENAMETOOLONG;return false;}
+    strcpy(job->dir, dir);
+    strcpy(job->name, name);
+    if (scores){
+        for (uint32_t i = 0; i < MOTION_LOG_SLOTS; ++i){ // Slot by slot, the detector's thread may still be recording
+            uint64_t t = atomic_load_explicit(&scores->timestamps[i], memory_order_acquire);
+            uint32_t score = atomic_load_explicit(&scores->scores[i], memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&scores->timestamps[i], memory_order_relaxed) != t) t = 0;
+            atomic_store_explicit(&job->scores.scores[i], score, memory_order_relaxed);
+            atomic_store_explicit(&job->scores.timestamps[i], t, memory_order_relaxed);
+        }
+    }
+    job->index.scores = NULL; // The live log goes away with the session; from here on the copy is used
+    return true;
+}
+
+void sidecar_job_run(void *arg){
+    sidecar_job *job = arg;
+    TRACE_BEGIN("sidecars");
+    int dir_fd = open(job->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    bool present = dir_fd >= 0 && fstatat(dir_fd, job->name, &st, 0) == 0; // Evicted while queued: nothing left to describe
+    uint64_t written = 0, failed = 0;
+
+    seek_index *ix = &job->index;
+    if (job->want_index && ix->started){
+        for (uint32_t i = 0; i < ix->header.entry_count; ++i) // Keyframes written before their low-res frame was scored
+            if (ix->entries[i].motion_score == SEEK_SCORE_UNKNOWN)
+                ix->entries[i].motion_score = motion_log_lookup(&job->scores, ix->header.start_pts_ns + ix->entries[i].time_ns);
+        if (present && write_sidecar(dir_fd, job, CLIP_SEEK_INDEX_SUFFIX, fill_index)) ++written;
+        else ++failed;
+    }
+    if (job->thumb.ready){
+        if (present && write_sidecar(dir_fd, job, CLIP_THUMBNAIL_SUFFIX, fill_thumbnail)) ++written;
+        else ++failed;
+    }
+    if (written) metrics_count(METRIC_SIDECARS_WRITTEN, written);
+    if (failed || ix->truncated) metrics_count(METRIC_SIDECAR_ERRORS, failed + ix->truncated);
+
+    if (dir_fd >= 0) close(dir_fd);
+    sidecar_job_destroy(job);
+    TRACE_END();
+}
+
+void sidecar_job_destroy(sidecar_job *job){
+    if (!job) return;
+    free(job->index.entries);
+    free(job->thumb.pixels);
+    free(job->thumb.row);
+    free(job);
+}
@@ -0,0 +1,246 @@
+#include "cv_pi5/storage.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *const sidecar_suffixes[] = { CLIP_THUMBNAIL_SUFFIX, CLIP_SEEK_INDEX_SUFFIX };
+
+clip_class clip_class_of(const char *name){
+    const char *dot = name ? strrchr(name, '.') : NULL;
+    size_t n = strlen(CLIP_MANUAL_MARK);
+    if (dot && (size_t)(dot - name) > n && !strncmp(dot - n, CLIP_MANUAL_MARK, n)) return CLIP_CLASS_MANUAL;
+    return CLIP_CLASS_MOTION;
+}
+
+bool clip_rename(int from_dir_fd, const char *from, int to_dir_fd, const char *to){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (renameat2(from_dir_fd, from, to_dir_fd, to, RENAME_NOREPLACE) == 0) return true;
+    if (errno != EINVAL && errno != ENOSYS) return false;
+    // A filesystem without RENAME_NOREPLACE: a hard link fails the same way on a taken name
+    if (linkat(from_dir_fd, from, to_dir_fd, to, 0) == 0){(void)unlinkat(from_dir_fd, from, 0); return true;}
+    if (errno != EPERM && errno != EOPNOTSUPP) return false;
+    // Nor links (FAT): check first, which only another process racing for the name can defeat
+    if (faccessat(to_dir_fd, to, F_OK, AT_SYMLINK_NOFOLLOW) == 0){errno = EEXIST;return false;}
+    return renameat(from_dir_fd, from, to_dir_fd, to) == 0;
+}
+
+bool clip_delete(int dir_fd, const char *name){
+    /*
+        If successful returns true
+        else returns false and an errno, with the sidecars left
+    */
+    if (unlinkat(dir_fd, name, 0) != 0 && errno != ENOENT) return false; // Already gone is fine
+    char path[CLIP_NAME_MAX + 8];
+    for (size_t i = 0; i < sizeof sidecar_suffixes / sizeof *sidecar_suffixes; ++i){
+        snprintf(path, sizeof path, "%s%s", name, sidecar_suffixes[i]);
+        (void)unlinkat(dir_fd, path, 0); // Most clips have them, a missing one is fine
+    }
+    return true;
+}
+
+static bool older(const clip_entry *a, const clip_entry *b){
+    if (a->mtime_ns != b->mtime_ns) return a->mtime_ns < b->mtime_ns;
+    return strcmp(a->name, b->name) < 0; // Same mtime: the sortable file names break the tie
+}
+
+static void swap_entries(clip_entry *a, clip_entry *b){
+    clip_entry t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void sift_up(clip_heap *h, size_t i){
+    while (i > 0){
+        size_t parent = (i - 1) / 2;
+        if (!older(&h->heap[i], &h->heap[parent])) break;
+        swap_entries(&h->heap[i], &h->heap[parent]);
+        i = parent;
+    }
+}
+
+static void sift_down(clip_heap *h, size_t i){
+    for (;;){
+        size_t l = 2 * i + 1, r = l + 1, smallest = i;
+        if (l < h->count && older(&h->heap[l], &h->heap[smallest])) smallest = l;
+        if (r < h->count && older(&h->heap[r], &h->heap[smallest])) smallest = r;
+        if (smallest == i) break;
+        swap_entries(&h->heap[i], &h->heap[smallest]);
+        i = smallest;
+    }
+}
+
+bool clip_index_add(clip_index *idx, const char *name, uint64_t bytes, int64_t mtime_ns){
+    if (!idx || !name || !*name || strlen(name) >= CLIP_NAME_MAX){errno = EINVAL;return false;}
+
+    clip_class kind = clip_class_of(name);
+    clip_heap *h = &idx->classes[kind];
+    if (h->count == h->capacity){ // Grows rarely: doubling, and only when a clip is added
+        size_t capacity = h->capacity ? h->capacity * 2 : 1024;
+        clip_entry *heap = realloc(h->heap, capacity * sizeof *heap);
+        if (!heap){errno = ENOMEM;return false;}
+        h->heap = heap;
+        h->capacity = capacity;
+    }
+
+    clip_entry *e = &h->heap[h->count];
+    strcpy(e->name, name);
+    e->bytes = bytes;
+    e->mtime_ns = mtime_ns;
+    e->kind = kind;
+    sift_up(h, h->count++);
+    h->bytes += bytes;
+    idx->count++;
+    idx->total_bytes += bytes;
+    return true;
+}
+
+static bool add_stat(clip_index *idx, const char *name, const struct stat *st){
+    int64_t mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000ll + st->st_mtim.tv_nsec;
+    return clip_index_add(idx, name, (uint64_t)st->st_blocks * 512u, mtime_ns); // Allocated size is what eviction frees
+}
+
+bool clip_index_add_file(clip_index *idx, const char *name){
+    struct stat st;
+    if (!idx || !name || strlen(name) >= CLIP_NAME_MAX || !clip_name_valid(name)){errno = EINVAL;return false;} // Nothing else is ever evicted
+    if (fstatat(idx->dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return false;
+    if (!S_ISREG(st.st_mode)){errno = EINVAL;return false;}
+    return add_stat(idx, name, &st);
+}
+
+bool clip_index_open(clip_index *idx, const char *dir){
+    /*
+        The only full scan of the directory this index ever does.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!idx || !dir || !*dir){errno = EINVAL;return false;}
+    memset(idx, 0, sizeof *idx);
+
+    idx->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (idx->dir_fd < 0) return false;
+
+    int scan_fd = dup(idx->dir_fd); // fdopendir() takes ownership of its fd
+    DIR *d = scan_fd >= 0 ? fdopendir(scan_fd) : NULL;
+    if (!d){int saved = errno; if (scan_fd >= 0) close(scan_fd); close(idx->dir_fd); errno = saved; return false;}
+
+    struct dirent *de;
+    bool ok = true;
+    while (ok && (de = readdir(d))){
+        if (de->d_type != DT_REG && de->d_type != DT_UNKNOWN) continue;
+        // Clips only: not ".", "..", in-progress temp files, sidecars or anyone else's files
+        if (strlen(de->d_name) >= CLIP_NAME_MAX || !clip_name_valid(de->d_name)) continue;
+
+        struct stat st;
+        if (fstatat(idx->dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        ok = add_stat(idx, de->d_name, &st);
+    }
+    int saved = errno;
+    closedir(d);
+    if (!ok){clip_index_close(idx);errno = saved;return false;}
+    return true;
+}
+
+void clip_index_close(clip_index *idx){
+    if (!idx) return;
+    if (idx->dir_fd >= 0) close(idx->dir_fd);
+    for (int c = 0; c < CLIP_CLASS_COUNT; ++c) free(idx->classes[c].heap);
+    memset(idx, 0, sizeof *idx);
+    idx->dir_fd = -1;
+}
+
+void clip_index_set_retention(clip_index *idx, const uint32_t retention_s[CLIP_CLASS_COUNT]){
+    for (int c = 0; c < CLIP_CLASS_COUNT; ++c) idx->retention_s[c] = retention_s[c];
+}
+
+static double spent(const clip_index *idx, const clip_entry *e, int64_t now_ns){
+    // Share of its retention the clip has used up; 0 for a class kept indefinitely
+    uint32_t retention = idx->retention_s[e->kind];
+    if (!retention || now_ns <= e->mtime_ns) return 0.0;
+    return (double)(now_ns - e->mtime_ns) / 1e9 / retention;
+}
+
+static int next_class(const clip_index *idx, int64_t now_ns){
+    // Each heap's head is its class's oldest, so only the heads compete
+    int best = -1;
+    double best_spent = 0.0;
+    for (int c = 0; c < CLIP_CLASS_COUNT; ++c){
+        const clip_heap *h = &idx->classes[c];
+        if (!h->count) continue;
+        double s = spent(idx, &h->heap[0], now_ns);
+        if (best < 0 || s > best_spent || (s == best_spent && older(&h->heap[0], &idx->classes[best].heap[0]))){best = c; best_spent = s;}
+    }
+    return best;
+}
+
+bool clip_index_next(const clip_index *idx, int64_t now_ns, clip_entry *next, bool *expired){
+    int c = idx ? next_class(idx, now_ns) : -1;
+    if (c < 0){errno = ENOENT;return false;}
+    const clip_entry *e = &idx->classes[c].heap[0];
+    if (next) *next = *e;
+    if (expired) *expired = spent(idx, e, now_ns) >= 1.0;
+    return true;
+}
+
+bool clip_index_take_next(clip_index *idx, int64_t now_ns, clip_entry *taken){
+    int c = idx ? next_class(idx, now_ns) : -1;
+    if (c < 0){errno = ENOENT;return false;}
+    clip_heap *h = &idx->classes[c];
+    clip_entry e = h->heap[0];
+    h->heap[0] = h->heap[--h->count];
+    sift_down(h, 0);
+    h->bytes -= e.bytes;
+    idx->count--;
+    idx->total_bytes -= e.bytes;
+    if (taken) *taken = e;
+    return true;
+}
+
+bool clip_index_evict_next(clip_index *idx, clip_entry *evicted){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000ll + now.tv_nsec;
+    clip_entry next;
+    if (!clip_index_next(idx, now_ns, &next, NULL)) return false;
+    if (!clip_delete(idx->dir_fd, next.name)) return false; // Still indexed, for the next try
+    (void)clip_index_take_next(idx, now_ns, &next);
+    idx->evicted_clips++;
+    idx->evicted_bytes += next.bytes;
+    if (evicted) *evicted = next;
+    return true;
+}
+
+bool clip_index_free_bytes(const clip_index *idx, uint64_t *free_bytes){
+    struct statvfs vfs;
+    if (!idx || fstatvfs(idx->dir_fd, &vfs) != 0) return false;
+    *free_bytes = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+    return true;
+}
+
+int clip_index_make_space(clip_index *idx, uint64_t needed_bytes){
+    uint64_t free_bytes;
+    if (!clip_index_free_bytes(idx, &free_bytes)) return -1;
+
+    // Count on the index for what each deletion frees instead of asking the filesystem every time
+    int evicted = 0;
+    while (free_bytes < needed_bytes){
+        clip_entry next;
+        if (!clip_index_evict_next(idx, &next)){
+            if (errno == ENOENT) errno = ENOSPC;
+            return -1;
+        }
+        free_bytes += next.bytes;
+        ++evicted;
+    }
+    return evicted;
+}
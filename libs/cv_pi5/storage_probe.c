@@ -0,0 +1,90 @@
+#include "cv_pi5/storage_probe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+static void find_mount(storage_probe *p){
+    /*
+        The mountinfo line for the directory's device; with several (bind
+        mounts) the last one wins, which is the one on top
+    */
+    FILE *f = fopen("/proc/self/mountinfo", "re");
+    if (!f) return;
+
+    char line[1024];
+    while (fgets(line, sizeof line, f)){
+        // id parent maj:min root mount-point options [optional...] - fstype source super-options
+        unsigned maj, min;
+        char mount_point[256];
+        if (sscanf(line, "%*u %*u %u:%u %*s %255s", &maj, &min, mount_point) != 3) continue;
+        if (makedev(maj, min) != p->dev) continue;
+
+        const char *sep = strstr(line, " - ");
+        char fs_type[32];
+        if (!sep || sscanf(sep + 3, "%31s", fs_type) != 1) continue;
+        memcpy(p->mount_point, mount_point, sizeof p->mount_point);
+        memcpy(p->fs_type, fs_type, sizeof p->fs_type);
+    }
+    fclose(f);
+}
+
+bool storage_probe_run(storage_probe *p, const char *dir){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!p || !dir || !*dir){errno = EINVAL;return false;}
+    memset(p, 0, sizeof *p);
+
+    struct stat st;
+    if (stat(dir, &st) != 0) return false;
+    if (!S_ISDIR(st.st_mode)){errno = ENOTDIR;return false;}
+    p->dev = st.st_dev;
+
+    struct statvfs vfs;
+    struct statfs fs;
+    if (statvfs(dir, &vfs) != 0 || statfs(dir, &fs) != 0) return false;
+    p->fs_magic = (uint64_t)fs.f_type;
+    p->block_size = (uint32_t)vfs.f_bsize;
+    p->free_bytes = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+    p->total_bytes = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+
+    // EROFS from access() covers read-only mounts too
+    p->writable = !(vfs.f_flag & ST_RDONLY) && access(dir, W_OK | X_OK) == 0;
+
+    if (p->writable){
+        int fd = open(dir, O_TMPFILE | O_WRONLY | O_DIRECT | O_CLOEXEC, 0600);
+        if (fd >= 0){p->direct_io = true; close(fd);}
+        else if (errno == EOPNOTSUPP || errno == EISDIR){ // No O_TMPFILE here, so O_DIRECT can't be told apart: let the clip file try
+            p->direct_io = true;
+        }
+    }
+
+    find_mount(p);
+    return true;
+}
+
+bool storage_probe_differs(const storage_probe *a, const storage_probe *b){
+    return a->dev != b->dev || a->writable != b->writable || a->direct_io != b->direct_io ||
+           a->fs_magic != b->fs_magic || strcmp(a->mount_point, b->mount_point) != 0;
+}
+
+int storage_probe_watch(void){
+    int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    storage_probe_watch_ack(fd); // The first read arms the change notification
+    return fd;
+}
+
+void storage_probe_watch_ack(int fd){
+    char buf[4096];
+    if (lseek(fd, 0, SEEK_SET) < 0) return;
+    while (read(fd, buf, sizeof buf) > 0){}
+}
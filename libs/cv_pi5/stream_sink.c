@@ -0,0 +1,273 @@
+#include "cv_pi5/stream_sink.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static int listen_on(uint16_t port){
+    /*
+        IPv6 with v4-mapped addresses where the kernel has IPv6, else IPv4.
+        If successful returns the socket
+        else returns -1 and an errno
+    */
+    int one = 1, zero = 0;
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0){
+        struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_port = htons(port), .sin6_addr = IN6ADDR_ANY_INIT };
+        (void)setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof zero);
+        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        if (bind(fd, (const struct sockaddr *)&addr, sizeof addr) == 0 && listen(fd, STREAM_SINK_MAX_CLIENTS) == 0) return fd;
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        if (errno != EADDRNOTAVAIL && errno != EAFNOSUPPORT) return -1;
+    } else if (errno != EAFNOSUPPORT) return -1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof addr) != 0 || listen(fd, STREAM_SINK_MAX_CLIENTS) != 0){
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static void drop_client(stream_sink *s, stream_client *c){
+    (void)evloop_remove(&s->loop, c->fd);
+    close(c->fd);
+    free(c->tail);
+    *c = (stream_client){ .fd = -1 };
+    atomic_fetch_sub_explicit(&s->client_count, 1, memory_order_relaxed);
+}
+
+static bool keep_tail(stream_client *c, const uint8_t *data, size_t size){
+    /*
+        What the socket had no room for, the start of the tail already sent
+        dropped. Returns false when it cannot be held
+    */
+    size_t left = c->tail_size - c->tail_sent;
+    if (left + size > c->tail_capacity){
+        uint8_t *grown = malloc(left + size);
+        if (!grown) return false;
+        memcpy(grown, c->tail + c->tail_sent, left);
+        free(c->tail);
+        c->tail = grown;
+        c->tail_capacity = left + size;
+    } else {
+        memmove(c->tail, c->tail + c->tail_sent, left);
+    }
+    memcpy(c->tail + left, data, size);
+    c->tail_size = left + size;
+    c->tail_sent = 0;
+    return true;
+}
+
+static void send_batch(stream_sink *s, stream_client *c, uint64_t now){
+    // One sendmsg: the client's tail, then the batch from its start or, joining, its first keyframe
+    size_t from = c->synced ? 0 : s->batch_key;
+    bool wants_batch = from < s->batch_size;
+    struct iovec iov[2];
+    int count = 0;
+    size_t tail_left = c->tail_size - c->tail_sent;
+    if (tail_left) iov[count++] = (struct iovec){ .iov_base = c->tail + c->tail_sent, .iov_len = tail_left };
+    if (wants_batch) iov[count++] = (struct iovec){ .iov_base = s->batch + from, .iov_len = s->batch_size - from };
+    if (!count) return; // Waiting for a keyframe to join at
+
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t)count };
+    ssize_t n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN && errno != EINTR){drop_client(s, c);return;}
+    size_t sent = n > 0 ? (size_t)n : 0;
+    metrics_count(METRIC_STREAM_BYTES, sent);
+    atomic_fetch_add_explicit(&s->bytes_sent, sent, memory_order_relaxed);
+
+    if (sent < tail_left){
+        // Still behind on earlier batches: this one is skipped whole, and the client rejoins at a keyframe
+        c->tail_sent += sent;
+        if (wants_batch){c->synced = false; metrics_count(METRIC_STREAM_UNITS_SKIPPED, s->batch_units);}
+    } else {
+        sent -= tail_left;
+        c->tail_sent = c->tail_size = 0;
+        if (wants_batch){
+            c->synced = true;
+            if (sent < s->batch_size - from && !keep_tail(c, s->batch + from + sent, s->batch_size - from - sent)){drop_client(s, c);return;}
+        }
+    }
+    if (c->tail_size == c->tail_sent){c->behind_since_ns = 0;return;}
+    if (!c->behind_since_ns) c->behind_since_ns = now;
+    else if (now - c->behind_since_ns > (uint64_t)STREAM_SINK_STALL_MS * 1000000ull) drop_client(s, c);
+}
+
+static bool batch_write(void *ctx, const void *data, size_t length){
+    stream_sink *s = ctx;
+    if (s->batch_size + length > s->batch_capacity){
+        size_t capacity = s->batch_capacity ? s->batch_capacity : 256u << 10;
+        while (capacity < s->batch_size + length) capacity *= 2;
+        uint8_t *grown = realloc(s->batch, capacity);
+        if (!grown){errno = ENOMEM;return false;}
+        s->batch = grown;
+        s->batch_capacity = capacity;
+    }
+    memcpy(s->batch + s->batch_size, data, length);
+    s->batch_size += length;
+    return true;
+}
+
+static bool fill_batch(stream_sink *s){
+    /*
+        Muxes up to a batch of queued access units, releasing each once it is
+        in the batch. Returns false when the queue was empty
+    */
+    s->batch_size = 0;
+    s->batch_key = SIZE_MAX;
+    s->batch_units = 0;
+    packet_ring_item item;
+    while (s->batch_units < STREAM_SINK_BATCH_PACKETS && packet_ring_peek(&s->queue, &item)){
+        size_t start = s->batch_size;
+        bool key = item.pkt.flags & PACKET_FLAG_KEYFRAME;
+        if (s->mux.started || key){ // The stream opens on a keyframe, with its tables
+            size_t mux_start = s->batch_size;
+            if (ts_mux_packet(&s->mux, &item.pkt, batch_write, s) && ts_mux_flush(&s->mux, batch_write, s)){
+                if (key && s->batch_key == SIZE_MAX) s->batch_key = start;
+                ++s->batch_units;
+            } else {
+                s->batch_size = mux_start; // Out of memory: lose the access unit, resync on the next keyframe
+                ts_mux_restart(&s->mux);
+            }
+        }
+        packet_ring_release(&s->queue, &item);
+    }
+    return s->batch_units > 0 || packet_ring_peek(&s->queue, &item);
+}
+
+static void on_wake(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events;
+    stream_sink *s = ctx;
+    uint64_t count;
+    while (read(fd, &count, sizeof count) < 0 && errno == EINTR) {}
+    if (atomic_load_explicit(&s->stop, memory_order_acquire)){evloop_stop(loop);return;}
+
+    while (fill_batch(s)){
+        if (!s->batch_units) continue;
+        uint64_t now = metrics_now_ns();
+        TRACE_BEGIN("stream_send");
+        for (int i = 0; i < STREAM_SINK_MAX_CLIENTS; ++i)
+            if (s->clients[i].fd >= 0) send_batch(s, &s->clients[i], now);
+        TRACE_END();
+    }
+}
+
+static void on_client(evloop *loop, int fd, uint32_t events, void *ctx){
+    // Viewers have nothing to say: anything readable is a hangup, or ignored
+    (void)loop; (void)events;
+    stream_sink *s = ctx;
+    char discard[256];
+    ssize_t n;
+    while ((n = read(fd, discard, sizeof discard)) > 0) {}
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    for (int i = 0; i < STREAM_SINK_MAX_CLIENTS; ++i)
+        if (s->clients[i].fd == fd){drop_client(s, &s->clients[i]);return;}
+}
+
+static void on_accept(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events;
+    stream_sink *s = ctx;
+    int client;
+    while ((client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        stream_client *c = NULL;
+        for (int i = 0; i < STREAM_SINK_MAX_CLIENTS && !c; ++i)
+            if (s->clients[i].fd < 0) c = &s->clients[i];
+        if (!c || !evloop_add(loop, client, EPOLLIN | EPOLLRDHUP, on_client, s)){close(client);continue;} // Full: the viewer sees a hangup
+        int one = 1, sndbuf = STREAM_SINK_SNDBUF;
+        (void)setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one); // Batches are whole already
+        (void)setsockopt(client, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+        *c = (stream_client){ .fd = client };
+        atomic_fetch_add_explicit(&s->client_count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->clients_served, 1, memory_order_relaxed);
+    }
+}
+
+static void *sink_main(void *arg){
+    stream_sink *s = arg;
+    (void)evloop_run(&s->loop);
+    return NULL;
+}
+
+bool stream_sink_start(stream_sink *s, uint16_t port, encoder_codec codec, const wall_clock *clock){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!s){errno = EINVAL;return false;}
+    memset(s, 0, sizeof *s);
+    for (int i = 0; i < STREAM_SINK_MAX_CLIENTS; ++i) s->clients[i].fd = -1;
+    if (!ts_mux_init(&s->mux, codec, 1)) return false; // Tables at every keyframe, where viewers join
+    s->mux.clock = clock;
+    if (!packet_ring_init(&s->queue, STREAM_SINK_QUEUE_PACKETS, STREAM_SINK_QUEUE_BYTES, NULL, NULL)) return false;
+    if (!evloop_init(&s->loop)){int saved = errno; packet_ring_destroy(&s->queue); errno = saved; return false;}
+
+    int saved = 0;
+    s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s->listen_fd = s->wake_fd >= 0 ? listen_on(port) : -1;
+    if (s->listen_fd < 0 || !evloop_add(&s->loop, s->wake_fd, EPOLLIN, on_wake, s) ||
+        !evloop_add(&s->loop, s->listen_fd, EPOLLIN, on_accept, s)) saved = errno;
+    if (!saved && (saved = pthread_create(&s->thread, NULL, sink_main, s)) == 0) return true;
+
+    if (s->listen_fd >= 0) close(s->listen_fd);
+    if (s->wake_fd >= 0) close(s->wake_fd);
+    evloop_destroy(&s->loop);
+    packet_ring_destroy(&s->queue);
+    errno = saved;
+    return false;
+}
+
+void stream_sink_offer(stream_sink *s, const packet_ring_item *item){
+    if (item->ref != PACKET_RING_NO_REF) return;
+    bool key = item->pkt.flags & PACKET_FLAG_KEYFRAME;
+    if (s->gap && !key){metrics_count(METRIC_STREAM_QUEUE_DROPPED, 1);return;}
+
+    bool ok;
+    if (item->pool){
+        buffer_pool_ref(item->pool, item->buffer); // The sink's own, dropped when it releases the packet
+        ok = packet_ring_push_buffer(&s->queue, &item->pkt, item->pool, item->buffer);
+        if (!ok) buffer_pool_unref(item->pool, item->buffer);
+    } else {
+        ok = packet_ring_push(&s->queue, &item->pkt);
+    }
+    s->gap = !ok;
+    if (!ok){metrics_count(METRIC_STREAM_QUEUE_DROPPED, 1); TRACE_INSTANT("stream_queue_dropped");return;}
+
+    uint64_t one = 1;
+    ssize_t n;
+    do { n = write(s->wake_fd, &one, sizeof one); } while (n < 0 && errno == EINTR);
+}
+
+void stream_sink_stop(stream_sink *s){
+    if (!s) return;
+    atomic_store_explicit(&s->stop, true, memory_order_release);
+    uint64_t one = 1;
+    ssize_t n;
+    do { n = write(s->wake_fd, &one, sizeof one); } while (n < 0 && errno == EINTR);
+    pthread_join(s->thread, NULL);
+
+    for (int i = 0; i < STREAM_SINK_MAX_CLIENTS; ++i)
+        if (s->clients[i].fd >= 0) drop_client(s, &s->clients[i]);
+    packet_ring_item item;
+    while (packet_ring_peek(&s->queue, &item)) packet_ring_release(&s->queue, &item); // Pool references go back
+    close(s->listen_fd);
+    close(s->wake_fd);
+    evloop_destroy(&s->loop);
+    packet_ring_destroy(&s->queue);
+    free(s->batch);
+}
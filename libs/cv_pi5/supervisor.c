@@ -0,0 +1,227 @@
+#include "cv_pi5/supervisor.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/watchdog.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+static uint32_t percent(size_t used, size_t capacity){
+    return capacity ? (uint32_t)(used * 100 / capacity) : 0;
+}
+
+static void kick(supervisor *sv){
+    // A write pings every watchdog driver, and a plain file standing in for one
+    ssize_t n;
+    do { n = write(sv->watchdog_fd, "k", 1); } while (n < 0 && errno == EINTR);
+    if (n == 1){
+        atomic_fetch_add_explicit(&sv->kicks, 1, memory_order_relaxed);
+        metrics_count(METRIC_WATCHDOG_KICKS, 1);
+    }
+}
+
+static void disarm(supervisor *sv){
+    // The magic close: drivers without nowayout stop counting down
+    if (sv->watchdog_fd < 0) return;
+    ssize_t n;
+    do { n = write(sv->watchdog_fd, "V", 1); } while (n < 0 && errno == EINTR);
+    close(sv->watchdog_fd);
+    sv->watchdog_fd = -1;
+}
+
+static void step(supervisor_slot *slot, int by){
+    int action = atomic_load_explicit(&slot->action, memory_order_relaxed) + by;
+    if (action < SUPERVISOR_NOMINAL || action > SUPERVISOR_DROP_FRAMES) return;
+    atomic_store_explicit(&slot->action, action, memory_order_relaxed);
+    metrics_count(by > 0 ? METRIC_SUPERVISOR_ESCALATIONS : METRIC_SUPERVISOR_RECOVERIES, 1);
+    TRACE_COUNTER("supervisor_action", action);
+}
+
+static bool sample(supervisor *sv, supervisor_slot *slot, uint64_t now){
+    /*
+        Moves the slot's action along the ladder.
+        Returns false when the subject is stalled
+    */
+    const supervisor_subject *s = &slot->subject;
+    const supervisor_config *cfg = &sv->cfg;
+    uint64_t heartbeat = atomic_load_explicit(&s->loop->iterations, memory_order_relaxed);
+    if (heartbeat != slot->heartbeat){slot->heartbeat = heartbeat; slot->heartbeat_ns = now;}
+
+    uint32_t queue = 0;
+    if (s->frames){
+        frame_ring_stats fs;
+        frame_ring_get_stats(s->frames, &fs);
+        queue = percent(fs.occupancy, fs.capacity);
+    }
+    if (s->packets){
+        packet_ring_stats ps;
+        packet_ring_get_stats(s->packets, &ps);
+        uint32_t slots = percent(ps.occupancy, ps.capacity), arena = percent(ps.arena_used, ps.arena_size);
+        if (slots > queue) queue = slots;
+        if (arena > queue) queue = arena;
+        if (ps.popped != slot->progress){slot->progress = ps.popped; slot->progress_ns = now;}
+    } else {
+        slot->progress_ns = now; // Nothing to make progress on: the heartbeat is all there is
+    }
+    uint64_t write_ns = s->writer ? atomic_exchange_explicit(&s->writer->write_ns_max, 0, memory_order_relaxed) : 0;
+
+    uint64_t write_high_ns = (uint64_t)cfg->write_high_ms * 1000000ull;
+    bool over = queue >= cfg->queue_high_pct || (write_high_ns && write_ns >= write_high_ns);
+    bool clear = queue < cfg->queue_clear_pct && (!write_high_ns || write_ns < write_high_ns);
+    if (over){
+        slot->clear = 0;
+        if (++slot->over >= cfg->escalate_samples){slot->over = 0; step(slot, 1);}
+    } else if (clear){
+        slot->over = 0;
+        if (++slot->clear >= cfg->recover_samples){slot->clear = 0; step(slot, -1);}
+    } else {
+        slot->over = slot->clear = 0; // Between the thresholds: neither run goes on
+    }
+
+    uint64_t stall_ns = (uint64_t)cfg->stall_ms * 1000000ull;
+    uint64_t moved = slot->heartbeat_ns < slot->progress_ns ? slot->heartbeat_ns : slot->progress_ns;
+    bool stalled = now - moved >= stall_ns;
+    if (stalled && !slot->stalled){
+        atomic_fetch_add_explicit(&sv->stalls, 1, memory_order_relaxed);
+        metrics_count(METRIC_PIPELINE_STALLS, 1);
+        TRACE_INSTANT("pipeline_stall");
+    }
+    slot->stalled = stalled;
+    return !stalled;
+}
+
+static void *supervisor_main(void *arg){
+    supervisor *sv = arg;
+    struct timespec due;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    pthread_mutex_lock(&sv->lock);
+    while (!sv->stopping){
+        due.tv_sec += sv->cfg.interval_ms / 1000;
+        due.tv_nsec += (long)(sv->cfg.interval_ms % 1000) * 1000000L;
+        if (due.tv_nsec >= 1000000000L){due.tv_sec += 1; due.tv_nsec -= 1000000000L;}
+        while (!sv->stopping && pthread_cond_timedwait(&sv->wake, &sv->lock, &due) != ETIMEDOUT) {}
+        if (sv->stopping) break;
+
+        uint64_t now = metrics_now_ns();
+        bool healthy = true;
+        for (int i = 0; i < SUPERVISOR_MAX_SUBJECTS; ++i){
+            if (sv->slots[i].attached && !sample(sv, &sv->slots[i], now)) healthy = false;
+        }
+        if (healthy && sv->watchdog_fd >= 0) kick(sv);
+
+        struct timespec late;
+        clock_gettime(CLOCK_MONOTONIC, &late);
+        if (late.tv_sec > due.tv_sec + 1) due = late; // Suspended or starved: no burst of catch-up samples
+    }
+    pthread_mutex_unlock(&sv->lock);
+    return NULL;
+}
+
+static bool open_watchdog(supervisor *sv, const char *path){
+    /*
+        Opening arms the device: from here a failure disarms it again.
+        If successful returns true
+        else returns false and an errno
+    */
+    sv->watchdog_fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (sv->watchdog_fd < 0) return false;
+    struct stat st;
+    if (fstat(sv->watchdog_fd, &st) != 0 || !S_ISCHR(st.st_mode)) return true; // A stand-in file only counts kicks
+    int timeout = (int)sv->cfg.watchdog_timeout_s;
+    if (timeout && ioctl(sv->watchdog_fd, WDIOC_SETTIMEOUT, &timeout) != 0){
+        int saved = errno;
+        disarm(sv);
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+bool supervisor_start(supervisor *sv, const supervisor_config *cfg){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!sv || !cfg || !cfg->interval_ms || !cfg->stall_ms || !cfg->escalate_samples || !cfg->recover_samples ||
+        cfg->queue_clear_pct > cfg->queue_high_pct){errno = EINVAL;return false;}
+    memset(sv, 0, sizeof *sv);
+    sv->cfg = *cfg;
+    sv->cfg.watchdog = NULL; // Only needed until it is open, below
+    sv->watchdog_fd = -1;
+    for (int i = 0; i < SUPERVISOR_MAX_SUBJECTS; ++i) atomic_init(&sv->slots[i].action, SUPERVISOR_NOMINAL);
+    atomic_init(&sv->kicks, 0);
+    atomic_init(&sv->stalls, 0);
+
+    if (cfg->watchdog && *cfg->watchdog && !open_watchdog(sv, cfg->watchdog)) return false;
+
+    pthread_condattr_t attr; // Timed waits on CLOCK_MONOTONIC, which setting the time does not move
+    int r = pthread_condattr_init(&attr);
+    if (r == 0){
+        if ((r = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)) == 0 && (r = pthread_mutex_init(&sv->lock, NULL)) == 0 &&
+            (r = pthread_cond_init(&sv->wake, &attr)) != 0) pthread_mutex_destroy(&sv->lock);
+        pthread_condattr_destroy(&attr);
+    }
+    if (r == 0 && (r = pthread_create(&sv->thread, NULL, supervisor_main, sv)) != 0){
+        pthread_cond_destroy(&sv->wake);
+        pthread_mutex_destroy(&sv->lock);
+    }
+    if (r != 0){
+        disarm(sv);
+        errno = r;
+        return false;
+    }
+    return true;
+}
+
+int supervisor_attach(supervisor *sv, const supervisor_subject *subject){
+    if (!sv || !subject || !subject->loop){errno = EINVAL;return -1;}
+    uint64_t now = metrics_now_ns();
+    pthread_mutex_lock(&sv->lock);
+    for (int i = 0; i < SUPERVISOR_MAX_SUBJECTS; ++i){
+        supervisor_slot *slot = &sv->slots[i];
+        if (slot->attached) continue;
+        slot->subject = *subject;
+        slot->over = slot->clear = 0;
+        slot->heartbeat = atomic_load_explicit(&subject->loop->iterations, memory_order_relaxed);
+        slot->progress = 0;
+        slot->heartbeat_ns = slot->progress_ns = now; // Given stall_ms to show it is alive
+        slot->stalled = false;
+        atomic_store_explicit(&slot->action, SUPERVISOR_NOMINAL, memory_order_relaxed);
+        slot->attached = true;
+        pthread_mutex_unlock(&sv->lock);
+        return i;
+    }
+    pthread_mutex_unlock(&sv->lock);
+    errno = ENOSPC;
+    return -1;
+}
+
+void supervisor_detach(supervisor *sv, int slot){
+    // Under the lock: a sample in progress finishes with the subject's pointers before this returns
+    if (!sv || slot < 0 || slot >= SUPERVISOR_MAX_SUBJECTS) return;
+    pthread_mutex_lock(&sv->lock);
+    sv->slots[slot].attached = false;
+    pthread_mutex_unlock(&sv->lock);
+}
+
+supervisor_action supervisor_action_for(supervisor *sv, int slot){
+    if (!sv || slot < 0 || slot >= SUPERVISOR_MAX_SUBJECTS) return SUPERVISOR_NOMINAL;
+    return (supervisor_action)atomic_load_explicit(&sv->slots[slot].action, memory_order_relaxed);
+}
+
+void supervisor_stop(supervisor *sv){
+    if (!sv) return;
+    pthread_mutex_lock(&sv->lock);
+    sv->stopping = true;
+    pthread_cond_signal(&sv->wake);
+    pthread_mutex_unlock(&sv->lock);
+    pthread_join(sv->thread, NULL);
+    pthread_cond_destroy(&sv->wake);
+    pthread_mutex_destroy(&sv->lock);
+    disarm(sv);
+}
@@ -0,0 +1,69 @@
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define TRACE_EVENT_MAX 128 // bytes per marker line, names longer than that are cut
+
+static atomic_int marker_fd = -1;
+static int pid;
+
+static void emit(const char *line, int length){
+    int fd = atomic_load_explicit(&marker_fd, memory_order_relaxed);
+    if (fd < 0 || length <= 0) return;
+    if (length >= TRACE_EVENT_MAX) length = TRACE_EVENT_MAX - 1;
+    (void)write(fd, line, (size_t)length); // A full ftrace buffer drops the event, as the kernel's own do
+}
+
+bool trace_start(void){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    static const char *const paths[] = { "/sys/kernel/tracing/trace_marker", "/sys/kernel/debug/tracing/trace_marker" };
+    if (atomic_load_explicit(&marker_fd, memory_order_relaxed) >= 0) return true;
+    int fd = -1;
+    for (size_t i = 0; i < sizeof paths / sizeof paths[0] && fd < 0; ++i) fd = open(paths[i], O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    pid = (int)getpid();
+    int expected = -1;
+    if (!atomic_compare_exchange_strong(&marker_fd, &expected, fd)) close(fd); // Another thread got there first
+    return true;
+}
+
+void trace_stop(void){
+    // The fd stays open: a thread past the load in emit() may still write to it
+    atomic_store_explicit(&marker_fd, -1, memory_order_relaxed);
+}
+
+bool trace_enabled(void){
+    return atomic_load_explicit(&marker_fd, memory_order_relaxed) >= 0;
+}
+
+void trace_begin(const char *name){
+    if (!trace_enabled()) return;
+    char line[TRACE_EVENT_MAX];
+    emit(line, snprintf(line, sizeof line, "B|%d|%s", pid, name));
+}
+
+void trace_end(void){
+    if (!trace_enabled()) return;
+    char line[TRACE_EVENT_MAX];
+    emit(line, snprintf(line, sizeof line, "E|%d", pid));
+}
+
+void trace_instant(const char *name){
+    // A zero-length slice: every atrace reader shows those, not all know instant events
+    if (!trace_enabled()) return;
+    trace_begin(name);
+    trace_end();
+}
+
+void trace_counter(const char *name, int64_t value){
+    if (!trace_enabled()) return;
+    char line[TRACE_EVENT_MAX];
+    emit(line, snprintf(line, sizeof line, "C|%d|%s|%lld", pid, name, (long long)value));
+}
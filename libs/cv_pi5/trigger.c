@@ -0,0 +1,93 @@
+#include "cv_pi5/trigger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+bool trigger_open_gpio(trigger_source *t, const char *chip, uint32_t line, bool rising_edge){
+    /*
+        Requests one input line with edge detection. The line fd becomes
+        readable for every edge, with the kernel's own event timestamp.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!t || !chip || !*chip){errno = EINVAL;return false;}
+    memset(t, 0, sizeof *t);
+    t->kind = TRIGGER_GPIO;
+    t->fd = -1;
+
+    int chip_fd = open(chip, O_RDONLY | O_CLOEXEC);
+    if (chip_fd < 0) return false;
+
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof req);
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    strncpy(req.consumer, "cam_trigger", sizeof req.consumer - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | (rising_edge ? GPIO_V2_LINE_FLAG_EDGE_RISING : GPIO_V2_LINE_FLAG_EDGE_FALLING);
+
+    int r = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+    int saved = errno;
+    close(chip_fd);
+    if (r != 0){errno = saved;return false;}
+
+    int flags = fcntl(req.fd, F_GETFL);
+    if (flags < 0 || fcntl(req.fd, F_SETFL, flags | O_NONBLOCK) != 0){saved = errno; close(req.fd); errno = saved; return false;}
+    t->fd = req.fd;
+    return true;
+}
+
+bool trigger_open_socket(trigger_source *t, const char *path){
+    /*
+        Binds a Unix datagram socket at path, replacing a stale one.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!t || !path || !*path){errno = EINVAL;return false;}
+    memset(t, 0, sizeof *t);
+    t->kind = TRIGGER_SOCKET;
+    t->fd = -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path){errno = ENAMETOOLONG;return false;}
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    (void)unlink(path); // Left behind by a previous run that didn't exit cleanly
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0){int saved = errno; close(fd); errno = saved; return false;}
+
+    t->fd = fd;
+    strcpy(t->path, path);
+    return true;
+}
+
+int trigger_read(trigger_source *t){
+    int count = 0;
+
+    if (t->kind == TRIGGER_GPIO){
+        struct gpio_v2_line_event events[16];
+        ssize_t n;
+        while ((n = read(t->fd, events, sizeof events)) > 0) count += (int)(n / (ssize_t)sizeof events[0]);
+    } else {
+        char buf[64];
+        while (recv(t->fd, buf, sizeof buf, 0) >= 0) ++count; // Contents are ignored, a datagram is a trigger
+    }
+    return count;
+}
+
+void trigger_close(trigger_source *t){
+    if (!t || t->fd < 0) return;
+    close(t->fd);
+    t->fd = -1;
+    if (t->kind == TRIGGER_SOCKET && t->path[0]) unlink(t->path);
+    t->path[0] = '\0';
+}
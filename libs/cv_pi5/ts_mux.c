@@ -0,0 +1,226 @@
+#include "cv_pi5/ts_mux.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define TS_PID_PAT 0x0000
+#define TS_PID_PMT 0x1000
+#define TS_PID_VIDEO 0x0100         // also carries the PCR
+#define TS_PAYLOAD 184
+
+#define TS_STREAM_H264 0x1B
+#define TS_STREAM_HEVC 0x24
+
+#define TS_CLOCK_START 90000u       // first PCR at 1 s, clear of the 33-bit wrap
+#define TS_DECODE_DELAY 9000u       // PTS runs 100 ms ahead of the PCR
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t length){
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i){
+        crc ^= (uint32_t)data[i] << 24;
+        for (int bit = 0; bit < 8; ++bit) crc = crc & 0x80000000u ? crc << 1 ^ 0x04C11DB7u : crc << 1;
+    }
+    return crc;
+}
+
+static bool flush_buffer(ts_muxer *m, ts_mux_write_fn write, void *ctx){
+    if (m->fill == 0) return true;
+    if (!write(ctx, m->buffer, m->fill)) return false;
+    m->bytes += m->fill;
+    m->fill = 0;
+    return true;
+}
+
+static uint8_t *next_packet(ts_muxer *m, ts_mux_write_fn write, void *ctx){
+    if (m->fill == sizeof m->buffer && !flush_buffer(m, write, ctx)) return NULL;
+    uint8_t *p = m->buffer + m->fill;
+    m->fill += TS_PACKET_SIZE;
+    return p;
+}
+
+static void put_header(uint8_t *p, uint16_t pid, bool unit_start, bool adaptation, uint8_t *cc){
+    p[0] = 0x47;
+    p[1] = (uint8_t)((unit_start ? 0x40 : 0) | (pid >> 8 & 0x1F));
+    p[2] = (uint8_t)pid;
+    p[3] = (uint8_t)((adaptation ? 0x30 : 0x10) | (*cc & 0x0F));
+    *cc = (uint8_t)((*cc + 1) & 0x0F);
+}
+
+static bool put_section(ts_muxer *m, uint16_t pid, uint8_t *cc, uint8_t *section, size_t length, ts_mux_write_fn write, void *ctx){
+    /*
+        section holds everything up to, not including, the CRC, with 4 bytes spare after it
+    */
+    uint32_t crc = crc32_mpeg(section, length);
+    section[length] = (uint8_t)(crc >> 24);
+    section[length + 1] = (uint8_t)(crc >> 16);
+    section[length + 2] = (uint8_t)(crc >> 8);
+    section[length + 3] = (uint8_t)crc;
+
+    uint8_t *p = next_packet(m, write, ctx);
+    if (!p) return false;
+    put_header(p, pid, true, false, cc);
+    p[4] = 0; // pointer_field
+    memcpy(p + 5, section, length + 4);
+    memset(p + 5 + length + 4, 0xFF, TS_PACKET_SIZE - 5 - length - 4);
+    return true;
+}
+
+static bool put_tables(ts_muxer *m, ts_mux_write_fn write, void *ctx){
+    uint8_t pat[16] = {
+        0x00, 0xB0, 13,                 // table_id, section_length
+        0x00, 0x01, 0xC1, 0x00, 0x00,   // transport_stream_id, version 0 current, section 0 of 0
+        0x00, 0x01, 0xE0 | TS_PID_PMT >> 8, TS_PID_PMT & 0xFF,
+    };
+    uint8_t pmt[21] = {
+        0x02, 0xB0, 18,
+        0x00, 0x01, 0xC1, 0x00, 0x00,   // program_number 1
+        0xE0 | TS_PID_VIDEO >> 8, TS_PID_VIDEO & 0xFF,
+        0xF0, 0x00,                     // no program descriptors
+        m->codec == ENCODER_CODEC_HEVC ? TS_STREAM_HEVC : TS_STREAM_H264,
+        0xE0 | TS_PID_VIDEO >> 8, TS_PID_VIDEO & 0xFF,
+        0xF0, 0x00,
+    };
+    return put_section(m, TS_PID_PAT, &m->cc_pat, pat, 12, write, ctx) &&
+           put_section(m, TS_PID_PMT, &m->cc_pmt, pmt, 17, write, ctx);
+}
+
+static bool starts_with_delimiter(const ts_muxer *m, const encoded_packet *pkt){
+    const uint8_t *d = pkt->data;
+    size_t skip = pkt->size >= 4 && d[0] == 0 && d[1] == 0 && d[2] == 1 ? 3
+                : pkt->size >= 5 && d[0] == 0 && d[1] == 0 && d[2] == 0 && d[3] == 1 ? 4 : 0;
+    if (!skip) return false;
+    return m->codec == ENCODER_CODEC_HEVC ? (d[skip] >> 1 & 0x3F) == 35 : (d[skip] & 0x1F) == 9;
+}
+
+bool ts_mux_init(ts_muxer *m, encoder_codec codec, uint32_t fragment_keyframes){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!m || (codec != ENCODER_CODEC_H264 && codec != ENCODER_CODEC_HEVC)){errno = EINVAL;return false;}
+    memset(m, 0, sizeof *m);
+    m->codec = codec;
+    m->fragment_keyframes = fragment_keyframes ? fragment_keyframes : 1;
+    return true;
+}
+
+void ts_mux_restart(ts_muxer *m){
+    encoder_codec codec = m->codec;
+    uint32_t fragment_keyframes = m->fragment_keyframes;
+    bool passthrough = m->passthrough;
+    const wall_clock *clock = m->clock;
+    (void)ts_mux_init(m, codec, fragment_keyframes);
+    m->passthrough = passthrough;
+    m->clock = clock;
+}
+
+static uint64_t start_pcr(const ts_muxer *m, uint64_t pts_ns){
+    if (!m->clock) return TS_CLOCK_START;
+    int64_t wall = wall_clock_to_wall(m->clock, pts_ns);
+    if (wall <= 0) return TS_CLOCK_START; // A clock never set: start like an unclocked stream
+    uint64_t w = (uint64_t)wall;
+    return (w / 100000u * 9u + w % 100000u * 9u / 100000u) & 0x1FFFFFFFFull;
+}
+
+bool ts_mux_packet(ts_muxer *m, const encoded_packet *pkt, ts_mux_write_fn write, void *ctx){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (m->passthrough){
+        if (!write(ctx, pkt->data, pkt->size)) return false;
+        m->bytes += pkt->size;
+        return true;
+    }
+
+    bool key = pkt->flags & PACKET_FLAG_KEYFRAME;
+    if (ts_mux_starts_fragment(m, pkt)){
+        if (!m->started){m->base_ns = pkt->pts_ns; m->base_pcr = start_pcr(m, pkt->pts_ns); m->started = true;}
+        if (!put_tables(m, write, ctx)) return false;
+        m->keyframes_in_fragment = 0;
+        ++m->fragments;
+    }
+    if (key) ++m->keyframes_in_fragment;
+
+    uint64_t pcr = (pkt->pts_ns > m->base_ns ? (pkt->pts_ns - m->base_ns) * 9u / 100000u : 0) + m->base_pcr;
+    uint64_t pts = (pcr + TS_DECODE_DELAY) & 0x1FFFFFFFFull;
+    pcr &= 0x1FFFFFFFFull;
+
+    // PES header, unbounded length as video allows, PTS only since no backend emits B-frames
+    uint8_t head[14 + 7] = {
+        0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 5,
+        (uint8_t)(0x21 | (pts >> 29 & 0x0E)), (uint8_t)(pts >> 22), (uint8_t)(pts >> 14 | 1), (uint8_t)(pts >> 7), (uint8_t)(pts << 1 | 1),
+    };
+    size_t head_length = 14;
+    if (!starts_with_delimiter(m, pkt)){ // H.222 wants every access unit to open with one
+        static const uint8_t aud_h264[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+        static const uint8_t aud_hevc[] = { 0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50 };
+        const uint8_t *aud = m->codec == ENCODER_CODEC_HEVC ? aud_hevc : aud_h264;
+        size_t aud_length = m->codec == ENCODER_CODEC_HEVC ? sizeof aud_hevc : sizeof aud_h264;
+        memcpy(head + head_length, aud, aud_length);
+        head_length += aud_length;
+    }
+
+    const uint8_t *src[2] = { head, pkt->data };
+    size_t left[2] = { head_length, pkt->size };
+    int seg = 0;
+    bool first = true;
+
+    while (left[0] + left[1] > 0){
+        size_t remaining = left[0] + left[1];
+        uint8_t *p = next_packet(m, write, ctx);
+        if (!p) return false;
+
+        bool adaptation = first;
+        size_t af_body = first ? 7 : 0;     // flags and PCR
+        size_t room = TS_PAYLOAD - (adaptation ? 1 + af_body : 0);
+        size_t stuffing = 0;
+        if (remaining < room){              // Pad the last packet through the adaptation field
+            stuffing = room - remaining;
+            if (!adaptation){
+                adaptation = true;
+                --stuffing;                 // the length byte
+                if (stuffing > 0){af_body = 1; --stuffing;}
+            }
+        }
+
+        put_header(p, TS_PID_VIDEO, first, adaptation, &m->cc_video);
+        uint8_t *q = p + 4;
+        if (adaptation){
+            *q++ = (uint8_t)(af_body + stuffing);
+            if (af_body > 0) *q++ = first ? (uint8_t)(0x10 | (key ? 0x40 : 0)) : 0; // PCR, random access
+            if (first){
+                *q++ = (uint8_t)(pcr >> 25);
+                *q++ = (uint8_t)(pcr >> 17);
+                *q++ = (uint8_t)(pcr >> 9);
+                *q++ = (uint8_t)(pcr >> 1);
+                *q++ = (uint8_t)(pcr << 7 | 0x7E);
+                *q++ = 0;
+            }
+            memset(q, 0xFF, stuffing);
+            q += stuffing;
+        }
+
+        size_t n = (size_t)(p + TS_PACKET_SIZE - q);
+        while (n > 0){
+            if (left[seg] == 0){++seg; continue;}
+            size_t take = n < left[seg] ? n : left[seg];
+            memcpy(q, src[seg], take);
+            q += take;
+            src[seg] += take;
+            left[seg] -= take;
+            n -= take;
+        }
+        first = false;
+    }
+    return true;
+}
+
+bool ts_mux_starts_fragment(const ts_muxer *m, const encoded_packet *pkt){
+    if (m->passthrough) return false;
+    return !m->started || ((pkt->flags & PACKET_FLAG_KEYFRAME) && m->keyframes_in_fragment >= m->fragment_keyframes);
+}
+
+bool ts_mux_flush(ts_muxer *m, ts_mux_write_fn write, void *ctx){
+    return flush_buffer(m, write, ctx);
+}
@@ -0,0 +1,9 @@
+#include "cv_pi5/cv_pi5.h"
+
+// The build passes the project() version in; the header has to agree with it
+_Static_assert(CV_PI5_VERSION_MAJOR == CV_PI5_BUILD_VERSION_MAJOR && CV_PI5_VERSION_MINOR == CV_PI5_BUILD_VERSION_MINOR &&
+               CV_PI5_VERSION_PATCH == CV_PI5_BUILD_VERSION_PATCH, "cv_pi5.h and CMakeLists.txt disagree on the version");
+
+uint32_t cv_pi5_version(void){
+    return (uint32_t)CV_PI5_VERSION_MAJOR << 16 | (uint32_t)CV_PI5_VERSION_MINOR << 8 | (uint32_t)CV_PI5_VERSION_PATCH;
+}
@@ -0,0 +1,124 @@
+#include "cv_pi5/wall_clock.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define WALL_CLOCK_SAMPLES 3        // reads per measurement, keeping the tightest
+#define WALL_CLOCK_DRIFT_WEIGHT 8   // drift follows 1/8 of each new rate estimate
+#define WALL_CLOCK_SLEW_DIVISOR 4   // phase error taken in per update
+
+static uint64_t ns_of(const struct timespec *ts){
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+static bool measure(uint64_t *mono_ns, int64_t *offset_ns){
+    /*
+        Reads the wall clock between two monotonic reads. The pair closest
+        together bounds best when the wall read happened; a preemption
+        between the reads only widens one pair.
+        If successful returns true
+        else returns false and an errno
+    */
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < WALL_CLOCK_SAMPLES; i++){
+        struct timespec before, real, after;
+        if (clock_gettime(CLOCK_MONOTONIC, &before) != 0 || clock_gettime(CLOCK_REALTIME, &real) != 0 ||
+            clock_gettime(CLOCK_MONOTONIC, &after) != 0) return false;
+        uint64_t a = ns_of(&before), b = ns_of(&after);
+        if (b - a >= best) continue;
+        best = b - a;
+        *mono_ns = a + (b - a) / 2;
+        *offset_ns = (int64_t)ns_of(&real) - (int64_t)*mono_ns;
+    }
+    return true;
+}
+
+static int64_t offset_at(uint64_t mono_ns, uint64_t base_mono, int64_t base_offset, int64_t drift_ppb){
+    // Drift is at most 5e5 ppb, so the product stays in range for some 200 days from the base
+    int64_t elapsed = (int64_t)(mono_ns - base_mono);
+    return base_offset + elapsed / 1000000000ll * drift_ppb + elapsed % 1000000000ll * drift_ppb / 1000000000ll;
+}
+
+static void publish(wall_clock *c, uint64_t base_mono, int64_t base_offset, int64_t drift_ppb){
+    uint32_t seq = atomic_load_explicit(&c->seq, memory_order_relaxed);
+    atomic_store_explicit(&c->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&c->base_mono_ns, base_mono, memory_order_relaxed);
+    atomic_store_explicit(&c->base_offset_ns, base_offset, memory_order_relaxed);
+    atomic_store_explicit(&c->drift_ppb, drift_ppb, memory_order_relaxed);
+    atomic_store_explicit(&c->seq, seq + 2, memory_order_release);
+}
+
+bool wall_clock_init(wall_clock *c){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!c){errno = EINVAL;return false;}
+    memset(c, 0, sizeof *c);
+    uint64_t mono;
+    int64_t offset;
+    if (!measure(&mono, &offset)) return false;
+    publish(c, mono, offset, 0);
+    c->started = true;
+    c->last_mono_ns = mono;
+    c->last_offset_ns = offset;
+    c->steps = 1;
+    return true;
+}
+
+bool wall_clock_update(wall_clock *c){
+    uint64_t mono;
+    int64_t offset;
+    if (!measure(&mono, &offset)) return false;
+
+    uint64_t base_mono = atomic_load_explicit(&c->base_mono_ns, memory_order_relaxed);
+    int64_t base_offset = atomic_load_explicit(&c->base_offset_ns, memory_order_relaxed);
+    int64_t drift = atomic_load_explicit(&c->drift_ppb, memory_order_relaxed);
+    int64_t predicted = offset_at(mono, base_mono, base_offset, drift), error = offset - predicted;
+
+    if (!c->started || error > WALL_CLOCK_STEP_NS || error < -WALL_CLOCK_STEP_NS){
+        // The wall clock was set: anything measured before it says nothing about the rate
+        publish(c, mono, offset, c->started ? drift : 0);
+        c->started = true;
+        c->last_mono_ns = mono;
+        c->last_offset_ns = offset;
+        c->steps++;
+        errno = 0;
+        return true;
+    }
+
+    int64_t elapsed = (int64_t)(mono - c->last_mono_ns);
+    if (elapsed > 0){
+        int64_t rate = (offset - c->last_offset_ns) * 1000000000ll / elapsed; // fits: both under a step apart
+        drift += (rate - drift) / WALL_CLOCK_DRIFT_WEIGHT;
+        if (drift > WALL_CLOCK_MAX_DRIFT_PPB) drift = WALL_CLOCK_MAX_DRIFT_PPB;
+        if (drift < -WALL_CLOCK_MAX_DRIFT_PPB) drift = -WALL_CLOCK_MAX_DRIFT_PPB;
+    }
+    publish(c, mono, predicted + error / WALL_CLOCK_SLEW_DIVISOR, drift);
+    c->last_mono_ns = mono;
+    c->last_offset_ns = offset;
+    errno = 0;
+    return false;
+}
+
+int64_t wall_clock_to_wall(const wall_clock *c, uint64_t mono_ns){
+    uint32_t seq;
+    uint64_t base_mono;
+    int64_t base_offset, drift;
+    do {
+        seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        base_mono = atomic_load_explicit(&c->base_mono_ns, memory_order_relaxed);
+        base_offset = atomic_load_explicit(&c->base_offset_ns, memory_order_relaxed);
+        drift = atomic_load_explicit(&c->drift_ppb, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&c->seq, memory_order_relaxed));
+    return (int64_t)mono_ns + offset_at(mono_ns, base_mono, base_offset, drift);
+}
+
+struct timespec wall_clock_timespec(const wall_clock *c, uint64_t mono_ns){
+    int64_t wall = wall_clock_to_wall(c, mono_ns);
+    struct timespec ts = { .tv_sec = (time_t)(wall / 1000000000ll), .tv_nsec = (long)(wall % 1000000000ll) };
+    if (ts.tv_nsec < 0){ts.tv_sec--; ts.tv_nsec += 1000000000l;}
+    return ts;
+}
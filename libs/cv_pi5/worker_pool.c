@@ -0,0 +1,118 @@
+#include "cv_pi5/worker_pool.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+struct worker_job {
+    worker_job_fn fn;
+    void *arg;
+    worker_job *next;
+};
+
+static void lower_priority(void){
+    /*
+        Best effort: the calling thread only, and a pool that runs at normal
+        priority is slower to stay out of the way, not broken
+    */
+    struct sched_param param = { .sched_priority = 0 };
+    (void)pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    (void)syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT); // Who 0: this thread
+}
+
+static void *worker_main(void *arg){
+    worker_pool *pool = arg;
+    lower_priority();
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;){
+        while (!pool->head && !pool->stopping) pthread_cond_wait(&pool->wake, &pool->lock);
+        worker_job *job = pool->head;
+        if (!job) break; // Stopping with the queue drained
+
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->fn(job->arg);
+        free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->completed++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+bool worker_pool_start(worker_pool *pool, unsigned threads, size_t max_queued){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!pool || threads == 0 || threads > WORKER_POOL_MAX_THREADS || max_queued == 0){errno = EINVAL;return false;}
+
+    memset(pool, 0, sizeof *pool);
+    pool->max_queued = max_queued;
+    int r = pthread_mutex_init(&pool->lock, NULL);
+    if (r != 0){errno = r;return false;}
+    r = pthread_cond_init(&pool->wake, NULL);
+    if (r != 0){pthread_mutex_destroy(&pool->lock);errno = r;return false;}
+
+    for (unsigned i = 0; i < threads; ++i){
+        r = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+        if (r != 0){
+            worker_pool_stop(pool); // Joins the ones already running
+            errno = r;
+            return false;
+        }
+        pool->thread_count++;
+    }
+    return true;
+}
+
+bool worker_pool_submit(worker_pool *pool, worker_job_fn fn, void *arg){
+    if (!pool || !fn){errno = EINVAL;return false;}
+
+    worker_job *job = malloc(sizeof *job);
+    if (!job){errno = ENOMEM;return false;}
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->stopping || pool->queued >= pool->max_queued){
+        pthread_mutex_unlock(&pool->lock);
+        free(job);
+        errno = EAGAIN;
+        return false;
+    }
+    if (pool->tail) pool->tail->next = job;
+    else pool->head = job;
+    pool->tail = job;
+    pool->queued++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+void worker_pool_stop(worker_pool *pool){
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->thread_count; ++i) pthread_join(pool->threads[i], NULL);
+    pool->thread_count = 0;
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+}
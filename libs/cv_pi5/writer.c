@@ -0,0 +1,260 @@
+#include "cv_pi5/writer.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/trace.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static void record_error(frame_writer *w, int error){
+    int expected = 0;
+    atomic_compare_exchange_strong(&w->error, &expected, error ? error : EIO); // Keep the first one
+}
+
+static bool healthy(frame_writer *w){
+    return atomic_load_explicit(&w->error, memory_order_relaxed) == 0;
+}
+
+static bool write_out(void *ctx, const void *data, size_t length){
+    frame_writer *w = ctx;
+    if (!clip_file_write(w->out, data, length)) return false;
+    metrics_count(METRIC_BYTES_WRITTEN, length);
+    atomic_fetch_add_explicit(&w->bytes_written, length, memory_order_relaxed);
+    return true;
+}
+
+static uint64_t unsynced(const frame_writer *w){
+    return clip_file_unsynced(w->out) + (w->mux ? w->mux->fill : 0);
+}
+
+static void note_call(frame_writer *w, uint64_t ns){
+    uint64_t max = atomic_load_explicit(&w->write_ns_max, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&w->write_ns_max, &max, ns, memory_order_relaxed, memory_order_relaxed));
+}
+
+static void writeback(frame_writer *w){
+    TRACE_BEGIN("writeback");
+    bool ok = clip_file_writeback(w->out);
+    TRACE_END();
+    if (!ok){record_error(w, errno);return;}
+    w->writeback_at = w->out->size;
+}
+
+static void datasync(frame_writer *w){
+    /*
+        Everything handed to the writer so far, the muxer's buffer included,
+        made durable. The fsync stage measures from the newest frame now safe
+    */
+    if (w->mux && !ts_mux_flush(w->mux, write_out, w)){record_error(w, errno);return;}
+    uint64_t start = metrics_now_ns();
+    TRACE_BEGIN("fdatasync");
+    bool ok = clip_file_datasync(w->out);
+    TRACE_END();
+    note_call(w, metrics_now_ns() - start);
+    if (!ok){record_error(w, errno);return;}
+    metrics_record_since(METRIC_STAGE_FSYNC, w->last_pts_ns);
+    atomic_fetch_add_explicit(&w->datasyncs, 1, memory_order_relaxed);
+    w->writeback_at = w->out->size;
+    w->fragments_unsynced = 0;
+}
+
+static bool starts_fragment(const frame_writer *w, const encoded_packet *pkt){
+    if (w->mux && !w->mux->passthrough) return ts_mux_starts_fragment(w->mux, pkt);
+    return pkt->flags & PACKET_FLAG_KEYFRAME; // Bare streams: a fragment per GOP
+}
+
+static void note_unsynced(frame_writer *w){
+    uint64_t bytes = unsynced(w);
+    if (bytes <= atomic_load_explicit(&w->unsynced_max, memory_order_relaxed)) return;
+    atomic_store_explicit(&w->unsynced_max, bytes, memory_order_relaxed);
+    metrics_peak(METRIC_PEAK_UNSYNCED_BYTES, bytes);
+}
+
+static bool write_packet(void *ctx, const encoded_packet *pkt){
+    frame_writer *w = ctx;
+    if (!healthy(w)) return false; // After a failure keep draining, just stop writing
+
+    if (w->sync.datasync_fragments && w->out->size && starts_fragment(w, pkt) &&
+        ++w->fragments_unsynced >= w->sync.datasync_fragments) datasync(w); // The fragments before this one, whole
+    if (w->index) seek_index_note(w->index, pkt, w->out->size + (w->mux ? w->mux->fill : 0));
+
+    uint64_t start = metrics_now_ns();
+    TRACE_BEGIN("write");
+    bool ok = w->mux ? ts_mux_packet(w->mux, pkt, write_out, w) : write_out(w, pkt->data, pkt->size);
+    TRACE_END();
+    if (!ok){
+        record_error(w, errno);
+        metrics_count(METRIC_WRITE_ERRORS, 1);
+        return false;
+    }
+    uint64_t took = metrics_now_ns() - start;
+    metrics_record(METRIC_STAGE_WRITE_CALL, took);
+    note_call(w, took);
+    metrics_count(METRIC_PACKETS_WRITTEN, 1);
+    atomic_fetch_add_explicit(&w->packets_written, 1, memory_order_relaxed);
+    w->last_pts_ns = pkt->pts_ns;
+
+    if (w->sync.writeback_bytes && w->out->size - w->writeback_at >= w->sync.writeback_bytes) writeback(w);
+    note_unsynced(w);
+    return true;
+}
+
+static bool flush_if_triggered(frame_writer *w){
+    /*
+        Returns true once packets should be written live
+    */
+    if (!w->pre || w->flushed) return true;
+    if (!atomic_load_explicit(&w->triggered, memory_order_acquire)) return false;
+
+    TRACE_BEGIN("pretrigger_flush");
+    (void)pretrigger_flush(w->pre, write_packet, w);
+    TRACE_END();
+    w->flushed = true;
+    return true;
+}
+
+static void rotate(frame_writer *w){
+    /*
+        The current clip ends here, whole and synced, and the writer starts
+        over on the next file as if just started
+    */
+    atomic_store_explicit(&w->rotate_requested, false, memory_order_relaxed);
+    TRACE_INSTANT("rotate");
+    if (w->mux && healthy(w) && !ts_mux_flush(w->mux, write_out, w)) record_error(w, errno);
+    if (w->sync.datasync_fragments && healthy(w) && w->out->size){note_unsynced(w); datasync(w);}
+    if (!clip_file_close(w->out)) record_error(w, errno);
+    int error = atomic_exchange_explicit(&w->error, 0, memory_order_relaxed); // Belongs to the old clip
+
+    w->out = w->next_out;
+    w->index = w->next_index;
+    if (w->mux) ts_mux_restart(w->mux);
+    atomic_store_explicit(&w->triggered, false, memory_order_relaxed);
+    w->flushed = false;
+    w->writeback_at = 0;
+    w->fragments_unsynced = 0;
+
+    atomic_store_explicit(&w->rotated_error, error, memory_order_relaxed);
+    atomic_fetch_add_explicit(&w->rotations, 1, memory_order_release);
+    uint64_t one = 1;
+    ssize_t n;
+    do { n = write(w->rotated_fd, &one, sizeof one); } while (n < 0 && errno == EINTR);
+}
+
+static void handle_packet(frame_writer *w, const packet_ring_item *item){
+    if ((item->pkt.flags & PACKET_FLAG_KEYFRAME) && atomic_load_explicit(&w->rotate_requested, memory_order_acquire)) rotate(w);
+    if (flush_if_triggered(w)){ // History goes out ahead of the first live packet
+        if (write_packet(w, &item->pkt)) metrics_record_since(METRIC_STAGE_WRITE, item->pkt.pts_ns);
+    } else if (item->pool && w->pre->pool == item->pool) (void)pretrigger_append_buffer(w->pre, &item->pkt, item->buffer); // Shared, not copied
+    else (void)pretrigger_append(w->pre, &item->pkt);
+
+    if (w->stream) stream_sink_offer(w->stream, item);
+    packet_ring_release(w->ring, item);
+}
+
+static void *writer_main(void *arg){
+    frame_writer *w = arg;
+    packet_ring_item item;
+
+    for (;;){
+        while (packet_ring_peek(w->ring, &item)) handle_packet(w, &item);
+        flush_if_triggered(w); // A trigger with no packet behind it yet
+        if (atomic_exchange_explicit(&w->writeback_requested, false, memory_order_acq_rel) && healthy(w)) writeback(w);
+        if (atomic_load_explicit(&w->stop, memory_order_acquire)){
+            while (packet_ring_peek(w->ring, &item)) handle_packet(w, &item); // Pushes that raced with stop
+            break;
+        }
+
+        uint64_t count;
+        if (read(w->wake_fd, &count, sizeof count) < 0 && errno != EINTR && errno != EAGAIN){
+            record_error(w, errno);
+            break;
+        }
+    }
+    if (w->mux && healthy(w) && !ts_mux_flush(w->mux, write_out, w)) record_error(w, errno); // The clip's tail
+    if (w->sync.datasync_fragments && healthy(w) && w->out->size){note_unsynced(w); datasync(w);} // Before the caller renames it into place
+    return NULL;
+}
+
+bool writer_start(frame_writer *w, packet_ring *ring, clip_file *out, pretrigger_buffer *pre, ts_muxer *mux,
+                  const writer_sync_policy *sync, seek_index *index, stream_sink *stream){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!w || !ring || !out){errno = EINVAL;return false;}
+
+    memset(w, 0, sizeof *w);
+    w->ring = ring;
+    w->out = out;
+    w->pre = pre;
+    w->mux = mux;
+    w->index = index;
+    w->stream = stream;
+    atomic_init(&w->triggered, false);
+    atomic_init(&w->stop, false);
+    atomic_init(&w->error, 0);
+    atomic_init(&w->packets_written, 0);
+    atomic_init(&w->bytes_written, 0);
+    if (sync) w->sync = *sync;
+    atomic_init(&w->writeback_requested, false);
+    atomic_init(&w->datasyncs, 0);
+    atomic_init(&w->unsynced_max, 0);
+    atomic_init(&w->write_ns_max, 0);
+    atomic_init(&w->rotate_requested, false);
+    atomic_init(&w->rotations, 0);
+    atomic_init(&w->rotated_error, 0);
+
+    w->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (w->wake_fd < 0) return false;
+    w->rotated_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->rotated_fd < 0){int saved = errno; close(w->wake_fd); w->wake_fd = -1; errno = saved; return false;}
+
+    int r = pthread_create(&w->thread, NULL, writer_main, w);
+    if (r != 0){close(w->wake_fd);close(w->rotated_fd);w->wake_fd = w->rotated_fd = -1;errno = r;return false;}
+    w->running = true;
+    return true;
+}
+
+void writer_notify(frame_writer *w){
+    uint64_t one = 1;
+    ssize_t n;
+    do { n = write(w->wake_fd, &one, sizeof one); } while (n < 0 && errno == EINTR);
+}
+
+void writer_trigger(frame_writer *w){
+    atomic_store_explicit(&w->triggered, true, memory_order_release);
+    writer_notify(w);
+}
+
+void writer_request_writeback(frame_writer *w){
+    atomic_store_explicit(&w->writeback_requested, true, memory_order_release);
+    writer_notify(w);
+}
+
+bool writer_rotate(frame_writer *w, clip_file *next, seek_index *next_index){
+    if (!w || !w->running || !next){errno = EINVAL;return false;}
+    if (atomic_load_explicit(&w->rotate_requested, memory_order_acquire)){errno = EBUSY;return false;}
+    w->next_out = next;
+    w->next_index = next_index;
+    atomic_store_explicit(&w->rotate_requested, true, memory_order_release); // Publishes both
+    writer_notify(w);
+    return true;
+}
+
+bool writer_stop(frame_writer *w){
+    if (!w || !w->running) return false;
+
+    atomic_store_explicit(&w->stop, true, memory_order_release);
+    writer_notify(w);
+    pthread_join(w->thread, NULL);
+    w->running = false;
+
+    close(w->wake_fd);
+    close(w->rotated_fd);
+    w->wake_fd = w->rotated_fd = -1;
+
+    int error = atomic_load(&w->error);
+    if (error){errno = error;return false;}
+    return true;
+}
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <linux/videodev2.h>
+
+#include "cv_pi5/buffer_pool.h"
+#include "cv_pi5/capture.h"
+#include "cv_pi5/clip_file.h"
+#include "cv_pi5/encode_stage.h"
+#include "cv_pi5/encoder.h"
+#include "cv_pi5/evloop.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/motion.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/pixconv.h"
+#include "cv_pi5/trace.h"
+#include "cv_pi5/ts_mux.h"
+#include "cv_pi5/writer.h"
+
+/*
+    cam_bench: drives the capture -> encode -> write pipeline from a
+    synthetic or replayed source, or a real camera, for a fixed time and
+    reports what it sustained:
+
+        fps, frames dropped at each point where the pipeline can drop them,
+        p50/p99/p99.9 latency from frame timestamp to the clip file, per
+        stage and end to end, CPU time of each pipeline thread, bytes written
+
+    A warm-up period is excluded from every number. With --influx the
+    summary is also printed as one InfluxDB line, and the --min and --max
+    gates turn a regression into a non-zero exit status.
+*/
+
+typedef struct {
+    const char *device;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint32_t pixelformat;
+    uint32_t capture_buffers;
+    const char *encoder;
+    uint32_t bitrate_bps;
+    const char *output;
+    bool keep_output;
+    bool container_ts;
+    bool direct_io;
+    writer_sync_policy sync;
+    bool motion;
+    uint64_t cpu_mask;
+    uint64_t encoder_cpu_mask;
+    uint32_t seconds;
+    uint32_t warmup_ms;
+    size_t pool_bytes;
+    bool influx;
+    bool trace;                 // ftrace markers, in builds with CV_PI5_TRACE
+
+    double min_fps;             // gates, 0 disables
+    long long max_drops;        // -1 disables
+    double max_p99_ms;
+    double max_p999_ms;
+} bench_options;
+
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t capture_cpu_ns;
+    uint64_t encode_cpu_ns;
+    uint64_t writer_cpu_ns;
+    uint64_t process_cpu_ns;
+    metrics_snapshot metrics;
+} bench_sample;
+
+typedef struct {
+    capture_device *cam;
+    frame_ring *ring;
+    encode_stage *stage;
+    frame_writer *writer;
+    motion_detector *motion;
+    const pixconv *luma_conv;   // NULL when the camera's first plane is luma
+    uint8_t *luma;
+    bool have_last;
+    uint32_t last_sequence;
+    bool failed;
+    int error;
+    bool warm;                  // start has been taken
+    bool done;                  // end has been taken
+    bench_sample start;
+    bench_sample end;
+} bench_session;
+
+static void usage(const char *argv0){
+    printf("usage: %s [options]\n"
+           "  --device DEV          synthetic (default), replay:FILE or a V4L2 node\n"
+           "  --size WxH            frame size (1920x1080)\n"
+           "  --fps N               frame rate (30)\n"
+           "  --format FOURCC       YU12, NV12, YUYV, ... (YU12)\n"
+           "  --buffers N           capture buffers, at most 16 (12)\n"
+           "  --encoder NAME        auto, v4l2m2m, x264 or raw (auto)\n"
+           "  --bitrate BPS         (8000000)\n"
+           "  --output PATH         clip file (/tmp/cam_bench.ts), removed afterwards unless --keep\n"
+           "  --keep                keep the clip file\n"
+           "  --es                  bare elementary stream instead of MPEG-TS\n"
+           "  --direct-io           O_DIRECT clip writes\n"
+           "  --sync-fragments N    fdatasync every N fragments and at the end (never)\n"
+           "  --writeback-mb N      start writeback every N MiB written (never)\n"
+           "  --no-motion           skip the motion detector\n"
+           "  --cpu-mask MASK       capture thread cores (unpinned)\n"
+           "  --encoder-cpu-mask M  encode stage cores (unpinned)\n"
+           "  --seconds N           measured time (10)\n"
+           "  --warmup-ms N         excluded start-up time (1000)\n"
+           "  --pool-mb N           shared packet buffers (64)\n"
+           "  --influx              also print the summary as an InfluxDB line\n"
+           "  --trace               ftrace markers per stage (profile builds)\n"
+           "  --min-fps X --max-drops N --max-p99-ms X --max-p999-ms X\n"
+           "                        fail (exit 1) when the run is worse\n", argv0);
+}
+
+static bool parse_args(bench_options *o, int argc, char **argv){
+    static const struct option long_options[] = {
+        { "device", required_argument, NULL, 'd' },
+        { "size", required_argument, NULL, 's' },
+        { "fps", required_argument, NULL, 'f' },
+        { "format", required_argument, NULL, 'F' },
+        { "buffers", required_argument, NULL, 'b' },
+        { "encoder", required_argument, NULL, 'e' },
+        { "bitrate", required_argument, NULL, 'B' },
+        { "output", required_argument, NULL, 'o' },
+        { "keep", no_argument, NULL, 'k' },
+        { "es", no_argument, NULL, 'E' },
+        { "direct-io", no_argument, NULL, 'D' },
+        { "sync-fragments", required_argument, NULL, 5 },
+        { "writeback-mb", required_argument, NULL, 6 },
+        { "no-motion", no_argument, NULL, 'M' },
+        { "cpu-mask", required_argument, NULL, 'c' },
+        { "encoder-cpu-mask", required_argument, NULL, 'C' },
+        { "seconds", required_argument, NULL, 't' },
+        { "warmup-ms", required_argument, NULL, 'w' },
+        { "pool-mb", required_argument, NULL, 'p' },
+        { "influx", no_argument, NULL, 'i' },
+        { "trace", no_argument, NULL, 'T' },
+        { "min-fps", required_argument, NULL, 1 },
+        { "max-drops", required_argument, NULL, 2 },
+        { "max-p99-ms", required_argument, NULL, 3 },
+        { "max-p999-ms", required_argument, NULL, 4 },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    *o = (bench_options){
+        .device = "synthetic", .width = 1920, .height = 1080, .fps = 30, .pixelformat = V4L2_PIX_FMT_YUV420,
+        .capture_buffers = 12, .encoder = "auto", .bitrate_bps = 8000000, .output = "/tmp/cam_bench.ts",
+        .container_ts = true, .motion = true, .seconds = 10, .warmup_ms = 1000, .pool_bytes = (size_t)64 << 20,
+        .max_drops = -1,
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", long_options, NULL)) != -1){
+        switch (c){
+        case 'd': o->device = optarg; break;
+        case 's': if (sscanf(optarg, "%ux%u", &o->width, &o->height) != 2) return false; break;
+        case 'f': o->fps = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'F':
+            if (strlen(optarg) != 4) return false;
+            o->pixelformat = v4l2_fourcc(optarg[0], optarg[1], optarg[2], optarg[3]);
+            break;
+        case 'b': o->capture_buffers = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'e': o->encoder = optarg; break;
+        case 'B': o->bitrate_bps = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'o': o->output = optarg; break;
+        case 'k': o->keep_output = true; break;
+        case 'E': o->container_ts = false; break;
+        case 'D': o->direct_io = true; break;
+        case 'M': o->motion = false; break;
+        case 'c': o->cpu_mask = strtoull(optarg, NULL, 0); break;
+        case 'C': o->encoder_cpu_mask = strtoull(optarg, NULL, 0); break;
+        case 't': o->seconds = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'w': o->warmup_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'p': o->pool_bytes = (size_t)strtoul(optarg, NULL, 0) << 20; break;
+        case 'i': o->influx = true; break;
+        case 'T': o->trace = true; break;
+        case 1: o->min_fps = strtod(optarg, NULL); break;
+        case 2: o->max_drops = strtoll(optarg, NULL, 0); break;
+        case 3: o->max_p99_ms = strtod(optarg, NULL); break;
+        case 4: o->max_p999_ms = strtod(optarg, NULL); break;
+        case 5: o->sync.datasync_fragments = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 6: o->sync.writeback_bytes = strtoull(optarg, NULL, 0) << 20; break;
+        case 'h': usage(argv[0]); exit(0);
+        default: return false;
+        }
+    }
+    return optind == argc && o->width && o->height && o->fps && o->capture_buffers && o->capture_buffers <= CAPTURE_MAX_BUFFERS && o->seconds && o->pool_bytes;
+}
+
+static uint64_t thread_cpu_ns(pthread_t thread){
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t clock_ns(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void take_sample(const bench_session *s, bench_sample *out){
+    out->wall_ns = metrics_now_ns();
+    out->capture_cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID); // Capture runs on this thread
+    out->encode_cpu_ns = thread_cpu_ns(s->stage->thread);
+    out->writer_cpu_ns = thread_cpu_ns(s->writer->thread);
+    out->process_cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    metrics_snapshot_get(&out->metrics);
+}
+
+static void subtract_histogram(metrics_histogram *h, const metrics_histogram *before){
+    h->count -= before->count;
+    h->sum_ns -= before->sum_ns;
+    for (int i = 0; i < METRICS_BUCKETS; ++i) h->buckets[i] -= before->buckets[i];
+    // max_ns stays the maximum since start; there is no way to take a warm-up maximum out
+}
+
+static void session_fail(evloop *loop, bench_session *s, int error){
+    if (!s->failed){s->failed = true; s->error = error;}
+    evloop_stop(loop);
+}
+
+static bool luma_first(uint32_t pixelformat){
+    switch (pixelformat){
+    case V4L2_PIX_FMT_YUV420: case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_NV12: case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_GREY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void on_capture(evloop *loop, int fd, uint32_t events, void *ctx){
+    /*
+        cam_trigger's capture path, minus triggering: every frame is scored
+        for motion and pushed, and the clip is written from the first frame
+    */
+    (void)fd;
+    bench_session *s = ctx;
+    if (events & EPOLLERR){session_fail(loop, s, EIO);return;}
+
+    capture_frame frame;
+    int got, pushed = 0;
+    TRACE_BEGIN("capture");
+    while ((got = capture_dequeue(s->cam, &frame)) > 0){
+        metrics_record_since(METRIC_STAGE_DEQUEUE, frame.timestamp_ns);
+        metrics_count(METRIC_FRAMES_CAPTURED, 1);
+        if (s->have_last && frame.sequence != s->last_sequence + 1)
+            metrics_count(METRIC_FRAMES_SENSOR_DROPPED, frame.sequence - s->last_sequence - 1);
+        s->last_sequence = frame.sequence;
+        s->have_last = true;
+
+        if (s->motion){
+            uint64_t t = metrics_now_ns();
+            TRACE_BEGIN("motion");
+            const uint8_t *luma = s->cam->buffers[frame.index].planes[0].data;
+            pixconv_image src, dst = { .planes = { s->luma }, .strides = { s->cam->width } };
+            if (s->luma_conv && pixconv_capture_image(&src, s->cam, &frame)){pixconv_frame(s->luma_conv, &src, &dst, s->cam->height); luma = s->luma;}
+            if (motion_feed(s->motion, luma)) metrics_count(METRIC_MOTION_TRIGGERS, 1);
+            TRACE_END();
+            metrics_record(METRIC_STAGE_MOTION, metrics_now_ns() - t);
+        }
+
+        if (frame_ring_push(s->ring, &frame)) ++pushed;
+        else {
+            metrics_count(METRIC_FRAMES_RING_DROPPED, 1);
+            TRACE_INSTANT("ring_dropped");
+            if (!capture_requeue(s->cam, frame.index)){TRACE_END(); session_fail(loop, s, errno);return;}
+        }
+    }
+    TRACE_END();
+    if (pushed) encode_stage_notify(s->stage);
+    if (got < 0) session_fail(loop, s, errno);
+}
+
+static void on_warm(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events;
+    bench_session *s = ctx;
+    if (!evloop_timer_ack(fd)) return;
+    take_sample(s, &s->start);
+    s->warm = true;
+}
+
+static void finish(evloop *loop, bench_session *s){
+    if (s->warm && !s->done){
+        take_sample(s, &s->end); // While the stage threads still exist to be asked for their CPU time
+        s->done = true;
+    }
+    evloop_stop(loop);
+}
+
+static void on_done(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events;
+    if (evloop_timer_ack(fd)) finish(loop, ctx);
+}
+
+static void on_signal(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events;
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof info) == (ssize_t)sizeof info) {}
+    finish(loop, ctx); // A short run is still reported
+}
+
+static double ms(uint64_t ns){
+    return (double)ns / 1e6;
+}
+
+static bool report(const bench_options *o, const char *encoder, const bench_sample *a, bench_sample *b){
+    /*
+        Prints the summary; returns false when a gate failed
+    */
+    const uint64_t *c0 = a->metrics.counters, *c1 = b->metrics.counters;
+    double seconds = (double)(b->wall_ns - a->wall_ns) / 1e9;
+    uint64_t captured = c1[METRIC_FRAMES_CAPTURED] - c0[METRIC_FRAMES_CAPTURED];
+    uint64_t encoded = c1[METRIC_FRAMES_ENCODED] - c0[METRIC_FRAMES_ENCODED];
+    uint64_t sensor_drops = c1[METRIC_FRAMES_SENSOR_DROPPED] - c0[METRIC_FRAMES_SENSOR_DROPPED];
+    uint64_t ring_drops = c1[METRIC_FRAMES_RING_DROPPED] - c0[METRIC_FRAMES_RING_DROPPED];
+    uint64_t packet_drops = c1[METRIC_PACKETS_DROPPED] - c0[METRIC_PACKETS_DROPPED];
+    uint64_t drops = sensor_drops + ring_drops + packet_drops;
+    uint64_t bytes = c1[METRIC_BYTES_WRITTEN] - c0[METRIC_BYTES_WRITTEN];
+    double fps = seconds > 0 ? (double)encoded / seconds : 0;
+
+    for (int i = 0; i < METRIC_STAGE_COUNT; ++i) subtract_histogram(&b->metrics.stages[i], &a->metrics.stages[i]);
+    const metrics_histogram *e2e = &b->metrics.stages[METRIC_STAGE_WRITE];
+
+    printf("%s %ux%u@%u, encoder %s, %.1f s measured\n", o->device, o->width, o->height, o->fps, encoder, seconds);
+    printf("  fps          %.2f sustained (%llu captured, %llu encoded)\n", fps, (unsigned long long)captured, (unsigned long long)encoded);
+    printf("  drops        %llu: sensor %llu, frame ring %llu, packet ring %llu, pool exhausted %llu\n", (unsigned long long)drops,
+           (unsigned long long)sensor_drops, (unsigned long long)ring_drops, (unsigned long long)packet_drops,
+           (unsigned long long)(c1[METRIC_POOL_EXHAUSTED] - c0[METRIC_POOL_EXHAUSTED]));
+    printf("  written      %llu bytes, %.2f MB/s, %llu write errors\n", (unsigned long long)bytes, seconds > 0 ? (double)bytes / seconds / 1e6 : 0,
+           (unsigned long long)(c1[METRIC_WRITE_ERRORS] - c0[METRIC_WRITE_ERRORS]));
+    printf("  unsynced     %llu bytes at most%s\n", (unsigned long long)b->metrics.peaks[METRIC_PEAK_UNSYNCED_BYTES],
+           o->sync.datasync_fragments ? "" : ", nothing synced (--sync-fragments)");
+    printf("  latency (ms)     count      p50      p99    p99.9      max\n");
+    for (int i = 0; i < METRIC_STAGE_COUNT; ++i){
+        const metrics_histogram *h = &b->metrics.stages[i];
+        if (!h->count) continue;
+        printf("  %-12s %9llu %8.2f %8.2f %8.2f %8.2f\n", metrics_stage_name((metric_stage)i), (unsigned long long)h->count,
+               ms(metrics_quantile_ns(h, 0.5)), ms(metrics_quantile_ns(h, 0.99)), ms(metrics_quantile_ns(h, 0.999)), ms(h->max_ns));
+    }
+
+    // Encoder worker threads, if the backend has any, are what the process total has on top of the three stages
+    double wall = (double)(b->wall_ns - a->wall_ns);
+    double cpu_capture = 100.0 * (double)(b->capture_cpu_ns - a->capture_cpu_ns) / wall;
+    double cpu_encode = 100.0 * (double)(b->encode_cpu_ns - a->encode_cpu_ns) / wall;
+    double cpu_writer = 100.0 * (double)(b->writer_cpu_ns - a->writer_cpu_ns) / wall;
+    double cpu_total = 100.0 * (double)(b->process_cpu_ns - a->process_cpu_ns) / wall;
+    double cpu_other = cpu_total - cpu_capture - cpu_encode - cpu_writer;
+    printf("  cpu (%% of a core) capture %.1f, encode %.1f, writer %.1f, encoder workers %.1f, total %.1f\n",
+           cpu_capture, cpu_encode, cpu_writer, cpu_other > 0 ? cpu_other : 0, cpu_total);
+
+    uint64_t p50 = metrics_quantile_ns(e2e, 0.5), p99 = metrics_quantile_ns(e2e, 0.99), p999 = metrics_quantile_ns(e2e, 0.999);
+    if (o->influx)
+        printf("cam_bench,device=%s,encoder=%s,size=%ux%u fps=%.3f,frames=%llui,drops=%llui,bytes=%llui,"
+               "p50_ns=%llui,p99_ns=%llui,p999_ns=%llui,cpu_capture=%.2f,cpu_encode=%.2f,cpu_writer=%.2f,cpu_total=%.2f\n",
+               o->device, encoder, o->width, o->height, fps, (unsigned long long)encoded, (unsigned long long)drops, (unsigned long long)bytes,
+               (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999, cpu_capture, cpu_encode, cpu_writer, cpu_total);
+
+    bool ok = true;
+    if (o->min_fps > 0 && fps < o->min_fps){fprintf(stderr, "FAIL: %.2f fps, below %.2f\n", fps, o->min_fps); ok = false;}
+    if (o->max_drops >= 0 && drops > (uint64_t)o->max_drops){fprintf(stderr, "FAIL: %llu drops, above %lld\n", (unsigned long long)drops, o->max_drops); ok = false;}
+    if (o->max_p99_ms > 0 && ms(p99) > o->max_p99_ms){fprintf(stderr, "FAIL: p99 %.2f ms, above %.2f\n", ms(p99), o->max_p99_ms); ok = false;}
+    if (o->max_p999_ms > 0 && ms(p999) > o->max_p999_ms){fprintf(stderr, "FAIL: p99.9 %.2f ms, above %.2f\n", ms(p999), o->max_p999_ms); ok = false;}
+    if (e2e->count == 0){fprintf(stderr, "FAIL: nothing reached the clip file\n"); ok = false;}
+    return ok;
+}
+
+static void requeue_capture(void *ctx, uint32_t index){
+    (void)capture_requeue(ctx, index);
+}
+
+static bool pin_thread(uint64_t cpu_mask){
+    if (!cpu_mask) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; ++cpu)
+        if (cpu_mask & (1ull << cpu)) CPU_SET(cpu, &set);
+    int r = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+    if (r != 0){errno = r;return false;}
+    return true;
+}
+
+static bool run(const bench_options *o, bool *gates_ok){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    capture_config config = {
+        .device = o->device, .width = o->width, .height = o->height, .pixelformat = o->pixelformat,
+        .fps = o->fps, .buffer_count = o->capture_buffers,
+    };
+    ts_muxer mux;
+    capture_device cam;
+    frame_ring ring;
+    packet_ring packets;
+    buffer_pool pool;
+    clip_file out;
+    frame_writer writer;
+    encode_stage stage;
+    motion_detector motion;
+    pixconv luma_conv;
+    uint8_t *luma = NULL;
+    evloop loop;
+    bool have_ring = false, have_packets = false, have_pool = false, have_out = false, have_writer = false;
+    bool have_stage = false, have_motion = false, have_loop = false;
+    bench_session session = { .cam = &cam, .ring = &ring, .stage = &stage, .writer = &writer };
+    const char *encoder = NULL;
+    bool ok = false;
+    int saved = 0;
+
+    // Before any worker thread exists, so they all inherit the blocked mask
+    if (!(have_loop = evloop_init(&loop))) return false;
+    const int stop_signals[] = { SIGINT, SIGTERM };
+    if (evloop_add_signals(&loop, stop_signals, 2, on_signal, &session) < 0) goto done;
+
+    if (!capture_open(&cam, &config)) goto done;
+    if (!(have_ring = frame_ring_init(&ring, cam.buffer_count))) goto done;
+    if (!(have_packets = packet_ring_init(&packets, 256, (size_t)16 << 20, requeue_capture, &cam))) goto done;
+
+    const buffer_pool_class_config pool_classes[] = { // As cam_trigger sizes its pool
+        { .buffer_size = (size_t)64 << 10, .count = (uint32_t)(o->pool_bytes / 2 / ((size_t)64 << 10)) + 1 },
+        { .buffer_size = (size_t)512 << 10, .count = (uint32_t)(o->pool_bytes / 4 / ((size_t)512 << 10)) + 1 },
+        { .buffer_size = (size_t)4 << 20, .count = (uint32_t)(o->pool_bytes / 4 / ((size_t)4 << 20)) + 1 },
+    };
+    if (!(have_pool = buffer_pool_init(&pool, pool_classes, 3))) goto done;
+
+    clip_file_options out_options = { .direct_io = o->direct_io };
+    if (!(have_out = clip_file_open(&out, o->output, &out_options))) goto done;
+    bool muxed = o->container_ts && strcmp(o->encoder, "raw");
+    if (muxed && !ts_mux_init(&mux, ENCODER_CODEC_H264, 1)) goto done;
+    if (!(have_writer = writer_start(&writer, &packets, &out, NULL, muxed ? &mux : NULL, &o->sync, NULL, NULL))) goto done;
+
+    encoder_config enc_config = {
+        .codec = ENCODER_CODEC_H264,
+        .width = cam.width,
+        .height = cam.height,
+        .pixelformat = cam.pixelformat,
+        .num_planes = cam.num_planes,
+        .fps = o->fps,
+        .bitrate_bps = o->bitrate_bps,
+        .gop_length = o->fps,
+        .buffer_count = cam.buffer_count,
+    };
+    memcpy(enc_config.bytesperline, cam.bytesperline, sizeof enc_config.bytesperline);
+    if (!(have_stage = encode_stage_start(&stage, &cam, &ring, &packets, &pool, &writer, o->encoder, &enc_config, o->encoder_cpu_mask))) goto done;
+    if (muxed && !strcmp(encoder_name(&stage.enc), "raw")) mux.passthrough = true; // Before capture starts, as cam_trigger does
+
+    if (o->motion && !luma_first(cam.pixelformat) && pixconv_plan(&luma_conv, cam.pixelformat, V4L2_PIX_FMT_GREY, cam.width)
+        && !(luma = malloc((size_t)cam.width * cam.height))) perror("motion luma");
+    if (o->motion && (luma_first(cam.pixelformat) || luma)){ // Converted frames time the conversion as part of motion
+        motion_config mcfg = {
+            .width = cam.width, .height = cam.height, .stride = luma ? cam.width : cam.bytesperline[0],
+            .step = 4, .block = 16, .noise_floor = 12, .block_threshold = 16 * 16 * 8, .min_blocks = 4, .hold_frames = 3, .warmup_frames = 30,
+        };
+        if (!(have_motion = motion_init(&motion, &mcfg))) perror("motion");
+    }
+
+    if (have_motion) session.motion = &motion;
+    if (have_motion && luma){session.luma_conv = &luma_conv; session.luma = luma;}
+    if (!evloop_add(&loop, cam.fd, EPOLLIN, on_capture, &session)) goto done;
+    int warm_timer = evloop_add_timer(&loop, o->warmup_ms ? o->warmup_ms : 1, 0, on_warm, &session);
+    int done_timer = evloop_add_timer(&loop, (uint64_t)o->warmup_ms + (uint64_t)o->seconds * 1000u, 0, on_done, &session);
+    if (warm_timer < 0 || done_timer < 0) goto done;
+
+    if (!pin_thread(o->cpu_mask)) perror("pinning");
+    if (!capture_start(&cam)) goto done;
+    if (!evloop_run(&loop)){session.failed = true; session.error = errno;}
+    capture_stop(&cam);
+    if (session.failed){saved = session.error; goto done;}
+    if (!session.done){fprintf(stderr, "stopped during warm-up\n"); saved = EINTR; goto done;}
+
+    encoder = encoder_name(&stage.enc);
+    ok = true;
+
+done:
+    if (!ok && !saved) saved = errno;
+    if (have_stage && !encode_stage_stop(&stage) && ok){saved = errno; ok = false;}
+    if (have_writer && !writer_stop(&writer) && ok){saved = errno; ok = false;}
+    if (have_out && !clip_file_close(&out) && ok){saved = errno; ok = false;}
+    if (ok) *gates_ok = report(o, encoder, &session.start, &session.end);
+    if (have_out && !o->keep_output) (void)unlink(o->output);
+    capture_close(&cam);
+    if (have_motion) motion_destroy(&motion);
+    free(luma);
+    if (have_packets) packet_ring_destroy(&packets);
+    if (have_pool) buffer_pool_destroy(&pool);
+    if (have_ring) frame_ring_destroy(&ring);
+    if (have_loop) evloop_destroy(&loop);
+    errno = saved;
+    return ok;
+}
+
+int main(int argc, char **argv){
+    bench_options o;
+    if (!parse_args(&o, argc, argv)){usage(argv[0]);return 2;}
+#ifdef CV_PI5_TRACE
+    if (o.trace && !trace_start()) perror("trace"); // Measured without a timeline
+#else
+    if (o.trace) fprintf(stderr, "built without CV_PI5_TRACE, no tracepoints\n");
+#endif
+
+    bool gates_ok = false;
+    if (!run(&o, &gates_ok)){perror("cam_bench");return 2;}
+    return gates_ok ? 0 : 1;
+}
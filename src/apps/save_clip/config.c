@@ -0,0 +1,498 @@
+#include "config.h"
+#include "cv_pi5/clip_reaper.h"
+#include "cv_pi5/worker_pool.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum {
+    KEY_STRING,
+    KEY_BOOL,
+    KEY_INT,
+    KEY_U8,
+    KEY_U32,
+    KEY_U64,                    // accepts 0x... too, for CPU masks
+    KEY_MEGABYTES,              // size_t, given in MiB
+    KEY_MEGABYTES_U64,
+} key_type;
+
+typedef struct {
+    const char *section;
+    const char *key;
+    key_type type;
+    size_t offset;
+    size_t size;                // KEY_STRING buffer size
+    const char *help;
+} config_key;
+
+#define KEY(sec, k, t, field, h) { sec, k, t, offsetof(app_config, field), sizeof ((app_config *)0)->field, h }
+#define CAM_KEY(k, t, field, h) { "camera", k, t, offsetof(camera_spec, field), sizeof ((camera_spec *)0)->field, h }
+
+static const config_key app_keys[] = {
+    KEY("general",  "verbose",          KEY_BOOL,       verbose,                "progress and ring statistics on stdout"),
+    KEY("general",  "trace",            KEY_BOOL,       trace,                  "ftrace markers per pipeline stage (profile builds)"),
+    KEY("storage",  "dir",              KEY_STRING,     output_dir,             "where clips are written"),
+    KEY("storage",  "reserve_mb",       KEY_MEGABYTES_U64, storage_reserve_bytes, "free space kept ahead of the next clip"),
+    KEY("storage",  "preallocate",      KEY_BOOL,       clip_preallocate,       "fallocate each clip up front"),
+    KEY("storage",  "direct_io",        KEY_BOOL,       clip_direct_io,         "O_DIRECT clip writes"),
+    KEY("storage",  "writeback_mb",     KEY_MEGABYTES_U64, sync_writeback_bytes, "start writeback every N MiB written, 0 = timer only"),
+    KEY("storage",  "writeback_ms",     KEY_U32,        sync_interval_ms,       "and every N ms, 0 = by size only"),
+    KEY("storage",  "sync_fragments",   KEY_U32,        sync_fragments,         "fdatasync every N fragments (keyframes for es), 0 = never"),
+    KEY("storage",  "staging_dir",      KEY_STRING,     staging_dir,            "tmpfs clips are recorded into first, empty = straight to dir"),
+    KEY("storage",  "staging_mb",       KEY_MEGABYTES_U64, staging_bytes,       "staging space clips may take before spilling to dir"),
+    KEY("storage",  "move_mb",          KEY_MEGABYTES_U64, move_rate_bytes,     "MiB a second moved from staging to dir, 0 = unthrottled"),
+    KEY("retention", "motion_days",     KEY_U32,        motion_days,            "days motion clips are kept, 0 = until space is needed"),
+    KEY("retention", "manual_days",     KEY_U32,        manual_days,            "days triggered clips are kept, 0 = until space is needed"),
+    KEY("retention", "quota_mb",        KEY_MEGABYTES_U64, quota_bytes,         "all clips together, 0 = no quota"),
+    KEY("retention", "rate_mb",         KEY_MEGABYTES_U64, reap_rate_bytes,     "MiB a second deleted in the background, 0 = unthrottled"),
+    KEY("retention", "batch",           KEY_U32,        reap_batch,             "clips taken off the index at a time"),
+    KEY("retention", "interval_ms",     KEY_U32,        reap_interval_ms,       "between retention checks"),
+    KEY("clip",     "pre_ms",           KEY_U32,        pretrigger_ms,          "history kept ahead of a trigger"),
+    KEY("clip",     "post_ms",          KEY_U32,        posttrigger_ms,         "recording after a trigger"),
+    KEY("clip",     "pretrigger_mb",    KEY_MEGABYTES,  pretrigger_bytes,       "memory for the pre-trigger history, 0 = sized from bitrate and pretrigger_ms"),
+    KEY("clip",     "container",        KEY_STRING,     container,              "ts (crash-safe MPEG-TS) or es (bare stream)"),
+    KEY("clip",     "fragment_keyframes", KEY_U32,      fragment_keyframes,     "keyframes per self-contained ts fragment"),
+    KEY("clip",     "max_ms",           KEY_U32,        clip_max_ms,            "longest clip repeated triggers extend to, 0 unlimited"),
+    KEY("clip",     "debounce_ms",      KEY_U32,        trigger_debounce_ms,    "triggers ignored this soon after the last"),
+    KEY("clip",     "max_concurrent",   KEY_U32,        max_concurrent_clips,   "cameras recording at once, 0 unlimited"),
+    KEY("pipeline", "capture_buffers",  KEY_U32,        capture_buffers,        "V4L2 buffers per camera"),
+    KEY("pipeline", "frame_ring",       KEY_U32,        frame_ring_slots,       "frame ring slots, 0 = one per buffer"),
+    KEY("pipeline", "packet_ring",      KEY_U32,        packet_ring_slots,      "packet ring slots"),
+    KEY("pipeline", "packet_arena_mb",  KEY_MEGABYTES,  packet_arena_bytes,     "packet ring byte arena"),
+    KEY("pipeline", "pool_mb",          KEY_MEGABYTES,  pool_bytes,             "shared packet buffer pool, 0 = pretrigger_mb + packet_arena_mb"),
+    KEY("encoder",  "backend",          KEY_STRING,     encoder,                "auto, v4l2m2m, x264 or raw"),
+    KEY("encoder",  "bitrate",          KEY_U32,        bitrate_bps,            "bits per second"),
+    KEY("encoder",  "gop_frames",       KEY_U32,        gop_frames,             "frames between keyframes, 0 = fps"),
+    KEY("trigger",  "socket",           KEY_STRING,     trigger_socket,         "Unix datagram trigger socket, empty disables"),
+    KEY("trigger",  "gpio_chip",        KEY_STRING,     trigger_gpio_chip,      "gpiochip of the trigger line"),
+    KEY("trigger",  "gpio_line",        KEY_INT,        trigger_gpio_line,      "trigger line offset, -1 disables"),
+    KEY("motion",   "enabled",          KEY_BOOL,       motion_enabled,         "motion in the luma plane triggers"),
+    KEY("motion",   "step",             KEY_U32,        motion.step,            "downscale factor: 1, 2 or 4"),
+    KEY("motion",   "block",            KEY_U32,        motion.block,           "block edge: 16 or 32"),
+    KEY("motion",   "noise_floor",      KEY_U8,         motion.noise_floor,     "per-pixel difference ignored"),
+    KEY("motion",   "block_threshold",  KEY_U32,        motion.block_threshold, "summed difference of a changed block"),
+    KEY("motion",   "min_blocks",       KEY_U32,        motion.min_blocks,      "changed blocks for a motion frame"),
+    KEY("motion",   "hold_frames",      KEY_U32,        motion.hold_frames,     "motion frames in a row to trigger"),
+    KEY("motion",   "warmup_frames",    KEY_U32,        motion.warmup_frames,   "frames ignored at start"),
+    KEY("pressure", "enabled",          KEY_BOOL,       pressure_enabled,       "degrade bitrate, fps, then size under pressure"),
+    KEY("pressure", "interval_ms",      KEY_U32,        pressure_interval_ms,   "sampling interval"),
+    KEY("pressure", "free_low_mb",      KEY_MEGABYTES_U64, pressure.free_low_bytes, "free space that counts as pressure, 0 = 2 x reserve"),
+    KEY("pressure", "free_clear_mb",    KEY_MEGABYTES_U64, pressure.free_clear_bytes, "free space that clears it, 0 = 3 x reserve"),
+    KEY("pressure", "temp_high_mc",     KEY_INT,        pressure.temp_high_mc,  "SoC temperature, millidegrees C"),
+    KEY("pressure", "temp_clear_mc",    KEY_INT,        pressure.temp_clear_mc, "temperature that clears it"),
+    KEY("pressure", "queue_high_pct",   KEY_U32,        pressure.queue_high_pct, "fullest ring, percent"),
+    KEY("pressure", "queue_clear_pct",  KEY_U32,        pressure.queue_clear_pct, "ring level that clears it"),
+    KEY("pressure", "degrade_samples",  KEY_U32,        pressure.degrade_samples, "samples under pressure per step down"),
+    KEY("pressure", "recover_samples",  KEY_U32,        pressure.recover_samples, "clear samples per step back up"),
+    KEY("supervisor", "enabled",        KEY_BOOL,       supervisor_enabled,     "shed analytics, fps, then frames under sustained backlog"),
+    KEY("supervisor", "interval_ms",    KEY_U32,        supervisor.interval_ms, "sampling interval"),
+    KEY("supervisor", "stall_ms",       KEY_U32,        supervisor.stall_ms,    "a pipeline standing still this long is stalled"),
+    KEY("supervisor", "queue_high_pct", KEY_U32,        supervisor.queue_high_pct, "fullest ring, percent"),
+    KEY("supervisor", "queue_clear_pct", KEY_U32,       supervisor.queue_clear_pct, "ring level that clears it"),
+    KEY("supervisor", "write_high_ms",  KEY_U32,        supervisor.write_high_ms, "slowest write or fdatasync per sample, 0 = ignored"),
+    KEY("supervisor", "escalate_samples", KEY_U32,      supervisor.escalate_samples, "backed-up samples per step up"),
+    KEY("supervisor", "recover_samples", KEY_U32,       supervisor.recover_samples, "clear samples per step back down"),
+    KEY("supervisor", "watchdog",       KEY_STRING,     watchdog_path,          "watchdog device, e.g. /dev/watchdog, empty = none"),
+    KEY("supervisor", "watchdog_timeout_s", KEY_U32,    supervisor.watchdog_timeout_s, "set on the device, 0 = driver default"),
+    KEY("sidecar",  "index",            KEY_BOOL,       sidecar_index,          "keyframe seek index next to each clip"),
+    KEY("sidecar",  "thumbnail_width",  KEY_U32,        thumbnail_width,        "JPEG thumbnail next to each clip, 0 disables"),
+    KEY("sidecar",  "workers",          KEY_U32,        sidecar_workers,        "idle-priority threads writing sidecars"),
+    KEY("stats",    "socket",           KEY_STRING,     stats_socket,           "Unix stream socket serving metrics, empty disables"),
+    KEY("stats",    "interval_ms",      KEY_U32,        metrics_interval_ms,    "metrics dump to stderr, 0 disables"),
+};
+
+static const config_key camera_keys[] = {
+    CAM_KEY("device",           KEY_STRING, device,             "V4L2 capture node, synthetic or replay:FILE"),
+    CAM_KEY("width",            KEY_U32,    width,              "capture width"),
+    CAM_KEY("height",           KEY_U32,    height,             "capture height"),
+    CAM_KEY("fps",              KEY_U32,    fps,                "frames per second"),
+    CAM_KEY("cpu_mask",         KEY_U64,    cpu_mask,           "capture thread cores, 0 = unpinned"),
+    CAM_KEY("rt_priority",      KEY_INT,    rt_priority,        "capture thread SCHED_FIFO priority, 0 = none"),
+    CAM_KEY("encoder_cpu_mask", KEY_U64,    encoder_cpu_mask,   "encode stage cores"),
+    CAM_KEY("lores_device",     KEY_STRING, lores_device,       "low-res side stream for motion, empty = main stream"),
+    CAM_KEY("lores_width",      KEY_U32,    lores_width,        "side stream width"),
+    CAM_KEY("lores_height",     KEY_U32,    lores_height,       "side stream height"),
+    CAM_KEY("lores_cpu_mask",   KEY_U64,    lores_cpu_mask,     "analytics thread cores, 0 = unpinned"),
+    CAM_KEY("export_socket",    KEY_STRING, export_socket,      "Unix socket sharing frames zero-copy, empty = off"),
+    CAM_KEY("stream_port",      KEY_U32,    stream_port,        "TCP port streaming live MPEG-TS to viewers, 0 = off"),
+};
+
+static const camera_spec default_camera = {
+    .name = "cam0", .device = "/dev/video0", .width = 1920, .height = 1080, .fps = 30,
+    .cpu_mask = 0x1, .rt_priority = 50, .encoder_cpu_mask = 0xC, // Software encoding stays on cores 2-3
+    .lores_width = 480, .lores_height = 270,    // What the main stream's luma is scored at with step 4
+};
+
+void config_defaults(app_config *cfg){
+    memset(cfg, 0, sizeof *cfg);
+    cfg->verbose = true;
+
+    snprintf(cfg->output_dir, sizeof cfg->output_dir, "%s", "/var/lib/cam_trigger/clips");
+    cfg->storage_reserve_bytes = (uint64_t)1 << 30;
+    cfg->clip_preallocate = true;
+    cfg->clip_direct_io = true;
+    cfg->sync_writeback_bytes = (uint64_t)4 << 20;
+    cfg->sync_interval_ms = 1000;
+    cfg->sync_fragments = 1;            // With one keyframe a second, about a second of video at stake
+    cfg->staging_bytes = (uint64_t)256 << 20;
+    cfg->move_rate_bytes = (uint64_t)8 << 20; // Well under what an SD card sustains, leaving it room for direct writes
+
+    cfg->motion_days = 7;
+    cfg->manual_days = 30;
+    cfg->reap_rate_bytes = (uint64_t)64 << 20; // Deleting costs the flash journal and discard work, not the bytes themselves
+    cfg->reap_batch = 16;
+    cfg->reap_interval_ms = 60000;
+
+    cfg->pretrigger_ms = 2000;
+    cfg->posttrigger_ms = 10000;
+    cfg->pretrigger_bytes = 0;          // Sized by size_pretrigger(): a fixed default is wrong for every bitrate but one
+    snprintf(cfg->container, sizeof cfg->container, "%s", "ts");
+    cfg->fragment_keyframes = 1;
+    cfg->clip_max_ms = 60000;
+    cfg->trigger_debounce_ms = 250;     // A flickering sensor makes one trigger, not a dozen
+    cfg->max_concurrent_clips = 0;
+
+    cfg->capture_buffers = 12;
+    cfg->packet_ring_slots = 256;
+    cfg->packet_arena_bytes = (size_t)16 << 20;
+
+    snprintf(cfg->encoder, sizeof cfg->encoder, "%s", "auto");
+    cfg->bitrate_bps = 8000000;
+
+    snprintf(cfg->trigger_socket, sizeof cfg->trigger_socket, "%s", "/tmp/cam_trigger.sock");
+    snprintf(cfg->trigger_gpio_chip, sizeof cfg->trigger_gpio_chip, "%s", "/dev/gpiochip0");
+    cfg->trigger_gpio_line = -1;
+
+    cfg->motion_enabled = true;
+    cfg->motion = (motion_config){
+        .step = 4,                      // 1920x1080 is scored at 480x270
+        .block = 16,
+        .noise_floor = 12,
+        .block_threshold = 16 * 16 * 8, // Mean change of 8 levels above the noise floor
+        .min_blocks = 4,
+        .hold_frames = 3,
+        .warmup_frames = 30,
+    };
+
+    cfg->pressure_enabled = true;
+    cfg->pressure_interval_ms = 1000;
+    cfg->pressure = (pressure_config){
+        .temp_high_mc = 78000,          // The Pi 5 firmware starts throttling at 80 C
+        .temp_clear_mc = 70000,
+        .queue_high_pct = 50,
+        .queue_clear_pct = 20,
+        .degrade_samples = 3,
+        .recover_samples = 10,
+    };
+
+    cfg->supervisor_enabled = true;
+    cfg->supervisor = (supervisor_config){
+        .interval_ms = 200,
+        .stall_ms = 10000,
+        .queue_high_pct = 75,           // Above the pressure controller's: it gets the first go
+        .queue_clear_pct = 30,
+        .write_high_ms = 1000,
+        .escalate_samples = 5,
+        .recover_samples = 25,
+        .watchdog_timeout_s = 15,
+    };
+
+    cfg->sidecar_index = true;
+    cfg->thumbnail_width = 320;
+    cfg->sidecar_workers = 1;           // A few files per clip, never in a hurry
+
+    snprintf(cfg->stats_socket, sizeof cfg->stats_socket, "%s", "/tmp/cam_trigger.stats");
+    cfg->metrics_interval_ms = 10000;
+}
+
+static bool parse_unsigned(const char *value, uint64_t max, uint64_t *out){
+    if (!*value || *value == '-') return false;
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(value, &end, 0);
+    if (errno || *end || v > max) return false;
+    *out = v;
+    return true;
+}
+
+static bool set_value(void *base, const config_key *k, const char *value){
+    void *field = (char *)base + k->offset;
+    uint64_t u;
+    switch (k->type){
+    case KEY_STRING:
+        if (strlen(value) >= k->size) return false;
+        memcpy(field, value, strlen(value) + 1);
+        return true;
+    case KEY_BOOL:
+        if (!strcmp(value, "true") || !strcmp(value, "yes") || !strcmp(value, "on") || !strcmp(value, "1")) *(bool *)field = true;
+        else if (!strcmp(value, "false") || !strcmp(value, "no") || !strcmp(value, "off") || !strcmp(value, "0")) *(bool *)field = false;
+        else return false;
+        return true;
+    case KEY_INT: {
+        char *end;
+        errno = 0;
+        long v = strtol(value, &end, 0);
+        if (!*value || errno || *end || v < -1 || v > INT32_MAX) return false;
+        *(int *)field = (int)v;
+        return true;
+    }
+    case KEY_U8:
+        if (!parse_unsigned(value, UINT8_MAX, &u)) return false;
+        *(uint8_t *)field = (uint8_t)u;
+        return true;
+    case KEY_U32:
+        if (!parse_unsigned(value, UINT32_MAX, &u)) return false;
+        *(uint32_t *)field = (uint32_t)u;
+        return true;
+    case KEY_U64:
+        if (!parse_unsigned(value, UINT64_MAX, &u)) return false;
+        *(uint64_t *)field = u;
+        return true;
+    case KEY_MEGABYTES:
+        if (!parse_unsigned(value, SIZE_MAX >> 20, &u)) return false;
+        *(size_t *)field = (size_t)u << 20;
+        return true;
+    case KEY_MEGABYTES_U64:
+        if (!parse_unsigned(value, UINT64_MAX >> 20, &u)) return false;
+        *(uint64_t *)field = u << 20;
+        return true;
+    }
+    return false;
+}
+
+static camera_spec *camera_named(app_config *cfg, const char *name){
+    /*
+        Finds the camera, or appends one with the built-in cam0's settings
+        under the new name. Any camera given at all replaces the built-in one.
+    */
+    if (!*name || strlen(name) >= sizeof cfg->cameras[0].name){errno = EINVAL;return NULL;}
+    for (size_t i = 0; i < cfg->camera_count; ++i)
+        if (!strcmp(cfg->cameras[i].name, name)) return &cfg->cameras[i];
+    if (cfg->camera_count == CONFIG_MAX_CAMERAS){errno = ENOSPC;return NULL;}
+
+    camera_spec *cam = &cfg->cameras[cfg->camera_count++];
+    *cam = default_camera;
+    snprintf(cam->name, sizeof cam->name, "%s", name);
+    return cam;
+}
+
+bool config_set(app_config *cfg, const char *section, const char *key, const char *value){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!cfg || !section || !key || !value){errno = EINVAL;return false;}
+
+    if (!strncmp(section, "camera.", 7)){
+        for (size_t i = 0; i < sizeof camera_keys / sizeof camera_keys[0]; ++i){
+            if (strcmp(camera_keys[i].key, key)) continue;
+            camera_spec *cam = camera_named(cfg, section + 7);
+            if (!cam) return false;
+            if (!set_value(cam, &camera_keys[i], value)){errno = EINVAL;return false;}
+            return true;
+        }
+        errno = ENOENT;
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof app_keys / sizeof app_keys[0]; ++i){
+        if (strcmp(app_keys[i].section, section) || strcmp(app_keys[i].key, key)) continue;
+        if (!set_value(cfg, &app_keys[i], value)){errno = EINVAL;return false;}
+        return true;
+    }
+    errno = ENOENT;
+    return false;
+}
+
+static char *trim(char *s){
+    while (isspace((unsigned char)*s)) ++s;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+bool config_load_file(app_config *cfg, const char *path, char *err, size_t err_size){
+    /*
+        "key = value" lines under "[section]" headers; '#' and ';' start
+        comments. A section header on its own is enough to add a camera.
+        If successful returns true
+        else returns false and an errno, with the reason in err
+    */
+    FILE *f = fopen(path, "re");
+    if (!f){snprintf(err, err_size, "%s: %s", path, strerror(errno));return false;}
+
+    char line[512], section[64] = "";
+    unsigned lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof line, f)){
+        ++lineno;
+        char *hash = strpbrk(line, "#;");
+        if (hash) *hash = '\0';
+        char *s = trim(line);
+        if (!*s) continue;
+
+        if (*s == '['){
+            char *close = strchr(s, ']');
+            if (!close || close[1] || (size_t)(close - s - 1) >= sizeof section){
+                snprintf(err, err_size, "%s:%u: bad section header", path, lineno);
+                errno = EINVAL; ok = false; break;
+            }
+            *close = '\0';
+            snprintf(section, sizeof section, "%s", trim(s + 1));
+            if (!strncmp(section, "camera.", 7) && !camera_named(cfg, section + 7)){
+                snprintf(err, err_size, "%s:%u: camera %s: %s", path, lineno, section + 7, strerror(errno));
+                ok = false;
+            }
+            continue;
+        }
+
+        char *eq = strchr(s, '=');
+        if (!eq){snprintf(err, err_size, "%s:%u: expected key = value", path, lineno); errno = EINVAL; ok = false; break;}
+        *eq = '\0';
+        char *key = trim(s), *value = trim(eq + 1);
+        if (!config_set(cfg, section, key, value)){
+            snprintf(err, err_size, "%s:%u: %s.%s: %s", path, lineno, section, key,
+                     errno == ENOENT ? "unknown key" : errno == ENOSPC ? "too many cameras" : "bad value");
+            ok = false;
+        }
+    }
+    if (ok && ferror(f)){snprintf(err, err_size, "%s: read error", path); errno = EIO; ok = false;}
+
+    int saved = errno;
+    fclose(f);
+    errno = saved;
+    return ok;
+}
+
+static void usage(const char *argv0){
+    printf("usage: %s [-c FILE] [--section.key=value ...]\n\n", argv0);
+    printf("Without -c, %s is read if it exists.\n\n", CONFIG_DEFAULT_PATH);
+    for (size_t i = 0; i < sizeof app_keys / sizeof app_keys[0]; ++i)
+        printf("  %s.%-20s %s\n", app_keys[i].section, app_keys[i].key, app_keys[i].help);
+    for (size_t i = 0; i < sizeof camera_keys / sizeof camera_keys[0]; ++i)
+        printf("  camera.NAME.%-13s %s\n", camera_keys[i].key, camera_keys[i].help);
+}
+
+static void size_pretrigger(app_config *cfg){
+    /*
+        Unless set, the pre-trigger history gets what pretrigger_ms takes
+        at the encoder's bitrate plus a keyframe interval, for the keyframe
+        it has to start from, doubled for bursts over the average. The pool
+        behind it is prefaulted and locked, per camera, so it is kept to
+        what the bitrate needs (about 6 MiB at the default 8 Mbit/s)
+    */
+    if (cfg->pretrigger_bytes) return;
+    uint32_t slowest = UINT32_MAX;
+    for (size_t i = 0; i < cfg->camera_count; ++i)
+        if (cfg->cameras[i].fps && cfg->cameras[i].fps < slowest) slowest = cfg->cameras[i].fps;
+    uint64_t gop_ms = cfg->gop_frames && slowest != UINT32_MAX ? (uint64_t)cfg->gop_frames * 1000u / slowest : 1000u;
+    uint64_t bytes = (uint64_t)cfg->bitrate_bps / 8u * ((uint64_t)cfg->pretrigger_ms + gop_ms) / 1000u * 2u;
+    bytes = (bytes + ((1u << 20) - 1)) & ~(uint64_t)((1u << 20) - 1); // Whole MiB, at least one
+    cfg->pretrigger_bytes = bytes ? (size_t)bytes : (size_t)1 << 20;
+}
+
+static bool validate(const app_config *cfg, char *err, size_t err_size){
+    if (!cfg->output_dir[0]){snprintf(err, err_size, "storage.dir is empty");return false;}
+    if (cfg->staging_dir[0] && !cfg->staging_bytes){snprintf(err, err_size, "storage.staging_mb must be positive");return false;}
+    if (cfg->staging_dir[0] && !strcmp(cfg->staging_dir, cfg->output_dir)){snprintf(err, err_size, "storage.staging_dir must differ from storage.dir");return false;}
+    if (!cfg->reap_interval_ms || !cfg->reap_batch || cfg->reap_batch > CLIP_REAPER_MAX_BATCH){
+        snprintf(err, err_size, "retention.interval_ms must be positive and retention.batch 1 to %d", CLIP_REAPER_MAX_BATCH);
+        return false;
+    }
+    if ((uint64_t)cfg->motion_days * 86400u > UINT32_MAX || (uint64_t)cfg->manual_days * 86400u > UINT32_MAX){snprintf(err, err_size, "retention days must be under 49710");return false;}
+    if (cfg->posttrigger_ms == 0){snprintf(err, err_size, "clip.post_ms must be positive");return false;}
+    if (cfg->clip_max_ms && cfg->clip_max_ms < cfg->posttrigger_ms){snprintf(err, err_size, "clip.max_ms must be 0 or at least clip.post_ms");return false;}
+    if (strcmp(cfg->container, "ts") && strcmp(cfg->container, "es")){snprintf(err, err_size, "clip.container must be ts or es");return false;}
+    if (cfg->capture_buffers == 0 || cfg->capture_buffers > CAPTURE_MAX_BUFFERS){
+        snprintf(err, err_size, "pipeline.capture_buffers must be 1 to %d", CAPTURE_MAX_BUFFERS);
+        return false;
+    }
+    if (cfg->packet_ring_slots == 0 || cfg->packet_arena_bytes == 0){snprintf(err, err_size, "pipeline.packet_ring and packet_arena_mb must be positive");return false;}
+    if (cfg->pressure_enabled && !cfg->pressure_interval_ms){snprintf(err, err_size, "pressure.interval_ms must be positive");return false;}
+    if (cfg->supervisor_enabled){
+        const supervisor_config *sv = &cfg->supervisor;
+        if (!sv->interval_ms || !sv->escalate_samples || !sv->recover_samples){snprintf(err, err_size, "supervisor.interval_ms and _samples must be positive");return false;}
+        if (sv->stall_ms <= sv->interval_ms){snprintf(err, err_size, "supervisor.stall_ms must be longer than supervisor.interval_ms");return false;}
+        if (sv->queue_clear_pct > sv->queue_high_pct || sv->queue_high_pct > 100){snprintf(err, err_size, "supervisor.queue_clear_pct must be at most queue_high_pct, at most 100");return false;}
+    } else if (cfg->watchdog_path[0]){
+        snprintf(err, err_size, "supervisor.watchdog needs supervisor.enabled");
+        return false;
+    }
+    if ((cfg->sidecar_index || cfg->thumbnail_width) && (cfg->sidecar_workers == 0 || cfg->sidecar_workers > WORKER_POOL_MAX_THREADS)){
+        snprintf(err, err_size, "sidecar.workers must be 1 to %d", WORKER_POOL_MAX_THREADS);
+        return false;
+    }
+    for (size_t i = 0; i < cfg->camera_count; ++i){
+        const camera_spec *cam = &cfg->cameras[i];
+        if (!cam->device[0] || !cam->width || !cam->height || !cam->fps){
+            snprintf(err, err_size, "camera.%s needs device, width, height and fps", cam->name);
+            return false;
+        }
+        if (cam->lores_device[0] && (!cam->lores_width || !cam->lores_height)){
+            snprintf(err, err_size, "camera.%s.lores_device needs lores_width and lores_height", cam->name);
+            return false;
+        }
+        if (cam->stream_port > 65535){snprintf(err, err_size, "camera.%s.stream_port must be 0 to 65535", cam->name);return false;}
+        for (size_t j = 0; j < i; ++j)
+            if (cam->stream_port && cfg->cameras[j].stream_port == cam->stream_port){
+                snprintf(err, err_size, "camera.%s.stream_port is camera.%s's too", cam->name, cfg->cameras[j].name);
+                return false;
+            }
+    }
+    return true;
+}
+
+int config_parse(app_config *cfg, int argc, char **argv){
+    /*
+        Returns 1 to run, 0 after printing usage, -1 after printing an error
+    */
+    config_defaults(cfg);
+
+    const char *path = NULL;
+    for (int i = 1; i < argc; ++i){
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")){usage(argv[0]);return 0;}
+        if (!strcmp(argv[i], "-c")){
+            if (i + 1 >= argc){fprintf(stderr, "-c needs a file\n");return -1;}
+            path = argv[++i];
+        }
+    }
+
+    char err[512];
+    bool explicit_path = path != NULL;
+    if (!path) path = CONFIG_DEFAULT_PATH;
+    if ((explicit_path || access(path, F_OK) == 0) && !config_load_file(cfg, path, err, sizeof err)){
+        fprintf(stderr, "%s\n", err);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; ++i){
+        if (!strcmp(argv[i], "-c")){++i;continue;}
+        const char *arg = argv[i];
+        if (strncmp(arg, "--", 2)){fprintf(stderr, "unexpected argument %s, see -h\n", arg);return -1;}
+
+        // --section.key=value; the key is after the last '.' so camera.cam0.fps works
+        char buf[512];
+        if (strlen(arg + 2) >= sizeof buf){fprintf(stderr, "%s: too long\n", arg);return -1;}
+        strcpy(buf, arg + 2);
+        char *eq = strchr(buf, '=');
+        if (eq) *eq = '\0';
+        char *dot = strrchr(buf, '.');
+        if (!eq || !dot){fprintf(stderr, "%s: expected --section.key=value\n", arg);return -1;}
+        *dot = '\0';
+        if (!config_set(cfg, buf, dot + 1, eq + 1)){
+            fprintf(stderr, "%s: %s\n", arg,
+                    errno == ENOENT ? "unknown key" : errno == ENOSPC ? "too many cameras" : "bad value");
+            return -1;
+        }
+    }
+
+    if (cfg->camera_count == 0) cfg->cameras[cfg->camera_count++] = default_camera;
+    size_pretrigger(cfg);
+    if (!validate(cfg, err, sizeof err)){fprintf(stderr, "%s\n", err);return -1;}
+    return 1;
+}
@@ -0,0 +1,149 @@
+#ifndef CV_PI5_SAVE_CLIP_CONFIG_H
+#define CV_PI5_SAVE_CLIP_CONFIG_H
+
+/*
+    cam_trigger's runtime configuration, parsed once at startup into one flat
+    struct that nothing writes to afterwards.
+
+    Sources, each overriding the one before:
+        built-in defaults
+        an INI file: -c FILE, else /etc/cam_trigger.conf if it exists
+        command-line overrides: --section.key=value
+
+    e.g.
+        [storage]
+        dir = /mnt/nvme/clips
+
+        [camera.cam0]
+        device = /dev/video0
+        width = 1920
+        height = 1080
+        cpu_mask = 0x1
+        lores_device = /dev/video1
+
+    A [camera.NAME] section adds a camera, or changes it if NAME already
+    exists; when no file names one, a single cam0 on /dev/video0 is used.
+    Keys are listed by `cam_trigger -h`.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cv_pi5/motion.h"
+#include "cv_pi5/pressure.h"
+#include "cv_pi5/supervisor.h"
+
+#define CONFIG_MAX_CAMERAS 4
+#define CONFIG_PATH_MAX 256
+#define CONFIG_DEFAULT_PATH "/etc/cam_trigger.conf"
+
+typedef struct {
+    char name[16];              // prefixes clip and temp file names
+    char device[64];
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+    uint64_t cpu_mask;          // capture and event loop thread, 0 leaves it unpinned
+    int rt_priority;            // SCHED_FIFO priority of that thread, 0 keeps SCHED_OTHER
+    uint64_t encoder_cpu_mask;  // encode stage, and a software encoder's workers
+    char lores_device[64];      // ISP low-res output for motion, empty scores the main stream's luma
+    uint32_t lores_width;
+    uint32_t lores_height;
+    uint64_t lores_cpu_mask;    // analytics thread scoring the low-res stream
+    char export_socket[108];    // publishes the main stream's frames to other processes, empty disables
+    uint32_t stream_port;       // TCP port serving the live transport stream to viewers, 0 disables
+} camera_spec;
+
+typedef struct {
+    bool verbose;
+    bool trace;                         // ftrace markers per pipeline stage, in builds with CV_PI5_TRACE
+
+    // [storage]
+    char output_dir[CONFIG_PATH_MAX];
+    uint64_t storage_reserve_bytes;     // free space kept ahead of the next clip
+    bool clip_preallocate;              // fallocate bitrate x duration up front
+    bool clip_direct_io;                // O_DIRECT writes, bypassing the page cache
+    uint64_t sync_writeback_bytes;      // start writeback every this many bytes, 0 only on the timer
+    uint32_t sync_interval_ms;          // and this often, 0 disables the timer
+    uint32_t sync_fragments;            // fdatasync every this many fragments and at the end, 0 never
+    char staging_dir[CONFIG_PATH_MAX];  // tmpfs clips are recorded into before moving to output_dir, empty for none
+    uint64_t staging_bytes;             // of it clips may take before new ones go straight to output_dir
+    uint64_t move_rate_bytes;           // per second, copying staged clips to output_dir, 0 unthrottled
+
+    // [retention]
+    uint32_t motion_days;               // motion clips kept this long, 0 until space is needed
+    uint32_t manual_days;               // clips a trigger source asked for
+    uint64_t quota_bytes;               // all clips in output_dir together, 0 for no quota
+    uint64_t reap_rate_bytes;           // per second freed by the background reaper, 0 unthrottled
+    uint32_t reap_batch;                // clips it takes off the index per lock hold
+    uint32_t reap_interval_ms;          // between retention checks, and after every clip saved
+
+    // [clip]
+    uint32_t pretrigger_ms;
+    uint32_t posttrigger_ms;
+    size_t pretrigger_bytes;            // 0 until config_parse() sizes it from bitrate_bps and pretrigger_ms
+    char container[8];                  // ts: MPEG-TS, playable up to a power cut; es: bare elementary stream
+    uint32_t fragment_keyframes;        // ts only: keyframes between PAT/PMT repeats, i.e. per fragment
+    uint32_t clip_max_ms;               // triggers extend a clip up to this long, 0 without limit
+    uint32_t trigger_debounce_ms;       // triggers this soon after the last one are ignored
+    uint32_t max_concurrent_clips;      // cameras recording a clip at once, 0 without limit
+
+    // [pipeline]
+    uint32_t capture_buffers;           // spare buffers absorb encode and write latency spikes
+    uint32_t frame_ring_slots;          // 0: one per capture buffer
+    uint32_t packet_ring_slots;
+    size_t packet_arena_bytes;
+    size_t pool_bytes;                  // shared packet buffers; 0: pre-trigger memory plus the arena
+
+    // [encoder]
+    char encoder[16];                   // auto, v4l2m2m, x264 or raw
+    uint32_t bitrate_bps;
+    uint32_t gop_frames;                // 0: one keyframe a second
+
+    // [trigger]
+    char trigger_socket[CONFIG_PATH_MAX];   // empty disables the socket trigger
+    char trigger_gpio_chip[CONFIG_PATH_MAX];
+    int trigger_gpio_line;              // -1 disables the GPIO trigger
+
+    // [motion]
+    bool motion_enabled;
+    motion_config motion;               // geometry is filled in per camera
+
+    // [pressure]
+    bool pressure_enabled;
+    uint32_t pressure_interval_ms;
+    pressure_config pressure;           // free space marks of 0 follow storage_reserve_bytes
+
+    // [supervisor]
+    bool supervisor_enabled;
+    supervisor_config supervisor;       // watchdog left NULL, for the caller to point at watchdog_path
+    char watchdog_path[CONFIG_PATH_MAX];// hardware watchdog kicked while every pipeline progresses, empty for none
+
+    // [sidecar]
+    bool sidecar_index;                 // <clip>.idx: keyframe offsets, times and motion scores
+    uint32_t thumbnail_width;           // <clip>.jpg this many pixels wide, 0 disables
+    uint32_t sidecar_workers;           // idle-priority threads writing them
+
+    // [stats]
+    char stats_socket[CONFIG_PATH_MAX];
+    uint32_t metrics_interval_ms;       // 0 disables the periodic dump
+
+    camera_spec cameras[CONFIG_MAX_CAMERAS];
+    size_t camera_count;
+} app_config;
+
+void config_defaults(app_config *cfg);
+
+// Sets one key; section is e.g. "storage" or "camera.cam0".
+// Returns true, or false with errno EINVAL (bad value), ENOENT (unknown key) or ENOSPC (too many cameras)
+bool config_set(app_config *cfg, const char *section, const char *key, const char *value);
+
+// Applies an INI file. On failure returns false with errno set and a message, with the line, in err
+bool config_load_file(app_config *cfg, const char *path, char *err, size_t err_size);
+
+// Defaults, config file, then --section.key=value overrides from argv.
+// Returns 1 to run, 0 when -h was asked for (usage already printed), -1 on error (message already printed)
+int config_parse(app_config *cfg, int argc, char **argv);
+
+#endif
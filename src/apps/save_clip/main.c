@@ -1,31 +1,1048 @@
 #include <stdio.h>
-#inlcude <stdlib.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
-#inlcude <sys/types.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <linux/videodev2.h>
 
+#include "cv_pi5/analytics.h"
+#include "cv_pi5/buffer_pool.h"
+#include "cv_pi5/capture.h"
+#include "cv_pi5/clip_file.h"
+#include "cv_pi5/clip_mover.h"
+#include "cv_pi5/clip_name.h"
+#include "cv_pi5/clip_reaper.h"
+#include "cv_pi5/encode_stage.h"
+#include "cv_pi5/encoder.h"
+#include "cv_pi5/evloop.h"
+#include "cv_pi5/frame_export.h"
+#include "cv_pi5/frame_ring.h"
+#include "cv_pi5/metrics.h"
+#include "cv_pi5/motion.h"
+#include "cv_pi5/packet_ring.h"
+#include "cv_pi5/pixconv.h"
+#include "cv_pi5/pressure.h"
+#include "cv_pi5/pretrigger.h"
+#include "cv_pi5/sidecar.h"
+#include "cv_pi5/storage.h"
+#include "cv_pi5/storage_probe.h"
+#include "cv_pi5/stream_sink.h"
+#include "cv_pi5/supervisor.h"
+#include "cv_pi5/trigger.h"
+#include "cv_pi5/trace.h"
+#include "cv_pi5/ts_mux.h"
+#include "cv_pi5/wall_clock.h"
+#include "cv_pi5/worker_pool.h"
+#include "cv_pi5/writer.h"
 
-static char output_dir[] = "/home/james/ComputerVision/CV_PI5_data/clips";
+#include "config.h"
 
-void activate_cam(const char* path_temp, int duration_ms, bool verbose){
-    
+
+static app_config cfg;    // Parsed once by config_parse(), read-only afterwards
+static const char clip_temp_suffix[] = ".clip.tmp"; // After a '.', the camera name and a slot: hidden, so the clip index never counts a clip in progress
+static const char metrics_measurement[] = "cam_trigger";
+static const unsigned clip_name_attempts = 16; // Names tried for one clip before giving up on it, each the next in sequence
+
+typedef struct {
+    const camera_spec *spec;
+    evloop loop;                // this camera's own: capture, clip timer, control
+    int control_fd;             // eventfd the main thread kicks for a trigger or a stop
+    atomic_bool trigger_pending;    // motion seen by the analytics thread
+    atomic_bool manual_pending;     // a trigger source fired: the clip is kept for retention.manual_days
+    atomic_bool stop_pending;
+    clip_namer namer;
+    bool namer_ready;
+    pressure_controller pressure;   // outlives a clip, so the next one opens at the level this one left
+    bool pressure_ready;
+    pthread_t thread;
+    bool started;
+    bool ok;
+    int error;
+} camera_pipeline;
+
+static evloop main_loop;
+static trigger_source triggers[2];
+static int trigger_count;
+static camera_pipeline pipelines[CONFIG_MAX_CAMERAS];
+static unsigned pipelines_running;
+static int pipelines_done_fd = -1; // eventfd, one count per pipeline thread that exits
+static pthread_mutex_t clips_lock = PTHREAD_MUTEX_INITIALIZER; // clip index and renames into output_dir
+static clip_index clips;
+static bool clips_indexed;
+static storage_probe output_probe; // What cfg.output_dir's filesystem can do, refreshed on mount changes
+static bool output_probed;
+static worker_pool sidecar_workers; // Thumbnails and seek indexes, written at idle priority once a clip is in place
+static bool sidecar_workers_ready;
+static clip_mover mover; // Staged clips on to output_dir, when cfg.staging_dir is set
+static bool mover_ready;
+static uint64_t staging_reserved; // With clips_lock held: staging space promised to clips still recording
+static clip_reaper reaper; // Retention and the quota, from the clip index, paced so deletions never crowd the clips' writes
+static bool reaper_ready;
+static wall_clock wall; // Capture timestamps to wall time, updated by this thread once a second
+static bool wall_ready;
+static supervisor health; // Watches every pipeline from its own thread, and kicks the watchdog
+static bool health_ready;
+static bool shutdown_requested;
+static atomic_uint clips_recording; // cameras inside a clip's trigger window, at most cfg.max_concurrent_clips
+
+int check_storage(const char* path);
+char* create_filename(camera_pipeline *p, char *buffer, size_t size, uint64_t start_ns, bool manual);
+static bool save_clip(const char *temp_name, const char *clip_name);
+static bool output_direct_io(void);
+
+typedef struct {
+    clip_file file;
+    bool open;
+    bool staged;               // in cfg.staging_dir, else straight in cfg.output_dir
+    uint64_t reserved;         // of the staging budget, while staged and open
+    sidecar_job *job;          // NULL without sidecars
+    uint64_t start_ns;         // CLOCK_MONOTONIC of the trigger, 0 until one begins the clip
+    bool manual;               // a trigger source began or extended it, not only motion
+    char temp_name[64];        // in whichever directory the clip is recorded
+} clip_slot;
+
+typedef struct {
+    camera_pipeline *pipe;
+    capture_device *cam;
+    frame_ring *ring;
+    encode_stage *stage;
+    frame_writer *writer;
+    motion_detector *motion;   // NULL when motion triggering is off or runs on the low-res stream
+    capture_device *lores;     // NULL without a low-res side stream
+    frame_ring *lores_ring;
+    analytics_stage *analytics;
+    frame_export *export;      // NULL unless frames are shared with other processes
+    motion_log *scores;        // NULL unless scores go to the clip's seek index
+    sidecar_thumbnail *thumb;  // NULL without a thumbnail, else taken from the first frame recorded live
+    uint32_t motion_blocks;
+    const pixconv *luma_conv;  // NULL when motion reads the camera's own luma plane
+    uint8_t *luma;             // else its luma, converted here for each frame
+    packet_ring *packets;
+    clip_slot *slots;          // two: the clip being written and the next one, already open
+    unsigned current;
+    uint64_t rotations_seen;
+    int clip_timer;
+    unsigned frame_divisor;    // pressure: keep one frame in this many
+    unsigned scale_divisor;    // pressure: the size capture was opened at
+    int supervised;            // supervisor slot, -1 while unwatched
+    supervisor_action action;  // the supervisor's, as last applied here
+    int duration_ms;
+    bool one_shot;             // no trigger source: one clip is the whole run
+    bool triggered;            // inside a clip's trigger window
+    bool rotating;             // window over, the writer has yet to move to the next file
+    bool trigger_deferred;     // a trigger for the next clip: it came while rotating, or past clip.max_ms
+    bool next_manual;          // the trigger the next begin_clip() acts on was a manual one
+    bool restart;              // a clip boundary wants capture reopened
+    uint64_t clip_start_ns;
+    uint64_t last_trigger_ns;
+    uint64_t waiting_since_ns; // a trigger held back by clip.max_concurrent
+    unsigned clips_saved;
+    bool failed;
+    int error;
+    unsigned frames;
+    unsigned sensor_drops;
+    uint32_t last_sequence;
+} cam_session;
+
+static void requeue_capture(void *ctx, uint32_t index){
+    (void)capture_requeue(ctx, index); // Raw frames released by the writer go straight back to the driver
+}
+
+static void session_fail(evloop *loop, cam_session *s, int error){
+    if (!s->failed){s->failed = true; s->error = error;}
+    evloop_stop(loop);
+}
+
+static bool claim_clip(void){
+    unsigned n = atomic_load_explicit(&clips_recording, memory_order_relaxed);
+    do {
+        if (cfg.max_concurrent_clips && n >= cfg.max_concurrent_clips) return false;
+    } while (!atomic_compare_exchange_weak_explicit(&clips_recording, &n, n + 1, memory_order_relaxed, memory_order_relaxed));
+    return true;
+}
+
+static void release_clip(void){
+    atomic_fetch_sub_explicit(&clips_recording, 1, memory_order_relaxed);
+}
+
+static seek_index *slot_index(clip_slot *slot){
+    return slot->job && slot->job->want_index ? &slot->job->index : NULL;
+}
+
+static bool staging_reserve(uint64_t bytes){
+    // Room for one more clip of about bytes, in the staging budget and on the staging filesystem
+    struct statvfs vfs;
+    if (!mover_ready || statvfs(cfg.staging_dir, &vfs) != 0 || (uint64_t)vfs.f_bavail * vfs.f_frsize < bytes) return false;
+    pthread_mutex_lock(&clips_lock);
+    bool fits = clip_mover_pending_bytes(&mover) + staging_reserved + bytes <= cfg.staging_bytes;
+    if (fits) staging_reserved += bytes;
+    pthread_mutex_unlock(&clips_lock);
+    return fits;
+}
+
+static void staging_release(uint64_t bytes){
+    pthread_mutex_lock(&clips_lock);
+    staging_reserved -= bytes;
+    pthread_mutex_unlock(&clips_lock);
+}
+
+static bool slot_open(cam_session *s, clip_slot *slot){
+    /*
+        Makes room for the next clip and opens its temp file ahead of the
+        trigger, so that starting a clip never waits on the filesystem.
+        With a staging directory the clip is recorded there while the budget
+        has room for the longest clip triggers can make, and straight into
+        output_dir when it does not.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (check_storage(cfg.output_dir) < 0) return false;
+    uint64_t clip_ms = (cfg.clip_max_ms ? cfg.clip_max_ms : (uint32_t)s->duration_ms) + (uint64_t)cfg.pretrigger_ms;
+    uint64_t estimate = (uint64_t)cfg.bitrate_bps / 8u * clip_ms / 1000u;
+    slot->staged = staging_reserve(estimate);
+    slot->reserved = slot->staged ? estimate : 0;
+
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", slot->staged ? cfg.staging_dir : cfg.output_dir, slot->temp_name);
+    clip_file_options options = { 0 }; // Staged: RAM gains nothing from either
+    if (!slot->staged){
+        options.preallocate_bytes = cfg.clip_preallocate ? (uint64_t)cfg.bitrate_bps / 8u * ((uint64_t)s->duration_ms + cfg.pretrigger_ms) / 1000u : 0;
+        options.direct_io = cfg.clip_direct_io && output_direct_io();
+    }
+    if (!clip_file_open(&slot->file, path, &options)){
+        int saved = errno;
+        if (slot->staged) staging_release(slot->reserved);
+        errno = saved;
+        return false;
+    }
+    slot->open = true;
+
+    if (sidecar_workers_ready && !(slot->job = sidecar_job_create(s->cam->width, s->cam->height, cfg.sidecar_index, cfg.thumbnail_width)))
+        fprintf(stderr, "%s: sidecars: %s\n", s->pipe->spec->name, strerror(errno)); // The clip goes without
+    if (slot->job && s->scores){slot->job->index.scores = s->scores; slot->job->index.header.motion_blocks = s->motion_blocks;}
+    if (slot->job && wall_ready) slot->job->index.clock = &wall;
+    slot->start_ns = 0;
+    slot->manual = false;
+    return true;
+}
+
+static void submit_sidecars(sidecar_job *job, const char *clip_name){
+    // Once the clip is in output_dir
+    if (worker_pool_submit(&sidecar_workers, sidecar_job_run, job)) return;
+    fprintf(stderr, "sidecars for %s: %s\n", clip_name, strerror(errno)); // The clip itself is safe
+    sidecar_job_destroy(job);
+}
+
+static bool stage_clip(const char *temp_name, const char *clip_name, uint64_t bytes, sidecar_job *job){
+    /*
+        Names a finished clip in the staging directory and queues it, with
+        its sidecar job, for the mover; a clip renamed but not queued is
+        still picked up by the next start
+        If successful returns true
+        else returns false and an errno, leaving job with the caller; EEXIST
+        when a clip of that name is already staged
+    */
+    if (!clip_rename(mover.staging_fd, temp_name, mover.staging_fd, clip_name)) return false;
+    return clip_mover_submit(&mover, clip_name, bytes, job);
+}
+
+static bool slot_finish(cam_session *s, clip_slot *slot, bool closed, int error){
+    /*
+        Closes the slot's clip unless the writer already has, renames it
+        into place and queues its sidecars. A clip with a failed write is
+        kept for what it holds; an empty one, which never saw a trigger, is
+        deleted.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!slot->open) return true;
+    const char *name = s->pipe->spec->name;
+    slot->open = false;
+    if (!closed && !clip_file_close(&slot->file) && !error) error = errno;
+    if (error) fprintf(stderr, "%s: clip %s: %s\n", name, slot->file.size ? "cut short" : "lost", strerror(error));
+
+    sidecar_job *job = slot->job;
+    slot->job = NULL;
+    if (slot->staged) staging_release(slot->reserved); // The mover accounts for it from here
+    char clip_name[CLIP_NAME_MAX];
+    bool ok = true;
+    if (slot->file.size == 0){
+        char path[4096];
+        snprintf(path, sizeof path, "%s/%s", slot->staged ? cfg.staging_dir : cfg.output_dir, slot->temp_name);
+        (void)unlink(path);
+    } else {
+        ok = false;
+        for (unsigned attempt = 0; !ok && attempt < clip_name_attempts; ++attempt){ // Taken, by an earlier run: the next name
+            if (!create_filename(s->pipe, clip_name, sizeof clip_name, slot->start_ns, slot->manual)) break;
+            if (job && !sidecar_job_set_clip(job, cfg.output_dir, clip_name, s->scores)){
+                fprintf(stderr, "%s: sidecars for %s: %s\n", name, clip_name, strerror(errno));
+                sidecar_job_destroy(job);
+                job = NULL;
+            }
+            ok = slot->staged ? stage_clip(slot->temp_name, clip_name, slot->file.size, job) : save_clip(slot->temp_name, clip_name);
+            if (!ok && errno != EEXIST) break;
+        }
+        if (ok){
+            metrics_count(METRIC_CLIPS_SAVED, 1);
+            if (mover_ready && !slot->staged) metrics_count(METRIC_STAGING_SPILLS, 1);
+            ++s->clips_saved;
+            if (cfg.verbose) printf("%s: %s %s, %llu KiB\n", name, slot->staged ? "staged" : "saved", clip_name, (unsigned long long)(slot->file.size >> 10));
+            if (job && !slot->staged) submit_sidecars(job, clip_name);
+            job = NULL; // With the mover or the workers
+        } else {
+            fprintf(stderr, "%s: saving clip: %s\n", name, strerror(errno));
+        }
+    }
+    int saved = errno;
+    sidecar_job_destroy(job);
+    errno = saved;
+    return ok;
+}
+
+static bool begin_clip(cam_session *s, uint64_t now){
+    /*
+        The trigger proper: the pre-trigger history goes to the current
+        slot's clip, live frames follow, and the clip timer counts down
+        duration_ms from now. Returns false, leaving the trigger waiting,
+        while clip.max_concurrent other clips are recording
+    */
+    if (!claim_clip()){
+        if (!s->waiting_since_ns) s->waiting_since_ns = now;
+        return false;
+    }
+    s->waiting_since_ns = 0;
+    s->triggered = true;
+    s->clip_start_ns = now;
+    TRACE_INSTANT("clip_begin");
+    clip_slot *slot = &s->slots[s->current];
+    slot->start_ns = now;
+    slot->manual = s->next_manual;
+    s->next_manual = false;
+    s->thumb = slot->job && slot->job->thumb.pixels ? &slot->job->thumb : NULL;
+    writer_trigger(s->writer);
+    (void)evloop_timer_set(s->clip_timer, (uint64_t)s->duration_ms, 0);
+    return true;
+}
+
+static void start_clip(cam_session *s, bool manual){
+    /*
+        A trigger, from any source. Outside a clip it begins one. Inside one
+        it only pushes the end out to duration_ms from now, up to
+        clip.max_ms from the clip's start, so a burst of triggers makes one
+        longer clip instead of many overlapping ones; what would run past
+        max_ms goes to the next clip, which follows without a gap. Triggers
+        within clip.debounce_ms of the one before are dropped outright.
+        A manual trigger keeps the clip it lands in for the manual
+        retention, even one it only extends or is debounced in
+    */
+    uint64_t now = metrics_now_ns();
+    if (manual && s->triggered) s->slots[s->current].manual = true;
+    if (s->last_trigger_ns && now - s->last_trigger_ns < (uint64_t)cfg.trigger_debounce_ms * 1000000ull){
+        metrics_count(METRIC_TRIGGERS_COALESCED, 1);
+        return;
+    }
+    s->last_trigger_ns = now;
+    if (s->rotating){s->trigger_deferred = true; s->next_manual |= manual; return;}
+    if (!s->triggered){s->next_manual |= manual; (void)begin_clip(s, now); return;}
+
+    metrics_count(METRIC_TRIGGERS_COALESCED, 1);
+    uint64_t end = now + (uint64_t)s->duration_ms * 1000000ull;
+    uint64_t limit = cfg.clip_max_ms ? s->clip_start_ns + (uint64_t)cfg.clip_max_ms * 1000000ull : UINT64_MAX;
+    if (end > limit){end = limit; s->trigger_deferred = true; s->next_manual |= manual;}
+    if (end > now) (void)evloop_timer_set(s->clip_timer, (end - now + 999999u) / 1000000u, 0);
+}
+
+static void end_clip(evloop *loop, cam_session *s){
+    /*
+        The clip's trigger window is over. A one-shot run ends here;
+        otherwise the writer moves on to the next slot's file at the next
+        keyframe and the camera is armed again, with encoder, rings and
+        capture left running
+    */
+    s->triggered = false;
+    release_clip();
+    if (s->one_shot){evloop_stop(loop);return;}
+
+    clip_slot *next = &s->slots[s->current ^ 1];
+    if (!next->open && !slot_open(s, next)){session_fail(loop, s, errno);return;} // Failed after the last clip, one more try
+    if (!writer_rotate(s->writer, &next->file, slot_index(next))){session_fail(loop, s, errno);return;}
+    s->rotating = true;
+}
+
+static bool finish_rotation(cam_session *s){
+    // Once the writer has closed the current slot's clip and moved to the other slot
+    uint64_t rotations = atomic_load_explicit(&s->writer->rotations, memory_order_acquire);
+    if (rotations == s->rotations_seen) return false;
+    s->rotations_seen = rotations;
+    clip_slot *done = &s->slots[s->current];
+    s->current ^= 1;
+    s->rotating = false;
+    s->thumb = NULL;
+    (void)slot_finish(s, done, true, atomic_load_explicit(&s->writer->rotated_error, memory_order_relaxed)); // Reported, recording goes on
+    return true;
+}
+
+static void on_capture(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)fd;
+    cam_session *s = ctx;
+    if (events & EPOLLERR){session_fail(loop, s, EIO);return;}
+
+    supervisor_action action = supervisor_action_for(&health, s->supervised);
+    if (action != s->action){
+        static const char *const what[] = { "back to normal", "shedding analytics", "lowering fps", "dropping backlogged frames" };
+        fprintf(stderr, "%s: supervisor: %s\n", s->pipe->spec->name, what[action]);
+        s->action = action;
+    }
+    unsigned divisor = action >= SUPERVISOR_LOWER_FPS && s->frame_divisor < SUPERVISOR_FPS_DIVISOR ? SUPERVISOR_FPS_DIVISOR : s->frame_divisor;
+
+    capture_frame frame;
+    int got, pushed = 0;
+    TRACE_BEGIN("capture");
+    while ((got = capture_dequeue(s->cam, &frame)) > 0){ // Drain everything the driver has ready
+        metrics_record_since(METRIC_STAGE_DEQUEUE, frame.timestamp_ns);
+        metrics_count(METRIC_FRAMES_CAPTURED, 1);
+        if (s->frames && frame.sequence != s->last_sequence + 1){
+            s->sensor_drops += frame.sequence - s->last_sequence - 1;
+            metrics_count(METRIC_FRAMES_SENSOR_DROPPED, frame.sequence - s->last_sequence - 1);
+            TRACE_COUNTER("sensor_drops", s->sensor_drops);
+        }
+        s->last_sequence = frame.sequence;
+        ++s->frames;
+        if (s->export) frame_export_publish(s->export, &frame); // While the buffer is still ours
+
+        bool score = s->motion != NULL;
+        if (score && action >= SUPERVISOR_SHED_ANALYTICS && frame.sequence % SUPERVISOR_ANALYTICS_DIVISOR){score = false; metrics_count(METRIC_ANALYTICS_SHED, 1);}
+        if (score){ // Scored before the push: once queued, the buffer may be back with the driver
+            uint64_t start = metrics_now_ns();
+            TRACE_BEGIN("motion");
+            const uint8_t *luma = s->cam->buffers[frame.index].planes[0].data;
+            pixconv_image src, dst = { .planes = { s->luma }, .strides = { s->cam->width } };
+            if (s->luma_conv && pixconv_capture_image(&src, s->cam, &frame)){pixconv_frame(s->luma_conv, &src, &dst, s->cam->height); luma = s->luma;}
+            bool moved = motion_feed(s->motion, luma);
+            TRACE_END();
+            metrics_record(METRIC_STAGE_MOTION, metrics_now_ns() - start);
+            if (s->scores) motion_log_record(s->scores, frame.timestamp_ns, s->motion->score);
+            if (moved){metrics_count(METRIC_MOTION_TRIGGERS, 1); start_clip(s, false);} // While recording it extends the clip
+        }
+        if (s->thumb && s->triggered && !s->thumb->ready && !sidecar_thumbnail_take(s->thumb, s->cam, &frame))
+            s->thumb = NULL; // Pixel format it cannot read: the clip goes without
+
+        if (divisor > 1 && frame.sequence % divisor){ // Shed by the pressure controller or the supervisor, after motion saw it
+            metrics_count(METRIC_FRAMES_SHED, 1);
+            if (!capture_requeue(s->cam, frame.index)){TRACE_END(); session_fail(loop, s, errno);return;}
+            continue;
+        }
+        if (action == SUPERVISOR_DROP_FRAMES){
+            frame_ring_stats fstats;
+            frame_ring_get_stats(s->ring, &fstats);
+            if (fstats.occupancy * 2 >= fstats.capacity){ // The encoder is that far behind: this frame would only wait
+                metrics_count(METRIC_FRAMES_BACKLOG_DROPPED, 1);
+                TRACE_INSTANT("backlog_dropped");
+                if (!capture_requeue(s->cam, frame.index)){TRACE_END(); session_fail(loop, s, errno);return;}
+                continue;
+            }
+        }
+
+        if (frame_ring_push(s->ring, &frame)) ++pushed;
+        else {
+            metrics_count(METRIC_FRAMES_RING_DROPPED, 1);
+            TRACE_INSTANT("ring_dropped");
+            if (!capture_requeue(s->cam, frame.index)){TRACE_END(); session_fail(loop, s, errno);return;} // Ring full: drop the frame, keep the buffer
+        }
+    }
+    TRACE_END();
+    if (pushed) encode_stage_notify(s->stage);
+    if (got < 0){session_fail(loop, s, errno);return;}
+
+    if (s->waiting_since_ns){ // Retried once per wakeup until a slot frees up or the trigger is stale
+        uint64_t now = metrics_now_ns();
+        if (!begin_clip(s, now) && now - s->waiting_since_ns > (uint64_t)s->duration_ms * 1000000ull){
+            s->waiting_since_ns = 0;
+            s->next_manual = false;
+            metrics_count(METRIC_TRIGGERS_DROPPED, 1);
+        }
+    }
+}
+
+static void on_export_client(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)fd; (void)events;
+    cam_session *s = ctx;
+    if (!frame_export_accept(s->export) && errno != EAGAIN && errno != EWOULDBLOCK)
+        fprintf(stderr, "%s: frame export: %s\n", s->pipe->spec->name, strerror(errno)); // That consumer only, capture goes on
+}
+
+static void on_lores_capture(evloop *loop, int fd, uint32_t events, void *ctx){
+    /*
+        The side stream only changes hands here: descriptors go to the
+        analytics thread, which hands the buffers back to the driver
+    */
+    (void)fd;
+    cam_session *s = ctx;
+    if (events & EPOLLERR){session_fail(loop, s, EIO);return;}
+
+    capture_frame frame;
+    int got, pushed = 0;
+    bool shed = supervisor_action_for(&health, s->supervised) >= SUPERVISOR_SHED_ANALYTICS;
+    while ((got = capture_dequeue(s->lores, &frame)) > 0){
+        if (shed && frame.sequence % SUPERVISOR_ANALYTICS_DIVISOR){
+            metrics_count(METRIC_ANALYTICS_SHED, 1);
+            if (!capture_requeue(s->lores, frame.index)){session_fail(loop, s, errno);return;}
+            continue;
+        }
+        if (frame_ring_push(s->lores_ring, &frame)){++pushed;continue;}
+        metrics_count(METRIC_ANALYTICS_DROPPED, 1);
+        if (!capture_requeue(s->lores, frame.index)){session_fail(loop, s, errno);return;}
+    }
+    if (pushed) analytics_notify(s->analytics);
+    if (got < 0) session_fail(loop, s, errno);
+}
+
+static void on_writeback_timer(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events;
+    cam_session *s = ctx;
+    if (evloop_timer_ack(fd)) writer_request_writeback(s->writer); // The writer thread owns the file
+}
+
+static uint32_t queue_pct(size_t occupancy, size_t capacity){
+    return capacity ? (uint32_t)(occupancy * 100u / capacity) : 0;
+}
+
+static void on_pressure_timer(evloop *loop, int fd, uint32_t events, void *ctx){
+    /*
+        One controller sample: free space, the hottest thermal zone and the
+        fuller of this camera's two rings. A level change retargets the
+        encoder and the frame divisor at once; a resolution change waits for
+        the next clip
+    */
+    (void)loop; (void)events;
+    cam_session *s = ctx;
+    if (!evloop_timer_ack(fd)) return;
+    pressure_controller *pc = &s->pipe->pressure;
+
+    pressure_sample sample = { 0 };
+    struct statvfs vfs;
+    if (statvfs(cfg.output_dir, &vfs) == 0){
+        sample.free_known = true;
+        sample.free_bytes = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+    }
+    sample.temp_known = pressure_read_temp(pc, &sample.temp_mc);
+    frame_ring_stats fstats;
+    packet_ring_stats pstats;
+    frame_ring_get_stats(s->ring, &fstats);
+    packet_ring_get_stats(s->packets, &pstats);
+    uint32_t frames_pct = queue_pct(fstats.occupancy, fstats.capacity), packets_pct = queue_pct(pstats.occupancy, pstats.capacity);
+    sample.queue_pct = frames_pct > packets_pct ? frames_pct : packets_pct;
+
+    int change = pressure_update(pc, &sample);
+    if (!change) return;
+    metrics_count(change > 0 ? METRIC_PRESSURE_DEGRADES : METRIC_PRESSURE_RECOVERS, 1);
+
+    const pressure_step *step = pressure_step_for(pc->level);
+    encode_stage_set_bitrate(s->stage, (uint32_t)((uint64_t)cfg.bitrate_bps * step->bitrate_pct / 100u));
+    s->frame_divisor = step->fps_divisor;
+    const char *why = pc->reasons & PRESSURE_STORAGE ? "low storage" : pc->reasons & PRESSURE_THERMAL ? "thermal"
+                    : pc->reasons & PRESSURE_QUEUE ? "queue backlog" : "cleared";
+    fprintf(stderr, "%s: pressure level %d, %s: bitrate %u%%, 1 in %u frames, size 1/%u from the next clip\n",
+            s->pipe->spec->name, pc->level, why, step->bitrate_pct, step->fps_divisor, step->scale_divisor);
+}
+
+static bool luma_first(uint32_t pixelformat){
+    switch (pixelformat){
+    case V4L2_PIX_FMT_YUV420: case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_NV12: case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_GREY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void on_control(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events;
+    cam_session *s = ctx;
+    eventfd_t n;
+    (void)eventfd_read(fd, &n);
+    bool manual = atomic_exchange_explicit(&s->pipe->manual_pending, false, memory_order_acq_rel);
+    if (atomic_exchange_explicit(&s->pipe->trigger_pending, false, memory_order_acq_rel) || manual) start_clip(s, manual);
+    if (atomic_load_explicit(&s->pipe->stop_pending, memory_order_acquire)) evloop_stop(loop);
+}
+
+static void pipeline_kick(camera_pipeline *p, atomic_bool *flag){
+    atomic_store_explicit(flag, true, memory_order_release);
+    (void)eventfd_write(p->control_fd, 1);
+}
+
+static void on_lores_motion(void *ctx){
+    camera_pipeline *p = ctx;
+    pipeline_kick(p, &p->trigger_pending); // From the analytics thread; start_clip runs on the pipeline's own
+}
+
+static void on_trigger(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events; (void)ctx;
+    for (int i = 0; i < trigger_count; ++i){
+        if (triggers[i].fd != fd || trigger_read(&triggers[i]) <= 0) continue;
+        for (size_t c = 0; c < cfg.camera_count; ++c)
+            if (pipelines[c].started) pipeline_kick(&pipelines[c], &pipelines[c].manual_pending); // Every camera records the event
+    }
+}
+
+static void on_pipeline_done(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events; (void)ctx;
+    eventfd_t n;
+    if (eventfd_read(fd, &n) != 0) return;
+    pipelines_running -= n < pipelines_running ? (unsigned)n : pipelines_running;
+    if (pipelines_running == 0) evloop_stop(loop);
+}
+
+static void on_clip_timer(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)events;
+    if (evloop_timer_ack(fd)) end_clip(loop, ctx);
+}
+
+static void on_rotated(evloop *loop, int fd, uint32_t events, void *ctx){
+    /*
+        The writer has finished a clip and is armed on the next slot: save
+        the finished clip, open the one after it and, between clips, pick up
+        a deferred trigger or a pressure size change. Opening and saving
+        here costs this thread a few filesystem calls once per clip, which
+        the spare capture buffers absorb
+    */
+    (void)events;
+    cam_session *s = ctx;
+    eventfd_t n;
+    if (eventfd_read(fd, &n) != 0 || !finish_rotation(s)) return;
+
+    clip_slot *next = &s->slots[s->current ^ 1];
+    if (!slot_open(s, next)) fprintf(stderr, "%s: next clip: %s\n", s->pipe->spec->name, strerror(errno)); // Retried when this one ends
+
+    camera_pipeline *p = s->pipe;
+    if (s->trigger_deferred){s->trigger_deferred = false; (void)begin_clip(s, metrics_now_ns());}
+    else if (p->pressure_ready && pressure_step_for(p->pressure.level)->scale_divisor != s->scale_divisor){s->restart = true; evloop_stop(loop);}
+}
+
+static void on_wall_clock_timer(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events; (void)ctx;
+    if (evloop_timer_ack(fd) && wall_clock_update(&wall)) metrics_count(METRIC_WALL_CLOCK_STEPS, 1);
+}
+
+static void on_metrics_timer(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events; (void)ctx;
+    if (evloop_timer_ack(fd)) (void)metrics_dump(STDERR_FILENO, metrics_measurement);
+}
+
+static void on_stats_client(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events; (void)ctx;
+    metrics_serve(fd, metrics_measurement);
+}
+
+static void on_signal(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events; (void)ctx;
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof info) == (ssize_t)sizeof info) shutdown_requested = true;
+    if (!shutdown_requested) return;
+    for (size_t c = 0; c < cfg.camera_count; ++c) // Each pipeline finalises its clip; the main loop ends when the last one is done
+        if (pipelines[c].started) pipeline_kick(&pipelines[c], &pipelines[c].stop_pending);
+}
+
+static bool pin_thread(uint64_t cpu_mask, int rt_priority){
+    /*
+        Pins the calling thread to cpu_mask and, for rt_priority > 0, moves
+        it to SCHED_FIFO. Threads it creates afterwards inherit both.
+        If successful returns true
+        else returns false and an errno (EPERM without CAP_SYS_NICE)
+    */
+    if (cpu_mask){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; ++cpu)
+            if (cpu_mask & (1ull << cpu)) CPU_SET(cpu, &set);
+        int r = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+        if (r != 0){errno = r;return false;}
+    }
+    if (rt_priority > 0){
+        struct sched_param param = { .sched_priority = rt_priority };
+        int r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (r != 0){errno = r;return false;}
+    }
+    return true;
+}
+
+static bool probe_output_dir(bool verbose){
+    /*
+        Replaces output_probe with a fresh probe of cfg.output_dir. When the
+        directory now sits on different storage the clip index is dropped,
+        to be rebuilt from the new filesystem by the next check_storage().
+        If successful returns true
+        else returns false and an errno
+    */
+    storage_probe fresh;
+    if (!storage_probe_run(&fresh, cfg.output_dir)) return false;
+
+    pthread_mutex_lock(&clips_lock);
+    bool changed = output_probed && storage_probe_differs(&output_probe, &fresh);
+    if (changed && output_probe.dev != fresh.dev && clips_indexed){clip_index_close(&clips); clips_indexed = false;}
+    output_probe = fresh;
+    output_probed = true;
+    pthread_mutex_unlock(&clips_lock);
+
+    if (verbose || changed)
+        printf("%s%s: %s on %s, %u-byte blocks, %llu MiB free, %s%s\n", changed ? "storage changed, " : "",
+               cfg.output_dir, fresh.fs_type[0] ? fresh.fs_type : "unknown fs", fresh.mount_point[0] ? fresh.mount_point : "?",
+               fresh.block_size, (unsigned long long)(fresh.free_bytes >> 20),
+               fresh.writable ? "writable" : "read-only", fresh.direct_io ? ", O_DIRECT" : "");
+    return true;
+}
+
+static bool output_direct_io(void){
+    pthread_mutex_lock(&clips_lock);
+    bool direct = output_probe.direct_io;
+    pthread_mutex_unlock(&clips_lock);
+    return direct;
+}
+
+static bool clips_muxed(void){
+    // A transport stream for anything encoded; an explicit raw backend keeps bare frames
+    return !strcmp(cfg.container, "ts") && strcmp(cfg.encoder, "raw");
+}
+
+static void on_mounts_changed(evloop *loop, int fd, uint32_t events, void *ctx){
+    (void)loop; (void)events; (void)ctx;
+    storage_probe_watch_ack(fd);
+    if (!probe_output_dir(false)) fprintf(stderr, "%s: %s\n", cfg.output_dir, strerror(errno));
+}
+
+static bool index_ready(const char *path){
+    // With clips_lock held
+    if (clips_indexed) return true;
+    clips_indexed = clip_index_open(&clips, path);
+    const uint32_t retention_s[CLIP_CLASS_COUNT] = { [CLIP_CLASS_MOTION] = cfg.motion_days * 86400u, [CLIP_CLASS_MANUAL] = cfg.manual_days * 86400u };
+    if (clips_indexed) clip_index_set_retention(&clips, retention_s);
+    return clips_indexed;
+}
+
+bool activate_cam(camera_pipeline *p, int duration_ms, bool verbose, bool *restart){
+    /*
+        Records clips from p's camera until told to stop: each one the last
+        pretrigger_ms before a trigger followed by duration_ms after the
+        last trigger that extended it (start_clip()). Clips are written
+        into two hidden temp files in turn, the next one opened while the
+        current one records, and renamed into place as they close; capture,
+        encoder and rings stay up from one clip to the next.
+        Everything runs off p's own event loop on the calling thread, which
+        only dequeues and pushes descriptors into the frame ring when the
+        capture fd is readable. Once the workers are up the thread is pinned
+        and raised to the camera's real-time priority; the workers keep
+        their own placement.
+        The encode stage imports the capture buffers into the encoder and
+        pushes packets to the writer thread, so neither encoding nor slow
+        storage ever holds up the sensor.
+        Motion in the luma plane is a trigger alongside the external sources;
+        with neither the call itself is the trigger, for a single clip. With a low-res side
+        stream configured, motion is scored on that instead, by its own
+        analytics thread, and the full-size frames go straight to the
+        encoder untouched.
+        With an export socket, other processes map the capture buffers and
+        follow the frames through a shared descriptor ring (frame_export.h).
+        Under pressure capture opens at the degradation level the last call
+        left, and the controller keeps adjusting it from a timer; a size
+        change sets *restart at the next clip boundary, for the caller to
+        call again.
+        The writer syncs the clip at fragment boundaries, with writeback in
+        between driven by size and a timer (storage.sync_fragments and
+        writeback_mb/_ms).
+        With sidecars enabled the clip's seek index, motion scores and
+        thumbnail are collected on the way and handed to the workers once
+        the clip is in place.
+        Returns, with the clip in progress finalised, on SIGINT/SIGTERM.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!p || !restart || duration_ms <= 0){errno = EINVAL;return false;}
+    *restart = false;
+    const camera_spec *spec = p->spec;
+    const pressure_step *step = pressure_step_for(p->pressure_ready ? p->pressure.level : 0);
+
+    capture_config config = {
+        .device = spec->device,
+        .width = spec->width / step->scale_divisor & ~1u,   // 4:2:0 wants even sizes
+        .height = spec->height / step->scale_divisor & ~1u,
+        .pixelformat = V4L2_PIX_FMT_YUV420,
+        .fps = spec->fps,
+        .buffer_count = cfg.capture_buffers,
+    };
+    capture_device cam;
+    frame_ring ring;
+    packet_ring packets;
+    pretrigger_buffer history;
+    frame_writer writer;
+    encode_stage stage;
+    clip_slot slots[2] = { 0 };
+    ts_muxer mux;
+    buffer_pool pool;
+    motion_detector motion;
+    capture_device lores;
+    frame_ring lores_ring;
+    analytics_stage analytics;
+    frame_export export;
+    motion_log *scores = NULL;
+    pixconv luma_conv;
+    uint8_t *luma = NULL;
+    bool have_export = false;
+    stream_sink stream;
+    bool have_stream = false;
+    bool have_motion = false, have_pool = false, have_lores = false, have_lores_ring = false, have_analytics = false;
+    bool have_ring = false, have_packets = false, have_history = false, have_writer = false, have_stage = false;
+    bool ok = false;
+    int saved = 0;
+
+    for (unsigned i = 0; i < 2; ++i) snprintf(slots[i].temp_name, sizeof slots[i].temp_name, ".%s.%u%s", spec->name, i, clip_temp_suffix);
+    cam_session session = { .pipe = p, .slots = slots, .duration_ms = duration_ms, .frame_divisor = step->fps_divisor,
+                            .scale_divisor = step->scale_divisor, .supervised = -1, .one_shot = trigger_count == 0 && !cfg.motion_enabled };
+
+    if (!capture_open(&cam, &config)) return false;
+    session.cam = &cam;
+    if (!(have_ring = frame_ring_init(&ring, cfg.frame_ring_slots ? cfg.frame_ring_slots : cam.buffer_count))) goto done;
+    if (!(have_packets = packet_ring_init(&packets, cfg.packet_ring_slots, cfg.packet_arena_bytes, requeue_capture, &cam))) goto done;
+
+    // Half the pool for P-frames, the rest for keyframes and raw frames of up to 4 MiB
+    size_t pool_bytes = cfg.pool_bytes ? cfg.pool_bytes : cfg.pretrigger_bytes + cfg.packet_arena_bytes;
+    const buffer_pool_class_config pool_classes[] = {
+        { .buffer_size = (size_t)64 << 10, .count = (uint32_t)(pool_bytes / 2 / ((size_t)64 << 10)) + 1 },
+        { .buffer_size = (size_t)512 << 10, .count = (uint32_t)(pool_bytes / 4 / ((size_t)512 << 10)) + 1 },
+        { .buffer_size = (size_t)4 << 20, .count = (uint32_t)(pool_bytes / 4 / ((size_t)4 << 20)) + 1 },
+    };
+    if (!(have_pool = buffer_pool_init(&pool, pool_classes, 3))) goto done;
+
+    size_t max_packets = (size_t)config.fps * (size_t)cfg.pretrigger_ms / 1000u * 2u + 16u; // Room for a full window plus one GOP
+    if (!(have_history = pretrigger_init_pooled(&history, &pool, cfg.pretrigger_bytes, max_packets, (uint64_t)cfg.pretrigger_ms * 1000000ull))) goto done;
+
+    if (cfg.motion_enabled && spec->lores_device[0]){
+        capture_config lores_config = {
+            .device = spec->lores_device,
+            .width = spec->lores_width & ~1u,
+            .height = spec->lores_height & ~1u,
+            .pixelformat = V4L2_PIX_FMT_YUV420,
+            .fps = config.fps,
+            .buffer_count = 4,      // Scored and handed back within a frame or two
+        };
+        have_lores = capture_open(&lores, &lores_config);
+        if (have_lores && !luma_first(lores.pixelformat)){capture_close(&lores); have_lores = false; errno = ENOTSUP;}
+        if (!have_lores) fprintf(stderr, "%s: low-res stream %s: %s, scoring the main stream\n", spec->name, spec->lores_device, strerror(errno));
+    }
+    if (cfg.motion_enabled && !have_lores && !luma_first(cam.pixelformat)){ // Packed YUV or RGB, as from USB cameras
+        if (pixconv_plan(&luma_conv, cam.pixelformat, V4L2_PIX_FMT_GREY, cam.width) && !(luma = malloc((size_t)cam.width * cam.height))) errno = ENOMEM;
+        if (!luma) fprintf(stderr, "%s: motion on %.4s frames: %s\n", spec->name, (const char *)&cam.pixelformat, strerror(errno));
+    }
+    if (cfg.motion_enabled && (have_lores || luma_first(cam.pixelformat) || luma)){
+        const capture_device *scored = have_lores ? &lores : &cam;
+        motion_config mcfg = cfg.motion;
+        mcfg.width = scored->width;
+        mcfg.height = scored->height;
+        mcfg.stride = luma ? cam.width : scored->bytesperline[0];
+        if (have_lores) mcfg.step = 1;  // The ISP has already done the downscale
+        have_motion = motion_init(&motion, &mcfg);
+        if (!have_motion) perror("motion trigger");
+    }
+    if (have_motion && sidecar_workers_ready && cfg.sidecar_index && !(scores = calloc(1, sizeof *scores)))
+        fprintf(stderr, "%s: motion scores: %s\n", spec->name, strerror(ENOMEM)); // Indexed without them
+    session.scores = scores;
+    if (have_motion) session.motion_blocks = motion.grid_width * motion.grid_height;
+    if (have_motion && luma){session.luma_conv = &luma_conv; session.luma = luma;}
+    if (!have_motion) session.one_shot = trigger_count == 0;
+
+    if (!slot_open(&session, &slots[0])) goto done;
+    if (!session.one_shot && !slot_open(&session, &slots[1])) fprintf(stderr, "%s: next clip: %s\n", spec->name, strerror(errno)); // Retried when the first one ends
+    bool muxed = clips_muxed();
+    if (muxed && !ts_mux_init(&mux, ENCODER_CODEC_H264, cfg.fragment_keyframes)) goto done;
+    if (muxed && wall_ready) mux.clock = &wall; // PTS as time of day, the same on every camera
+    const writer_sync_policy sync = { .writeback_bytes = cfg.sync_writeback_bytes, .datasync_fragments = cfg.sync_fragments };
+    if (spec->stream_port){ // Ahead of the writer, which feeds it
+        have_stream = stream_sink_start(&stream, (uint16_t)spec->stream_port, ENCODER_CODEC_H264, wall_ready ? &wall : NULL);
+        if (!have_stream) fprintf(stderr, "%s: stream on port %u: %s\n", spec->name, spec->stream_port, strerror(errno)); // Recording goes on without it
+    }
+    if (!(have_writer = writer_start(&writer, &packets, &slots[0].file, &history, muxed ? &mux : NULL, &sync, slot_index(&slots[0]),
+                                     have_stream ? &stream : NULL))) goto done;
+
+    encoder_config enc_config = {
+        .codec = ENCODER_CODEC_H264,
+        .width = cam.width,
+        .height = cam.height,
+        .pixelformat = cam.pixelformat,
+        .num_planes = cam.num_planes,
+        .fps = config.fps,
+        .bitrate_bps = (uint32_t)((uint64_t)cfg.bitrate_bps * step->bitrate_pct / 100u),
+        .gop_length = cfg.gop_frames ? cfg.gop_frames : config.fps, // One keyframe a second bounds how far back a clip can start
+        .buffer_count = cam.buffer_count,
+    };
+    memcpy(enc_config.bytesperline, cam.bytesperline, sizeof enc_config.bytesperline);
+    if (!(have_stage = encode_stage_start(&stage, &cam, &ring, &packets, &pool, &writer, cfg.encoder, &enc_config, spec->encoder_cpu_mask))) goto done;
+    if (muxed && !strcmp(encoder_name(&stage.enc), "raw")){
+        // auto fell back to raw frames, which no TS stream type carries. Set before capture starts,
+        // so the ring hand-offs order it before the writer's first packet
+        mux.passthrough = true;
+        fprintf(stderr, "%s: raw encoder, clip written unmuxed\n", spec->name);
+    }
+    if (have_stream && !strcmp(encoder_name(&stage.enc), "raw")){
+        fprintf(stderr, "%s: raw encoder, nothing to stream on port %u\n", spec->name, spec->stream_port); // Raw frames stay with the writer
+    }
+
+    if (have_motion && have_lores){
+        if (!(have_lores_ring = frame_ring_init(&lores_ring, lores.buffer_count)) ||
+            !(have_analytics = analytics_start(&analytics, &lores, &lores_ring, &motion, scores, on_lores_motion, p, spec->lores_cpu_mask))) goto done;
+    }
+
+    if (spec->export_socket[0]){
+        have_export = frame_export_start(&export, &cam, spec->export_socket);
+        if (!have_export) fprintf(stderr, "%s: frame export on %s: %s\n", spec->name, spec->export_socket, strerror(errno)); // Recording goes on without it
+    }
+
+    session.ring = &ring;
+    session.stage = &stage;
+    session.writer = &writer;
+    session.packets = &packets;
+    if (have_analytics){session.lores = &lores; session.lores_ring = &lores_ring; session.analytics = &analytics;}
+    else if (have_motion) session.motion = &motion;
+    if (have_export) session.export = &export;
+    session.clip_timer = evloop_add_timer(&p->loop, 0, 0, on_clip_timer, &session);
+    if (session.clip_timer < 0) goto done;
+    if (!evloop_add(&p->loop, writer.rotated_fd, EPOLLIN, on_rotated, &session)){(void)evloop_remove(&p->loop, session.clip_timer); goto done;}
+    if (!evloop_add(&p->loop, cam.fd, EPOLLIN, on_capture, &session)){
+        (void)evloop_remove(&p->loop, writer.rotated_fd);
+        (void)evloop_remove(&p->loop, session.clip_timer);
+        goto done;
+    }
+    if (have_analytics && !evloop_add(&p->loop, lores.fd, EPOLLIN, on_lores_capture, &session)){
+        (void)evloop_remove(&p->loop, cam.fd);
+        (void)evloop_remove(&p->loop, writer.rotated_fd);
+        (void)evloop_remove(&p->loop, session.clip_timer);
+        goto done;
+    }
+    if (have_export && !evloop_add(&p->loop, export.listen_fd, EPOLLIN, on_export_client, &session)) perror("frame export");
+    int writeback_timer = cfg.sync_interval_ms ? evloop_add_timer(&p->loop, cfg.sync_interval_ms, cfg.sync_interval_ms, on_writeback_timer, &session) : -1;
+    if (cfg.sync_interval_ms && writeback_timer < 0) perror("writeback timer"); // Size-driven writeback still runs
+    int pressure_timer = p->pressure_ready ? evloop_add_timer(&p->loop, cfg.pressure_interval_ms, cfg.pressure_interval_ms, on_pressure_timer, &session) : -1;
+    if (p->pressure_ready && pressure_timer < 0) perror("pressure timer"); // Runs on without degrading
+    (void)evloop_add(&p->loop, p->control_fd, EPOLLIN, on_control, &session); // A trigger or stop sent early is still pending
+
+    if (verbose) printf("%s: capturing %ux%u from %s into %s, encoder %s\n", spec->name, cam.width, cam.height, spec->device, cfg.output_dir, encoder_name(&stage.enc));
+    if (verbose && have_analytics) printf("%s: motion on %ux%u from %s\n", spec->name, lores.width, lores.height, spec->lores_device);
+    if (!pin_thread(spec->cpu_mask, spec->rt_priority)) fprintf(stderr, "%s: pinning: %s\n", spec->name, strerror(errno));
+
+    ok = capture_start(&cam) && (!have_analytics || capture_start(&lores));
+    if (!ok) saved = errno;
+    else {
+        if (health_ready){
+            const supervisor_subject subject = { .name = spec->name, .loop = &p->loop, .frames = &ring, .packets = &packets, .writer = &writer };
+            session.supervised = supervisor_attach(&health, &subject);
+            if (session.supervised < 0) fprintf(stderr, "%s: supervisor: %s\n", spec->name, strerror(errno)); // Runs on unwatched
+        }
+        if (session.one_shot){session.next_manual = true; (void)begin_clip(&session, metrics_now_ns());} // What the run was started for
+        else if (verbose) printf("%s: armed, waiting for a trigger\n", spec->name);
+        if (!evloop_run(&p->loop)){session.failed = true; session.error = errno;}
+        if (session.failed){ok = false; saved = session.error;}
+        supervisor_detach(&health, session.supervised); // Before anything it watches is torn down
+        session.supervised = -1;
+    }
+
+    (void)evloop_remove(&p->loop, p->control_fd);
+    (void)evloop_remove(&p->loop, cam.fd);
+    if (have_analytics) (void)evloop_remove(&p->loop, lores.fd);
+    if (have_export) (void)evloop_remove(&p->loop, export.listen_fd);
+    (void)evloop_remove(&p->loop, session.clip_timer);
+    (void)evloop_remove(&p->loop, writer.rotated_fd);
+    if (pressure_timer >= 0) (void)evloop_remove(&p->loop, pressure_timer);
+    if (writeback_timer >= 0) (void)evloop_remove(&p->loop, writeback_timer);
+    if (have_analytics){  // Quiescent before motion is read
+        have_analytics = false;
+        if (!analytics_stop(&analytics) && ok){saved = errno; ok = false;}
+    }
+
+    if (verbose){
+        frame_ring_stats fstats;
+        packet_ring_stats pstats;
+        frame_ring_get_stats(&ring, &fstats);
+        packet_ring_get_stats(&packets, &pstats);
+        printf("%s: captured %u frames, %u dropped by the sensor\n", spec->name, session.frames, session.sensor_drops);
+        printf("%s: %u clips saved so far\n", spec->name, session.clips_saved);
+        if (have_motion) printf("%s: motion: %llu frames scored, %llu triggers, last score %u of %u blocks\n", spec->name,
+                                (unsigned long long)motion.frames, (unsigned long long)motion.fired, motion.score, motion.grid_width * motion.grid_height);
+        printf("%s: frame ring: capacity %zu, high water %zu, overflows %llu\n",
+               spec->name, fstats.capacity, fstats.high_water, (unsigned long long)fstats.overflows);
+        buffer_pool_class_stats bstats[3];
+        buffer_pool_get_stats(&pool, bstats, 3);
+        for (int i = 0; i < 3; ++i)
+            printf("%s: pool %zu KiB%s: %u buffers, low water %u free, exhausted %llu\n", spec->name, bstats[i].buffer_size >> 10,
+                   pool.hugetlb ? " (hugetlb)" : "", bstats[i].count, bstats[i].low_water, (unsigned long long)bstats[i].exhausted);
+        printf("%s: packet ring: capacity %zu, high water %zu, overflows %llu\n",
+               spec->name, pstats.capacity, pstats.high_water, (unsigned long long)pstats.overflows);
+        if (cfg.sync_fragments) printf("%s: durability: %llu fdatasyncs, at most %llu KiB unsynced\n", spec->name,
+                                       (unsigned long long)writer.datasyncs, (unsigned long long)(writer.unsynced_max >> 10));
+        if (have_export) printf("%s: frame export: %llu consumers served\n", spec->name, (unsigned long long)export.clients_served);
+        if (have_stream) printf("%s: stream: %llu viewers served, %llu KiB sent\n", spec->name,
+                                (unsigned long long)stream.clients_served, (unsigned long long)(stream.bytes_sent >> 10));
+        if (muxed && !mux.passthrough) printf("%s: transport stream: %llu fragments\n", spec->name, (unsigned long long)mux.fragments);
+    }
+
+done:
+    // Upstream first, so every buffer still in flight is released before the capture device goes away
+    if (!ok && !saved) saved = errno;
+    if (have_stage && !encode_stage_stop(&stage) && ok){saved = errno; ok = false;}
+    int write_error = have_writer && !writer_stop(&writer) ? errno : 0;
+    if (write_error && ok){saved = write_error; ok = false;}
+    if (have_stream) stream_sink_stop(&stream); // Once the writer no longer feeds it, and before the pool its queue holds buffers of
+    if (have_analytics && !analytics_stop(&analytics) && ok){saved = errno; ok = false;}
+    if (have_writer) (void)finish_rotation(&session); // One the loop stopped before seeing
+    if (session.triggered) release_clip();
+    if (!slot_finish(&session, &slots[session.current], false, write_error) && ok){saved = errno; ok = false;}
+    if (!slot_finish(&session, &slots[session.current ^ 1], false, 0) && ok){saved = errno; ok = false;} // Empty: deleted
+    if (have_export) frame_export_stop(&export); // After the stage and writer: their requeues bump the shared generations
+    if (have_lores) capture_close(&lores);
+    if (have_lores_ring) frame_ring_destroy(&lores_ring);
+    capture_close(&cam);
+    if (have_motion) motion_destroy(&motion);
+    if (have_history) pretrigger_destroy(&history);
+    if (have_packets) packet_ring_destroy(&packets);
+    if (have_pool) buffer_pool_destroy(&pool); // Last: the history and the ring both hold pool buffers
+    if (have_ring) frame_ring_destroy(&ring);
+    free(scores);
+    free(luma);
+    *restart = ok && session.restart;
+    errno = saved;
+    return ok;
 }
 
 bool ensure_output_dir(const char* path){
     /* 
 
         Checks whether output directory exsists, if not creates it. 
+        Runs once at startup.
         If successful returns true
         else returns false and an errno 
 
     */
 
     if (!path || !*path) return false; // Checking for NULL pointers
+
+    struct stat existing; // The usual case: already there, so no copy and no mkdir per component
+    if (stat(path, &existing) == 0){
+        if (S_ISDIR(existing.st_mode)) return true;
+        errno = ENOTDIR;
+        return false;
+    }
     
     char *buffer = strdup(path); // Copies path to a buffer for modifying
     if (!buffer){return false;} // Checking NULL return from strdup()
@@ -52,52 +1069,344 @@ bool ensure_output_dir(const char* path){
     return true; 
 }
 
-bool ensure_output_dir_writeable(const char* path){
+int check_storage(const char* path){
     /*
-        Returns true only if a temp file can be created and deleted in the output directory 
+        Makes sure the next clip fits in path.
+        If storage space is sufficient nothing happens,
+        else space is created by deleting clips, next to go first
+        (clip_index_next(): the furthest through their retention).
+        The clip index is built on the first call and kept up to date after
+        that, so no call after the first rescans the directory. Every camera
+        writes into the same directory, so one index accounts for all of
+        them and the oldest clip goes first whichever camera recorded it.
+        Clips still in the staging directory, queued or recording, are on
+        their way here: the space kept covers them on top of the reserve,
+        so the mover never finds the final media full, and it is the
+        oldest clips already there that make way for them.
+        Safe to call from any pipeline thread, and from the mover's.
+        Returns how many clips were deleted, or -1 and an errno
     */
-    if(!path ||!*path)return false;
+    if (!path || !*path){errno = EINVAL;return -1;}
 
-    size_t need = (size_t)snprintf(NULL,0,"%s/.write_check-XXXXXX",path) + 1; // Checks number of bytes needed for the final string
-    char *temp_path = malloc(need);
-    if (!temp_path)return false;
+    pthread_mutex_lock(&clips_lock);
+    int deleted = -1;
+    uint64_t staged = mover_ready ? clip_mover_pending_bytes(&mover) + staging_reserved : 0;
+    if (index_ready(path))
+        deleted = clip_index_make_space(&clips, cfg.storage_reserve_bytes + staged);
+    int saved = errno;
+    pthread_mutex_unlock(&clips_lock);
+    errno = saved;
+    return deleted;
+}
 
-    snprintf(temp_path,need,"%s/.write_check-XXXXXX",path);
+static uint32_t first_sequence(const char *prefix){
+    /*
+        One past the highest sequence among prefix's clips in output_dir and
+        the staging dir, so that a restart within the second a previous run
+        named its last clip in does not name the next one the same
+    */
+    uint32_t next = 0, sequence;
+    pthread_mutex_lock(&clips_lock);
+    if (index_ready(cfg.output_dir)){
+        for (int c = 0; c < CLIP_CLASS_COUNT; ++c)
+            for (size_t i = 0; i < clips.classes[c].count; ++i)
+                if (clip_name_sequence(clips.classes[c].heap[i].name, prefix, &sequence) && sequence >= next) next = sequence + 1;
+    }
+    pthread_mutex_unlock(&clips_lock);
 
-    int fd = mkstemp(temp_path);
-    if (fd<0){free(temp_path);return false;}
-    close(fd);
-    
-    if(unlink(temp_path)!=0){free(temp_path);return false;}
+    DIR *dir = mover_ready ? fdopendir(dup(mover.staging_fd)) : NULL;
+    if (!dir) return next;
+    for (struct dirent *e; (e = readdir(dir)); )
+        if (clip_name_sequence(e->d_name, prefix, &sequence) && sequence >= next) next = sequence + 1;
+    closedir(dir);
+    return next;
+}
 
-    free(temp_path);
+char* create_filename(camera_pipeline *p, char *buffer, size_t size, uint64_t start_ns, bool manual){
+    /*
+        Writes p's next clip name into buffer, e.g.
+        cam0_20260314T091502Z_000042.ts
+        stamped with the wall time of start_ns, the trigger's
+        CLOCK_MONOTONIC time, or with now when it is 0. A manual clip's
+        name carries CLIP_MANUAL_MARK before the extension, which is
+        all its retention class is kept as.
+        Each camera's names sort in recording order, its sequence going on
+        from the clips already on disk.
+        Returns buffer, or NULL and an errno if it is too small
+    */
+    if (!p->namer_ready){
+        char prefix[CLIP_NAME_PREFIX_MAX];
+        snprintf(prefix, sizeof prefix, "%s_", p->spec->name);
+        if (!clip_namer_init(&p->namer, prefix, clips_muxed() ? ".ts" : ".h264")) return NULL;
+        p->namer.sequence = first_sequence(prefix);
+        p->namer_ready = true;
+    }
+    size_t length;
+    if (!start_ns || !wall_ready) length = clip_namer_next(&p->namer, buffer, size);
+    else {
+        struct timespec realtime = wall_clock_timespec(&wall, start_ns);
+        length = clip_namer_format(&p->namer, &realtime, buffer, size);
+    }
+    if (!length) return NULL;
+    if (!manual) return buffer;
+
+    size_t mark = sizeof CLIP_MANUAL_MARK - 1, extension = p->namer.extension_len;
+    if (length + mark >= size){errno = ERANGE;return NULL;}
+    memmove(buffer + length - extension + mark, buffer + length - extension, extension + 1);
+    memcpy(buffer + length - extension, CLIP_MANUAL_MARK, mark);
+    return buffer;
+}
+
+static bool save_clip(const char *temp_name, const char *clip_name){
+    pthread_mutex_lock(&clips_lock);
+    bool ok = index_ready(cfg.output_dir) &&
+              clip_rename(clips.dir_fd, temp_name, clips.dir_fd, clip_name) && clip_index_add_file(&clips, clip_name); // EEXIST: never over another clip
+    int saved = errno;
+    pthread_mutex_unlock(&clips_lock);
+    if (ok && reaper_ready && cfg.quota_bytes) clip_reaper_kick(&reaper); // The quota may be over by this clip
+    errno = saved;
+    return ok;
+}
+
+static clip_index *reaper_acquire(void *ctx){
+    (void)ctx;
+    pthread_mutex_lock(&clips_lock);
+    if (index_ready(cfg.output_dir)) return &clips;
+    pthread_mutex_unlock(&clips_lock);
+    return NULL;
+}
+
+static void reaper_release(void *ctx){
+    (void)ctx;
+    pthread_mutex_unlock(&clips_lock);
+}
+
+static bool mover_make_room(void *ctx, uint64_t bytes){
+    (void)ctx; (void)bytes; // Already part of the staged bytes check_storage() keeps room for
+    return check_storage(cfg.output_dir) >= 0;
+}
+
+static void on_clip_moved(void *ctx, const char *name, uint64_t bytes, void *arg, int error){
+    // Mover thread
+    (void)ctx;
+    if (error){
+        fprintf(stderr, "%s: left in %s: %s\n", name, cfg.staging_dir, strerror(error));
+        sidecar_job_destroy(arg);
+        return;
+    }
+    pthread_mutex_lock(&clips_lock);
+    bool indexed = index_ready(cfg.output_dir) && clip_index_add_file(&clips, name);
+    pthread_mutex_unlock(&clips_lock);
+    if (!indexed) fprintf(stderr, "%s: not indexed, eviction will not see it until restart\n", name);
+    else if (reaper_ready && cfg.quota_bytes) clip_reaper_kick(&reaper);
+    if (cfg.verbose) printf("moved %s to %s, %llu KiB\n", name, cfg.output_dir, (unsigned long long)(bytes >> 10));
+    if (arg) submit_sidecars(arg, name);
+}
+
+static bool start_staging(void){
+    /*
+        Starts the mover on cfg.staging_dir and queues the clips a previous
+        run staged but never moved. Only names clip_name_valid() accepts
+        are recovered: a shared staging dir such as /dev/shm holds other
+        programs' files, which are never moved or deleted. Any filesystem works; only tmpfs makes
+        a burst of triggers independent of the flash, so anything else is
+        worth a warning.
+        If successful returns true
+        else returns false and an errno
+    */
+    if (!ensure_output_dir(cfg.staging_dir)) return false;
+    storage_probe probe;
+    if (storage_probe_run(&probe, cfg.staging_dir) && strcmp(probe.fs_type, "tmpfs") && strcmp(probe.fs_type, "ramfs"))
+        fprintf(stderr, "%s is on %s, not tmpfs: staging gains little\n", cfg.staging_dir, probe.fs_type[0] ? probe.fs_type : "an unknown fs");
+
+    const clip_mover_config mcfg = {
+        .staging_dir = cfg.staging_dir, .final_dir = cfg.output_dir, .rate_bytes = cfg.move_rate_bytes,
+        .make_room = mover_make_room, .done = on_clip_moved,
+    };
+    if (!clip_mover_start(&mover, &mcfg)) return false;
+    mover_ready = true;
+
+    DIR *dir = fdopendir(dup(mover.staging_fd));
+    if (!dir) return true; // Leftovers wait for the next start
+    unsigned recovered = 0;
+    for (struct dirent *e; (e = readdir(dir)); ){
+        struct stat st;
+        if (!clip_name_valid(e->d_name)) continue; // Temp files, sidecars and anyone else's files
+        if (fstatat(dirfd(dir), e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (clip_mover_submit(&mover, e->d_name, (uint64_t)st.st_size, NULL)) ++recovered;
+    }
+    closedir(dir);
+    if (recovered) printf("%s: moving %u clips staged by an earlier run\n", cfg.staging_dir, recovered);
     return true;
 }
 
-int check_storage(const char* path){
-    
-    // if storage space is sufficient
-    // else create space by replacing the oldest 
+static void *camera_main(void *arg){
+    /*
+        One camera's pipeline thread: records clips until stopped, reopening
+        capture only when a clip boundary asks for it
+    */
+    camera_pipeline *p = arg;
+    bool restart;
+    do {
+        p->ok = activate_cam(p, (int)cfg.posttrigger_ms, cfg.verbose, &restart);
+        if (!p->ok){p->error = errno; fprintf(stderr, "%s: recording failed: %s\n", p->spec->name, strerror(errno));}
+        else if (restart && cfg.verbose) printf("%s: reopening capture at the new size\n", p->spec->name);
+    } while (p->ok && restart && !atomic_load_explicit(&p->stop_pending, memory_order_acquire));
 
+    (void)eventfd_write(pipelines_done_fd, 1);
+    return NULL;
 }
 
-char* create_filename(){
+static bool pipeline_start(camera_pipeline *p, const camera_spec *spec){
+    /*
+        If successful returns true
+        else returns false and an errno
+    */
+    memset(p, 0, sizeof *p);
+    p->spec = spec;
+    p->control_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->control_fd < 0) return false;
+    if (!evloop_init(&p->loop)){int saved = errno; close(p->control_fd); errno = saved; return false;}
+    if (cfg.pressure_enabled){
+        pressure_config pcfg = cfg.pressure;
+        if (!pcfg.free_low_bytes) pcfg.free_low_bytes = cfg.storage_reserve_bytes * 2;
+        if (!pcfg.free_clear_bytes) pcfg.free_clear_bytes = cfg.storage_reserve_bytes * 3;
+        p->pressure_ready = pressure_init(&p->pressure, &pcfg);
+        if (!p->pressure_ready) fprintf(stderr, "%s: pressure control: %s\n", spec->name, strerror(errno));
+    }
 
+    int r = pthread_create(&p->thread, NULL, camera_main, p);
+    if (r != 0){
+        if (p->pressure_ready) pressure_destroy(&p->pressure);
+        evloop_destroy(&p->loop);
+        close(p->control_fd);
+        errno = r;
+        return false;
+    }
+    p->started = true;
+    return true;
+}
 
+static bool pipeline_join(camera_pipeline *p){
+    if (!p->started) return false;
+    pthread_join(p->thread, NULL);
+    evloop_destroy(&p->loop);
+    close(p->control_fd);
+    if (p->pressure_ready) pressure_destroy(&p->pressure);
+    p->started = false;
+    return p->ok;
 }
 
 
-int main(){
+int main(int argc, char **argv){
+
+    int parsed = config_parse(&cfg, argc, argv);
+    if(parsed <= 0) return parsed < 0 ? 2 : 0;
+
+    if(!ensure_output_dir(cfg.output_dir)){puts("output dir not found");return 0;}
+    if(!probe_output_dir(cfg.verbose)){perror("output dir");return 1;}
+    if(!output_probe.writable){puts("output dir not writeable");return 0;}
+
+    if(!evloop_init(&main_loop)){perror("event loop");return 1;}
+
+    // Before any worker thread exists, so they all inherit the blocked mask
+    const int stop_signals[] = { SIGINT, SIGTERM };
+    if(evloop_add_signals(&main_loop, stop_signals, 2, on_signal, NULL) < 0){perror("signalfd");return 1;}
+
+    if(cfg.trigger_socket[0]){
+        if(trigger_open_socket(&triggers[trigger_count], cfg.trigger_socket)) ++trigger_count;
+        else perror("trigger socket");
+    }
+    if(cfg.trigger_gpio_line >= 0){
+        if(trigger_open_gpio(&triggers[trigger_count], cfg.trigger_gpio_chip, (uint32_t)cfg.trigger_gpio_line, true)) ++trigger_count;
+        else perror("trigger gpio");
+    }
+
+    if(check_storage(cfg.output_dir) < 0){perror("not enough storage");return 1;}
+
+    int stats_fd = cfg.stats_socket[0] ? metrics_listen(cfg.stats_socket) : -1;
+    if(cfg.stats_socket[0] && (stats_fd < 0 || !evloop_add(&main_loop, stats_fd, EPOLLIN, on_stats_client, NULL))) perror("stats socket");
+    if(cfg.metrics_interval_ms && evloop_add_timer(&main_loop, cfg.metrics_interval_ms, cfg.metrics_interval_ms, on_metrics_timer, NULL) < 0) perror("metrics timer");
+
+    if(cfg.trace){
+#ifdef CV_PI5_TRACE
+        if(!trace_start()) perror("trace"); // Records without a timeline
+#else
+        fprintf(stderr, "built without CV_PI5_TRACE, no tracepoints\n");
+#endif
+    }
+
+    wall_ready = wall_clock_init(&wall);
+    if(!wall_ready) perror("wall clock"); // Clips are named and stamped from the clock when they are saved
+    int wall_clock_timer = wall_ready ? evloop_add_timer(&main_loop, WALL_CLOCK_UPDATE_MS, WALL_CLOCK_UPDATE_MS, on_wall_clock_timer, NULL) : -1;
+    if(wall_ready && wall_clock_timer < 0) perror("wall clock timer");
+
+    int mounts_fd = storage_probe_watch();
+    if(mounts_fd < 0 || !evloop_add(&main_loop, mounts_fd, EPOLLPRI, on_mounts_changed, NULL)) perror("mount watch");
+
+    if(cfg.staging_dir[0] && !start_staging()) perror("staging"); // Clips go straight to the output dir
+
+    if(cfg.motion_days || cfg.manual_days || cfg.quota_bytes){
+        const clip_reaper_config rcfg = {
+            .acquire = reaper_acquire, .release = reaper_release, .quota_bytes = cfg.quota_bytes,
+            .rate_bytes = cfg.reap_rate_bytes, .batch = cfg.reap_batch, .interval_ms = cfg.reap_interval_ms,
+        };
+        reaper_ready = clip_reaper_start(&reaper, &rcfg);
+        if(!reaper_ready) perror("retention"); // Clips are only deleted to make room
+        else clip_reaper_kick(&reaper); // What expired while not running
+    }
+
+    if(cfg.sidecar_index || cfg.thumbnail_width){
+        if(cfg.thumbnail_width && !sidecar_thumbnails_supported()) fprintf(stderr, "built without libjpeg, no thumbnails\n");
+        sidecar_workers_ready = worker_pool_start(&sidecar_workers, cfg.sidecar_workers, CONFIG_MAX_CAMERAS * 4);
+        if(!sidecar_workers_ready) perror("sidecar workers"); // Clips are recorded without them
+    }
 
-    if(!ensure_output_dir(output_dir)){puts("output dir not found");return 0;}
-    if(!ensure_output_dir_writeable(output_dir)){puts("output dir not writeable");return 0;}
+    // One pipeline thread per camera; this thread keeps triggers, signals and stats
+    pipelines_done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(pipelines_done_fd < 0 || !evloop_add(&main_loop, pipelines_done_fd, EPOLLIN, on_pipeline_done, NULL)){perror("pipelines");return 1;}
+    for(int i = 0; i < trigger_count; ++i) (void)evloop_add(&main_loop, triggers[i].fd, EPOLLIN, on_trigger, NULL);
 
+    int main_supervised = -1;
+    if(cfg.supervisor_enabled){
+        supervisor_config scfg = cfg.supervisor;
+        scfg.watchdog = cfg.watchdog_path;
+        health_ready = supervisor_start(&health, &scfg);
+        if(!health_ready) perror("supervisor"); // Records without backpressure shedding or the watchdog
+        // This loop wakes at least once a second for the wall clock, so it has a heartbeat to watch
+        const supervisor_subject subject = { .name = "main", .loop = &main_loop };
+        if(health_ready && wall_clock_timer >= 0) main_supervised = supervisor_attach(&health, &subject);
+    }
 
-    activate_cam();
+    for(size_t c = 0; c < cfg.camera_count; ++c){
+        if(pipeline_start(&pipelines[c], &cfg.cameras[c])) ++pipelines_running;
+        else fprintf(stderr, "%s: %s\n", cfg.cameras[c].name, strerror(errno));
+    }
+    if(pipelines_running > 0 && !evloop_run(&main_loop)) perror("event loop");
+    if(health_ready) supervisor_detach(&health, main_supervised); // No heartbeat from here on
 
-    // Create a temp file 
-    // Create the file that you want to save the clip in 
+    bool ok = true;
+    for(size_t c = 0; c < cfg.camera_count; ++c){
+        if(pipelines[c].started) pipeline_kick(&pipelines[c], &pipelines[c].stop_pending); // No-op for those already done
+        if(!pipeline_join(&pipelines[c])) ok = false;
+    }
+    if(health_ready){
+        supervisor_stop(&health); // Disarms the watchdog: what is left to do is bounded
+        if(cfg.verbose) printf("supervisor: %llu stalls, %llu watchdog kicks\n", (unsigned long long)health.stalls, (unsigned long long)health.kicks);
+    }
+    if(mover_ready) clip_mover_stop(&mover); // Moves what is still staged, handing its sidecars to the workers
+    if(reaper_ready){
+        clip_reaper_stop(&reaper);
+        if(cfg.verbose) printf("retention: %llu clips expired, %llu over quota, %llu MiB freed\n", (unsigned long long)reaper.expired_clips,
+                               (unsigned long long)reaper.quota_clips, (unsigned long long)(reaper.reaped_bytes >> 20));
+    }
+    if(sidecar_workers_ready) worker_pool_stop(&sidecar_workers); // Writes what the last clips left queued
 
-    while(1); 
-    return 0;
+    for(int i = 0; i < trigger_count; ++i) trigger_close(&triggers[i]);
+    evloop_destroy(&main_loop);
+    close(pipelines_done_fd);
+    if(mounts_fd >= 0) close(mounts_fd);
+    if(stats_fd >= 0){close(stats_fd);unlink(cfg.stats_socket);}
+    if(clips_indexed) clip_index_close(&clips);
+    return ok ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef CV_PI5_TESTS_CHECK_H
+#define CV_PI5_TESTS_CHECK_H
+
+/*
+    The unit tests' one assertion. A failed CHECK() prints where and what,
+    and the test carries on so that one run reports every failure; main()
+    ends with `return check_result();`, which ctest reads as pass or fail.
+*/
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)){fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++check_failures;} \
+    } while (0)
+
+static inline int check_result(void){
+    if (check_failures) fprintf(stderr, "%d checks failed\n", check_failures);
+    return check_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "cv_pi5/buffer_pool.h"
+
+#include "check.h"
+
+#include <errno.h>
+#include <string.h>
+
+static void test_classes(void){
+    buffer_pool pool;
+    const buffer_pool_class_config classes[] = { { 1000, 2 }, { 8192, 1 } };
+    CHECK(buffer_pool_init(&pool, classes, 2));
+    CHECK(pool.total == 3 && pool.class_count == 2);
+
+    // Smallest fitting class first, page aligned, then the larger class once it runs out
+    uint32_t a = buffer_pool_get(&pool, 100), b = buffer_pool_get(&pool, 1000), c = buffer_pool_get(&pool, 10);
+    CHECK(a == 0 && b == 1 && c == 2);
+    CHECK(buffer_pool_size(&pool, a) == 4096 && buffer_pool_size(&pool, c) == 8192);
+    CHECK(((uintptr_t)buffer_pool_data(&pool, a) & 4095) == 0);
+    CHECK(buffer_pool_data(&pool, b) == buffer_pool_data(&pool, a) + 4096);
+    CHECK(buffer_pool_data(&pool, c) == buffer_pool_data(&pool, b) + 4096);
+    CHECK(buffer_pool_get(&pool, 1) == BUFFER_POOL_NONE);
+    CHECK(buffer_pool_get(&pool, 9000) == BUFFER_POOL_NONE); // Larger than any class
+
+    buffer_pool_class_stats stats[2];
+    buffer_pool_get_stats(&pool, stats, 2);
+    CHECK(stats[0].buffer_size == 4096 && stats[0].count == 2 && stats[0].free == 0 && stats[0].low_water == 0);
+    CHECK(stats[1].free == 0 && stats[1].exhausted == 1);
+    CHECK(stats[0].exhausted == 2); // The fallback get, and the one nothing could serve
+
+    memset(buffer_pool_data(&pool, a), 0x5A, 4096);
+    buffer_pool_unref(&pool, a);
+    buffer_pool_get_stats(&pool, stats, 2);
+    CHECK(stats[0].free == 1 && stats[0].low_water == 0);
+    CHECK(buffer_pool_get(&pool, 1) == a); // The freed buffer comes straight back
+    buffer_pool_destroy(&pool);
+    CHECK(pool.fd == -1 && pool.base == NULL);
+}
+
+static void test_refcount(void){
+    buffer_pool pool;
+    const buffer_pool_class_config classes[] = { { 4096, 1 } };
+    CHECK(buffer_pool_init(&pool, classes, 1));
+    uint32_t index = buffer_pool_get(&pool, 4096);
+    CHECK(index == 0);
+
+    // Back on the free list only when the last reference goes
+    buffer_pool_ref(&pool, index);
+    buffer_pool_ref(&pool, index);
+    buffer_pool_unref(&pool, index);
+    buffer_pool_unref(&pool, index);
+    CHECK(buffer_pool_get(&pool, 1) == BUFFER_POOL_NONE);
+    buffer_pool_unref(&pool, index);
+    buffer_pool_class_stats stats;
+    buffer_pool_get_stats(&pool, &stats, 1);
+    CHECK(stats.free == 1 && stats.exhausted == 1);
+    CHECK(buffer_pool_get(&pool, 1) == index);
+    buffer_pool_unref(&pool, index);
+    buffer_pool_destroy(&pool);
+}
+
+static void test_bad_config(void){
+    buffer_pool pool;
+    const buffer_pool_class_config unordered[] = { { 8192, 1 }, { 4096, 1 } };
+    const buffer_pool_class_config empty[] = { { 4096, 0 } };
+    errno = 0;
+    CHECK(!buffer_pool_init(&pool, unordered, 2) && errno == EINVAL);
+    errno = 0;
+    CHECK(!buffer_pool_init(&pool, empty, 1) && errno == EINVAL);
+    errno = 0;
+    CHECK(!buffer_pool_init(&pool, empty, BUFFER_POOL_MAX_CLASSES + 1) && errno == EINVAL);
+}
+
+int main(void){
+    test_classes();
+    test_refcount();
+    test_bad_config();
+    return check_result();
+}
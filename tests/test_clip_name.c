@@ -0,0 +1,94 @@
+#include "cv_pi5/clip_name.h"
+
+#include "check.h"
+
+#include <errno.h>
+#include <string.h>
+
+static void test_format(void){
+    clip_namer n;
+    CHECK(clip_namer_init(&n, "cam0_", ".ts"));
+    char name[64];
+    struct timespec t = { .tv_sec = 1773479702 };
+    CHECK(clip_namer_format(&n, &t, name, sizeof name) == strlen("cam0_20260314T091502Z_000000.ts"));
+    CHECK(!strcmp(name, "cam0_20260314T091502Z_000000.ts"));
+    CHECK(clip_namer_format(&n, &t, name, sizeof name) && !strcmp(name, "cam0_20260314T091502Z_000001.ts"));
+
+    // Date and time across a leap day, and back to an earlier day: the cache follows
+    struct timespec leap = { .tv_sec = 1709251199 }, next = { .tv_sec = 1709251200 }, epoch = { .tv_sec = 0 };
+    CHECK(clip_namer_format(&n, &leap, name, sizeof name) && !strcmp(name, "cam0_20240229T235959Z_000002.ts"));
+    CHECK(clip_namer_format(&n, &next, name, sizeof name) && !strcmp(name, "cam0_20240301T000000Z_000003.ts"));
+    CHECK(clip_namer_format(&n, &epoch, name, sizeof name) && !strcmp(name, "cam0_19700101T000000Z_000004.ts"));
+}
+
+static void test_sequence(void){
+    clip_namer n;
+    CHECK(clip_namer_init(&n, "a_", ".h264"));
+    char name[64];
+    struct timespec t = { .tv_sec = 978264000 };
+    n.sequence = 999999;
+    CHECK(clip_namer_format(&n, &t, name, sizeof name) && !strcmp(name, "a_20001231T120000Z_999999.h264"));
+    CHECK(clip_namer_format(&n, &t, name, sizeof name) && !strcmp(name, "a_20001231T120000Z_000000.h264")); // Six digits wrap
+}
+
+static void test_limits(void){
+    clip_namer n;
+    char long_prefix[CLIP_NAME_PREFIX_MAX + 1];
+    memset(long_prefix, 'x', sizeof long_prefix - 1);
+    long_prefix[sizeof long_prefix - 1] = '\0';
+    errno = 0;
+    CHECK(!clip_namer_init(&n, long_prefix, ".ts") && errno == ENAMETOOLONG);
+
+    CHECK(clip_namer_init(&n, "cam0_", ".ts"));
+    char small[31]; // One short of the name and its terminator
+    struct timespec t = { .tv_sec = 1773479702 };
+    errno = 0;
+    CHECK(clip_namer_format(&n, &t, small, sizeof small) == 0 && errno == ERANGE);
+    char exact[32];
+    CHECK(clip_namer_format(&n, &t, exact, sizeof exact) == 31);
+}
+
+static void test_valid(void){
+    CHECK(clip_name_valid("cam0_20260314T091502Z_000042.ts"));
+    CHECK(clip_name_valid("cam0_20260314T091502Z_000042.h264"));
+    CHECK(clip_name_valid("cam0_20260314T091502Z_000042" CLIP_MANUAL_MARK ".ts"));
+    CHECK(clip_name_valid("front_door_20260314T091502Z_000042.ts"));
+
+    CHECK(!clip_name_valid(NULL));
+    CHECK(!clip_name_valid(""));
+    CHECK(!clip_name_valid("notes.txt"));
+    CHECK(!clip_name_valid("cam0_20260314T091502Z_000042.ts.jpg"));  // Sidecars
+    CHECK(!clip_name_valid("cam0_20260314T091502Z_000042.ts.idx"));
+    CHECK(!clip_name_valid(".cam0_20260314T091502Z_000042.ts"));     // Hidden: temp files
+    CHECK(!clip_name_valid("_20260314T091502Z_000042.ts"));          // No camera
+    CHECK(!clip_name_valid("cam0_20260314T091502_000042.ts"));       // No Z
+    CHECK(!clip_name_valid("cam0_20260314T091502Z_00042.ts"));       // Five digits
+    CHECK(!clip_name_valid("cam0_20260314T091502Z_000042.mp4"));
+    CHECK(!clip_name_valid("cam0_2026031AT091502Z_000042.ts"));
+    CHECK(!clip_name_valid("cam0-20260314T091502Z_000042.ts"));
+    CHECK(!clip_name_valid("dir/cam0_20260314T091502Z_000042.ts"));
+
+    // Whatever the namer makes is valid
+    clip_namer n;
+    CHECK(clip_namer_init(&n, "cam1_", ".h264"));
+    char name[64];
+    CHECK(clip_namer_next(&n, name, sizeof name) && clip_name_valid(name));
+}
+
+static void test_name_sequence(void){
+    uint32_t sequence = 0;
+    CHECK(clip_name_sequence("cam0_20260314T091502Z_000042.ts", "cam0_", &sequence) && sequence == 42);
+    CHECK(clip_name_sequence("cam0_20260314T091502Z_123456" CLIP_MANUAL_MARK ".h264", "cam0_", &sequence) && sequence == 123456);
+    CHECK(!clip_name_sequence("cam1_20260314T091502Z_000042.ts", "cam0_", &sequence));
+    CHECK(!clip_name_sequence("cam0_x_20260314T091502Z_000042.ts", "cam0_", &sequence)); // Another camera, cam0_x
+    CHECK(!clip_name_sequence("cam0_20260314T091502Z_000042.ts.jpg", "cam0_", &sequence));
+}
+
+int main(void){
+    test_format();
+    test_sequence();
+    test_limits();
+    test_valid();
+    test_name_sequence();
+    return check_result();
+}
@@ -0,0 +1,113 @@
+#include "config.h"
+
+#include "check.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char path[] = "/tmp/cv_pi5_config_XXXXXX";
+
+static void write_file(const char *text){
+    FILE *f = fopen(path, "we");
+    CHECK(f != NULL);
+    if (!f) return;
+    fputs(text, f);
+    fclose(f);
+}
+
+static int parse(app_config *cfg, const char *override){
+    // Always with -c, so the host's own config file never leaks in
+    char *argv[] = { "test_config", "-c", path, (char *)override, NULL };
+    return config_parse(cfg, override ? 4 : 3, argv);
+}
+
+static void test_defaults(void){
+    app_config cfg;
+    write_file("");
+    CHECK(parse(&cfg, NULL) == 1);
+    CHECK(!strcmp(cfg.output_dir, "/var/lib/cam_trigger/clips"));
+    CHECK(cfg.pretrigger_bytes == (size_t)6 << 20); // 8 Mbit/s for 2 s plus a 1 s GOP, doubled
+    CHECK(cfg.camera_count == 1 && !strcmp(cfg.cameras[0].name, "cam0"));
+    CHECK(!strcmp(cfg.container, "ts") && cfg.capture_buffers == 12);
+
+    CHECK(parse(&cfg, "--clip.pretrigger_mb=32") == 1 && cfg.pretrigger_bytes == (size_t)32 << 20);
+    CHECK(parse(&cfg, "--encoder.bitrate=16000000") == 1 && cfg.pretrigger_bytes == (size_t)12 << 20);
+    CHECK(parse(&cfg, "--camera.cam0.fps=15") == 1 && cfg.cameras[0].fps == 15);
+}
+
+static void test_file(void){
+    app_config cfg;
+    write_file("# comment\n"
+               "[storage]\n"
+               "dir = /srv/clips   ; trailing comment\n"
+               "\n"
+               "[camera.front]\n"
+               "device = /dev/video4\n"
+               "width = 1280\n"
+               "[camera.back]\n");
+    CHECK(parse(&cfg, "--camera.back.height=720") == 1);
+    CHECK(!strcmp(cfg.output_dir, "/srv/clips"));
+    CHECK(cfg.camera_count == 2); // Cameras named in the file replace the built-in cam0
+    CHECK(!strcmp(cfg.cameras[0].name, "front") && !strcmp(cfg.cameras[0].device, "/dev/video4") && cfg.cameras[0].width == 1280);
+    CHECK(!strcmp(cfg.cameras[1].name, "back") && cfg.cameras[1].height == 720);
+
+    char err[256];
+    app_config other;
+    config_defaults(&other);
+    write_file("[storage]\nnot_a_key = 1\n");
+    errno = 0;
+    CHECK(!config_load_file(&other, path, err, sizeof err) && errno == ENOENT && strstr(err, ":2:"));
+    write_file("[storage\n");
+    CHECK(!config_load_file(&other, path, err, sizeof err) && errno == EINVAL);
+    write_file("[camera.a]\n[camera.b]\n[camera.c]\n[camera.d]\n[camera.e]\n");
+    CHECK(!config_load_file(&other, path, err, sizeof err) && errno == ENOSPC);
+}
+
+static void test_set(void){
+    app_config cfg;
+    config_defaults(&cfg);
+    CHECK(config_set(&cfg, "clip", "post_ms", "500") && cfg.posttrigger_ms == 500);
+    errno = 0;
+    CHECK(!config_set(&cfg, "clip", "post_ms", "soon") && errno == EINVAL);
+    errno = 0;
+    CHECK(!config_set(&cfg, "clip", "pretrigger_ms", "500") && errno == ENOENT);
+    errno = 0;
+    CHECK(!config_set(&cfg, "camera.", "fps", "30") && errno == EINVAL);
+}
+
+static void test_validate(void){
+    app_config cfg;
+    write_file("");
+    static const char *const bad[] = {
+        "--pipeline.capture_buffers=17",
+        "--pipeline.capture_buffers=0",
+        "--storage.staging_dir=/var/lib/cam_trigger/clips",
+        "--clip.post_ms=0",
+        "--clip.container=mp4",
+        "--retention.batch=0",
+        "--camera.cam0.width=0",
+        "--no.such_key=1",
+        "stray",
+    };
+    for (size_t i = 0; i < sizeof bad / sizeof *bad; ++i) CHECK(parse(&cfg, bad[i]) == -1);
+    CHECK(parse(&cfg, "--pipeline.capture_buffers=16") == 1);
+    CHECK(parse(&cfg, "-h") == 0);
+}
+
+int main(void){
+    int fd = mkstemp(path);
+    if (fd < 0){perror("mkstemp");return 1;}
+    close(fd);
+
+    // parse() prints its errors and usage; only the checks matter here
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+    test_defaults();
+    test_file();
+    test_set();
+    test_validate();
+    unlink(path);
+    return check_result();
+}
@@ -0,0 +1,77 @@
+#include "cv_pi5/frame_ring.h"
+
+#include "check.h"
+
+#include <errno.h>
+
+static void test_fifo(void){
+    frame_ring ring;
+    CHECK(frame_ring_init(&ring, 5));
+    CHECK(ring.capacity == 8); // Rounded up to a power of two
+
+    frame_desc desc = { .index = 0 };
+    CHECK(!frame_ring_pop(&ring, &desc));
+    for (uint32_t i = 0; i < 8; ++i){
+        desc = (frame_desc){ .index = i, .sequence = 100 + i, .timestamp_ns = 1000u * i };
+        CHECK(frame_ring_push(&ring, &desc));
+    }
+    desc.index = 8;
+    CHECK(!frame_ring_push(&ring, &desc)); // Full: counted, not queued
+
+    for (uint32_t i = 0; i < 8; ++i)
+        CHECK(frame_ring_pop(&ring, &desc) && desc.index == i && desc.sequence == 100 + i && desc.timestamp_ns == 1000u * i);
+    CHECK(!frame_ring_pop(&ring, &desc));
+
+    frame_ring_stats stats;
+    frame_ring_get_stats(&ring, &stats);
+    CHECK(stats.capacity == 8 && stats.occupancy == 0 && stats.high_water == 8);
+    CHECK(stats.pushed == 8 && stats.popped == 8 && stats.overflows == 1);
+    frame_ring_destroy(&ring);
+    CHECK(ring.slots == NULL);
+
+    errno = 0;
+    CHECK(!frame_ring_init(&ring, 0) && errno == EINVAL);
+}
+
+static void test_stats_across_wrap(void){
+    frame_ring ring;
+    CHECK(frame_ring_init(&ring, 8));
+    frame_desc desc = { .index = 0 };
+
+    // A consumer that keeps up: the high water stays at what was really queued, many times round
+    for (uint32_t i = 0; i < 100; ++i){
+        desc.index = i;
+        CHECK(frame_ring_push(&ring, &desc));
+        CHECK(frame_ring_pop(&ring, &desc) && desc.index == i);
+    }
+    frame_ring_stats stats;
+    frame_ring_get_stats(&ring, &stats);
+    CHECK(stats.occupancy == 0 && stats.high_water == 1 && stats.overflows == 0);
+    CHECK(stats.pushed == 100 && stats.popped == 100);
+
+    // Three behind, still wrapping
+    for (uint32_t i = 0; i < 3; ++i) CHECK(frame_ring_push(&ring, &desc));
+    for (uint32_t i = 0; i < 50; ++i){
+        desc.index = i;
+        CHECK(frame_ring_push(&ring, &desc));
+        CHECK(frame_ring_pop(&ring, &desc));
+    }
+    frame_ring_get_stats(&ring, &stats);
+    CHECK(stats.occupancy == 3 && stats.high_water == 4 && stats.overflows == 0);
+
+    // Filled up across the wrap, overflowing, then drained
+    for (uint32_t i = 0; i < 5; ++i) CHECK(frame_ring_push(&ring, &desc));
+    for (uint32_t i = 0; i < 2; ++i) CHECK(!frame_ring_push(&ring, &desc));
+    frame_ring_get_stats(&ring, &stats);
+    CHECK(stats.occupancy == 8 && stats.high_water == 8 && stats.overflows == 2);
+    while (frame_ring_pop(&ring, &desc)) {}
+    frame_ring_get_stats(&ring, &stats);
+    CHECK(stats.occupancy == 0 && stats.high_water == 8 && stats.pushed == 158 && stats.popped == 158);
+    frame_ring_destroy(&ring);
+}
+
+int main(void){
+    test_fifo();
+    test_stats_across_wrap();
+    return check_result();
+}
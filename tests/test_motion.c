@@ -0,0 +1,111 @@
+#include "cv_pi5/motion.h"
+
+#include "check.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define W 64
+#define H 64
+
+static uint8_t dark[W * H], bright[W * H], noisy[W * H], corner[W * H];
+
+static void init(motion_detector *md, uint32_t hold_frames, uint32_t warmup_frames){
+    const motion_config cfg = {
+        .width = W, .height = H, .stride = W, .step = 1, .block = 16,
+        .noise_floor = 12, .block_threshold = 16 * 16 * 8, .min_blocks = 4,
+        .hold_frames = hold_frames, .warmup_frames = warmup_frames,
+    };
+    CHECK(motion_init(md, &cfg));
+    CHECK(md->grid_width == 4 && md->grid_height == 4);
+}
+
+static unsigned feed_moving(motion_detector *md, unsigned frames){
+    // Alternating frames: every block changes on every frame
+    unsigned fired = 0;
+    for (unsigned i = 0; i < frames; ++i)
+        if (motion_feed(md, (md->frames & 1) ? bright : dark)) ++fired;
+    return fired;
+}
+
+static void test_sustained(void){
+    motion_detector md;
+    init(&md, 3, 0);
+    CHECK(!motion_feed(&md, dark)); // Nothing to compare the first frame against
+
+    // A long run keeps firing, every hold_frames frames, so it keeps extending the clip
+    CHECK(feed_moving(&md, 300) == 100);
+    CHECK(md.fired == 100 && md.run == 300 && md.score == 16);
+    motion_destroy(&md);
+}
+
+static void test_hold(void){
+    motion_detector md;
+    init(&md, 3, 0);
+    CHECK(!motion_feed(&md, dark));
+
+    // Two motion frames and a still one: a flicker, the run starts over
+    CHECK(!motion_feed(&md, bright) && md.run == 1 && md.score == 16);
+    CHECK(!motion_feed(&md, dark) && md.run == 2);
+    CHECK(!motion_feed(&md, dark) && md.run == 0 && md.score == 0);
+    CHECK(!motion_feed(&md, bright) && !motion_feed(&md, dark));
+    CHECK(motion_feed(&md, bright) && md.fired == 1); // The third in a row fires
+    motion_destroy(&md);
+}
+
+static void test_warmup_and_reset(void){
+    motion_detector md;
+    init(&md, 2, 5);
+
+    // The first frame and the warm-up after it are never scored, moving or not
+    CHECK(feed_moving(&md, 6) == 0 && md.run == 0 && md.fired == 0);
+    CHECK(feed_moving(&md, 1) == 0 && md.run == 1);
+    CHECK(feed_moving(&md, 1) == 1 && md.fired == 1);
+
+    // A reset forgets the reference frame and the run, and warms up again
+    motion_reset(&md);
+    CHECK(md.frames == 0 && md.run == 0 && md.score == 0);
+    CHECK(feed_moving(&md, 6) == 0 && md.run == 0);
+    CHECK(feed_moving(&md, 2) == 1 && md.fired == 2);
+    motion_destroy(&md);
+}
+
+static void test_thresholds(void){
+    motion_detector md;
+    init(&md, 1, 0);
+
+    // Differences up to the noise floor count for nothing
+    for (unsigned i = 0; i < 10; ++i) CHECK(!motion_feed(&md, i & 1 ? noisy : dark));
+    CHECK(md.score == 0 && md.fired == 0);
+
+    // Three changed blocks are under min_blocks
+    for (unsigned i = 0; i < 10; ++i) CHECK(!motion_feed(&md, i & 1 ? corner : dark));
+    CHECK(md.score == 3 && md.fired == 0);
+    CHECK(motion_feed(&md, bright) && md.score == 13); // Every block but the corner's three
+    motion_destroy(&md);
+
+    motion_config cfg = {
+        .width = W, .height = H, .stride = W, .step = 3, .block = 16, .hold_frames = 1,
+    };
+    errno = 0;
+    CHECK(!motion_init(&md, &cfg) && errno == EINVAL);
+    cfg.step = 1;
+    cfg.hold_frames = 0;
+    errno = 0;
+    CHECK(!motion_init(&md, &cfg) && errno == EINVAL);
+    cfg.hold_frames = 1;
+    cfg.width = cfg.stride = 8; // Smaller than one block
+    errno = 0;
+    CHECK(!motion_init(&md, &cfg) && errno == EINVAL);
+}
+
+int main(void){
+    memset(bright, 200, sizeof bright);
+    memset(noisy, 12, sizeof noisy);
+    for (uint32_t y = 0; y < 16; ++y) memset(corner + y * W, 200, 3 * 16);
+    test_sustained();
+    test_hold();
+    test_warmup_and_reset();
+    test_thresholds();
+    return check_result();
+}
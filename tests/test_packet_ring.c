@@ -0,0 +1,120 @@
+#include "cv_pi5/packet_ring.h"
+
+#include "check.h"
+
+#include <errno.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t refs[8];
+    unsigned count;
+} released;
+
+static void on_release(void *ctx, uint32_t ref){
+    released *r = ctx;
+    if (r->count < sizeof r->refs / sizeof *r->refs) r->refs[r->count] = ref;
+    r->count++;
+}
+
+static void test_arena(void){
+    packet_ring ring;
+    CHECK(packet_ring_init(&ring, 3, 256, NULL, NULL));
+    CHECK(ring.capacity == 4); // Rounded up to a power of two
+
+    // Copied in, FIFO out, the arena's bytes back once released
+    uint8_t a[100], b[100];
+    memset(a, 'a', sizeof a);
+    memset(b, 'b', sizeof b);
+    encoded_packet pa = { .data = a, .size = sizeof a, .pts_ns = 1, .flags = PACKET_FLAG_KEYFRAME };
+    encoded_packet pb = { .data = b, .size = sizeof b, .pts_ns = 2 };
+    CHECK(packet_ring_push(&ring, &pa) && packet_ring_push(&ring, &pb));
+    memset(a, 0, sizeof a); // The ring has its own copy
+
+    encoded_packet pc = { .data = b, .size = 100, .pts_ns = 3 };
+    CHECK(!packet_ring_push(&ring, &pc)); // 56 bytes left in the arena
+    packet_ring_stats stats;
+    packet_ring_get_stats(&ring, &stats);
+    CHECK(stats.occupancy == 2 && stats.arena_used == 200 && stats.overflows == 1 && stats.pushed == 2);
+
+    packet_ring_item item;
+    CHECK(packet_ring_peek(&ring, &item) && item.pkt.pts_ns == 1 && item.pkt.flags == PACKET_FLAG_KEYFRAME);
+    CHECK(item.pkt.size == 100 && item.pkt.data[0] == 'a' && item.pkt.data[99] == 'a' && item.ref == PACKET_RING_NO_REF);
+    packet_ring_release(&ring, &item);
+
+    // The tail too short for it is skipped: this one wraps to the arena's start
+    CHECK(packet_ring_push(&ring, &pc));
+    CHECK(packet_ring_peek(&ring, &item) && item.pkt.pts_ns == 2 && item.pkt.data[0] == 'b');
+    packet_ring_release(&ring, &item);
+    CHECK(packet_ring_peek(&ring, &item) && item.pkt.pts_ns == 3 && item.pkt.data == ring.arena);
+    packet_ring_release(&ring, &item);
+    CHECK(!packet_ring_peek(&ring, &item));
+
+    packet_ring_get_stats(&ring, &stats);
+    CHECK(stats.occupancy == 0 && stats.arena_used == 0 && stats.popped == 3 && stats.high_water == 2);
+    encoded_packet empty = { .data = a, .size = 0 }, huge = { .data = a, .size = 257 };
+    CHECK(!packet_ring_push(&ring, &empty) && !packet_ring_push(&ring, &huge));
+    packet_ring_destroy(&ring);
+    CHECK(ring.slots == NULL && ring.arena == NULL);
+}
+
+static void test_slots_and_refs(void){
+    packet_ring ring;
+    released r = { .count = 0 };
+    CHECK(packet_ring_init(&ring, 2, 0, on_release, &r));
+    static const uint8_t frame[64];
+    encoded_packet pkt = { .data = frame, .size = sizeof frame };
+
+    // By reference: no arena needed, the capture buffer index handed back on release
+    CHECK(packet_ring_push_ref(&ring, &pkt, 7) && packet_ring_push_ref(&ring, &pkt, 3));
+    CHECK(!packet_ring_push_ref(&ring, &pkt, 5)); // Out of slots
+    CHECK(r.count == 0);
+    packet_ring_item item;
+    CHECK(packet_ring_peek(&ring, &item) && item.ref == 7 && item.pkt.data == frame);
+    packet_ring_release(&ring, &item);
+    CHECK(packet_ring_peek(&ring, &item) && item.ref == 3);
+    packet_ring_release(&ring, &item);
+    CHECK(r.count == 2 && r.refs[0] == 7 && r.refs[1] == 3);
+
+    packet_ring_stats stats;
+    packet_ring_get_stats(&ring, &stats);
+    CHECK(stats.capacity == 2 && stats.overflows == 1 && stats.high_water == 2);
+    packet_ring_destroy(&ring);
+
+    errno = 0;
+    CHECK(!packet_ring_init(&ring, 0, 0, NULL, NULL) && errno == EINVAL);
+}
+
+static void test_pool_buffers(void){
+    buffer_pool pool;
+    const buffer_pool_class_config classes[] = { { 4096, 2 } };
+    CHECK(buffer_pool_init(&pool, classes, 1));
+    packet_ring ring;
+    CHECK(packet_ring_init(&ring, 4, 0, NULL, NULL));
+
+    // The slot holds the producer's reference; a consumer keeping the bytes takes its own
+    uint32_t buffer = buffer_pool_get(&pool, 100);
+    memcpy(buffer_pool_data(&pool, buffer), "payload", 8);
+    encoded_packet pkt = { .data = buffer_pool_data(&pool, buffer), .size = 8 };
+    CHECK(packet_ring_push_buffer(&ring, &pkt, &pool, buffer));
+
+    packet_ring_item item;
+    CHECK(packet_ring_peek(&ring, &item) && item.pool == &pool && item.buffer == buffer && !strcmp((const char *)item.pkt.data, "payload"));
+    buffer_pool_ref(&pool, item.buffer);
+    packet_ring_release(&ring, &item);
+    buffer_pool_class_stats stats;
+    buffer_pool_get_stats(&pool, &stats, 1);
+    CHECK(stats.free == 1);
+    buffer_pool_unref(&pool, item.buffer);
+    buffer_pool_get_stats(&pool, &stats, 1);
+    CHECK(stats.free == 2);
+
+    packet_ring_destroy(&ring);
+    buffer_pool_destroy(&pool);
+}
+
+int main(void){
+    test_arena();
+    test_slots_and_refs();
+    test_pool_buffers();
+    return check_result();
+}
@@ -0,0 +1,164 @@
+#include "cv_pi5/storage.h"
+
+#include "check.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DAY_NS (86400ll * 1000000000ll)
+
+static char dir[64];
+static int64_t now_ns;
+
+static void put_file(const char *name, int64_t age_ns){
+    // 4 KiB, with its mtime age_ns before now
+    char path[256];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    static const char block[4096];
+    CHECK(write(fd, block, sizeof block) == (ssize_t)sizeof block);
+    int64_t t = now_ns - age_ns;
+    const struct timespec times[2] = { { .tv_sec = t / 1000000000ll, .tv_nsec = t % 1000000000ll },
+                                       { .tv_sec = t / 1000000000ll, .tv_nsec = t % 1000000000ll } };
+    CHECK(futimens(fd, times) == 0);
+    close(fd);
+}
+
+static bool exists(const char *name){
+    char path[256];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    return access(path, F_OK) == 0;
+}
+
+static void remove_all(void){
+    // Only what the tests made, and then the directory
+    static const char *const names[] = {
+        "cam0_20260101T000000Z_000000.ts", "cam0_20260101T000000Z_000000.ts.jpg", "cam0_20260101T000000Z_000000.ts.idx",
+        "cam0_20260102T000000Z_000001" CLIP_MANUAL_MARK ".ts", "cam0_20260103T000000Z_000002.ts",
+        "cam1_20260104T000000Z_000000.h264", "notes.txt", ".cam0.0.clip.tmp", "cam0_20260105T000000Z_000003.ts",
+        "a", "b", "c",
+    };
+    for (size_t i = 0; i < sizeof names / sizeof *names; ++i){
+        char path[256];
+        snprintf(path, sizeof path, "%s/%s", dir, names[i]);
+        (void)unlink(path);
+    }
+    (void)rmdir(dir);
+}
+
+static void populate(void){
+    put_file("cam0_20260101T000000Z_000000.ts", 10 * DAY_NS);
+    put_file("cam0_20260101T000000Z_000000.ts.jpg", 10 * DAY_NS);
+    put_file("cam0_20260101T000000Z_000000.ts.idx", 10 * DAY_NS);
+    put_file("cam0_20260102T000000Z_000001" CLIP_MANUAL_MARK ".ts", 9 * DAY_NS);
+    put_file("cam0_20260103T000000Z_000002.ts", 2 * DAY_NS);
+    put_file("cam1_20260104T000000Z_000000.h264", 1 * DAY_NS);
+    put_file("notes.txt", 20 * DAY_NS);             // Someone else's: never indexed, never deleted
+    put_file(".cam0.0.clip.tmp", 30 * DAY_NS);      // A clip still recording
+}
+
+static void test_scan_and_oldest_first(void){
+    populate();
+    clip_index idx;
+    CHECK(clip_index_open(&idx, dir));
+    CHECK(idx.count == 4);
+    CHECK(idx.total_bytes >= 4 * 4096u);
+    CHECK(idx.classes[CLIP_CLASS_MOTION].count == 3 && idx.classes[CLIP_CLASS_MANUAL].count == 1);
+
+    // Without retention every class is kept alike: oldest first, across classes
+    clip_entry e;
+    bool expired = true;
+    CHECK(clip_index_next(&idx, now_ns, &e, &expired) && !strcmp(e.name, "cam0_20260101T000000Z_000000.ts") && !expired);
+    CHECK(clip_index_evict_next(&idx, &e) && !strcmp(e.name, "cam0_20260101T000000Z_000000.ts"));
+    CHECK(!exists("cam0_20260101T000000Z_000000.ts") && !exists("cam0_20260101T000000Z_000000.ts.jpg") &&
+          !exists("cam0_20260101T000000Z_000000.ts.idx")); // Its sidecars went with it
+    CHECK(clip_index_evict_next(&idx, &e) && !strcmp(e.name, "cam0_20260102T000000Z_000001" CLIP_MANUAL_MARK ".ts") &&
+          e.kind == CLIP_CLASS_MANUAL);
+    CHECK(clip_index_evict_next(&idx, &e) && !strcmp(e.name, "cam0_20260103T000000Z_000002.ts"));
+    CHECK(clip_index_evict_next(&idx, &e) && !strcmp(e.name, "cam1_20260104T000000Z_000000.h264"));
+    errno = 0;
+    CHECK(!clip_index_evict_next(&idx, &e) && errno == ENOENT);
+    CHECK(idx.count == 0 && idx.total_bytes == 0 && idx.evicted_clips == 4);
+    CHECK(exists("notes.txt") && exists(".cam0.0.clip.tmp"));
+
+    // Added later: only clip names, and only regular files
+    errno = 0;
+    CHECK(!clip_index_add_file(&idx, "notes.txt") && errno == EINVAL);
+    put_file("cam0_20260105T000000Z_000003.ts", 0);
+    CHECK(clip_index_add_file(&idx, "cam0_20260105T000000Z_000003.ts") && idx.count == 1);
+    clip_index_close(&idx);
+    remove_all();
+}
+
+static void test_retention_order(void){
+    CHECK(mkdir(dir, 0755) == 0);
+    populate();
+    clip_index idx;
+    CHECK(clip_index_open(&idx, dir));
+    const uint32_t retention_s[CLIP_CLASS_COUNT] = { [CLIP_CLASS_MOTION] = 3 * 86400, [CLIP_CLASS_MANUAL] = 30 * 86400 };
+    clip_index_set_retention(&idx, retention_s);
+
+    // Furthest through its retention first: motion at 10 of 3 days, then motion at 2 of 3,
+    // then manual at 9 of 30 (0.3) against motion at 1 of 3 (0.33)
+    static const char *const order[] = {
+        "cam0_20260101T000000Z_000000.ts", "cam0_20260103T000000Z_000002.ts",
+        "cam1_20260104T000000Z_000000.h264", "cam0_20260102T000000Z_000001" CLIP_MANUAL_MARK ".ts",
+    };
+    static const bool past[] = { true, false, false, false };
+    uint64_t bytes = idx.total_bytes;
+    for (size_t i = 0; i < 4; ++i){
+        clip_entry next, taken;
+        bool expired = !past[i];
+        CHECK(clip_index_next(&idx, now_ns, &next, &expired) && !strcmp(next.name, order[i]) && expired == past[i]);
+        CHECK(clip_index_take_next(&idx, now_ns, &taken) && !strcmp(taken.name, next.name));
+        bytes -= taken.bytes;
+        CHECK(idx.total_bytes == bytes && idx.count == 3 - i);
+        CHECK(exists(taken.name)); // Taken off the index only, for clip_delete() later
+        CHECK(clip_delete(idx.dir_fd, taken.name) && !exists(taken.name));
+    }
+    CHECK(clip_delete(idx.dir_fd, "cam0_20260101T000000Z_000000.ts")); // Already gone is fine
+    clip_index_close(&idx);
+    remove_all();
+}
+
+static void test_rename(void){
+    CHECK(mkdir(dir, 0755) == 0);
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    CHECK(fd >= 0);
+    put_file("a", 0);
+    put_file("b", 0);
+    errno = 0;
+    CHECK(!clip_rename(fd, "a", fd, "b") && errno == EEXIST); // Never over another clip
+    CHECK(exists("a") && exists("b"));
+    CHECK(clip_rename(fd, "a", fd, "c") && !exists("a") && exists("c"));
+    close(fd);
+    remove_all();
+}
+
+static void test_class_of(void){
+    CHECK(clip_class_of("cam0_20260101T000000Z_000000.ts") == CLIP_CLASS_MOTION);
+    CHECK(clip_class_of("cam0_20260101T000000Z_000000" CLIP_MANUAL_MARK ".h264") == CLIP_CLASS_MANUAL);
+    CHECK(clip_class_of(CLIP_MANUAL_MARK ".ts") == CLIP_CLASS_MOTION); // A mark needs a name before it
+}
+
+int main(void){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    now_ns = (int64_t)now.tv_sec * 1000000000ll + now.tv_nsec;
+    snprintf(dir, sizeof dir, "/tmp/cv_pi5_storage_XXXXXX");
+    if (!mkdtemp(dir)){perror("mkdtemp");return 1;}
+
+    test_scan_and_oldest_first();
+    test_retention_order();
+    test_rename();
+    test_class_of();
+    return check_result();
+}
@@ -0,0 +1,185 @@
+#include "cv_pi5/ts_mux.h"
+
+#include "check.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PID_PAT 0x0000
+#define PID_PMT 0x1000
+#define PID_VIDEO 0x0100
+
+typedef struct {
+    uint8_t data[1 << 20];
+    size_t length;
+    unsigned writes;
+} sink;
+
+static bool sink_write(void *ctx, const void *data, size_t length){
+    sink *s = ctx;
+    if (s->length + length > sizeof s->data) return false;
+    memcpy(s->data + s->length, data, length);
+    s->length += length;
+    s->writes++;
+    return true;
+}
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t length){
+    // Bit by bit, independent of the muxer's own
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i)
+        for (int bit = 7; bit >= 0; --bit){
+            uint32_t in = (data[i] >> bit & 1u) ^ (crc >> 31);
+            crc = (crc << 1) ^ (in ? 0x04C11DB7u : 0);
+        }
+    return crc;
+}
+
+static uint16_t pid_of(const uint8_t *p){ return (uint16_t)((p[1] & 0x1F) << 8 | p[2]); }
+static bool unit_start(const uint8_t *p){ return p[1] & 0x40; }
+
+static const uint8_t *payload_of(const uint8_t *p, size_t *length){
+    size_t offset = 4;
+    if (p[3] & 0x20) offset += 1 + p[4]; // Adaptation field
+    *length = offset < 188 ? 188 - offset : 0;
+    return p + offset;
+}
+
+static uint64_t pts_of(const uint8_t *pes){
+    const uint8_t *t = pes + 9;
+    return (uint64_t)(t[0] >> 1 & 0x07) << 30 | (uint64_t)t[1] << 22 | (uint64_t)(t[2] >> 1) << 15 | (uint64_t)t[3] << 7 | t[4] >> 1;
+}
+
+static void check_section(const uint8_t *p, uint8_t table_id){
+    size_t length;
+    const uint8_t *s = payload_of(p, &length);
+    CHECK(unit_start(p));
+    CHECK(s[0] == 0);                                 // pointer_field
+    s += 1;
+    CHECK(s[0] == table_id);
+    size_t section_length = (size_t)(s[1] & 0x0F) << 8 | s[2];
+    CHECK(section_length + 3 <= length - 1);
+    CHECK(crc32_mpeg(s, 3 + section_length) == 0);   // Over the section and its CRC, a correct CRC leaves 0
+}
+
+static void test_tables(sink *out){
+    ts_muxer m;
+    CHECK(ts_mux_init(&m, ENCODER_CODEC_H264, 1));
+    uint8_t au[300];
+    memset(au, 0xAB, sizeof au);
+    au[0] = 0; au[1] = 0; au[2] = 0; au[3] = 1; au[4] = 0x65; // IDR slice, no delimiter: the muxer adds one
+    encoded_packet key = { .data = au, .size = sizeof au, .pts_ns = 5000000000ull, .flags = PACKET_FLAG_KEYFRAME };
+    CHECK(ts_mux_starts_fragment(&m, &key));
+    CHECK(ts_mux_packet(&m, &key, sink_write, out));
+    CHECK(ts_mux_flush(&m, sink_write, out));
+    CHECK(m.fragments == 1);
+    CHECK(out->length % TS_PACKET_SIZE == 0 && m.bytes == out->length);
+
+    const uint8_t *p = out->data;
+    for (size_t i = 0; i < out->length; i += TS_PACKET_SIZE) CHECK(p[i] == 0x47);
+
+    // PAT: program 1 on the PMT's PID
+    CHECK(pid_of(p) == PID_PAT);
+    check_section(p, 0x00);
+    size_t length;
+    const uint8_t *pat = payload_of(p, &length) + 1;
+    CHECK(pat[8] == 0 && pat[9] == 1 && ((pat[10] & 0x1F) << 8 | pat[11]) == PID_PMT);
+
+    // PMT: H.264 on the video PID, which also carries the PCR
+    p += TS_PACKET_SIZE;
+    CHECK(pid_of(p) == PID_PMT);
+    check_section(p, 0x02);
+    const uint8_t *pmt = payload_of(p, &length) + 1;
+    CHECK(((pmt[8] & 0x1F) << 8 | pmt[9]) == PID_VIDEO);
+    CHECK(pmt[12] == 0x1B && ((pmt[13] & 0x1F) << 8 | pmt[14]) == PID_VIDEO);
+
+    // PES: random access with a PCR, the stream starting at 1 s and PTS 100 ms after it
+    p += TS_PACKET_SIZE;
+    CHECK(pid_of(p) == PID_VIDEO && unit_start(p));
+    CHECK((p[3] & 0x20) && (p[5] & 0x10) && (p[5] & 0x40));
+    uint64_t pcr = (uint64_t)p[6] << 25 | (uint64_t)p[7] << 17 | (uint64_t)p[8] << 9 | (uint64_t)p[9] << 1 | p[10] >> 7;
+    CHECK(pcr == 90000);
+    const uint8_t *pes = payload_of(p, &length);
+    CHECK(pes[0] == 0 && pes[1] == 0 && pes[2] == 1 && pes[3] == 0xE0);
+    CHECK((pes[7] & 0xC0) == 0x80 && pes[8] == 5);
+    CHECK(pts_of(pes) == 99000);
+    CHECK(pes[14] == 0 && pes[15] == 0 && pes[16] == 0 && pes[17] == 1 && (pes[18] & 0x1F) == 9); // Access unit delimiter
+
+    // The access unit comes back whole from the video PID's payloads, counters running on
+    uint8_t es[1024];
+    size_t es_length = 0;
+    unsigned cc = p[3] & 0x0F;
+    for (const uint8_t *q = p; q < out->data + out->length; q += TS_PACKET_SIZE){
+        CHECK(pid_of(q) == PID_VIDEO);
+        if (q != p){CHECK((q[3] & 0x0F) == ((cc + 1) & 0x0F)); cc = q[3] & 0x0F;}
+        const uint8_t *d = payload_of(q, &length);
+        if (q == p){d += 14 + 6; length -= 14 + 6;} // PES header and the delimiter added
+        memcpy(es + es_length, d, length);
+        es_length += length;
+    }
+    CHECK(es_length == sizeof au && !memcmp(es, au, sizeof au));
+}
+
+static void test_fragments(sink *out){
+    ts_muxer m;
+    CHECK(ts_mux_init(&m, ENCODER_CODEC_HEVC, 2));
+    uint8_t au[64] = { 0, 0, 0, 1, 0x46, 0x01, 0x50 }; // Opens with an HEVC delimiter: none added
+    uint64_t pts = 1000000000ull;
+    for (int i = 0; i < 6; ++i){
+        encoded_packet pkt = { .data = au, .size = sizeof au, .pts_ns = pts, .flags = i % 2 == 0 ? PACKET_FLAG_KEYFRAME : 0 };
+        CHECK(ts_mux_packet(&m, &pkt, sink_write, out));
+        pts += 33333333ull;
+    }
+    CHECK(ts_mux_flush(&m, sink_write, out));
+    CHECK(m.fragments == 2); // Keyframes 0, 2 and 4, two to a fragment
+
+    unsigned pats = 0, pes = 0;
+    uint64_t first_pts = 0;
+    for (const uint8_t *p = out->data; p < out->data + out->length; p += TS_PACKET_SIZE){
+        if (pid_of(p) == PID_PAT) ++pats;
+        if (pid_of(p) == PID_PMT){
+            size_t length;
+            CHECK(payload_of(p, &length)[1 + 12] == 0x24);
+        }
+        if (pid_of(p) != PID_VIDEO || !unit_start(p)) continue;
+        size_t length;
+        const uint8_t *d = payload_of(p, &length);
+        uint64_t t = pts_of(d);
+        if (!pes) first_pts = t;
+        CHECK(t - first_pts == pes * 33333333ull * 9u / 100000u); // 90 kHz ticks since the first, rounded down
+        CHECK(!memcmp(d + 14, au, 7));
+        ++pes;
+    }
+    CHECK(pats == 2 && pes == 6);
+
+    // A restarted stream begins again with tables at the next keyframe, from 1 s
+    ts_mux_restart(&m);
+    CHECK(!m.started && m.fragments == 0 && m.codec == ENCODER_CODEC_HEVC && m.fragment_keyframes == 2);
+}
+
+static void test_passthrough_and_errors(sink *out){
+    ts_muxer m;
+    CHECK(!ts_mux_init(&m, (encoder_codec)7, 1));
+    CHECK(ts_mux_init(&m, ENCODER_CODEC_H264, 0) && m.fragment_keyframes == 1);
+    m.passthrough = true;
+    uint8_t raw[100] = { 1, 2, 3 };
+    encoded_packet pkt = { .data = raw, .size = sizeof raw, .flags = PACKET_FLAG_KEYFRAME };
+    CHECK(ts_mux_packet(&m, &pkt, sink_write, out));
+    CHECK(out->length == sizeof raw && !memcmp(out->data, raw, sizeof raw));
+}
+
+static sink *fresh(sink *s){
+    s->length = 0;
+    s->writes = 0;
+    return s;
+}
+
+int main(void){
+    sink *s = malloc(sizeof *s);
+    if (!s) return 1;
+    test_tables(fresh(s));
+    test_fragments(fresh(s));
+    test_passthrough_and_errors(fresh(s));
+    free(s);
+    return check_result();
+}